@@ -51,13 +51,27 @@ static char help[] = "BOUT++: Uses finite difference methods to solve plasma flu
 #include "utils.h"
 #include "invert_laplace.h"
 #include "interpolation.h"
+#include "fft.h"
+#ifdef PNCDF
+#include "pnc_format.h"
+#endif
+#ifdef NC4DF
+#include "nc4_format.h"
+#endif
 
 #include "mpi.h"
+#ifdef PETSC
+#include "petsc.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <string>
 using std::string;
 
@@ -66,7 +80,6 @@ using std::string;
 void bout_signal_handler(int sig);  // Handles segmentation faults
 #endif
 
-bool appending = false;
 char dumpname[512];
 
 real simtime;
@@ -89,6 +102,14 @@ int main(int argc, char **argv)
   char *grid_name;
   time_t start_time, end_time;
   bool dump_float; // Output dump files as floats
+  int dump_pack;   // Pack arrays into 8 or 16 bit integers. 0 = off
+  bool dump_parallel; // All processors write to a single dump file
+  bool dump_async;    // Write output files in a background thread
+  int dump_queue;     // Maximum number of outputs waiting to be written
+  bool dump_keep_open; // Keep the dump file open between outputs
+  int dump_flush;     // Number of outputs between flushes of the dump file
+  int dump_compress;  // Deflate level for compressed dump files. 0 = off
+  real dump_abstol, dump_reltol; // Error tolerances for lossy compression
 
   char *grid_ext, *dump_ext; ///< Extensions for restart and dump files
   
@@ -132,8 +153,14 @@ int main(int argc, char **argv)
   /// Start MPI
 #ifdef PETSC
   PetscInitialize(&argc,&argv,"../petscopt",help);
+#else
+#ifdef _OPENMP
+  // Only the master thread makes MPI calls
+  int mpi_thread;
+  MPI_Init_thread(&argc,&argv, MPI_THREAD_FUNNELED, &mpi_thread);
 #else
   MPI_Init(&argc,&argv);
+#endif
 #endif
   MPI_Comm_size(MPI_COMM_WORLD, &NPES);
   MPI_Comm_rank(MPI_COMM_WORLD, &MYPE);
@@ -185,6 +212,24 @@ int main(int argc, char **argv)
   output.write("\tnetCDF support disabled\n");
 #endif
 
+#ifdef NC4DF
+  output.write("\tCompressed netCDF-4 support enabled\n");
+#else
+  output.write("\tCompressed netCDF-4 support disabled\n");
+#endif
+
+#ifdef ASYNCIO
+  output.write("\tBackground output enabled\n");
+#else
+  output.write("\tBackground output disabled\n");
+#endif
+
+#ifdef _OPENMP
+  output.write("\tOpenMP enabled\n");
+#else
+  output.write("\tOpenMP disabled\n");
+#endif
+
 #ifdef METRIC3D
   output.write("\tRUNNING IN 3D-METRIC MODE\n");
 #endif
@@ -212,6 +257,15 @@ int main(int argc, char **argv)
     grid_name = DEFAULT_GRID;
   
   OPTION(dump_float,   true);
+  OPTION(dump_pack,    0);
+  OPTION(dump_parallel, false);
+  OPTION(dump_async,   false);
+  OPTION(dump_queue,   2);
+  OPTION(dump_keep_open, false);
+  OPTION(dump_flush,   1);
+  OPTION(dump_compress, 0);
+  OPTION(dump_abstol,  0.0);
+  OPTION(dump_reltol,  0.0);
   OPTION(ShiftXderivs, false);
   OPTION(IncIntShear,  false);
   OPTION(TwistShift,   false);
@@ -249,6 +303,14 @@ int main(int argc, char **argv)
     return(1);
   }
 
+#ifdef _OPENMP
+  int num_threads;
+  options.get("num_threads", num_threads, 0); // Threads per processor. 0 = OpenMP default
+  if(num_threads > 0)
+    omp_set_num_threads(num_threads);
+  output.write("\tUsing %d OpenMP threads per processor\n", omp_get_max_threads());
+#endif
+
   NYPE = NPES / NXPE;
   
   /// Get X and Y processor indices
@@ -277,6 +339,9 @@ int main(int argc, char **argv)
     dump_ext = DEFAULT_FILE_EXT;
   }
   
+  /// FFT settings. Reads saved FFTW wisdom if used
+  fft_init(data_dir);
+  
   /// Setup derivative methods
   if(derivs_init()) {
     output.write("Failed to initialise derivative methods. Aborting\n");
@@ -308,22 +373,79 @@ int main(int argc, char **argv)
     return 1;
   }
 
-  /// Set the file names
-  sprintf(dumpname, "%s/BOUT.dmp.%d.%s", data_dir, MYPE, dump_ext);
-
-  // Set file formats
+  /// Set the file names and formats
   output.write("Setting file formats\n");
-  dump.setFormat(data_format(dumpname));
+  if(dump_parallel) {
+#ifdef PNCDF
+    // All processors write to a single file
+    sprintf(dumpname, "%s/BOUT.dmp.nc", data_dir);
+    output.write("\tUsing parallel netCDF-4 format for file '%s'\n", dumpname);
+    dump.setFormat(new PncFormat);
+#else
+    output.write("\tWARNING: dump_parallel needs parallel netCDF-4 support. Writing one file per processor\n");
+    dump_parallel = false;
+#endif
+  }
+  bool dump_compressed = (dump_compress > 0) || (dump_abstol > 0.) || (dump_reltol > 0.);
+  if(dump_compressed && dump_parallel) {
+    output.write("\tWARNING: Compression can't be used with dump_parallel. Writing uncompressed\n");
+    dump_compressed = false;
+  }
+#ifndef NC4DF
+  if(dump_compressed) {
+    output.write("\tWARNING: Compressed output needs netCDF-4 support. Writing uncompressed\n");
+    dump_compressed = false;
+  }
+#endif
+  if(dump_compressed) {
+#ifdef NC4DF
+    // Lossy rounding only helps if the result is compressed
+    if(dump_compress <= 0)
+      dump_compress = 1;
+    sprintf(dumpname, "%s/BOUT.dmp.%d.nc", data_dir, MYPE);
+    output.write("\tUsing compressed netCDF-4 format for file '%s'\n", dumpname);
+    output.write("\t\tDeflate level %d, abstol %e, reltol %e\n", dump_compress, dump_abstol, dump_reltol);
+    Nc4Format *format = new Nc4Format;
+    format->setCompression(dump_compress, dump_abstol, dump_reltol);
+    dump.setFormat(format);
+    dump.setOutputOptions();
+#endif
+  }else if(!dump_parallel) {
+    sprintf(dumpname, "%s/BOUT.dmp.%d.%s", data_dir, MYPE, dump_ext);
+    dump.setFormat(data_format(dumpname));
+    dump.setOutputOptions(); // Only write parts of fields set in [output]
+  }
 
   if(dump_float)
     dump.setLowPrecision(); // Down-convert to floats
 
+  if(dump_pack > 0) {
+    output.write("\tPacking arrays in the dump file into %d bit integers\n", dump_pack);
+    dump.setPacking(dump_pack);
+  }
+
+  if(dump_keep_open) {
+    output.write("\tKeeping dump file open, flushing every %d outputs\n", dump_flush);
+    dump.setPersistent(dump_flush);
+  }
+
+  if(dump_async) {
+    if(dump_parallel) {
+      // Parallel files are written collectively, so can't be in a separate thread
+      output.write("\tWARNING: dump_async can't be used with dump_parallel. Writing files directly\n");
+    }else
+      Datafile::setAsync(dump_queue);
+  }
+
   /// Add book-keeping variables to the output files
   setup_files();
 
   /// initialise Laplacian inversion code
   invert_init();
 
+  /// Create the solver, so the physics module can add variables to it
+  solver = GenericSolver::create();
+
   output.write("Initialising physics module\n");
   /// Initialise physics module
 #ifdef CHECK
@@ -341,8 +463,8 @@ int main(int argc, char **argv)
 #endif
 
   /// Initialise the solver
-  solver.setRestartDir(data_dir);
-  if(solver.init(physics_run, argc, argv, restarting, NOUT, TIMESTEP)) {
+  solver->setRestartDir(data_dir);
+  if(solver->init(physics_run, argc, argv, restarting, NOUT, TIMESTEP)) {
     output.write("Failed to initialise solver. Aborting\n");
     return(1);
   }
@@ -369,7 +491,15 @@ int main(int argc, char **argv)
   output.write("Running simulation\n\n");
 
   /// Run the solver
-  solver.run(bout_monitor);
+  solver->run(bout_monitor);
+  delete solver;
+
+  /// Finish writing any queued output, and close the dump file
+  dump.close();
+  Datafile::finish();
+
+  /// Save FFTW wisdom for next time
+  fft_finish();
 
   // close MPI
 #ifdef PETSC
@@ -431,8 +561,8 @@ int bout_monitor(real t, int iter, int NOUT)
   }
   
   /// Collect timing information
-  int ncalls = solver.rhs_ncalls;
-  real wtime_rhs   = solver.rhs_wtime;
+  int ncalls = solver->rhs_ncalls;
+  real wtime_rhs   = solver->rhs_wtime;
   //real wtime_invert = 0.0; // wtime_invert is a global
   real wtime_comms = Communicator::wtime;  // Time spent communicating (part of RHS)
   real wtime_io    = Datafile::wtime;      // Time spend on I/O
@@ -541,22 +671,22 @@ void setup_files()
 void bout_solve(Field2D &var, Field2D &F_var, const char *name)
 {
   // Add to solver
-  solver.add(var, F_var, name);
+  solver->add(var, F_var, name);
 }
 
 void bout_solve(Field3D &var, Field3D &F_var, const char *name)
 {
-  solver.add(var, F_var, name);
+  solver->add(var, F_var, name);
 }
 
 void bout_solve(Vector2D &var, Vector2D &F_var, const char *name)
 {
-  solver.add(var, F_var, name);
+  solver->add(var, F_var, name);
 }
 
 void bout_solve(Vector3D &var, Vector3D &F_var, const char *name)
 {
-  solver.add(var, F_var, name);
+  solver->add(var, F_var, name);
 }
 
 /*!************************************************************************
@@ -566,7 +696,7 @@ void bout_solve(Vector3D &var, Vector3D &F_var, const char *name)
 bool bout_constrain(Field3D &var, Field3D &F_var, const char *name)
 {
   // Add to solver
-  solver.constraint(var, F_var, name);
+  solver->constraint(var, F_var, name);
 
   return true;
 }
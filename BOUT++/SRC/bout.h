@@ -81,7 +81,7 @@ int physics_run(real t);
 #endif
 
 // Solver object
-GLOBAL Solver solver;    // Interface to PVODE
+GLOBAL GenericSolver *solver;    // Time integration solver. Type set in BOUT.inp
 
 #undef GLOBAL
 
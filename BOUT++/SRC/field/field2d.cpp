@@ -33,6 +33,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 
 Field2D::Field2D()
@@ -82,11 +83,36 @@ real **Field2D::getData() const
   return data;
 }
 
+real* Field2D::begin()
+{
+  Allocate();
+  return data[0];
+}
+
+real* Field2D::end()
+{
+  return begin() + ngx*ngy;
+}
+
+const real* Field2D::begin() const
+{
+#ifdef CHECK
+  if(data == NULL)
+    error("Field2D: begin() on empty data\n");
+#endif
+  return data[0];
+}
+
+const real* Field2D::end() const
+{
+  return begin() + ngx*ngy;
+}
+
 ///////////// OPERATORS ////////////////
 
 Field2D & Field2D::operator=(const Field2D &rhs)
 {
-  int jx, jy;
+  int j;
 
   // Check for self-assignment
   if(this == &rhs)
@@ -106,9 +132,8 @@ Field2D & Field2D::operator=(const Field2D &rhs)
 
   // Copy data across
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] = rhs.data[jx][jy];
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] = rhs.data[0][j];
 
 #ifdef CHECK
   msg_stack.pop();
@@ -119,7 +144,7 @@ Field2D & Field2D::operator=(const Field2D &rhs)
 
 Field2D & Field2D::operator=(const real rhs)
 {
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   name = "<r2D>";
@@ -127,9 +152,8 @@ Field2D & Field2D::operator=(const real rhs)
 
   alloc_data(); // Make sure data is allocated
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] = rhs;
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] = rhs;
   return(*this);
 }
 
@@ -154,7 +178,7 @@ real* Field2D::operator[](int jx) const
 
 Field2D & Field2D::operator+=(const Field2D &rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   msg_stack.push("Field2D: += ( Field2D )");
@@ -166,9 +190,8 @@ Field2D & Field2D::operator+=(const Field2D &rhs)
   name = "("+name + "+" + rhs.name + ")";
 #endif
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] += rhs.data[jx][jy];
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] += rhs.data[0][j];
 
 #ifdef CHECK
   msg_stack.pop();
@@ -179,7 +202,7 @@ Field2D & Field2D::operator+=(const Field2D &rhs)
 
 Field2D & Field2D::operator+=(const real rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(data == (real**) NULL) {
@@ -191,16 +214,15 @@ Field2D & Field2D::operator+=(const real rhs)
   name = "("+name + "+real)";
 #endif
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] += rhs;
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] += rhs;
 
   return(*this);
 }
 
 Field2D & Field2D::operator-=(const Field2D &rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(rhs.data == (real**) NULL) {
@@ -217,16 +239,15 @@ Field2D & Field2D::operator-=(const Field2D &rhs)
   name = "("+name + "-" + rhs.name + ")";
 #endif
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] -= rhs.data[jx][jy];
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] -= rhs.data[0][j];
 
   return(*this);
 }
 
 Field2D & Field2D::operator-=(const real rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(data == (real**) NULL) {
@@ -238,16 +259,15 @@ Field2D & Field2D::operator-=(const real rhs)
   name = "("+name + "-real)";
 #endif
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] -= rhs;
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] -= rhs;
 
   return(*this);
 }
 
 Field2D & Field2D::operator*=(const Field2D &rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(rhs.data == (real**) NULL) {
@@ -264,16 +284,15 @@ Field2D & Field2D::operator*=(const Field2D &rhs)
   name = "("+name + "*" + rhs.name + ")";
 #endif
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] *= rhs.data[jx][jy];
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] *= rhs.data[0][j];
 
   return(*this);
 }
 
 Field2D & Field2D::operator*=(const real rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(data == (real**) NULL) {
@@ -285,18 +304,15 @@ Field2D & Field2D::operator*=(const real rhs)
   name = "("+name + "*real)";
 #endif
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      data[jx][jy] *= rhs;
-    }
-  }
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] *= rhs;
   
   return(*this);
 }
 
 Field2D & Field2D::operator/=(const Field2D &rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(rhs.data == (real**) NULL) {
@@ -313,16 +329,15 @@ Field2D & Field2D::operator/=(const Field2D &rhs)
   name = "("+name + "/" + rhs.name + ")";
 #endif
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] /= rhs.data[jx][jy];
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] /= rhs.data[0][j];
 
   return(*this);
 }
 
 Field2D & Field2D::operator/=(const real rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(data == (real**) NULL) {
@@ -336,18 +351,15 @@ Field2D & Field2D::operator/=(const real rhs)
 
   real inv_rhs = 1. / rhs; // Multiplication faster than division
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      data[jx][jy] *= inv_rhs;
-    }
-  }
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] *= inv_rhs;
   
   return(*this);
 }
 
 Field2D & Field2D::operator^=(const Field2D &rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(rhs.data == (real**) NULL) {
@@ -364,16 +376,15 @@ Field2D & Field2D::operator^=(const Field2D &rhs)
   name = "("+name + "^" + rhs.name + ")";
 #endif
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      data[jx][jy] = pow(data[jx][jy], rhs.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] = pow(data[0][j], rhs.data[0][j]);
 
   return(*this);
 }
 
 Field2D & Field2D::operator^=(const real rhs)
 {
-  int jx, jy;
+  int j;
 
 #ifdef CHECK
   if(data == (real**) NULL) {
@@ -385,11 +396,8 @@ Field2D & Field2D::operator^=(const real rhs)
   name = "("+name + "^real)";
 #endif
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      data[jx][jy] = pow(data[jx][jy], rhs);
-    }
-  }
+  for(j=0;j<ngx*ngy;j++)
+    data[0][j] = pow(data[0][j], rhs);
   
   return(*this);
 }
@@ -483,105 +491,6 @@ const Field2D Field2D::operator^(const real rhs) const
 
 ///////////// Left binary operators ////////////////
 
-const Field3D Field2D::operator+(const Field3D &other) const
-{
-  // just turn operator around
-  return(other + (*this));
-}
-
-const Field3D Field2D::operator-(const Field3D &other) const
-{
-  Field3D result = other;
-  real ***d;
-  int jx, jy, jz;
-
-  d = result.getData();
-
-#ifdef CHECK
-  if(d == (real***) NULL)
-    error("Field2D: - operator has invalid Fiel3D argument");
-  if(data == (real**) NULL)
-    error("Field2D: - operates on empty data");
-#endif
-
-#ifdef TRACK
-  result.name = "(" + name + "-" + other.name + ")";
-#endif  
-
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	d[jx][jy][jz] = data[jx][jy] - d[jx][jy][jz];
-
-  result.setLocation( other.getLocation() );
-
-  return(result);
-}
-
-const Field3D Field2D::operator*(const Field3D &other) const
-{
-  // turn operator around
-  return(other * (*this));
-}
-
-const Field3D Field2D::operator/(const Field3D &other) const
-{
-  Field3D result = other;
-  real ***d;
-  int jx, jy, jz;
-
-  d = result.getData();
-
-#ifdef CHECK
-  if(d == (real***) NULL)
-    error("Field2D: / operator has invalid Fiel3D argument");
-  if(data == (real**) NULL)
-    error("Field2D: / operates on empty data");
-#endif  
-
-#ifdef TRACK
-  result.name = "(" + name + "/" + other.name + ")";
-#endif
-
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	d[jx][jy][jz] = data[jx][jy] / d[jx][jy][jz];
-
-  result.setLocation( other.getLocation() );
-
-  return(result);
-}
-
-const Field3D Field2D::operator^(const Field3D &other) const
-{
-  Field3D result = other;
-  real ***d;
-  int jx, jy, jz;
-
-  d = result.getData();
-
-#ifdef CHECK
-  if(d == (real***) NULL)
-    error("Field2D: ^ operator has invalid Fiel3D argument");
-  if(data == (real**) NULL)
-    error("Field2D: ^ operates on empty data");
-#endif
-
-#ifdef TRACK
-  result.name = "(" + name + "^" + other.name + ")";
-#endif  
-
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	d[jx][jy][jz] = pow(data[jx][jy], d[jx][jy][jz]);
-
-  result.setLocation( other.getLocation() );
-
-  return(result);
-}
-
 const FieldPerp Field2D::operator+(const FieldPerp &other) const
 {
   FieldPerp result = other;
@@ -793,7 +702,7 @@ void Field2D::SetZStencil(stencil &fval, const bindex &bx, CELL_LOC loc) const
 
 const Field2D Field2D::Sqrt() const
 {
-  int jx, jy;
+  int jx, jy, j;
   Field2D result;
 
   // Check data set
@@ -818,16 +727,15 @@ const Field2D Field2D::Sqrt() const
 
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = sqrt(data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = sqrt(data[0][j]);
 
   return result;
 }
 
 const Field2D Field2D::Abs() const
 {
-  int jx, jy;
+  int j;
   Field2D result;
 
 #ifdef CHECK
@@ -844,9 +752,8 @@ const Field2D Field2D::Abs() const
 
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = fabs(data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = fabs(data[0][j]);
 
   return result;
 }
@@ -1019,6 +926,35 @@ int Field2D::setData(int x, int y, int z, real *rptr)
   return 1;
 }
 
+int Field2D::getLines(int x, int yge, int ylt, real *rptr) const
+{
+#ifdef CHECK
+  if(data == (real**) NULL) {
+    error("Field2D: getLines on empty data\n");
+    exit(1);
+  }
+  if((x < 0) || (x > ncx) || (yge < 0) || (ylt > ngy)) {
+    error("Field2D: getLines (%d,%d-%d) out of bounds\n", x, yge, ylt);
+    exit(1);
+  }
+#endif
+  memcpy(rptr, data[x] + yge, (ylt - yge)*sizeof(real));
+  return ylt - yge;
+}
+
+int Field2D::setLines(int x, int yge, int ylt, const real *rptr)
+{
+  Allocate();
+#ifdef CHECK
+  if((x < 0) || (x > ncx) || (yge < 0) || (ylt > ngy)) {
+    error("Field2D: setLines (%d,%d-%d) out of bounds\n", x, yge, ylt);
+    exit(1);
+  }
+#endif
+  memcpy(data[x] + yge, rptr, (ylt - yge)*sizeof(real));
+  return ylt - yge;
+}
+
 #ifdef CHECK
 /// Check if the data is valid
 bool Field2D::check_data(bool vital) const
@@ -1112,7 +1048,7 @@ const Field2D operator*(const real lhs, const Field2D &rhs)
 const Field2D operator/(const real lhs, const Field2D &rhs)
 {
   Field2D result = rhs;
-  int jx, jy;
+  int j;
   real **d;
 
   d = result.data;
@@ -1128,9 +1064,8 @@ const Field2D operator/(const real lhs, const Field2D &rhs)
   result.name = "(real/"+rhs.name+")";
 #endif
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      d[jx][jy] = lhs / d[jx][jy];
+  for(j=0;j<ngx*ngy;j++)
+    d[0][j] = lhs / d[0][j];
 
   return(result);
 }
@@ -1138,7 +1073,7 @@ const Field2D operator/(const real lhs, const Field2D &rhs)
 const Field2D operator^(const real lhs, const Field2D &rhs)
 {
   Field2D result = rhs;
-  int jx, jy;
+  int j;
   real **d;
 
   d = result.data;
@@ -1154,9 +1089,8 @@ const Field2D operator^(const real lhs, const Field2D &rhs)
   result.name = "(real^"+rhs.name+")";
 #endif
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      d[jx][jy] = pow(lhs, d[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    d[0][j] = pow(lhs, d[0][j]);
 
   return(result);
 }
@@ -1193,7 +1127,7 @@ bool finite(const Field2D &f)
 const Field2D sin(const Field2D &f)
 {
   Field2D result;
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   result.name = "sin("+f.name+")";
@@ -1201,9 +1135,8 @@ const Field2D sin(const Field2D &f)
 
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = sin(f.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = sin(f.data[0][j]);
 
   return result;
 }
@@ -1211,7 +1144,7 @@ const Field2D sin(const Field2D &f)
 const Field2D cos(const Field2D &f)
 {
   Field2D result;
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   result.name = "cos("+f.name+")";
@@ -1219,9 +1152,8 @@ const Field2D cos(const Field2D &f)
 
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = cos(f.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = cos(f.data[0][j]);
 
   return result;
 }
@@ -1229,7 +1161,7 @@ const Field2D cos(const Field2D &f)
 const Field2D tan(const Field2D &f)
 {
   Field2D result;
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   result.name = "tan("+f.name+")";
@@ -1237,9 +1169,8 @@ const Field2D tan(const Field2D &f)
 
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = tan(f.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = tan(f.data[0][j]);
 
   return result;
 }
@@ -1247,7 +1178,7 @@ const Field2D tan(const Field2D &f)
 const Field2D sinh(const Field2D &f)
 {
   Field2D result;
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   result.name = "sinh("+f.name+")";
@@ -1255,9 +1186,8 @@ const Field2D sinh(const Field2D &f)
 
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = sinh(f.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = sinh(f.data[0][j]);
 
   return result;
 }
@@ -1265,7 +1195,7 @@ const Field2D sinh(const Field2D &f)
 const Field2D cosh(const Field2D &f)
 {
   Field2D result;
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   result.name = "cosh("+f.name+")";
@@ -1273,9 +1203,8 @@ const Field2D cosh(const Field2D &f)
 
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = cosh(f.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = cosh(f.data[0][j]);
 
   return result;
 }
@@ -1283,7 +1212,7 @@ const Field2D cosh(const Field2D &f)
 const Field2D tanh(const Field2D &f)
 {
   Field2D result;
-  int jx, jy;
+  int j;
   
 #ifdef TRACK
   result.name = "tanh("+f.name+")";
@@ -1291,9 +1220,8 @@ const Field2D tanh(const Field2D &f)
 
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      result.data[jx][jy] = tanh(f.data[jx][jy]);
+  for(j=0;j<ngx*ngy;j++)
+    result.data[0][j] = tanh(f.data[0][j]);
 
   return result;
 }
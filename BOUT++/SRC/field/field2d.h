@@ -56,6 +56,12 @@ class Field2D : public Field, public FieldData {
   void Allocate();
   bool isAllocated() { return data !=  NULL; } ///< Test if data is allocated
 
+  /// Flat iteration over all ngx*ngy points, y fastest
+  real* begin();
+  real* end();
+  const real* begin() const;
+  const real* end() const;
+
   // Operators
 
   Field2D & operator=(const Field2D &rhs);
@@ -88,13 +94,7 @@ class Field2D : public Field, public FieldData {
   const Field2D operator^(const Field2D &other) const;
   const Field2D operator^(const real rhs) const;
 
-  // Left binary operators
-
-  const Field3D operator+(const Field3D &other) const;
-  const Field3D operator-(const Field3D &other) const;
-  const Field3D operator*(const Field3D &other) const;
-  const Field3D operator/(const Field3D &other) const;
-  const Field3D operator^(const Field3D &other) const;
+  // Left binary operators. Operators with Field3D are in field_expr.h
 
   const FieldPerp operator+(const FieldPerp &other) const;
   const FieldPerp operator-(const FieldPerp &other) const;
@@ -147,6 +147,8 @@ class Field2D : public Field, public FieldData {
   int  getData(int x, int y, int z, real *rptr) const;
   int  setData(int x, int y, int z, void *vptr);
   int  setData(int x, int y, int z, real *rptr);
+  int  getLines(int x, int yge, int ylt, real *rptr) const;
+  int  setLines(int x, int yge, int ylt, const real *rptr);
 
   bool ioSupport() { return true; } ///< This class supports I/O operations
   real *getData(int component) { 
@@ -25,6 +25,7 @@
 #include "mpi.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <math.h>
 
@@ -110,6 +111,31 @@ real*** Field3D::getData() const
   return(block->data);
 }
 
+real* Field3D::begin()
+{
+  Allocate(); // Caller may alter data, so make unique
+  return block->data[0][0];
+}
+
+real* Field3D::end()
+{
+  return begin() + ngx*ngy*ngz;
+}
+
+const real* Field3D::begin() const
+{
+#ifdef CHECK
+  if(block == NULL)
+    error("Field3D: begin() on empty data\n");
+#endif
+  return block->data[0][0];
+}
+
+const real* Field3D::end() const
+{
+  return begin() + ngx*ngy*ngz;
+}
+
 const Field2D Field3D::DC()
 {
   Field2D result;
@@ -243,7 +269,7 @@ Field3D & Field3D::operator=(const Field3D &rhs)
 
 Field3D & Field3D::operator=(const Field2D &rhs)
 {
-  int jx, jy, jz;
+  int j, jz;
   real **d;
 
 #ifdef CHECK
@@ -261,10 +287,10 @@ Field3D & Field3D::operator=(const Field2D &rhs)
 
   /// Copy data
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	block->data[jx][jy][jz] = d[jx][jy];
+  #pragma omp parallel for private(jz)
+  for(j=0;j<ngx*ngy;j++)
+    for(jz=0;jz<ngz;jz++)
+      block->data[0][0][j*ngz+jz] = d[0][j];
 
   /// Only 3D fields have locations
   //location = CELL_CENTRE;
@@ -337,7 +363,7 @@ const bvalue & Field3D::operator=(const bvalue &bv)
 
 real Field3D::operator=(const real val)
 {
-  int jx, jy, jz;
+  int j;
   
   Allocate();
 
@@ -351,10 +377,9 @@ real Field3D::operator=(const real val)
   name = "<r3D>";
 #endif
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	block->data[jx][jy][jz] = val;
+  #pragma omp parallel for
+  for(j=0;j<ngx*ngy*ngz;j++)
+    block->data[0][0][j] = val;
 
   // Only 3D fields have locations
   //location = CELL_CENTRE;
@@ -367,7 +392,7 @@ real Field3D::operator=(const real val)
 
 Field3D & Field3D::operator+=(const Field3D &rhs)
 {
-  int jx, jy, jz;
+  int j;
 
 #ifdef CHECK
   msg_stack.push("Field3D: += Field3D");
@@ -387,19 +412,17 @@ Field3D & Field3D::operator+=(const Field3D &rhs)
 
   if(block->refs == 1) {
     // This is the only reference to this data
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] += rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] += rhs.block->data[0][0][j];
   }else {
     // Need to put result in a new block
 
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] + rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] + rhs.block->data[0][0][j];
 
     block->refs--;
     block = nb;
@@ -414,7 +437,7 @@ Field3D & Field3D::operator+=(const Field3D &rhs)
 
 Field3D & Field3D::operator+=(const Field2D &rhs)
 {
-  int jx, jy, jz;
+  int j, jz;
   real **d;
 
 #ifdef CHECK
@@ -431,17 +454,17 @@ Field3D & Field3D::operator+=(const Field2D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] += d[jx][jy];
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        block->data[0][0][j*ngz+jz] += d[0][j];
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] + d[jx][jy];
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        nb->data[0][0][j*ngz+jz] = block->data[0][0][j*ngz+jz] + d[0][j];
 
     block->refs--;
     block = nb;
@@ -456,7 +479,7 @@ Field3D & Field3D::operator+=(const Field2D &rhs)
 
 Field3D & Field3D::operator+=(const real &rhs)
 {
-  int jx, jy, jz;
+  int j;
 #ifdef CHECK
   msg_stack.push("Field3D: += ( real )");
 
@@ -472,17 +495,15 @@ Field3D & Field3D::operator+=(const real &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] += rhs;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] += rhs;
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] + rhs;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] + rhs;
 
     block->refs--;
     block = nb;
@@ -499,7 +520,7 @@ Field3D & Field3D::operator+=(const real &rhs)
 
 Field3D & Field3D::operator-=(const Field3D &rhs)
 {
-  int jx, jy, jz;
+  int j;
 
 #ifdef CHECK
   msg_stack.push("Field3D: -= ( Field3D )");
@@ -517,17 +538,15 @@ Field3D & Field3D::operator-=(const Field3D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] -= rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] -= rhs.block->data[0][0][j];
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] - rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] - rhs.block->data[0][0][j];
 
     block->refs--;
     block = nb;
@@ -542,7 +561,7 @@ Field3D & Field3D::operator-=(const Field3D &rhs)
 
 Field3D & Field3D::operator-=(const Field2D &rhs)
 {
-  int jx, jy, jz;
+  int j, jz;
   real **d;
 
 #ifdef CHECK
@@ -558,18 +577,18 @@ Field3D & Field3D::operator-=(const Field2D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] -= d[jx][jy];
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        block->data[0][0][j*ngz+jz] -= d[0][j];
 
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] - d[jx][jy];
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        nb->data[0][0][j*ngz+jz] = block->data[0][0][j*ngz+jz] - d[0][j];
 
     block->refs--;
     block = nb;
@@ -584,7 +603,7 @@ Field3D & Field3D::operator-=(const Field2D &rhs)
 
 Field3D & Field3D::operator-=(const real &rhs)
 {
-  int jx, jy, jz;
+  int j;
 
 #ifdef CHECK
   msg_stack.push("Field3D: -= ( real )");
@@ -600,17 +619,15 @@ Field3D & Field3D::operator-=(const real &rhs)
 #endif
   
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] -= rhs;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] -= rhs;
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] - rhs;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] - rhs;
 
     block->refs--;
     block = nb;
@@ -627,7 +644,7 @@ Field3D & Field3D::operator-=(const real &rhs)
 
 Field3D & Field3D::operator*=(const Field3D &rhs)
 {
-  int jx, jy, jz;
+  int j;
 
 #ifdef CHECK
   msg_stack.push("Field3D: *= ( Field3D )");
@@ -646,17 +663,15 @@ Field3D & Field3D::operator*=(const Field3D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] *= rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] *= rhs.block->data[0][0][j];
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] * rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] * rhs.block->data[0][0][j];
 
     block->refs--;
     block = nb;
@@ -671,7 +686,7 @@ Field3D & Field3D::operator*=(const Field3D &rhs)
 
 Field3D & Field3D::operator*=(const Field2D &rhs)
 {
-  int jx, jy, jz;
+  int j, jz;
   real **d;
 
 #ifdef CHECK
@@ -687,17 +702,17 @@ Field3D & Field3D::operator*=(const Field2D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] *= d[jx][jy];
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        block->data[0][0][j*ngz+jz] *= d[0][j];
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] * d[jx][jy];
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        nb->data[0][0][j*ngz+jz] = block->data[0][0][j*ngz+jz] * d[0][j];
 
     block->refs--;
     block = nb;
@@ -712,7 +727,7 @@ Field3D & Field3D::operator*=(const Field2D &rhs)
 
 Field3D & Field3D::operator*=(const real rhs)
 {
-  int jx, jy, jz;
+  int j;
   
 #ifdef CHECK
   msg_stack.push("Field3D: *= ( real )");
@@ -728,18 +743,16 @@ Field3D & Field3D::operator*=(const real rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] *= rhs;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] *= rhs;
 
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] * rhs;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] * rhs;
 
     block->refs--;
     block = nb;
@@ -756,7 +769,7 @@ Field3D & Field3D::operator*=(const real rhs)
 
 Field3D & Field3D::operator/=(const Field3D &rhs)
 {
-  int jx, jy, jz;
+  int j;
 
   if(StaggerGrids && (rhs.location != location)) {
     // Interpolate and call again
@@ -782,18 +795,16 @@ Field3D & Field3D::operator/=(const Field3D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] /= rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] /= rhs.block->data[0][0][j];
     
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] / rhs.block->data[jx][jy][jz];
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] / rhs.block->data[0][0][j];
 
     block->refs--;
     block = nb;
@@ -808,7 +819,7 @@ Field3D & Field3D::operator/=(const Field3D &rhs)
 
 Field3D & Field3D::operator/=(const Field2D &rhs)
 {
-  int jx, jy, jz;
+  int j, jz;
   real **d;
 
 #ifdef CHECK
@@ -828,23 +839,21 @@ Field3D & Field3D::operator/=(const Field2D &rhs)
   /// Hence for now straight division is used
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++) {
-	real val = 1.0L / d[jx][jy]; // Because multiplications are faster than divisions
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] *= val;
-	  //block->data[jx][jy][jz] /= d[jx][jy];
-      }
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++) {
+      real val = 1.0L / d[0][j]; // Because multiplications are faster than divisions
+      for(jz=0;jz<ngz;jz++)
+	block->data[0][0][j*ngz+jz] *= val;
+    }
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++) {
-	real val = 1.0L / d[jx][jy];
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] * val;
-	//nb->data[jx][jy][jz] = block->data[jx][jy][jz] / d[jx][jy];
-      }
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++) {
+      real val = 1.0L / d[0][j];
+      for(jz=0;jz<ngz;jz++)
+	nb->data[0][0][j*ngz+jz] = block->data[0][0][j*ngz+jz] * val;
+    }
 
     block->refs--;
     block = nb;
@@ -859,7 +868,7 @@ Field3D & Field3D::operator/=(const Field2D &rhs)
 
 Field3D & Field3D::operator/=(const real rhs)
 {
-  int jx, jy, jz;
+  int j;
   
 #ifdef CHECK
   msg_stack.push("Field3D: /= ( real )");
@@ -877,17 +886,15 @@ Field3D & Field3D::operator/=(const real rhs)
   real val = 1.0 / rhs; // Because multiplication faster than division
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] *= val;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] *= val;
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = block->data[jx][jy][jz] * val;
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = block->data[0][0][j] * val;
 
     block->refs--;
     block = nb;
@@ -904,7 +911,7 @@ Field3D & Field3D::operator/=(const real rhs)
 
 Field3D & Field3D::operator^=(const Field3D &rhs)
 {
-  int jx, jy, jz;
+  int j;
 
   if(StaggerGrids && (rhs.location != location)) {
     // Interpolate and call again
@@ -930,18 +937,16 @@ Field3D & Field3D::operator^=(const Field3D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] = pow(block->data[jx][jy][jz], rhs.block->data[jx][jy][jz]);
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] = pow(block->data[0][0][j], rhs.block->data[0][0][j]);
 
   }else {
     memblock3d *nb = new_block();
     
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = pow(block->data[jx][jy][jz], rhs.block->data[jx][jy][jz]);
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = pow(block->data[0][0][j], rhs.block->data[0][0][j]);
     
     block->refs--;
     block = nb;
@@ -956,7 +961,7 @@ Field3D & Field3D::operator^=(const Field3D &rhs)
 
 Field3D & Field3D::operator^=(const Field2D &rhs)
 {
-  int jx, jy, jz;
+  int j, jz;
   real **d;
 
 #ifdef CHECK
@@ -972,18 +977,18 @@ Field3D & Field3D::operator^=(const Field2D &rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] = pow(block->data[jx][jy][jz], d[jx][jy]);
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        block->data[0][0][j*ngz+jz] = pow(block->data[0][0][j*ngz+jz], d[0][j]);
 
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = pow(block->data[jx][jy][jz], d[jx][jy]);
+    #pragma omp parallel for private(jz)
+    for(j=0;j<ngx*ngy;j++)
+      for(jz=0;jz<ngz;jz++)
+        nb->data[0][0][j*ngz+jz] = pow(block->data[0][0][j*ngz+jz], d[0][j]);
 
     block->refs--;
     block = nb;
@@ -998,7 +1003,7 @@ Field3D & Field3D::operator^=(const Field2D &rhs)
 
 Field3D & Field3D::operator^=(const real rhs)
 {
-  int jx, jy, jz;
+  int j;
 
 #ifdef CHECK
   msg_stack.push("Field3D: ^= ( real )");
@@ -1014,18 +1019,16 @@ Field3D & Field3D::operator^=(const real rhs)
 #endif
 
   if(block->refs == 1) {
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  block->data[jx][jy][jz] = pow(block->data[jx][jy][jz], rhs);
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      block->data[0][0][j] = pow(block->data[0][0][j], rhs);
 
   }else {
     memblock3d *nb = new_block();
 
-    for(jx=0;jx<ngx;jx++)
-      for(jy=0;jy<ngy;jy++)
-	for(jz=0;jz<ngz;jz++)
-	  nb->data[jx][jy][jz] = pow(block->data[jx][jy][jz], rhs);
+    #pragma omp parallel for
+    for(j=0;j<ngx*ngy*ngz;j++)
+      nb->data[0][0][j] = pow(block->data[0][0][j], rhs);
 
     block->refs--;
     block = nb;
@@ -1043,76 +1046,72 @@ Field3D & Field3D::operator^=(const real rhs)
  *                      BINARY OPERATORS 
  ***************************************************************/
 
-/////////////////// ADDITION ///////////////////
+// Operators between Field3D, Field2D and real are expression
+// templates (field_expr.h). These prepare their operands
 
-const Field3D Field3D::operator+() const
+const real* expr_leaf_data(Field3D &f, CELL_LOC loc)
 {
-  Field3D result = *this;
-
-#ifdef TRACK
-  result.name = name;
+#ifdef CHECK
+  msg_stack.push("Field3D: expression operand");
+  f.check_data();
 #endif
-  
-  return result;
-}
 
+  if(StaggerGrids && (f.getLocation() != loc))
+    f = interp_to(f, loc);
 
-const Field3D Field3D::operator+(const Field3D &other) const
-{
-  Field3D result = *this;
-  result += other;
-  return(result);
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  // Const version, so shared data isn't copied
+  const Field3D &cf = f;
+  return cf.begin();
 }
 
-const Field3D Field3D::operator+(const Field2D &other) const
+const real* expr_leaf_data(const Field2D &f)
 {
-  Field3D result = *this;
-  result += other;
-  return(result);
+#ifdef CHECK
+  msg_stack.push("Field3D: Field2D expression operand");
+  f.check_data();
+  msg_stack.pop();
+#endif
+  
+  return f.begin();
 }
 
-const FieldPerp Field3D::operator+(const FieldPerp &other) const
+real expr_pow(real a, real b)
 {
-  FieldPerp result = other;
-  result += (*this);
-  return(result);
+  return pow(a, b);
 }
 
-const Field3D Field3D::operator+(const real &rhs) const
+#ifdef TRACK
+string expr_leaf_name(const Field2D &f)
 {
-  Field3D result = *this;
-  result += rhs;
-  return(result);
+  return f.name;
 }
+#endif
 
-/////////////////// SUBTRACTION ////////////////
+/////////////////// ADDITION ///////////////////
 
-const Field3D Field3D::operator-() const
+const Field3D Field3D::operator+() const
 {
   Field3D result = *this;
 
-  result *= -1.0;
-
 #ifdef TRACK
-  result.name = "(-"+name+")";
+  result.name = name;
 #endif
   
   return result;
 }
 
-const Field3D Field3D::operator-(const Field3D &other) const
+const FieldPerp Field3D::operator+(const FieldPerp &other) const
 {
-  Field3D result = *this;
-  result -= other;
+  FieldPerp result = other;
+  result += (*this);
   return(result);
 }
 
-const Field3D Field3D::operator-(const Field2D &other) const
-{
-  Field3D result = *this;
-  result -= other;
-  return(result);
-}
+/////////////////// SUBTRACTION ////////////////
 
 const FieldPerp Field3D::operator-(const FieldPerp &other) const
 {
@@ -1134,29 +1133,8 @@ const FieldPerp Field3D::operator-(const FieldPerp &other) const
   return(result);
 }
 
-const Field3D Field3D::operator-(const real &rhs) const
-{
-  Field3D result = *this;
-  result -= rhs;
-  return(result);
-}
-
 ///////////////// MULTIPLICATION ///////////////
 
-const Field3D Field3D::operator*(const Field3D &other) const
-{
-  Field3D result = *this;
-  result *= other;
-  return(result);
-}
-
-const Field3D Field3D::operator*(const Field2D &other) const
-{
-  Field3D result = *this;
-  result *= other;
-  return(result);
-}
-
 const FieldPerp Field3D::operator*(const FieldPerp &other) const
 {
   FieldPerp result = other;
@@ -1164,29 +1142,8 @@ const FieldPerp Field3D::operator*(const FieldPerp &other) const
   return(result);
 }
 
-const Field3D Field3D::operator*(const real rhs) const
-{
-  Field3D result = *this;
-  result *= rhs;
-  return(result);
-}
-
 //////////////////// DIVISION ////////////////////
 
-const Field3D Field3D::operator/(const Field3D &other) const
-{
-  Field3D result = *this;
-  result /= other;
-  return(result);
-}
-
-const Field3D Field3D::operator/(const Field2D &other) const
-{
-  Field3D result = *this;
-  result /= other;
-  return(result);
-}
-
 const FieldPerp Field3D::operator/(const FieldPerp &other) const
 {
   real **d;
@@ -1211,29 +1168,8 @@ const FieldPerp Field3D::operator/(const FieldPerp &other) const
   return(result);
 }
 
-const Field3D Field3D::operator/(const real rhs) const
-{
-  Field3D result = *this;
-  result /= rhs;
-  return(result);
-}
-
 ////////////// EXPONENTIATION /////////////////
 
-const Field3D Field3D::operator^(const Field3D &other) const
-{
-  Field3D result = *this;
-  result ^= other;
-  return(result);
-}
-
-const Field3D Field3D::operator^(const Field2D &other) const
-{
-  Field3D result = *this;
-  result ^= other;
-  return(result);
-}
-
 const FieldPerp Field3D::operator^(const FieldPerp &other) const
 {
   real **d;
@@ -1258,13 +1194,6 @@ const FieldPerp Field3D::operator^(const FieldPerp &other) const
   return(result);
 }
 
-const Field3D Field3D::operator^(const real rhs) const
-{
-  Field3D result = *this;
-  result ^= rhs;
-  return(result);
-}
-
 /***************************************************************
  *                         STENCILS
  ***************************************************************/
@@ -1575,10 +1504,42 @@ void Field3D::ShiftZ(int jx, int jy, double zangle)
   block->data[jx][jy][ncz] = block->data[jx][jy][0];
 }
 
+/// Shifts all z lines in field data d. Line i (= jx*ngy + jy) is 
+/// shifted by zangle[i*zstride]. Uses one batched FFT each way
+static void shiftz_lines(real *d, const real *zangle, int zstride)
+{
+  static dcomplex *v = (dcomplex*) NULL;
+  int nc = ncz/2 + 1, nlines = ngx*ngy;
+  real kwave;
+
+  if(ncz == 1)
+    return;
+
+  if(v == (dcomplex*) NULL) {
+    // Allocate memory
+    v = new dcomplex[nlines*nc];
+  }
+
+  rfft_many(d, ncz, nlines, ngz, v); // Forward FFT
+
+  // Apply phase shift
+  for(int i=0;i<nlines;i++) {
+    real za = zangle[i*zstride];
+    for(int jz=1;jz<=ncz/2;jz++) {
+      kwave=jz*2.0*PI/zlength; // wave number is 1/[rad]
+      v[i*nc+jz] *= dcomplex(cos(kwave*za) , -sin(kwave*za));
+    }
+  }
+
+  irfft_many(v, ncz, nlines, d, ngz); // Reverse FFT
+
+  for(int i=0;i<nlines;i++)
+    d[i*ngz+ncz] = d[i*ngz];
+}
+
 const Field3D Field3D::ShiftZ(const Field2D zangle) const
 {
   Field3D result;
-  int jx, jy;
 
 #ifdef CHECK
   msg_stack.push("Field3D: ShiftZ ( Field2D )");
@@ -1587,11 +1548,8 @@ const Field3D Field3D::ShiftZ(const Field2D zangle) const
 
   result = *this;
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      result.ShiftZ(jx, jy, zangle[jx][jy]);
-    }
-  }
+  // Field2D data is contiguous, one value per z line
+  shiftz_lines(result.begin(), zangle[0], 1);
 
 #ifdef CHECK
   msg_stack.pop();
@@ -1603,7 +1561,6 @@ const Field3D Field3D::ShiftZ(const Field2D zangle) const
 const Field3D Field3D::ShiftZ(const real zangle) const
 {
   Field3D result;
-  int jx, jy;
 
 #ifdef CHECK
   msg_stack.push("Field3D: ShiftZ ( real )");
@@ -1612,11 +1569,7 @@ const Field3D Field3D::ShiftZ(const real zangle) const
 
   result = *this;
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      result.ShiftZ(jx, jy, zangle);
-    }
-  }
+  shiftz_lines(result.begin(), &zangle, 0);
 
 #ifdef CHECK
   msg_stack.pop();
@@ -1781,10 +1734,9 @@ const Field3D Field3D::Sqrt() const
 
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++) 
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = sqrt(block->data[jx][jy][jz]);
+  #pragma omp parallel for
+  for(int j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = sqrt(block->data[0][0][j]);
 
 #ifdef CHECK
   msg_stack.pop();
@@ -1797,7 +1749,6 @@ const Field3D Field3D::Sqrt() const
 
 const Field3D Field3D::Abs() const
 {
-  int jx, jy, jz;
   Field3D result;
 
 #ifdef CHECK
@@ -1814,10 +1765,9 @@ const Field3D Field3D::Abs() const
 
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++) 
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = fabs(block->data[jx][jy][jz]);
+  #pragma omp parallel for
+  for(int j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = fabs(block->data[0][0][j]);
 
   result.location = location;
 
@@ -1973,6 +1923,42 @@ int Field3D::setData(int x, int y, int z, real *rptr)
   return 1;
 }
 
+int Field3D::getLines(int x, int yge, int ylt, real *rptr) const
+{
+#ifdef CHECK
+  if(block == NULL) {
+    error("Field3D: getLines on empty data\n");
+    exit(1);
+  }
+  if((x < 0) || (x > ncx) || (yge < 0) || (ylt > ngy)) {
+    error("Field3D: getLines (%d,%d-%d) out of bounds\n", x, yge, ylt);
+    exit(1);
+  }
+#endif
+  // z lines are contiguous, but only the first ncz points are sent
+  real **d = block->data[x];
+  for(int y=yge;y<ylt;y++)
+    memcpy(rptr + (y-yge)*ncz, d[y], ncz*sizeof(real));
+  
+  return (ylt - yge)*ncz;
+}
+
+int Field3D::setLines(int x, int yge, int ylt, const real *rptr)
+{
+  Allocate();
+#ifdef CHECK
+  if((x < 0) || (x > ncx) || (yge < 0) || (ylt > ngy)) {
+    error("Field3D: setLines (%d,%d-%d) out of bounds\n", x, yge, ylt);
+    exit(1);
+  }
+#endif
+  real **d = block->data[x];
+  for(int y=yge;y<ylt;y++)
+    memcpy(d[y], rptr + (y-yge)*ncz, ncz*sizeof(real));
+  
+  return (ylt - yge)*ncz;
+}
+
 #ifdef CHECK
 /// Check if the data is valid
 bool Field3D::check_data(bool vital) const
@@ -2056,10 +2042,8 @@ void Field3D::alloc_data() const
 
       memblock3d* nb = new_block();
 
-      for(int jx=0;jx<ngx;jx++)
-	for(int jy=0;jy<ngy;jy++)
-	  for(int jz=0;jz<ngz;jz++)
-	    nb->data[jx][jy][jz] = block->data[jx][jy][jz];
+      for(int j=0;j<ngx*ngy*ngz;j++)
+	nb->data[0][0][j] = block->data[0][0][j];
 
       block->refs--;
       block = nb;
@@ -2091,95 +2075,18 @@ void Field3D::free_data()
   block = NULL;
 }
 
-/***************************************************************
- *               NON-MEMBER OVERLOADED OPERATORS
- ***************************************************************/
-
-const Field3D operator-(const real &lhs, const Field3D &rhs)
-{
-  Field3D result;
-  int jx, jy, jz;
-
-#ifdef TRACK
-  result.name = "(real-"+rhs.name+")";
-#endif
-
-  result.Allocate();
-  
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = lhs - rhs.block->data[jx][jy][jz];
-
-  result.location = rhs.location;
-
-  return result;
-}
-
-const Field3D operator+(const real &lhs, const Field3D &rhs)
-{
-  return rhs+lhs;
-}
-
-const Field3D operator*(const real lhs, const Field3D &rhs)
-{
-  return(rhs * lhs);
-}
-
-const Field3D operator/(const real lhs, const Field3D &rhs)
-{
-  Field3D result = rhs;
-  int jx, jy, jz;
-  real ***d;
-
-  d = result.getData();
-#ifdef CHECK
-  if(d == (real***) NULL) {
-    bout_error("Field3D: left / operator has invalid Field3D argument");
-  }
-#endif
-
-#ifdef TRACK
-  result.name = "(real/"+rhs.name+")";
-#endif
-  
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	d[jx][jy][jz] = lhs / d[jx][jy][jz];
-
-  result.setLocation( rhs.getLocation() );
-
-  return(result);
-}
-
-const Field3D operator^(const real lhs, const Field3D &rhs)
+real* Field3D::expr_data(CELL_LOC loc)
 {
-  Field3D result = rhs;
-  int jx, jy, jz;
-  real ***d;
-
-  d = result.getData();
-
-#ifdef CHECK
-  if(d == (real***) NULL) {
-    output.write("Field3D: left ^ operator has invalid Field3D argument");
-    exit(1);
-  }
-#endif
-
-#ifdef TRACK
-  result.name = "(real^"+rhs.name+")";
-#endif
+  // Existing values aren't needed, so if shared just get a new block
+  if((block != NULL) && (block->refs > 1))
+    free_data();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	d[jx][jy][jz] = pow(lhs, d[jx][jy][jz]);
+  if(block == NULL)
+    block = new_block();
 
-  result.setLocation( rhs.getLocation() );
+  location = loc;
 
-  return(result);
+  return block->data[0][0];
 }
 
 //////////////// NON-MEMBER FUNCTIONS //////////////////
@@ -2209,14 +2116,12 @@ real max(const Field3D &f, bool allpe)
 const Field3D sin(const Field3D &f)
 {
   Field3D result;
-  int jx, jy, jz;
+  int j;
   
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = sin(f.block->data[jx][jy][jz]);
+  for(j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = sin(f.block->data[0][0][j]);
 
 #ifdef TRACK
   result.name = "sin("+f.name+")";
@@ -2230,14 +2135,12 @@ const Field3D sin(const Field3D &f)
 const Field3D cos(const Field3D &f)
 {
   Field3D result;
-  int jx, jy, jz;
+  int j;
   
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = cos(f.block->data[jx][jy][jz]);
+  for(j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = cos(f.block->data[0][0][j]);
 
 #ifdef TRACK
   result.name = "cos("+f.name+")";
@@ -2251,14 +2154,12 @@ const Field3D cos(const Field3D &f)
 const Field3D tan(const Field3D &f)
 {
   Field3D result;
-  int jx, jy, jz;
+  int j;
   
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = tan(f.block->data[jx][jy][jz]);
+  for(j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = tan(f.block->data[0][0][j]);
 
 #ifdef TRACK
   result.name = "tan("+f.name+")";
@@ -2272,14 +2173,12 @@ const Field3D tan(const Field3D &f)
 const Field3D sinh(const Field3D &f)
 {
   Field3D result;
-  int jx, jy, jz;
+  int j;
   
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = sinh(f.block->data[jx][jy][jz]);
+  for(j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = sinh(f.block->data[0][0][j]);
 
 #ifdef TRACK
   result.name = "sinh("+f.name+")";
@@ -2293,14 +2192,12 @@ const Field3D sinh(const Field3D &f)
 const Field3D cosh(const Field3D &f)
 {
   Field3D result;
-  int jx, jy, jz;
+  int j;
   
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = cosh(f.block->data[jx][jy][jz]);
+  for(j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = cosh(f.block->data[0][0][j]);
 
 #ifdef TRACK
   result.name = "cosh("+f.name+")";
@@ -2314,14 +2211,12 @@ const Field3D cosh(const Field3D &f)
 const Field3D tanh(const Field3D &f)
 {
   Field3D result;
-  int jx, jy, jz;
+  int j;
   
   result.Allocate();
   
-  for(jx=0;jx<ngx;jx++)
-    for(jy=0;jy<ngy;jy++)
-      for(jz=0;jz<ngz;jz++)
-	result.block->data[jx][jy][jz] = tanh(f.block->data[jx][jy][jz]);
+  for(j=0;j<ngx*ngy*ngz;j++)
+    result.block->data[0][0][j] = tanh(f.block->data[0][0][j]);
 
 #ifdef TRACK
   result.name = "tanh("+f.name+")";
@@ -2336,33 +2231,32 @@ const Field3D filter(const Field3D &var, int N0)
 {
   Field3D result;
   static dcomplex *f = (dcomplex*) NULL;
-  int jx, jy, jz;
+  int nc = ncz/2 + 1, nlines = ngx*ngy;
   
   if(f == (dcomplex*) NULL) {
     // Allocate memory
-    f = new dcomplex[ncz/2 + 1];
+    f = new dcomplex[nlines*nc];
   }
 
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-
-      rfft(var.block->data[jx][jy], ncz, f); // Forward FFT
+  rfft_many(var.block->data[0][0], ncz, nlines, ngz, f); // Forward FFT
 
-      for(jz=0;jz<=ncz/2;jz++) {
-	
-	if(jz != N0) {
-	  // Zero this component
-	  f[jz] = 0.0;
-	}
+  for(int i=0;i<nlines;i++) {
+    for(int jz=0;jz<=ncz/2;jz++) {
+      
+      if(jz != N0) {
+	// Zero this component
+	f[i*nc+jz] = 0.0;
       }
-
-      irfft(f, ncz, result.block->data[jx][jy]); // Reverse FFT
-
-      result.block->data[jx][jy][ncz] = result.block->data[jx][jy][0];
     }
   }
+
+  real *d = result.block->data[0][0];
+  irfft_many(f, ncz, nlines, d, ngz); // Reverse FFT
+
+  for(int i=0;i<nlines;i++)
+    d[i*ngz+ncz] = d[i*ngz];
   
 #ifdef TRACK
   result.name = "filter("+var.name+")";
@@ -2464,7 +2358,6 @@ const Field3D low_pass(const Field3D &var, int zmax)
 {
   Field3D result;
   static dcomplex *f = NULL;
-  int jx, jy, jz;
 
 #ifdef CHECK
   msg_stack.push("low_pass(Field3D, %d)", zmax);
@@ -2473,8 +2366,9 @@ const Field3D low_pass(const Field3D &var, int zmax)
   if(!var.isAllocated())
     return var;
 
+  int nc = ncz/2 + 1, nlines = ngx*ngy;
   if(f == NULL)
-    f = new dcomplex[ncz/2 + 1];
+    f = new dcomplex[nlines*nc];
  
   if((zmax >= ncz/2) || (zmax < 0)) {
     // Removing nothing
@@ -2483,19 +2377,18 @@ const Field3D low_pass(const Field3D &var, int zmax)
   
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      // Take FFT in the Z direction
-      rfft(var.block->data[jx][jy], ncz, f);
-      
-      // Filter in z
-      for(jz=zmax+1;jz<=ncz/2;jz++)
-	f[jz] = 0.0;
-
-      irfft(f, ncz, result.block->data[jx][jy]); // Reverse FFT
-      result.block->data[jx][jy][ncz] = result.block->data[jx][jy][0];
-    }
-  }
+  // Take FFT in the Z direction
+  rfft_many(var.block->data[0][0], ncz, nlines, ngz, f);
+  
+  // Filter in z
+  for(int i=0;i<nlines;i++)
+    for(int jz=zmax+1;jz<=ncz/2;jz++)
+      f[i*nc+jz] = 0.0;
+  
+  real *d = result.block->data[0][0];
+  irfft_many(f, ncz, nlines, d, ngz); // Reverse FFT
+  for(int i=0;i<nlines;i++)
+    d[i*ngz+ncz] = d[i*ngz];
   
   result.location = var.location;
 
@@ -2510,7 +2403,6 @@ const Field3D low_pass(const Field3D &var, int zmax, int zmin)
 {
   Field3D result;
   static dcomplex *f = NULL;
-  int jx, jy, jz;
 
 #ifdef CHECK
   msg_stack.push("low_pass(Field3D, %d, %d)", zmax, zmin);
@@ -2519,8 +2411,9 @@ const Field3D low_pass(const Field3D &var, int zmax, int zmin)
   if(!var.isAllocated())
     return var;
 
+  int nc = ncz/2 + 1, nlines = ngx*ngy;
   if(f == NULL)
-    f = new dcomplex[ncz/2 + 1];
+    f = new dcomplex[nlines*nc];
  
   if((zmax >= ncz/2) || (zmax < 0)) {
     // Removing nothing
@@ -2529,24 +2422,25 @@ const Field3D low_pass(const Field3D &var, int zmax, int zmin)
   
   result.Allocate();
 
-  for(jx=0;jx<ngx;jx++) {
-    for(jy=0;jy<ngy;jy++) {
-      // Take FFT in the Z direction
-      rfft(var.block->data[jx][jy], ncz, f);
-      
-      // Filter in z
-      for(jz=zmax+1;jz<=ncz/2;jz++)
-	f[jz] = 0.0;
-
-      // Filter zonal mode
-      if(zmin==0) {
-	f[0] = 0.0;
-      }
-      irfft(f, ncz, result.block->data[jx][jy]); // Reverse FFT
-      result.block->data[jx][jy][ncz] = result.block->data[jx][jy][0];
+  // Take FFT in the Z direction
+  rfft_many(var.block->data[0][0], ncz, nlines, ngz, f);
+  
+  for(int i=0;i<nlines;i++) {
+    // Filter in z
+    for(int jz=zmax+1;jz<=ncz/2;jz++)
+      f[i*nc+jz] = 0.0;
+    
+    // Filter zonal mode
+    if(zmin==0) {
+      f[i*nc] = 0.0;
     }
   }
   
+  real *d = result.block->data[0][0];
+  irfft_many(f, ncz, nlines, d, ngz); // Reverse FFT
+  for(int i=0;i<nlines;i++)
+    d[i*ngz+ncz] = d[i*ngz];
+  
   result.location = var.location;
 
 #ifdef CHECK
@@ -31,9 +31,12 @@ class Field3D;
 #include "stencils.h"
 #include "bout_types.h"
 
+template<typename E> class FieldExpr;
+
 /// Structure to store blocks of memory for Field3D class
 struct memblock3d {
-  /// memory block
+  /// memory block. data[0][0] is a single contiguous, DATA_ALIGN aligned
+  /// array of ngx*ngy*ngz values, ordered [x][y][z]
   real ***data;
 
   /// Number of references
@@ -69,6 +72,12 @@ class Field3D : public Field, public FieldData {
   real*** getData() const;
   bool isAllocated() const { return block !=  NULL; } ///< Test if data is allocated
 
+  /// Flat iteration over all ngx*ngy*ngz points, z fastest
+  real* begin();     ///< Makes data unique, so may copy
+  real* end();
+  const real* begin() const;
+  const real* end() const;
+
 
   /// Returns DC component
   const Field2D DC();
@@ -89,25 +98,36 @@ class Field3D : public Field, public FieldData {
   Field3D & operator=(const FieldPerp &rhs);
   const bvalue & operator=(const bvalue &val);
   real operator=(const real val);
+  /// Evaluate an expression (see field_expr.h)
+  template<typename E>
+  Field3D & operator=(const FieldExpr<E> &rhs);
 
   /// Addition operators
   Field3D & operator+=(const Field3D &rhs);
   Field3D & operator+=(const Field2D &rhs);
+  template<typename E>
+  Field3D & operator+=(const FieldExpr<E> &rhs);
   Field3D & operator+=(const real &rhs);
   
   /// Subtraction
   Field3D & operator-=(const Field3D &rhs);
   Field3D & operator-=(const Field2D &rhs);
+  template<typename E>
+  Field3D & operator-=(const FieldExpr<E> &rhs);
   Field3D & operator-=(const real &rhs);
 
   /// Multiplication
   Field3D & operator*=(const Field3D &rhs);
   Field3D & operator*=(const Field2D &rhs);
+  template<typename E>
+  Field3D & operator*=(const FieldExpr<E> &rhs);
   Field3D & operator*=(const real rhs);
   
   /// Division
   Field3D & operator/=(const Field3D &rhs);
   Field3D & operator/=(const Field2D &rhs);
+  template<typename E>
+  Field3D & operator/=(const FieldExpr<E> &rhs);
   Field3D & operator/=(const real rhs);
 
   /// Exponentiation (use pow() function)
@@ -115,34 +135,15 @@ class Field3D : public Field, public FieldData {
   Field3D & operator^=(const Field2D &rhs);
   Field3D & operator^=(const real rhs);
   
-  // Binary operators
+  // Binary operators. Operators between Field3D, Field2D and real
+  // values are in field_expr.h
 
   const Field3D operator+() const;
-  const Field3D operator+(const Field3D &other) const;
-  const Field3D operator+(const Field2D &other) const;
   const FieldPerp operator+(const FieldPerp &other) const;
-  const Field3D operator+(const real &rhs) const;
-
-  const Field3D operator-() const;
-  const Field3D operator-(const Field3D &other) const;
-  const Field3D operator-(const Field2D &other) const;
   const FieldPerp operator-(const FieldPerp &other) const;
-  const Field3D operator-(const real &rhs) const;
-
-  const Field3D operator*(const Field3D &other) const;
-  const Field3D operator*(const Field2D &other) const;
   const FieldPerp operator*(const FieldPerp &other) const;
-  const Field3D operator*(const real rhs) const;
-
-  const Field3D operator/(const Field3D &other) const;
-  const Field3D operator/(const Field2D &other) const;
   const FieldPerp operator/(const FieldPerp &other) const;
-  const Field3D operator/(const real rhs) const;
-
-  const Field3D operator^(const Field3D &other) const;
-  const Field3D operator^(const Field2D &other) const;
   const FieldPerp operator^(const FieldPerp &other) const;
-  const Field3D operator^(const real rhs) const;
 
   // Stencils for differencing
 
@@ -189,10 +190,6 @@ class Field3D : public Field, public FieldData {
   real Min(bool allpe=false) const;
   real Max(bool allpe=false) const;
 
-  // Friend operators
-  friend const Field3D operator-(const real &lhs, const Field3D &rhs);
-  friend const Field3D operator+(const real &lhs, const Field3D &rhs);
-
   // Friend functions
   
   friend const Field3D sin(const Field3D &f);
@@ -219,6 +216,8 @@ class Field3D : public Field, public FieldData {
   int  getData(int x, int y, int z, real *rptr) const;
   int  setData(int x, int y, int z, void *vptr);
   int  setData(int x, int y, int z, real *rptr);
+  int  getLines(int x, int yge, int ylt, real *rptr) const;
+  int  setLines(int x, int yge, int ylt, const real *rptr);
 
   bool ioSupport() { return true; } ///< This class supports I/O operations
   real *getData(int component) { 
@@ -257,20 +256,19 @@ class Field3D : public Field, public FieldData {
   void alloc_data() const;
   /// Releases the data array, putting onto global stack
   void free_data();
+  /// Returns data to write an expression result into, setting location
+  real* expr_data(CELL_LOC loc);
   
   CELL_LOC location; // Location of the variable in the cell
 };
 
-// Non-member overloaded operators
-
-const Field3D operator*(const real lhs, const Field3D &rhs);
-const Field3D operator/(const real lhs, const Field3D &rhs);
-const Field3D operator^(const real lhs, const Field3D &rhs);
-
 // Non-member functions
 const Field3D sqrt(const Field3D &f);
 const Field3D abs(const Field3D &f);
 real min(const Field3D &f, bool allpe=false);
 real max(const Field3D &f, bool allpe=false);
 
+// Arithmetic operators
+#include "field_expr.h"
+
 #endif /* __FIELD3D_H__ */
@@ -53,6 +53,12 @@ class FieldData {
   virtual int setData(int x, int y, int z, void *vptr) = 0;
   virtual int setData(int x, int y, int z, real *rptr) = 0;
 
+  /// Copies points (x, yge <= y < ylt, 0 <= z < ncz) to rptr in the same order
+  /// as repeated calls to getData. Returns number of reals, or -1 if not implemented
+  virtual int getLines(int x, int yge, int ylt, real *rptr) const { return -1; }
+  /// Sets a block of points copied by getLines. Returns number of reals or -1
+  virtual int setLines(int x, int yge, int ylt, const real *rptr) { return -1; }
+
   // This code for inputting/outputting to file (all optional)
   virtual bool  ioSupport() { return false; }  ///< Return true if these functions implemented
   virtual const string getSuffix(int component) const { return string(""); }
@@ -0,0 +1,357 @@
+/*!
+ * \file field_expr.h
+ *
+ * \brief Expression templates for Field3D arithmetic
+ *
+ * Binary operators (+, -, *, /, ^) where at least one side is a Field3D
+ * don't compute anything, but return a small object describing the
+ * expression. The whole expression is evaluated in a single loop when
+ * it is assigned to, or converted to, a Field3D. This avoids a temporary Field3D and a
+ * pass over memory for every operator, so
+ *
+ *   ddt(Ni) = -b0xGrad_dot_Grad(phi,Ni)/Bxy + 2.*Ni0*Te0*...
+ *
+ * is done in one pass rather than one per operator.
+ *
+ * Operands can be Field3D, Field2D, real or another expression.
+ * Field3D operands are held by (reference counted) copy, Field2D by
+ * reference so expressions shouldn't outlive the statement they're in.
+ *
+ * With staggered grids, Field3D operands are interpolated to the
+ * location of the first (leftmost) Field3D in the expression, which
+ * is the same location the result had when operators were evaluated
+ * one at a time.
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FIELD_EXPR_H__
+#define __FIELD_EXPR_H__
+
+#include "field3d.h"
+#include "field2d.h"
+#include "bout_types.h"
+
+extern int ngx, ngy, ngz;
+
+/// Checks a Field3D operand, interpolates it to loc if needed, and
+/// returns a pointer to its (contiguous) data. Defined in field3d.cpp
+const real* expr_leaf_data(Field3D &f, CELL_LOC loc);
+/// Checks a Field2D operand and returns a pointer to its data
+const real* expr_leaf_data(const Field2D &f);
+/// pow(), here so this header doesn't need math.h
+real expr_pow(real a, real b);
+#ifdef TRACK
+/// Field2D may not be complete here (if field2d.h was included first)
+string expr_leaf_name(const Field2D &f);
+#endif
+
+/// Base class of all expressions. E is the derived type
+template<typename E>
+class FieldExpr {
+ public:
+  const E& expr() const { return static_cast<const E&>(*this); }
+
+  /// Evaluates the expression. Used when passed to functions
+  operator Field3D() const;
+};
+
+////////////////////// OPERANDS //////////////////////
+
+/// Field3D operand. Indexed by the flat 3D index
+class ExprField3D : public FieldExpr<ExprField3D> {
+ public:
+  ExprField3D(const Field3D &field) : f(field), data(NULL) { }
+
+  CELL_LOC location() const { return f.getLocation(); }
+  void prepare(CELL_LOC loc) const { data = expr_leaf_data(f, loc); }
+  real operator()(int i2, int i3) const { return data[i3]; }
+#ifdef TRACK
+  string name() const { return f.name; }
+#endif
+ private:
+  mutable Field3D f;
+  mutable const real *data;
+};
+
+/// Field2D operand. Indexed by the flat 2D index
+class ExprField2D : public FieldExpr<ExprField2D> {
+ public:
+  ExprField2D(const Field2D &field) : f(&field), data(NULL) { }
+
+  CELL_LOC location() const { return CELL_DEFAULT; }
+  void prepare(CELL_LOC loc) const { data = expr_leaf_data(*f); }
+  real operator()(int i2, int i3) const { return data[i2]; }
+#ifdef TRACK
+  string name() const { return expr_leaf_name(*f); }
+#endif
+ private:
+  const Field2D *f;
+  mutable const real *data;
+};
+
+/// Constant operand
+class ExprReal : public FieldExpr<ExprReal> {
+ public:
+  ExprReal(real value) : val(value) { }
+
+  CELL_LOC location() const { return CELL_DEFAULT; }
+  void prepare(CELL_LOC loc) const { }
+  real operator()(int i2, int i3) const { return val; }
+#ifdef TRACK
+  string name() const { return "real"; }
+#endif
+ private:
+  real val;
+};
+
+////////////////////// OPERATIONS //////////////////////
+
+struct ExprAdd {
+  static real apply(real a, real b) { return a + b; }
+  static const char* symbol() { return "+"; }
+};
+
+struct ExprSub {
+  static real apply(real a, real b) { return a - b; }
+  static const char* symbol() { return "-"; }
+};
+
+struct ExprMul {
+  static real apply(real a, real b) { return a * b; }
+  static const char* symbol() { return "*"; }
+};
+
+struct ExprDiv {
+  static real apply(real a, real b) { return a / b; }
+  static const char* symbol() { return "/"; }
+};
+
+struct ExprPow {
+  static real apply(real a, real b) { return expr_pow(a, b); }
+  static const char* symbol() { return "^"; }
+};
+
+/// Binary operation on two expressions
+template<typename L, typename R, typename Op>
+class ExprBinary : public FieldExpr< ExprBinary<L,R,Op> > {
+ public:
+  ExprBinary(const L &left, const R &right) : lhs(left), rhs(right) { }
+
+  CELL_LOC location() const {
+    CELL_LOC loc = lhs.location();
+    if(loc == CELL_DEFAULT)
+      loc = rhs.location();
+    return loc;
+  }
+  void prepare(CELL_LOC loc) const {
+    lhs.prepare(loc);
+    rhs.prepare(loc);
+  }
+  real operator()(int i2, int i3) const {
+    return Op::apply(lhs(i2, i3), rhs(i2, i3));
+  }
+#ifdef TRACK
+  string name() const { return "(" + lhs.name() + Op::symbol() + rhs.name() + ")"; }
+#endif
+ private:
+  L lhs;
+  R rhs;
+};
+
+/// Unary minus
+template<typename E>
+class ExprNeg : public FieldExpr< ExprNeg<E> > {
+ public:
+  ExprNeg(const E &e) : arg(e) { }
+
+  CELL_LOC location() const { return arg.location(); }
+  void prepare(CELL_LOC loc) const { arg.prepare(loc); }
+  real operator()(int i2, int i3) const { return -arg(i2, i3); }
+#ifdef TRACK
+  string name() const { return "(-" + arg.name() + ")"; }
+#endif
+ private:
+  E arg;
+};
+
+////////////////////// OPERAND TYPES //////////////////////
+
+/// Maps the type of an operator argument to the type stored in the
+/// expression. Types not listed can't be used in expressions.
+template<typename T>
+struct ExprOperand {
+  enum { valid = 0, is3D = 0 };
+};
+
+template<>
+struct ExprOperand<Field3D> {
+  enum { valid = 1, is3D = 1 };
+  typedef ExprField3D type;
+  static type make(const Field3D &f) { return type(f); }
+};
+
+template<>
+struct ExprOperand<Field2D> {
+  enum { valid = 1, is3D = 0 };
+  typedef ExprField2D type;
+  static type make(const Field2D &f) { return type(f); }
+};
+
+template<typename T>
+struct ExprScalar {
+  enum { valid = 1, is3D = 0 };
+  typedef ExprReal type;
+  static type make(const T &val) { return type(val); }
+};
+
+template<> struct ExprOperand<double> : public ExprScalar<double> { };
+template<> struct ExprOperand<float>  : public ExprScalar<float> { };
+template<> struct ExprOperand<int>    : public ExprScalar<int> { };
+template<> struct ExprOperand<long>   : public ExprScalar<long> { };
+
+/// Expressions always contain a Field3D
+template<typename L, typename R, typename Op>
+struct ExprOperand< ExprBinary<L,R,Op> > {
+  enum { valid = 1, is3D = 1 };
+  typedef ExprBinary<L,R,Op> type;
+  static const type& make(const type &e) { return e; }
+};
+
+template<typename E>
+struct ExprOperand< ExprNeg<E> > {
+  enum { valid = 1, is3D = 1 };
+  typedef ExprNeg<E> type;
+  static const type& make(const type &e) { return e; }
+};
+
+/// Result of a binary operator. Only has a type (so the operator only
+/// exists) if both arguments are operands and at least one is 3D
+template<typename L, typename R, typename Op,
+	 bool enable = ExprOperand<L>::valid && ExprOperand<R>::valid
+	               && (ExprOperand<L>::is3D || ExprOperand<R>::is3D)>
+struct ExprResult { };
+
+template<typename L, typename R, typename Op>
+struct ExprResult<L, R, Op, true> {
+  typedef ExprBinary<typename ExprOperand<L>::type, typename ExprOperand<R>::type, Op> type;
+};
+
+////////////////////// OPERATORS //////////////////////
+
+#define FIELD_EXPR_OPERATOR(op, Op)                                             \
+  template<typename L, typename R>                                              \
+  inline const typename ExprResult<L, R, Op>::type operator op(const L &lhs, const R &rhs) \
+  {                                                                             \
+    return typename ExprResult<L, R, Op>::type(ExprOperand<L>::make(lhs),       \
+                                               ExprOperand<R>::make(rhs));      \
+  }
+
+FIELD_EXPR_OPERATOR(+, ExprAdd)
+FIELD_EXPR_OPERATOR(-, ExprSub)
+FIELD_EXPR_OPERATOR(*, ExprMul)
+FIELD_EXPR_OPERATOR(/, ExprDiv)
+FIELD_EXPR_OPERATOR(^, ExprPow)
+
+#undef FIELD_EXPR_OPERATOR
+
+/// Unary minus. Only defined for 3D operands
+template<typename E, bool enable = ExprOperand<E>::is3D>
+struct ExprNegResult { };
+
+template<typename E>
+struct ExprNegResult<E, true> {
+  typedef ExprNeg<typename ExprOperand<E>::type> type;
+};
+
+template<typename E>
+inline const typename ExprNegResult<E>::type operator-(const E &e)
+{
+  return typename ExprNegResult<E>::type(ExprOperand<E>::make(e));
+}
+
+////////////////////// EVALUATION //////////////////////
+
+template<typename E>
+FieldExpr<E>::operator Field3D() const
+{
+  Field3D result;
+  result = expr();
+  return result;
+}
+
+/// Evaluates the expression in a single loop over all points
+template<typename E>
+Field3D & Field3D::operator=(const FieldExpr<E> &rhs)
+{
+  const E &e = rhs.expr();
+
+  CELL_LOC loc = e.location();
+  e.prepare(loc);
+
+  // Operands hold a reference to their data, so if this field
+  // appears in the expression it isn't the only reference
+  real *d = expr_data(loc);
+
+  int n2 = ngx*ngy;
+#ifdef _OPENMP
+  // Guarded since this header is included everywhere
+  #pragma omp parallel for
+#endif
+  for(int i2=0;i2<n2;i2++) {
+    int i3 = i2*ngz;
+    for(int jz=0;jz<ngz;jz++, i3++)
+      d[i3] = e(i2, i3);
+  }
+
+#ifdef TRACK
+  name = e.name();
+#endif
+
+  return *this;
+}
+
+template<typename E>
+Field3D & Field3D::operator+=(const FieldExpr<E> &rhs)
+{
+  return *this = *this + rhs.expr();
+}
+
+template<typename E>
+Field3D & Field3D::operator-=(const FieldExpr<E> &rhs)
+{
+  return *this = *this - rhs.expr();
+}
+
+template<typename E>
+Field3D & Field3D::operator*=(const FieldExpr<E> &rhs)
+{
+  return *this = *this * rhs.expr();
+}
+
+template<typename E>
+Field3D & Field3D::operator/=(const FieldExpr<E> &rhs)
+{
+  return *this = *this / rhs.expr();
+}
+
+#endif // __FIELD_EXPR_H__
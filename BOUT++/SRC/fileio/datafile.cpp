@@ -40,6 +40,7 @@
 #undef DATAFILE_ORIGIN
 
 #include "globals.h"
+#include "fft.h" // For output of Fourier modes
 
 #ifdef PDBF
 #include "pdb_format.h"
@@ -51,6 +52,13 @@
 
 #include <string.h>
 
+#ifdef ASYNCIO
+#include <pthread.h>
+#include <stdlib.h> // For atexit
+#include <deque>
+using std::deque;
+#endif
+
 // Define a default file extension
 #ifdef PDBF
 char DEFAULT_FILE_EXT[] = "pdb";
@@ -128,6 +136,255 @@ DataFormat *data_format(const char *filename)
   return data_format(NULL);
 }
 
+/////////////////////////////////////////////////////////////
+// Copies of the variables being written
+
+/// Copy of one variable
+struct DataRecord {
+  string name;
+  bool grow;
+  bool integer;  ///< Data is in idata, otherwise rdata
+  int lx, ly, lz;
+  vector<int>  idata;
+  vector<real> rdata;
+};
+
+/// Copy of all the variables being written to one file
+struct DataFrame {
+  DataFormat *file;
+  string filename;
+  bool append;
+  bool keep_open;  ///< Leave the file open afterwards
+  bool flush;      ///< Flush the file if left open
+  
+  int nrec;               ///< Number of records used
+  vector<DataRecord> rec; ///< Kept between outputs so the memory is reused
+
+  DataFrame() : file(NULL), append(false), keep_open(false), flush(false), nrec(0) {}
+
+  /// Add a record, returning a reference to be filled in
+  DataRecord &add(const string &name, bool grow, bool integer, int lx = 0, int ly = 0, int lz = 0) {
+    if(nrec == (int) rec.size())
+      rec.push_back(DataRecord());
+    DataRecord &r = rec[nrec++];
+    r.name = name;
+    r.grow = grow;
+    r.integer = integer;
+    r.lx = lx; r.ly = ly; r.lz = lz;
+    return r;
+  }
+};
+
+/// Write a frame to its file
+static bool write_frame(DataFrame &frame)
+{
+  DataFormat *file = frame.file;
+  
+  // Appending to a file which was left open
+  bool reopen = !(frame.append && file->is_valid() && (file->filename() != NULL) 
+		  && (frame.filename == file->filename()));
+
+  if(reopen && !file->openw(frame.filename, frame.append))
+    return false;
+
+  if(!file->is_valid())
+    return false;
+  
+  file->setRecord(-1); // Latest record
+
+  for(int i=0;i<frame.nrec;i++) {
+    DataRecord &r = frame.rec[i];
+    if(r.integer) {
+      if(r.grow) {
+	file->write_rec(&(r.idata[0]), r.name, r.lx, r.ly, r.lz);
+      }else
+	file->write(&(r.idata[0]), r.name, r.lx, r.ly, r.lz);
+    }else {
+      if(r.grow) {
+	file->write_rec(&(r.rdata[0]), r.name, r.lx, r.ly, r.lz);
+      }else
+	file->write(&(r.rdata[0]), r.name, r.lx, r.ly, r.lz);
+    }
+  }
+
+  if(frame.keep_open) {
+    if(frame.flush)
+      file->flush();
+  }else
+    file->close();
+
+  return true;
+}
+
+/////////////////////////////////////////////////////////////
+// Background output thread
+//
+// Frames are taken from a fixed pool, so at most nqueue outputs can be
+// waiting. When all frames are in use, writes block until one has been
+// written (back-pressure). Only the background thread calls the file
+// format libraries while it's running; reads call flush() first.
+
+static bool async_io = false;  ///< Background thread is running
+static DataFrame sync_frame;   ///< Used when writing directly
+
+#ifdef ASYNCIO
+static pthread_t io_thread;
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_work = PTHREAD_COND_INITIALIZER; ///< Frame queued, or stopping
+static pthread_cond_t io_done = PTHREAD_COND_INITIALIZER; ///< Frame written
+
+static deque<DataFrame*> io_queue; ///< Frames waiting to be written
+static vector<DataFrame*> io_free; ///< Frames available
+static int io_nframes;             ///< Total number of frames
+static bool io_stop = false;
+static bool io_error = false;      ///< A write failed since the last flush
+
+static void *io_main(void *arg)
+{
+  pthread_mutex_lock(&io_lock);
+  while(true) {
+    while(io_queue.empty() && !io_stop)
+      pthread_cond_wait(&io_work, &io_lock);
+    
+    if(io_queue.empty())
+      break; // Stopping, and nothing left to write
+    
+    DataFrame *frame = io_queue.front();
+    io_queue.pop_front();
+    
+    pthread_mutex_unlock(&io_lock);
+    bool ok = write_frame(*frame);
+    if(!ok)
+      output.write("\tWARNING: Could not write file '%s'\n", frame->filename.c_str());
+    pthread_mutex_lock(&io_lock);
+    
+    if(!ok)
+      io_error = true;
+    io_free.push_back(frame);
+    pthread_cond_broadcast(&io_done);
+  }
+  pthread_mutex_unlock(&io_lock);
+  return NULL;
+}
+
+static bool io_atexit = false; ///< finish() registered with atexit
+#endif
+
+/// Get a frame to copy variables into, waiting for one to be free
+static DataFrame *get_frame()
+{
+#ifdef ASYNCIO
+  if(async_io) {
+    pthread_mutex_lock(&io_lock);
+    while(io_free.empty())
+      pthread_cond_wait(&io_done, &io_lock);
+    DataFrame *frame = io_free.back();
+    io_free.pop_back();
+    pthread_mutex_unlock(&io_lock);
+    return frame;
+  }
+#endif
+  return &sync_frame;
+}
+
+/// Write a frame, or pass it to the background thread
+static bool put_frame(DataFrame *frame)
+{
+#ifdef ASYNCIO
+  if(async_io) {
+    pthread_mutex_lock(&io_lock);
+    io_queue.push_back(frame);
+    bool ok = !io_error;
+    pthread_cond_signal(&io_work);
+    pthread_mutex_unlock(&io_lock);
+    return ok;
+  }
+#endif
+  return write_frame(*frame);
+}
+
+bool Datafile::setAsync(int nqueue)
+{
+#ifdef ASYNCIO
+  if(async_io)
+    finish();
+
+  if(nqueue < 1)
+    nqueue = 1;
+
+  io_nframes = nqueue;
+  for(int i=0;i<io_nframes;i++)
+    io_free.push_back(new DataFrame);
+  io_stop = false;
+  io_error = false;
+  
+  if(pthread_create(&io_thread, NULL, io_main, NULL) != 0) {
+    output.write("\tWARNING: Could not start output thread. Writing files directly\n");
+    for(int i=0;i<io_nframes;i++)
+      delete io_free[i];
+    io_free.clear();
+    return false;
+  }
+  output.write("\tWriting files in the background, up to %d outputs queued\n", io_nframes);
+  async_io = true;
+
+  if(!io_atexit) {
+    // Make sure queued outputs are written before global Datafiles are destroyed
+    atexit(finish);
+    io_atexit = true;
+  }
+  return true;
+#else
+  output.write("\tWARNING: Background writing not available (compile with -DASYNCIO). Writing files directly\n");
+  return false;
+#endif
+}
+
+bool Datafile::flush()
+{
+#ifdef ASYNCIO
+  if(!async_io)
+    return true;
+  
+  real tstart = MPI_Wtime();
+  
+  pthread_mutex_lock(&io_lock);
+  while((int) io_free.size() < io_nframes)
+    pthread_cond_wait(&io_done, &io_lock);
+  bool ok = !io_error;
+  io_error = false;
+  pthread_mutex_unlock(&io_lock);
+  
+  wtime += MPI_Wtime() - tstart;
+  
+  return ok;
+#else
+  return true;
+#endif
+}
+
+void Datafile::finish()
+{
+#ifdef ASYNCIO
+  if(!async_io)
+    return;
+
+  flush();
+  
+  pthread_mutex_lock(&io_lock);
+  io_stop = true;
+  pthread_cond_signal(&io_work);
+  pthread_mutex_unlock(&io_lock);
+  
+  pthread_join(io_thread, NULL);
+  async_io = false;
+  
+  for(int i=0;i<io_nframes;i++)
+    delete io_free[i];
+  io_free.clear();
+#endif
+}
+
 ///////////////////////////////////////
 // Global variables, shared between Datafile objects
 bool Datafile::enabled = true;
@@ -136,34 +393,60 @@ real Datafile::wtime = 0.0;
 Datafile::Datafile()
 {
   low_prec = false;
+  pack_bits = 0;
+  out_opts = false;
+  persist = false;
+  flush_interval = 1;
+  nappend = 0;
+  file = NULL;
   setFormat(data_format()); // Set default format
 }
 
 Datafile::Datafile(DataFormat *format)
 {
   low_prec = false;
+  pack_bits = 0;
+  out_opts = false;
+  persist = false;
+  flush_interval = 1;
+  nappend = 0;
+  file = NULL;
   setFormat(format);
 }
 
 Datafile::~Datafile()
 {
-  
+  close(); // Queued outputs may use this file format
 }
 
 void Datafile::setFormat(DataFormat *format)
 {
+  close();
+  
   file = format;
   
   if(low_prec)
     file->setLowPrecision();
+  if(pack_bits > 0)
+    file->setPacking(pack_bits);
 }
 
 void Datafile::setLowPrecision()
 {
+  flush();
+  
   low_prec = true;
   file->setLowPrecision();
 }
 
+void Datafile::setPacking(int bits)
+{
+  flush();
+
+  pack_bits = bits;
+  file->setPacking(bits);
+}
+
 void Datafile::add(int &i, const char *name, int grow)
 {
   VarStr<int> d;
@@ -232,6 +515,36 @@ void Datafile::add(Vector3D &f, const char *name, int grow)
   v3d_arr.push_back(d);
 }
 
+void Datafile::setPersistent(int flush_every)
+{
+  persist = true;
+  flush_interval = flush_every;
+  nappend = 0;
+}
+
+void Datafile::setOutputOptions(bool on)
+{
+  out_opts = on;
+  
+  // Re-read the options for each variable
+  for(std::vector< VarStr<Field2D> >::iterator it = f2d_arr.begin(); it != f2d_arr.end(); it++)
+    it->region_set = false;
+  for(std::vector< VarStr<Field3D> >::iterator it = f3d_arr.begin(); it != f3d_arr.end(); it++)
+    it->region_set = false;
+  for(std::vector< VarStr<Vector2D> >::iterator it = v2d_arr.begin(); it != v2d_arr.end(); it++)
+    it->region_set = false;
+  for(std::vector< VarStr<Vector3D> >::iterator it = v3d_arr.begin(); it != v3d_arr.end(); it++)
+    it->region_set = false;
+}
+
+void Datafile::close()
+{
+  flush(); // Finish any background writes first
+  
+  if((file != NULL) && file->is_valid())
+    file->close(); // Also flushes the file
+}
+
 int Datafile::read(const char *format, ...)
 {
   va_list ap;  // List of arguments
@@ -244,6 +557,8 @@ int Datafile::read(const char *format, ...)
     vsprintf(filename, format, ap);
   va_end(ap);
 
+  flush(); // Finish any background writes first
+
   // Record starting time
   real tstart = MPI_Wtime();
   
@@ -346,6 +661,165 @@ int Datafile::read(const char *format, ...)
   return 0;
 }
 
+/// Read files written with a different processor decomposition
+/*!
+ * format should contain a single %d, which is replaced by the processor
+ * number e.g. "data/BOUT.restart.%d.pdb". npes, nxpe, mxsub and mysub
+ * describe the decomposition the files were written with. The global
+ * grid size and MXG, MYG and MZ must be the same as in this run.
+ *
+ * Each processor opens only the files which overlap its domain, and reads
+ * the overlapping block of each variable. Guard cells at processor
+ * boundaries are set from the files, so are only correct at the edges
+ * of the domain; they should be communicated before use as usual.
+ * Scalars are read from the first file opened.
+ */
+int Datafile::read_repart(const char *format, int npes, int nxpe, int mxsub, int mysub)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Datafile::read_repart(%s, %d, %d)", format, npes, nxpe);
+#endif
+
+  if((format == (const char*) NULL) || (nxpe < 1) || (mxsub < 1) || (mysub < 1))
+    return 1;
+
+  flush(); // Finish any background writes first
+
+  int nype = npes / nxpe;
+  if((mxsub*nxpe != MXSUB*NXPE) || (mysub*nype != MYSUB*NYPE)) {
+    output.write("\tERROR: Grid size %dx%d doesn't match files (%dx%d)\n",
+		 MXSUB*NXPE, MYSUB*NYPE, mxsub*nxpe, mysub*nype);
+    return 1;
+  }
+
+  real tstart = MPI_Wtime();
+
+  int jx, jy;
+
+  // Which of the old processors holds each local index, and where.
+  // Guard cells are taken from the processor holding the nearest point
+  // in this domain, so at the edges of the domain these are the boundaries.
+  vector<int> xproc(ngx), xind(ngx);
+  for(jx=0;jx<ngx;jx++) {
+    int gx = PE_XIND*MXSUB + jx; // Global X index, including guard cells
+    int gxc = gx;
+    if(gxc < PE_XIND*MXSUB + MXG)
+      gxc = PE_XIND*MXSUB + MXG;
+    if(gxc >= (PE_XIND+1)*MXSUB + MXG)
+      gxc = (PE_XIND+1)*MXSUB + MXG - 1;
+    int p = (gxc - MXG) / mxsub;
+    xproc[jx] = p;
+    xind[jx] = gx - p*mxsub;
+  }
+
+  vector<int> yproc(ngy), yind(ngy);
+  for(jy=0;jy<ngy;jy++) {
+    int gy = PE_YIND*MYSUB + jy - MYG; // Global Y index (no guard cells)
+    int gyc = gy;
+    if(gyc < PE_YIND*MYSUB)
+      gyc = PE_YIND*MYSUB;
+    if(gyc >= (PE_YIND+1)*MYSUB)
+      gyc = (PE_YIND+1)*MYSUB - 1;
+    int p = gyc / mysub;
+    yproc[jy] = p;
+    yind[jy] = gy - p*mysub + MYG;
+  }
+
+  // Make sure data is allocated
+  for(std::vector< VarStr<Field2D> >::iterator it = f2d_arr.begin(); it != f2d_arr.end(); it++)
+    it->ptr->Allocate();
+  for(std::vector< VarStr<Field3D> >::iterator it = f3d_arr.begin(); it != f3d_arr.end(); it++)
+    it->ptr->Allocate();
+  for(std::vector< VarStr<Vector2D> >::iterator it = v2d_arr.begin(); it != v2d_arr.end(); it++) {
+    it->ptr->x.Allocate(); it->ptr->y.Allocate(); it->ptr->z.Allocate();
+  }
+  for(std::vector< VarStr<Vector3D> >::iterator it = v3d_arr.begin(); it != v3d_arr.end(); it++) {
+    it->ptr->x.Allocate(); it->ptr->y.Allocate(); it->ptr->z.Allocate();
+  }
+
+  // Buffer for one block of a variable. No bigger than a local field
+  real *buffer = new real[ngx*ngy*ngz];
+
+  bool first = true;
+  int xe, ye;
+  for(jx=0;jx<ngx;jx=xe) {
+    // Range of X indices held by the same processor
+    for(xe=jx+1;(xe<ngx) && (xproc[xe] == xproc[jx]);xe++);
+
+    for(jy=0;jy<ngy;jy=ye) {
+      for(ye=jy+1;(ye<ngy) && (yproc[ye] == yproc[jy]);ye++);
+
+      char filename[512];
+      sprintf(filename, format, yproc[jy]*nxpe + xproc[jx]);
+
+      if(!file->openr(filename) || !file->is_valid()) {
+	output.write("\tERROR: Could not open %s\n", filename);
+	delete[] buffer;
+	return 1;
+      }
+      file->setRecord(-1); // Read the latest record
+
+      if(first) {
+	// Read scalars
+	for(std::vector< VarStr<int> >::iterator it = int_arr.begin(); it != int_arr.end(); it++) {
+	  bool ok = it->grow ? file->read_rec(it->ptr, it->name) : file->read(it->ptr, it->name);
+	  if(!ok) {
+	    output.write("\tWARNING: Could not read integer %s. Setting to zero\n", it->name.c_str());
+	    *(it->ptr) = 0;
+	  }
+	}
+	for(std::vector< VarStr<real> >::iterator it = real_arr.begin(); it != real_arr.end(); it++) {
+	  bool ok = it->grow ? file->read_rec(it->ptr, it->name) : file->read(it->ptr, it->name);
+	  if(!ok) {
+	    output.write("\tWARNING: Could not read real %s. Setting to zero\n", it->name.c_str());
+	    *(it->ptr) = 0;
+	  }
+	}
+	first = false;
+      }
+
+      int lx = xe - jx, ly = ye - jy;
+      int fx = xind[jx], fy = yind[jy];
+
+      for(std::vector< VarStr<Field2D> >::iterator it = f2d_arr.begin(); it != f2d_arr.end(); it++)
+	read_block(it->name, it->ptr, it->grow, jx, lx, jy, ly, fx, fy, buffer);
+
+      for(std::vector< VarStr<Field3D> >::iterator it = f3d_arr.begin(); it != f3d_arr.end(); it++)
+	read_block(it->name, it->ptr, it->grow, jx, lx, jy, ly, fx, fy, buffer);
+
+      for(std::vector< VarStr<Vector2D> >::iterator it = v2d_arr.begin(); it != v2d_arr.end(); it++) {
+	const char *sep = it->covar ? "_" : "";
+	read_block(it->name+sep+"x", &(it->ptr->x), it->grow, jx, lx, jy, ly, fx, fy, buffer);
+	read_block(it->name+sep+"y", &(it->ptr->y), it->grow, jx, lx, jy, ly, fx, fy, buffer);
+	read_block(it->name+sep+"z", &(it->ptr->z), it->grow, jx, lx, jy, ly, fx, fy, buffer);
+	it->ptr->covariant = it->covar;
+      }
+
+      for(std::vector< VarStr<Vector3D> >::iterator it = v3d_arr.begin(); it != v3d_arr.end(); it++) {
+	const char *sep = it->covar ? "_" : "";
+	read_block(it->name+sep+"x", &(it->ptr->x), it->grow, jx, lx, jy, ly, fx, fy, buffer);
+	read_block(it->name+sep+"y", &(it->ptr->y), it->grow, jx, lx, jy, ly, fx, fy, buffer);
+	read_block(it->name+sep+"z", &(it->ptr->z), it->grow, jx, lx, jy, ly, fx, fy, buffer);
+	it->ptr->covariant = it->covar;
+      }
+
+      file->close();
+    }
+  }
+
+  file->setOrigin(0, 0, 0);
+
+  delete[] buffer;
+
+  wtime += MPI_Wtime() - tstart;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return 0;
+}
+
 int Datafile::write(const char *format, ...)
 {
   va_list ap;  // List of arguments
@@ -390,42 +864,52 @@ bool Datafile::write(const string &filename, bool append)
   // Record starting time
   real tstart = MPI_Wtime();
 
-  if(!file->openw(filename, append))
-    return false;
-
-  if(!file->is_valid())
-    return false;
+  DataFrame *frame = get_frame(); // May wait for the background thread
   
-  file->setRecord(-1); // Latest record
+  frame->file = file;
+  frame->filename = filename;
+  frame->append = append;
+  frame->keep_open = persist && append;
+  frame->flush = false;
+  if(frame->keep_open) {
+    nappend++;
+    frame->flush = (flush_interval > 0) && (nappend % flush_interval == 0);
+  }
+  snapshot(*frame);
+  
+  bool ok = put_frame(frame);
+
+  wtime += MPI_Wtime() - tstart;
+
+  return ok;
+}
 
-  // Write integers
+void Datafile::snapshot(DataFrame &frame)
+{
+  frame.nrec = 0;
+  
+  // Integers
   for(std::vector< VarStr<int> >::iterator it = int_arr.begin(); it != int_arr.end(); it++) {
-    if(it->grow) {
-      file->write_rec(it->ptr, it->name);
-    }else {
-      file->write(it->ptr, it->name);
-    }
+    DataRecord &r = frame.add(it->name, it->grow, true);
+    r.idata.assign(1, *(it->ptr));
   }
   
-  // Write reals
+  // Reals
   for(std::vector< VarStr<real> >::iterator it = real_arr.begin(); it != real_arr.end(); it++) {
-    if(it->grow) {
-      file->write_rec(it->ptr, it->name);
-    }else {
-      file->write(it->ptr, it->name);
-    }
+    DataRecord &r = frame.add(it->name, it->grow, false);
+    r.rdata.assign(1, *(it->ptr));
   }
 
-  // Write 2D fields
+  // 2D fields
   
   for(std::vector< VarStr<Field2D> >::iterator it = f2d_arr.begin(); it != f2d_arr.end(); it++) {
-    write_f2d(it->name, it->ptr, it->grow);
+    write_f2d(frame, it->name, it->ptr, it->grow, get_region(*it, false));
   }
 
-  // Write 3D fields
+  // 3D fields
   
   for(std::vector< VarStr<Field3D> >::iterator it = f3d_arr.begin(); it != f3d_arr.end(); it++) {
-    write_f3d(it->name, it->ptr, it->grow);
+    write_f3d(frame, it->name, it->ptr, it->grow, get_region(*it, true));
   }
   
   // 2D vectors
@@ -436,17 +920,17 @@ bool Datafile::write(const string &filename, bool append)
       Vector2D v  = *(it->ptr);
       v.to_covariant();
       
-      write_f2d(it->name+string("_x"), &(v.x), it->grow);
-      write_f2d(it->name+string("_y"), &(v.y), it->grow);
-      write_f2d(it->name+string("_z"), &(v.z), it->grow);
+      write_f2d(frame, it->name+string("_x"), &(v.x), it->grow);
+      write_f2d(frame, it->name+string("_y"), &(v.y), it->grow);
+      write_f2d(frame, it->name+string("_z"), &(v.z), it->grow);
     }else {
       // Writing contravariant vector
       Vector2D v  = *(it->ptr);
       v.to_contravariant();
       
-      write_f2d(it->name+string("x"), &(v.x), it->grow);
-      write_f2d(it->name+string("y"), &(v.y), it->grow);
-      write_f2d(it->name+string("z"), &(v.z), it->grow);
+      write_f2d(frame, it->name+string("x"), &(v.x), it->grow);
+      write_f2d(frame, it->name+string("y"), &(v.y), it->grow);
+      write_f2d(frame, it->name+string("z"), &(v.z), it->grow);
     }
   }
 
@@ -458,25 +942,19 @@ bool Datafile::write(const string &filename, bool append)
       Vector3D v  = *(it->ptr);
       v.to_covariant();
       
-      write_f3d(it->name+string("_x"), &(v.x), it->grow);
-      write_f3d(it->name+string("_y"), &(v.y), it->grow);
-      write_f3d(it->name+string("_z"), &(v.z), it->grow);
+      write_f3d(frame, it->name+string("_x"), &(v.x), it->grow);
+      write_f3d(frame, it->name+string("_y"), &(v.y), it->grow);
+      write_f3d(frame, it->name+string("_z"), &(v.z), it->grow);
     }else {
       // Writing contravariant vector
       Vector3D v  = *(it->ptr);
       v.to_contravariant();
       
-      write_f3d(it->name+string("x"), &(v.x), it->grow);
-      write_f3d(it->name+string("y"), &(v.y), it->grow);
-      write_f3d(it->name+string("z"), &(v.z), it->grow);
+      write_f3d(frame, it->name+string("x"), &(v.x), it->grow);
+      write_f3d(frame, it->name+string("y"), &(v.y), it->grow);
+      write_f3d(frame, it->name+string("z"), &(v.z), it->grow);
     }
   }
-
-  file->close();
-
-  wtime += MPI_Wtime() - tstart;
-
-  return true;
 }
 
 /////////////////////////////////////////////////////////////
@@ -521,29 +999,261 @@ bool Datafile::read_f3d(const string &name, Field3D *f, bool grow)
   return true;
 }
 
-bool Datafile::write_f2d(const string &name, Field2D *f, bool grow)
+bool Datafile::read_block(const string &name, Field2D *f, bool grow,
+                          int x0, int lx, int y0, int ly, int fx0, int fy0, real *buffer)
+{
+  file->setOrigin(fx0, fy0, 0);
+
+  bool ok = grow ? file->read_rec(buffer, name, lx, ly) : file->read(buffer, name, lx, ly);
+  if(!ok) {
+    output.write("\tWARNING: Could not read 2D field %s. Setting to zero\n", name.c_str());
+    for(int i=0;i<lx*ly;i++)
+      buffer[i] = 0.0;
+  }
+
+  real **d = f->getData();
+  for(int i=0;i<lx;i++)
+    for(int j=0;j<ly;j++)
+      d[x0+i][y0+j] = buffer[i*ly + j];
+
+  return ok;
+}
+
+bool Datafile::read_block(const string &name, Field3D *f, bool grow,
+                          int x0, int lx, int y0, int ly, int fx0, int fy0, real *buffer)
+{
+  file->setOrigin(fx0, fy0, 0);
+
+  bool ok = grow ? file->read_rec(buffer, name, lx, ly, ngz) : file->read(buffer, name, lx, ly, ngz);
+  if(!ok) {
+    output.write("\tWARNING: Could not read 3D field %s. Setting to zero\n", name.c_str());
+    for(int i=0;i<lx*ly*ngz;i++)
+      buffer[i] = 0.0;
+  }
+
+  real ***d = f->getData();
+  for(int i=0;i<lx;i++)
+    for(int j=0;j<ly;j++)
+      for(int k=0;k<ngz;k++)
+	d[x0+i][y0+j][k] = buffer[(i*ly + j)*ngz + k];
+
+  return ok;
+}
+
+bool Datafile::write_f2d(DataFrame &frame, const string &name, Field2D *f, bool grow, OutputRegion *r)
 {
   if(!f->isAllocated())
     return false; // No data allocated
   
-  if(grow) {
-    return file->write_rec(*(f->getData()), name, ngx, ngy);
-  }else {
-    return file->write(*(f->getData()), name, ngx, ngy);
+  if(r == NULL) {
+    // Whole array
+    real *d = *(f->getData());
+    DataRecord &rec = frame.add(name, grow, false, ngx, ngy);
+    rec.rdata.assign(d, d + ngx*ngy);
+    return true;
   }
+
+  DataRecord &info = frame.add(name+string("_region"), false, true, 10);
+  info.idata.assign(r->info, r->info+10);
+  
+  if((r->nx == 0) || (r->ny == 0))
+    return true; // No part of the region on this processor
+  
+  real **d = f->getData();
+  DataRecord &rec = frame.add(name, grow, false, r->nx, r->ny);
+  rec.rdata.resize(r->nx*r->ny);
+  int n = 0;
+  for(int i=0;i<r->nx;i++)
+    for(int j=0;j<r->ny;j++)
+      rec.rdata[n++] = d[r->xs + i*r->dx][r->ys + j*r->dy];
+  return true;
 }
 
-bool Datafile::write_f3d(const string &name, Field3D *f, bool grow)
+bool Datafile::write_f3d(DataFrame &frame, const string &name, Field3D *f, bool grow, OutputRegion *r)
 {
   if(!f->isAllocated()) {
     //output << "Datafile: unallocated: " << name << endl;
     return false; // No data allocated
   }
   
-  if(grow) {
-    return file->write_rec(**(f->getData()), name, ngx, ngy, ngz);
-  }else {
-    return file->write(**(f->getData()), name, ngx, ngy, ngz);
+  if(r == NULL) {
+    // Whole array
+    real *d = **(f->getData());
+    DataRecord &rec = frame.add(name, grow, false, ngx, ngy, ngz);
+    rec.rdata.assign(d, d + ngx*ngy*ngz);
+    return true;
+  }
+  
+  DataRecord &info = frame.add(name+string("_region"), false, true, 10);
+  info.idata.assign(r->info, r->info+10);
+  
+  if((r->nx == 0) || (r->ny == 0) || (r->nz == 0))
+    return true; // No part of the region on this processor
+
+  real ***d = f->getData();
+  DataRecord &rec = frame.add(name, grow, false, r->nx, r->ny, r->nz);
+  rec.rdata.resize(r->nx*r->ny*r->nz);
+  int n = 0;
+  
+  if(r->nkz > 0) {
+    // Fourier modes in Z, as (real, imaginary) pairs
+    static dcomplex *cv = (dcomplex*) NULL;
+    if(cv == (dcomplex*) NULL)
+      cv = new dcomplex[ncz/2 + 1];
+    
+    for(int i=0;i<r->nx;i++)
+      for(int j=0;j<r->ny;j++) {
+	rfft(d[r->xs + i*r->dx][r->ys + j*r->dy], ncz, cv);
+	for(int k=0;k<r->nkz;k++) {
+	  rec.rdata[n++] = cv[k].Real();
+	  rec.rdata[n++] = cv[k].Imag();
+	}
+      }
+    return true;
   }
+  
+  for(int i=0;i<r->nx;i++)
+    for(int j=0;j<r->ny;j++) {
+      real *line = d[r->xs + i*r->dx][r->ys + j*r->dy];
+      for(int k=0;k<r->nz;k++)
+	rec.rdata[n++] = line[r->zs + k*r->dz];
+    }
+  return true;
 }
 
+/////////////////////////////////////////////////////////////
+// Output options
+
+/// Get an output option from [output_<var>], or [output] if not set
+static void output_option(const string &name, const char *key, int &val, int def)
+{
+  string section = string("output_") + name;
+  if(options.getInt(section.c_str(), key, val))
+    if(options.getInt("output", key, val))
+      val = def;
+}
+
+static void output_option(const string &name, const char *key, bool &val, bool def)
+{
+  string section = string("output_") + name;
+  if(options.getBool(section.c_str(), key, val))
+    if(options.getBool("output", key, val))
+      val = def;
+}
+
+/// Select every d'th point of the global range [gmin, gmax] within local range [lo, hi]
+/*!
+ * offset is the global index of local index 0. Sets the local index of the
+ * first point, and the number of points
+ */
+static void select_range(int gmin, int gmax, int d, int lo, int hi, int offset, int &start, int &n)
+{
+  int g0 = lo + offset;
+  if(g0 < gmin)
+    g0 = gmin;
+  g0 = gmin + ((g0 - gmin + d - 1)/d)*d; // Round up to a selected point
+  
+  int g1 = hi + offset;
+  if(g1 > gmax)
+    g1 = gmax;
+  
+  if(g1 < g0) {
+    start = lo;
+    n = 0;
+    return;
+  }
+  start = g0 - offset;
+  n = (g1 - g0)/d + 1;
+}
+
+/// Set the region to be written for a variable from the options
+/*!
+ * Options are read from [output_<name>], then [output]:
+ *
+ *   guards     false -> don't write guard cells, or the last Z point
+ *   xmin, xmax Range of global X indices (including X boundary cells).
+ *              Default 0 to nxg-1, or MXG to nxg-MXG-1 if guards is false
+ *   ymin, ymax Range of global Y indices (not including guard cells)
+ *   zmin, zmax Range of Z indices
+ *   xstride, ystride, zstride  Write every n'th point
+ *   nkz        Write the first nkz Fourier modes in Z instead of the values
+ *
+ * Unless all are left at their defaults, each processor only writes the points
+ * it owns, so the parts don't overlap. The whole domain is from (0,0), and
+ * the region written by this processor is given in <name>_region:
+ * {X start, nx, X stride, Y start, ny, Y stride, Z start, nz, Z stride, nkz}
+ * with start indices global. If nkz > 0 then nz = 2*nkz (real, imaginary pairs)
+ */
+void Datafile::set_region(const string &name, bool field3d, OutputRegion &r)
+{
+  bool guards;
+  int xmin, xmax, ymin, ymax, zmin, zmax;
+  
+  output_option(name, "guards", guards, true);
+  output_option(name, "xmin", xmin, -1);
+  output_option(name, "xmax", xmax, -1);
+  output_option(name, "ymin", ymin, -1);
+  output_option(name, "ymax", ymax, -1);
+  output_option(name, "zmin", zmin, -1);
+  output_option(name, "zmax", zmax, -1);
+  output_option(name, "xstride", r.dx, 1);
+  output_option(name, "ystride", r.dy, 1);
+  output_option(name, "zstride", r.dz, 1);
+  output_option(name, "nkz", r.nkz, 0);
+  
+  if(r.dx < 1) r.dx = 1;
+  if(r.dy < 1) r.dy = 1;
+  if(r.dz < 1) r.dz = 1;
+  if(!field3d) {
+    // No Z options for 2D variables
+    zmin = zmax = -1;
+    r.dz = 1;
+    r.nkz = 0;
+  }
+  if(r.nkz > ncz/2 + 1)
+    r.nkz = ncz/2 + 1;
+  
+  r.all = guards && (xmin < 0) && (xmax < 0) && (ymin < 0) && (ymax < 0) && (zmin < 0) && (zmax < 0) &&
+    (r.dx == 1) && (r.dy == 1) && (r.dz == 1) && (r.nkz <= 0);
+  if(r.all)
+    return;
+  
+  // Global ranges
+  int nxg = NXPE*MXSUB + 2*MXG, nyg = NYPE*MYSUB;
+  if((xmin < 0) || (xmin >= nxg)) xmin = guards ? 0 : MXG;
+  if((xmax < 0) || (xmax >= nxg)) xmax = guards ? nxg-1 : nxg-MXG-1;
+  if((ymin < 0) || (ymin >= nyg)) ymin = 0;
+  if((ymax < 0) || (ymax >= nyg)) ymax = nyg-1;
+  if((zmin < 0) || (zmin >= ngz)) zmin = 0;
+  if((zmax < 0) || (zmax >= ngz)) zmax = ncz-1; // Don't include the repeated point
+  
+  // Points owned by this processor: X boundary cells only at the edges
+  int xlo = (PE_XIND == 0) ? 0 : MXG;
+  int xhi = (PE_XIND == NXPE-1) ? ngx-1 : MXG+MXSUB-1;
+  
+  select_range(xmin, xmax, r.dx, xlo, xhi, PE_XIND*MXSUB, r.xs, r.nx);
+  select_range(ymin, ymax, r.dy, MYG, MYG+MYSUB-1, PE_YIND*MYSUB - MYG, r.ys, r.ny);
+  
+  if(!field3d) {
+    r.zs = 0;
+    r.nz = 0;
+  }else if(r.nkz > 0) {
+    r.zs = 0;
+    r.nz = 2*r.nkz;
+    r.dz = 1;
+  }else
+    select_range(zmin, zmax, r.dz, 0, ngz-1, 0, r.zs, r.nz);
+  
+  r.info[0] = r.xs + PE_XIND*MXSUB; r.info[1] = r.nx; r.info[2] = r.dx;
+  r.info[3] = r.ys + PE_YIND*MYSUB - MYG; r.info[4] = r.ny; r.info[5] = r.dy;
+  r.info[6] = r.zs; r.info[7] = r.nz; r.info[8] = r.dz;
+  r.info[9] = r.nkz;
+
+  output.write("\tOutput %s: X %d-%d (every %d), Y %d-%d (every %d)", name.c_str(), xmin, xmax, r.dx, ymin, ymax, r.dy);
+  if(r.nkz > 0) {
+    output.write(", %d Z modes\n", r.nkz);
+  }else if(field3d) {
+    output.write(", Z %d-%d (every %d)\n", zmin, zmax, r.dz);
+  }else
+    output.write("\n");
+}
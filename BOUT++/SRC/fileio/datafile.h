@@ -36,11 +36,17 @@ extern char DEFAULT_FILE_EXT[]; ///< Default file extension
 /// Omit argument (or pass NULL) for default format
 DataFormat *data_format(const char *filename = NULL);
 
+struct DataFrame; ///< Copy of the variables being written to a file
+
 /*!
   Uses a generic interface to file formats (DataFormat)
   and provides an interface for reading/writing simulation data.
   
   Data formats are currently implemented for PDB and netCDF.
+
+  Variables are copied when write() or append() is called. If setAsync()
+  has been called then the copies are written to file by a background
+  thread, so the variables can be changed straight away.
 */
 class Datafile {
  public:
@@ -52,6 +58,15 @@ class Datafile {
   void setFormat(DataFormat *format);
 
   void setLowPrecision(); ///< Only output floats
+  void setPacking(int bits); ///< Output arrays as 8 or 16 bit scaled integers, if supported
+
+  /// Keep the file open between appends, flushing every flush_every outputs
+  void setPersistent(int flush_every = 1);
+  /// Flush and close the file if it has been kept open
+  void close();
+
+  /// Apply the [output] options to fields (e.g. for dump files, not restarts)
+  void setOutputOptions(bool on = true);
 
   void add(int &i, const char *name, int grow = 0);
   void add(real &r, const char *name, int grow = 0);
@@ -63,6 +78,8 @@ class Datafile {
   /// Read a given file into the added variables
   int read(const char *filename, ...);
   int read(const string &filename) {return read(filename.c_str());}
+  /// Read files written with a different processor decomposition
+  int read_repart(const char *format, int npes, int nxpe, int mxsub, int mysub);
   /// Write the variables to the given file (over-writes existing file)
   int write(const char *filename, ...);
   /// Append data to an existing file (error if doesn't exist)
@@ -72,14 +89,37 @@ class Datafile {
 
   /// Set this to false to switch off all data writing
   static bool enabled;
+
+  /// Write files in a background thread, with up to nqueue outputs waiting
+  static bool setAsync(int nqueue = 2);
+  /// Wait until all outputs have been written. False if any failed
+  static bool flush();
+  /// Flush and stop the background thread
+  static void finish();
   
   static real wtime; ///< Keep track of wall-time used
  private:
   
   bool low_prec;
+  int pack_bits;
+
+  bool out_opts;      ///< Use [output] options when writing fields
+  bool persist;       ///< Keep file open between appends
+  int flush_interval; ///< Appends between flushes. 0 -> only when closed
+  int nappend;        ///< Number of appends since setPersistent
 
   DataFormat *file;
 
+  /// Part of a field to be written, set by the [output] options
+  struct OutputRegion {
+    bool all;         ///< Write the whole array, including guard cells
+    int xs, nx, dx;   ///< Local start index, number of points and stride
+    int ys, ny, dy;
+    int zs, nz, dz;
+    int nkz;          ///< If > 0, write the first nkz Fourier modes in Z
+    int info[10];     ///< Written to the file as <name>_region
+  };
+
   /// A structure to hold a pointer to a class, and associated name and flags
   template <class T>
     struct VarStr {
@@ -87,8 +127,24 @@ class Datafile {
       string name;
       bool grow;
       bool covar;
+      bool region_set;     ///< region has been read from the options
+      OutputRegion region;
+      VarStr() : region_set(false) {}
     };
 
+  /// Region of a field to write, or NULL for the whole array
+  template <class T>
+    OutputRegion *get_region(VarStr<T> &v, bool field3d) {
+      if(!out_opts)
+	return NULL;
+      if(!v.region_set) {
+	set_region(v.name, field3d, v.region);
+	v.region_set = true;
+      }
+      return v.region.all ? NULL : &(v.region);
+    }
+  void set_region(const string &name, bool field3d, OutputRegion &r);
+
   // one set per variable type
   vector< VarStr<int> >      int_arr;
   vector< VarStr<real> >     real_arr;
@@ -100,8 +156,17 @@ class Datafile {
   bool read_f2d(const string &name, Field2D *f, bool grow);
   bool read_f3d(const string &name, Field3D *f, bool grow);
 
-  bool write_f2d(const string &name, Field2D *f, bool grow);
-  bool write_f3d(const string &name, Field3D *f, bool grow);
+  /// Read part of a field into (x0,y0) from (fx0,fy0) in the open file
+  bool read_block(const string &name, Field2D *f, bool grow,
+                  int x0, int lx, int y0, int ly, int fx0, int fy0, real *buffer);
+  bool read_block(const string &name, Field3D *f, bool grow,
+                  int x0, int lx, int y0, int ly, int fx0, int fy0, real *buffer);
+
+  /// Copy all variables into a frame, ready to be written
+  void snapshot(DataFrame &frame);
+
+  bool write_f2d(DataFrame &frame, const string &name, Field2D *f, bool grow, OutputRegion *r = NULL);
+  bool write_f3d(DataFrame &frame, const string &name, Field3D *f, bool grow, OutputRegion *r = NULL);
 };
 
 #endif // __DATAFILE_H__
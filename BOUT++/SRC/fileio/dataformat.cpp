@@ -0,0 +1,45 @@
+/**************************************************************************
+ * Functions shared by the file formats
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact Ben Dudson, bd512@york.ac.uk
+ * 
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "dataformat.h"
+
+/// Convert n reals to floats for writing, without changing data
+/*!
+ * An out of range value can make the conversion corrupt the
+ * whole dataset, so values are clamped to +/- 1e20
+ */
+float* DataFormat::to_float(const real *data, int n, vector<float> &buffer)
+{
+  buffer.resize(n);
+  for(int i=0;i<n;i++) {
+    real val = data[i];
+    if(val > 1e20)
+      val = 1e20;
+    if(val < -1e20)
+      val = -1e20;
+    buffer[i] = (float) val;
+  }
+  return &buffer[0];
+}
@@ -84,6 +84,12 @@ class DataFormat {
   // Optional functions
   
   virtual void setLowPrecision() { }  // By default doesn't do anything
+  virtual void setPacking(int bits) { } // Store arrays as scaled integers
+  virtual void flush() { }            // Write any buffered data to disk
+
+ protected:
+  /// Convert reals to floats in buffer, clamped to the range of a float
+  static float* to_float(const real *data, int n, vector<float> &buffer);
 };
 
 #endif // __DATAFORMAT_H__
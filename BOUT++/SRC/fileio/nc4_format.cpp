@@ -0,0 +1,642 @@
+/**************************************************************************
+ * Compressed netCDF-4 format, one file per processor
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "globals.h"
+#include "nc4_format.h"
+
+#include "utils.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+// Define this to see loads of info messages
+//#define NC4DF_VERBOSE
+
+/// Round val to within the error tolerances
+/*!
+ * Rounds to a multiple of the largest power of two q with q/2 <= tol,
+ * where tol is the smaller of abstol and reltol*|val|. Multiplying and
+ * dividing by q is exact, so the error is at most q/2, and the bits of
+ * the mantissa below q are all zero.
+ */
+static real round_tol(real val, real abstol, real reltol)
+{
+  real tol = abstol;
+  if(reltol > 0.) {
+    real rtol = reltol*fabs(val);
+    if((tol <= 0.) || (rtol < tol))
+      tol = rtol;
+  }
+  if(!(tol > 0.)) // Zero, or NaN
+    return val;
+
+  int e;
+  frexp(tol, &e); // tol = m * 2^e, 0.5 <= m < 1
+  real q = ldexp(1.0, e);
+
+  real x = val / q;
+  if(!(fabs(x) < 1e15)) // Already more accurate than tol, or infinite
+    return val;
+
+  return q*floor(x + 0.5);
+}
+
+Nc4Format::Nc4Format()
+{
+  ncid = -1;
+  x0 = y0 = z0 = t0 = 0;
+  lowPrecision = false;
+
+  deflate = 1;
+  abstol = reltol = 0.;
+
+  default_rec = 0;
+  rec_nr.clear();
+
+  fname = NULL;
+}
+
+Nc4Format::~Nc4Format()
+{
+  close();
+}
+
+bool Nc4Format::openr(const string &name)
+{
+  return openr(name.c_str());
+}
+
+bool Nc4Format::openr(const char *name)
+{
+#ifdef CHECK
+  msg_stack.push("Nc4Format::openr");
+#endif
+
+  if(is_valid()) // Already open. Close then re-open
+    close();
+
+  if(nc_open(name, NC_NOWRITE, &ncid) != NC_NOERR) {
+    ncid = -1;
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+
+  // Dimensions are optional when reading
+  if(nc_inq_dimid(ncid, "x", &xDim) != NC_NOERR)
+    xDim = -1;
+  if(nc_inq_dimid(ncid, "y", &yDim) != NC_NOERR)
+    yDim = -1;
+  if(nc_inq_dimid(ncid, "z", &zDim) != NC_NOERR)
+    zDim = -1;
+  if(nc_inq_dimid(ncid, "t", &tDim) != NC_NOERR)
+    tDim = -1;
+
+  fname = copy_string(name);
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return true;
+}
+
+bool Nc4Format::openw(const string &name, bool append)
+{
+  return openw(name.c_str(), append);
+}
+
+bool Nc4Format::openw(const char *name, bool append)
+{
+#ifdef CHECK
+  msg_stack.push("Nc4Format::openw");
+#endif
+
+  if(is_valid()) // Already open. Close then re-open
+    close();
+
+  if(append) {
+    if(nc_open(name, NC_WRITE, &ncid) != NC_NOERR) {
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+
+    /// Get the dimensions from the file, and check they're the right size
+    size_t len[3];
+    if((nc_inq_dimid(ncid, "x", &xDim) != NC_NOERR) ||
+       (nc_inq_dimid(ncid, "y", &yDim) != NC_NOERR) ||
+       (nc_inq_dimid(ncid, "z", &zDim) != NC_NOERR) ||
+       (nc_inq_dimid(ncid, "t", &tDim) != NC_NOERR) ||
+       (nc_inq_dimlen(ncid, xDim, len) != NC_NOERR) ||
+       (nc_inq_dimlen(ncid, yDim, len+1) != NC_NOERR) ||
+       (nc_inq_dimlen(ncid, zDim, len+2) != NC_NOERR) ||
+       (len[0] != (size_t) ngx) || (len[1] != (size_t) ngy) || (len[2] != (size_t) ngz)) {
+      output.write("ERROR: NetCDF file '%s' has the wrong dimensions\n", name);
+      nc_close(ncid);
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+
+    // Get the size of the 't' dimension for records
+    size_t nt;
+    nc_inq_dimlen(ncid, tDim, &nt);
+    default_rec = nt;
+  }else {
+    // Classic model, so older tools can still read the files
+    if(nc_create(name, NC_NETCDF4 | NC_CLASSIC_MODEL | NC_CLOBBER, &ncid) != NC_NOERR) {
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+
+    /// Add the dimensions
+    if((nc_def_dim(ncid, "x", ngx, &xDim) != NC_NOERR) ||
+       (nc_def_dim(ncid, "y", ngy, &yDim) != NC_NOERR) ||
+       (nc_def_dim(ncid, "z", ngz, &zDim) != NC_NOERR) ||
+       (nc_def_dim(ncid, "t", NC_UNLIMITED, &tDim) != NC_NOERR)) {
+      nc_close(ncid);
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+    nc_enddef(ncid);
+
+    default_rec = 0; // Starting at record 0
+  }
+  rec_nr.clear();
+
+  fname = copy_string(name);
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return true;
+}
+
+void Nc4Format::close()
+{
+  if(!is_valid())
+    return;
+
+#ifdef CHECK
+  msg_stack.push("Nc4Format::close");
+#endif
+
+  nc_close(ncid);
+  ncid = -1;
+
+  free(fname);
+  fname = NULL;
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+}
+
+void Nc4Format::flush()
+{
+  if(!is_valid())
+    return;
+
+  nc_sync(ncid);
+}
+
+void Nc4Format::setCompression(int level, real abs, real rel)
+{
+  if(level < 0)
+    level = 0;
+  if(level > 9)
+    level = 9;
+  deflate = level;
+
+  abstol = abs;
+  reltol = rel;
+}
+
+const vector<int> Nc4Format::getSize(const char *name)
+{
+  vector<int> size;
+
+  if(!is_valid())
+    return size;
+
+  int varid, nd;
+  if((nc_inq_varid(ncid, name, &varid) != NC_NOERR) ||
+     (nc_inq_varndims(ncid, varid, &nd) != NC_NOERR))
+    return size;
+
+  if(nd == 0) {
+    size.push_back(1);
+    return size;
+  }
+
+  int dimids[NC_MAX_VAR_DIMS];
+  nc_inq_vardimid(ncid, varid, dimids);
+  for(int i=0;i<nd;i++) {
+    size_t len;
+    nc_inq_dimlen(ncid, dimids[i], &len);
+    size.push_back((int) len);
+  }
+
+  return size;
+}
+
+const vector<int> Nc4Format::getSize(const string &var)
+{
+  return getSize(var.c_str());
+}
+
+bool Nc4Format::setOrigin(int x, int y, int z)
+{
+  x0 = x;
+  y0 = y;
+  z0 = z;
+
+  return true;
+}
+
+bool Nc4Format::setRecord(int t)
+{
+  t0 = t;
+
+  return true;
+}
+
+bool Nc4Format::read(int *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, false);
+}
+
+bool Nc4Format::read(int *var, const string &name, int lx, int ly, int lz)
+{
+  return read(var, name.c_str(), lx, ly, lz);
+}
+
+bool Nc4Format::read(real *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, false);
+}
+
+bool Nc4Format::read(real *var, const string &name, int lx, int ly, int lz)
+{
+  return read(var, name.c_str(), lx, ly, lz);
+}
+
+bool Nc4Format::write(int *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, false);
+}
+
+bool Nc4Format::write(int *var, const string &name, int lx, int ly, int lz)
+{
+  return write(var, name.c_str(), lx, ly, lz);
+}
+
+bool Nc4Format::write(real *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, false);
+}
+
+bool Nc4Format::write(real *var, const string &name, int lx, int ly, int lz)
+{
+  return write(var, name.c_str(), lx, ly, lz);
+}
+
+/***************************************************************************
+ * Record-based (time-dependent) data
+ ***************************************************************************/
+
+bool Nc4Format::read_rec(int *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, true);
+}
+
+bool Nc4Format::read_rec(int *var, const string &name, int lx, int ly, int lz)
+{
+  return read_rec(var, name.c_str(), lx, ly, lz);
+}
+
+bool Nc4Format::read_rec(real *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, true);
+}
+
+bool Nc4Format::read_rec(real *var, const string &name, int lx, int ly, int lz)
+{
+  return read_rec(var, name.c_str(), lx, ly, lz);
+}
+
+bool Nc4Format::write_rec(int *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, true);
+}
+
+bool Nc4Format::write_rec(int *var, const string &name, int lx, int ly, int lz)
+{
+  return write_rec(var, name.c_str(), lx, ly, lz);
+}
+
+bool Nc4Format::write_rec(real *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, true);
+}
+
+bool Nc4Format::write_rec(real *var, const string &name, int lx, int ly, int lz)
+{
+  return write_rec(var, name.c_str(), lx, ly, lz);
+}
+
+/***************************************************************************
+ * Private functions
+ ***************************************************************************/
+
+/// Dimensions for a variable of size (lx, ly, lz), with a leading t if rec is true
+/*!
+ * Same as NcFormat: arrays which aren't the size of a field have their own
+ * dimensions, named by size e.g. "x10". Must be in define mode.
+ * Returns the number of dimensions
+ */
+int Nc4Format::get_dims(int lx, int ly, int lz, bool rec, int *dimids)
+{
+  int size[3] = {lx, ly, lz};
+  int fdim[3] = {xDim, yDim, zDim};
+  const char *label = "xyz";
+
+  int nd = 0;
+  if(rec)
+    dimids[nd++] = tDim;
+
+  int n = 0; // Number of spatial dimensions
+  if(lx != 0) n = 1;
+  if(ly != 0) n = 2;
+  if(lz != 0) n = 3;
+
+  for(int i=0;i<n;i++) {
+    int d = fdim[i];
+    size_t len = 0;
+    if((d >= 0) && (nc_inq_dimlen(ncid, d, &len) == NC_NOERR) && (len == (size_t) size[i])) {
+      dimids[nd++] = d;
+      continue;
+    }
+    char dname[32];
+    sprintf(dname, "%c%d", label[i], size[i]);
+    if(nc_inq_dimid(ncid, dname, &d) != NC_NOERR)
+      nc_def_dim(ncid, dname, size[i], &d);
+    dimids[nd++] = d;
+  }
+
+  return nd;
+}
+
+/// Find a variable, adding it to the file if needed. Returns -1 on failure
+int Nc4Format::get_var(const char *name, nc_type type, int lx, int ly, int lz, bool rec)
+{
+  int varid;
+  if(nc_inq_varid(ncid, name, &varid) == NC_NOERR)
+    return varid;
+
+  // Variable not in file, so add it
+  nc_redef(ncid);
+
+  int dimids[4];
+  int nd = get_dims(lx, ly, lz, rec, dimids);
+
+  if(nc_def_var(ncid, name, type, nd, dimids, &varid) != NC_NOERR) {
+    output.write("ERROR: NetCDF could not add '%s' to file '%s'\n", name, fname);
+    nc_enddef(ncid);
+    return -1;
+  }
+
+  if(nd > 0) {
+    size_t chunks[4];
+    int d = 0;
+    if(rec) {
+      // Time series of scalars are chunked in blocks of records,
+      // arrays are one chunk per record
+      chunks[d++] = (nd == 1) ? 256 : 1;
+    }
+    int size[3] = {lx, ly, lz};
+    for(int i=0;d<nd;i++)
+      chunks[d++] = size[i];
+
+    nc_def_var_chunking(ncid, varid, NC_CHUNKED, chunks);
+
+    if(deflate > 0)
+      nc_def_var_deflate(ncid, varid, 1, 1, deflate); // Shuffle, then deflate
+  }
+
+  nc_enddef(ncid);
+
+  if(rec)
+    rec_nr[name] = default_rec; // Starting record
+
+  return varid;
+}
+
+/// Next record to write for a variable
+int Nc4Format::get_rec(const char *name)
+{
+  if(rec_nr.find(name) == rec_nr.end())
+    rec_nr[name] = default_rec;
+  return rec_nr[name]++;
+}
+
+bool Nc4Format::read_data(int *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+  if((lx < 0) || (ly < 0) || (lz < 0))
+    return false;
+
+  int varid;
+  if(nc_inq_varid(ncid, name, &varid) != NC_NOERR) {
+#ifdef NC4DF_VERBOSE
+    output.write("INFO: NetCDF variable '%s' not found\n", name);
+#endif
+    return false;
+  }
+
+  size_t start[4], count[4];
+  int d = 0;
+  if(rec) {
+    int t = t0;
+    if(t < 0) {
+      // Latest record
+      size_t nt = 0;
+      if(tDim >= 0)
+	nc_inq_dimlen(ncid, tDim, &nt);
+      t = (nt > 0) ? nt-1 : 0;
+    }
+    start[d] = t; count[d] = 1; d++;
+  }
+  start[d] = x0; count[d] = lx;
+  start[d+1] = y0; count[d+1] = ly;
+  start[d+2] = z0; count[d+2] = lz;
+
+  return nc_get_vara_int(ncid, varid, start, count, data) == NC_NOERR;
+}
+
+bool Nc4Format::read_data(real *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+  if((lx < 0) || (ly < 0) || (lz < 0))
+    return false;
+
+  int varid;
+  if(nc_inq_varid(ncid, name, &varid) != NC_NOERR) {
+#ifdef NC4DF_VERBOSE
+    output.write("INFO: NetCDF variable '%s' not found\n", name);
+#endif
+    return false;
+  }
+
+  size_t start[4], count[4];
+  int d = 0;
+  if(rec) {
+    int t = t0;
+    if(t < 0) {
+      size_t nt = 0;
+      if(tDim >= 0)
+	nc_inq_dimlen(ncid, tDim, &nt);
+      t = (nt > 0) ? nt-1 : 0;
+    }
+    start[d] = t; count[d] = 1; d++;
+  }
+  start[d] = x0; count[d] = lx;
+  start[d+1] = y0; count[d+1] = ly;
+  start[d+2] = z0; count[d+2] = lz;
+
+  return nc_get_vara_double(ncid, varid, start, count, data) == NC_NOERR;
+}
+
+bool Nc4Format::write_data(int *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+  if((lx < 0) || (ly < 0) || (lz < 0))
+    return false;
+
+#ifdef CHECK
+  msg_stack.push("Nc4Format::write(int)");
+#endif
+
+  int varid = get_var(name, NC_INT, lx, ly, lz, rec);
+  if(varid < 0) {
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+
+  size_t start[4], count[4];
+  int d = 0;
+  if(rec) {
+    start[d] = get_rec(name); count[d] = 1; d++;
+  }
+  start[d] = rec ? 0 : x0;   count[d] = lx;
+  start[d+1] = rec ? 0 : y0; count[d+1] = ly;
+  start[d+2] = rec ? 0 : z0; count[d+2] = lz;
+
+  bool ok = nc_put_vara_int(ncid, varid, start, count, data) == NC_NOERR;
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return ok;
+}
+
+bool Nc4Format::write_data(real *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+  if((lx < 0) || (ly < 0) || (lz < 0))
+    return false;
+
+#ifdef CHECK
+  msg_stack.push("Nc4Format::write(real)");
+#endif
+
+  int varid = get_var(name, lowPrecision ? NC_FLOAT : NC_DOUBLE, lx, ly, lz, rec);
+  if(varid < 0) {
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+
+  size_t start[4], count[4];
+  int d = 0;
+  if(rec) {
+    start[d] = get_rec(name); count[d] = 1; d++;
+  }
+  start[d] = rec ? 0 : x0;   count[d] = lx;
+  start[d+1] = rec ? 0 : y0; count[d+1] = ly;
+  start[d+2] = rec ? 0 : z0; count[d+2] = lz;
+
+  // Number of values. Scalars have lx = 0 or 1
+  int n = 1;
+  if(lx > 1)  n *= lx;
+  if(ly != 0) n *= ly;
+  if(lz != 0) n *= lz;
+
+  real *buffer = data;
+  if(((lx > 1) || (ly != 0)) && ((abstol > 0.) || (reltol > 0.))) {
+    // Round arrays to within the tolerances. Scalars are left alone
+    dbuffer.resize(n);
+    for(int i=0;i<n;i++)
+      dbuffer[i] = round_tol(data[i], abstol, reltol);
+    buffer = &dbuffer[0];
+  }
+
+  bool ok;
+  if(lowPrecision) {
+    ok = nc_put_vara_float(ncid, varid, start, count, to_float(buffer, n, fbuffer)) == NC_NOERR;
+  }else
+    ok = nc_put_vara_double(ncid, varid, start, count, buffer) == NC_NOERR;
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return ok;
+}
@@ -0,0 +1,140 @@
+/*!
+ * \file nc4_format.h
+ *
+ * \brief Compressed netCDF-4 data format, one file per processor
+ *
+ * Uses the netCDF-4 C interface (HDF5 underneath). Arrays are stored in
+ * chunks, one per record, compressed with the shuffle and deflate filters.
+ *
+ * Optionally, before compression real values are rounded to the coarsest
+ * power of two allowed by an absolute and/or relative error tolerance. This
+ * zeroes the low bits of the mantissa, so the data compresses much better.
+ * The error in each value is at most abstol, and at most reltol times its
+ * magnitude. Scalars and integers are always written exactly.
+ *
+ * Files use the classic data model, so can be read by anything which reads
+ * netCDF files (as long as the netCDF library was built with netCDF-4).
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+class Nc4Format;
+
+#ifndef __NC4FORMAT_H__
+#define __NC4FORMAT_H__
+
+#include "dataformat.h"
+
+#include <netcdf.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::map;
+using std::vector;
+
+class Nc4Format : public DataFormat {
+ public:
+  Nc4Format();
+  ~Nc4Format();
+
+  bool openr(const string &name);
+  bool openr(const char *name);
+  bool openw(const string &name, bool append=false);
+  bool openw(const char *name, bool append=false);
+
+  bool is_valid() { return ncid >= 0; }
+
+  void close();
+
+  const char* filename() { return fname; };
+
+  const vector<int> getSize(const char *var);
+  const vector<int> getSize(const string &var);
+
+  // Set the origin for all subsequent calls
+  bool setOrigin(int x = 0, int y = 0, int z = 0);
+  bool setRecord(int t); // negative -> latest
+
+  // Read / Write simple variables up to 3D
+
+  bool read(int *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read(int *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+  bool read(real *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read(real *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+
+  bool write(int *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write(int *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+  bool write(real *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write(real *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+
+  // Read / Write record-based variables
+
+  bool read_rec(int *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read_rec(int *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+  bool read_rec(real *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read_rec(real *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+
+  bool write_rec(int *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write_rec(int *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+  bool write_rec(real *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write_rec(real *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+
+  void setLowPrecision() { lowPrecision = true; }
+  void flush();
+
+  /// Set the deflate level (0-9) and error tolerances (<= 0 for none)
+  void setCompression(int level, real abs = 0., real rel = 0.);
+
+ private:
+
+  char *fname; ///< Current file name
+
+  int ncid;    ///< netCDF file ID, or -1 if not open
+  int xDim, yDim, zDim, tDim; ///< Dimension IDs
+
+  bool lowPrecision; ///< When writing, down-convert to floats
+
+  int deflate;         ///< Deflate level. 0 = no compression
+  real abstol, reltol; ///< Error tolerances for the lossy step. 0 = lossless
+
+  int x0, y0, z0, t0; ///< Data origins
+
+  map<string, int> rec_nr; // Record number for each variable
+  int default_rec;  // Starting record. Useful when appending to existing file
+
+  int get_dims(int lx, int ly, int lz, bool rec, int *dimids);
+  int get_var(const char *name, nc_type type, int lx, int ly, int lz, bool rec);
+  int get_rec(const char *name);
+
+  bool read_data(int *data, const char *name, int lx, int ly, int lz, bool rec);
+  bool read_data(real *data, const char *name, int lx, int ly, int lz, bool rec);
+  bool write_data(int *data, const char *name, int lx, int ly, int lz, bool rec);
+  bool write_data(real *data, const char *name, int lx, int ly, int lz, bool rec);
+
+  vector<double> dbuffer; ///< Buffers for the rounded and converted data
+  vector<float> fbuffer;
+};
+
+#endif // __NC4FORMAT_H__
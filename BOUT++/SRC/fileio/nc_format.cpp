@@ -25,9 +25,64 @@
 
 #include "utils.h"
 
+#include <math.h>
+#include <limits>
+
 // Define this to see loads of info messages
 //#define NCDF_VERBOSE
 
+/// Number of values in an array of size (lx, ly, lz). Scalars have lx = 0 or 1
+static int nvalues(int lx, int ly, int lz)
+{
+  int n = (lx > 1) ? lx : 1;
+  if(ly != 0)
+    n *= ly;
+  if(lz != 0)
+    n *= lz;
+  return n;
+}
+
+/// Pack n values into integers q in [-qmax, qmax], with value = offset + q*scale
+/*!
+ * The error is at most scale/2. NaNs are stored as -qmax-1, which is the
+ * netCDF fill value, and infinities as the largest or smallest value
+ */
+template <class T>
+static void pack_values(const real *data, int n, int qmax, T *q, real &scale, real &offset)
+{
+  real dmin = 1e300, dmax = -1e300;
+  for(int i=0;i<n;i++) {
+    real v = data[i];
+    if(!(fabs(v) <= 1e300)) // NaN or infinite
+      continue;
+    if(v < dmin)
+      dmin = v;
+    if(v > dmax)
+      dmax = v;
+  }
+  if(dmin > dmax)
+    dmin = dmax = 0.; // No finite values
+
+  offset = 0.5*(dmin + dmax);
+  scale = (dmax - dmin) / (2.*qmax);
+  if(!(scale > 0.))
+    scale = 1.; // All the same value
+
+  for(int i=0;i<n;i++) {
+    real v = data[i];
+    if(v != v) {
+      q[i] = (T) (-qmax-1);
+      continue;
+    }
+    real x = floor((v - offset)/scale + 0.5);
+    if(x > qmax)
+      x = qmax;
+    if(x < -qmax)
+      x = -qmax;
+    q[i] = (T) x;
+  }
+}
+
 NcFormat::NcFormat()
 {
   dataFile = NULL;
@@ -35,6 +90,7 @@ NcFormat::NcFormat()
   recDimList = new const NcDim*[4];
   dimList = recDimList+1;
   lowPrecision = false;
+  packBits = 0;
 
   default_rec = 0;
   rec_nr.clear();
@@ -49,6 +105,7 @@ NcFormat::NcFormat(const char *name)
   recDimList = new const NcDim*[4];
   dimList = recDimList+1;
   lowPrecision = false;
+  packBits = 0;
 
   default_rec = 0;
   rec_nr.clear();
@@ -63,6 +120,7 @@ NcFormat::NcFormat(const string &name)
   recDimList = new const NcDim*[4];
   dimList = recDimList+1;
   lowPrecision = false;
+  packBits = 0;
 
   default_rec = 0;
   rec_nr.clear();
@@ -315,6 +373,57 @@ void NcFormat::close()
 #endif
 }
 
+/// Dimensions for a variable of size (lx, ly, lz), with a leading t if rec is true
+/*!
+ * Arrays which aren't the size of a field (e.g. output of part of a field)
+ * have their own dimensions, named by size e.g. "x10", which are added if needed
+ */
+const NcDim** NcFormat::get_dims(int lx, int ly, int lz, bool rec)
+{
+  int size[3] = {lx, ly, lz};
+  NcDim *fdim[3] = {xDim, yDim, zDim};
+  const char *label = "xyz";
+  
+  varDimList[0] = tDim;
+  for(int i=0;i<3;i++) {
+    NcDim *d = fdim[i];
+    if((size[i] > 0) && ((d == NULL) || (d->size() != size[i]))) {
+      char dname[32];
+      sprintf(dname, "%c%d", label[i], size[i]);
+      if(!(d = dataFile->get_dim(dname)))
+	d = dataFile->add_dim(dname, size[i]);
+    }
+    varDimList[i+1] = d;
+  }
+
+  if(rec)
+    return varDimList;
+  return varDimList+1;
+}
+
+void NcFormat::flush()
+{
+  if(!is_valid())
+    return;
+
+#ifdef NCDF_VERBOSE
+  NcError err(NcError::verbose_nonfatal);
+#else
+  NcError err(NcError::silent_nonfatal);
+#endif
+
+  dataFile->sync();
+}
+
+void NcFormat::setPacking(int bits)
+{
+  if((bits != 0) && (bits != 8) && (bits != 16)) {
+    output.write("WARNING: NetCDF arrays can be packed into 8 or 16 bits, not %d. Using 16\n", bits);
+    bits = 16;
+  }
+  packBits = bits;
+}
+
 const vector<int> NcFormat::getSize(const char *name)
 {
   vector<int> size;
@@ -494,6 +603,8 @@ bool NcFormat::read(real *data, const char *name, int lx, int ly, int lz)
 #endif
     return false;
   }
+
+  unpack(var, data, nvalues(lx, ly, lz), name, -1);
   
 #ifdef CHECK
   msg_stack.pop();
@@ -534,7 +645,7 @@ bool NcFormat::write(int *data, const char *name, int lx, int ly, int lz)
   if(!(var = dataFile->get_var(name))) {
     // Variable not in file, so add it.
     
-    var = dataFile->add_var(name, ncInt, nd, dimList);
+    var = dataFile->add_var(name, ncInt, nd, get_dims(lx, ly, lz, false));
     if(!var->is_valid()) {
       output.write("ERROR: NetCDF could not add int '%s' to file '%s'\n", name, fname);
       return false;
@@ -589,10 +700,7 @@ bool NcFormat::write(real *data, const char *name, int lx, int ly, int lz)
   NcVar *var;
   if(!(var = dataFile->get_var(name))) {
     // Variable not in file, so add it.
-    if(lowPrecision) {
-      var = dataFile->add_var(name, ncFloat, nd, dimList);
-    }else
-      var = dataFile->add_var(name, ncDouble, nd, dimList);
+    var = dataFile->add_var(name, real_type((lx > 1) || (ly != 0)), nd, get_dims(lx, ly, lz, false));
 
     if(!var->is_valid()) {
       output.write("ERROR: NetCDF could not add real '%s' to file '%s'\n", name, fname);
@@ -607,22 +715,12 @@ bool NcFormat::write(real *data, const char *name, int lx, int ly, int lz)
   if(!(var->set_cur(cur)))
     return false;
 
-  if(lowPrecision) {
-    // An out of range value can make the conversion
-    // corrupt the whole dataset. Make sure everything
-    // is in the range of a float
-    
-    for(int i=0;i<lx*ly*lz;i++) {
-      if(data[i] > 1e20)
-	data[i] = 1e20;
-      if(data[i] < -1e20)
-	data[i] = -1e20;
-    }
-  }
-
-  if(!(var->put(data, counts)))
+  if(!put_real(var, data, nvalues(lx, ly, lz), counts, -1))
     return false;
 
+  if((var->type() == ncShort) || (var->type() == ncByte))
+    write_scale(name, false);
+
 #ifdef CHECK
   msg_stack.pop();
 #endif
@@ -659,10 +757,12 @@ bool NcFormat::read_rec(int *data, const char *name, int lx, int ly, int lz)
   if(!(var = dataFile->get_var(name)))
     return false;
   
-  // NOTE: Probably should do something here to check t0
+  long t = t0;
+  if(t < 0) // Latest record
+    t = (tDim != NULL) ? tDim->size()-1 : 0;
 
   long cur[4], counts[4];
-  cur[0] = t0; cur[1] = x0;    cur[2] = y0;    cur[3] = z0;
+  cur[0] = t; cur[1] = x0;    cur[2] = y0;    cur[3] = z0;
   counts[0] = 1; counts[1] = lx; counts[2] = ly; counts[3] = lz;
   
   if(!(var->set_cur(cur)))
@@ -699,10 +799,12 @@ bool NcFormat::read_rec(real *data, const char *name, int lx, int ly, int lz)
   if(!(var = dataFile->get_var(name)))
     return false;
   
-  // NOTE: Probably should do something here to check t0
+  long t = t0;
+  if(t < 0) // Latest record
+    t = (tDim != NULL) ? tDim->size()-1 : 0;
 
   long cur[4], counts[4];
-  cur[0] = t0; cur[1] = x0;    cur[2] = y0;    cur[3] = z0;
+  cur[0] = t; cur[1] = x0;    cur[2] = y0;    cur[3] = z0;
   counts[0] = 1; counts[1] = lx; counts[2] = ly; counts[3] = lz;
   
   if(!(var->set_cur(cur)))
@@ -710,6 +812,8 @@ bool NcFormat::read_rec(real *data, const char *name, int lx, int ly, int lz)
   
   if(!(var->get(data, counts)))
     return false;
+
+  unpack(var, data, nvalues(lx, ly, lz), name, t);
   
   return true;
 }
@@ -744,7 +848,7 @@ bool NcFormat::write_rec(int *data, const char *name, int lx, int ly, int lz)
   if(!(var = dataFile->get_var(name))) {
     // Need to add to file
 
-    var = dataFile->add_var(name, ncInt, nd, recDimList);
+    var = dataFile->add_var(name, ncInt, nd, get_dims(lx, ly, lz, true));
 
     rec_nr[name] = default_rec; // Starting record
 
@@ -764,8 +868,6 @@ bool NcFormat::write_rec(int *data, const char *name, int lx, int ly, int lz)
 
   if(!var->put_rec(data, rec_nr[name]))
     return false;
-
-  var->sync();
   
   // Increment record number
   rec_nr[name] = rec_nr[name] + 1;
@@ -807,11 +909,7 @@ bool NcFormat::write_rec(real *data, const char *name, int lx, int ly, int lz)
   if(!(var = dataFile->get_var(name))) {
     // Need to add to file
     
-    NcType vartype = ncDouble;
-    if(lowPrecision)
-      vartype = ncFloat;
-  
-    var = dataFile->add_var(name, vartype, nd, recDimList);
+    var = dataFile->add_var(name, real_type((lx > 1) || (ly != 0)), nd, get_dims(lx, ly, lz, true));
     
     rec_nr[name] = default_rec; // Starting record
 
@@ -838,28 +936,16 @@ bool NcFormat::write_rec(real *data, const char *name, int lx, int ly, int lz)
   output.write("INFO: NetCDF writing record %d of '%s' in '%s'\n",t, name, fname); 
 #endif
 
-  if(lowPrecision) {
-    // An out of range value can make the conversion
-    // corrupt the whole dataset. Make sure everything
-    // is in the range of a float
-    
-    for(int i=0;i<lx*ly*lz;i++) {
-      if(data[i] > 1e20)
-	data[i] = 1e20;
-      if(data[i] < -1e20)
-	data[i] = -1e20;
-    }
-  }
-
   // Add the record
-  if(!var->put_rec(data, t))
+  if(!put_real(var, data, nvalues(lx, ly, lz), NULL, t))
     return false;
-
-  var->sync();
   
   // Increment record number
   rec_nr[name] = rec_nr[name] + 1;
 
+  if((var->type() == ncShort) || (var->type() == ncByte))
+    write_scale(name, true);
+
 #ifdef CHECK
   msg_stack.pop();
 #endif
@@ -876,4 +962,107 @@ bool NcFormat::write_rec(real *var, const string &name, int lx, int ly, int lz)
  * Private functions
  ***************************************************************************/
 
+/// Type used to store reals. Only arrays are packed
+NcType NcFormat::real_type(bool array)
+{
+  if(array && (packBits > 0))
+    return (packBits == 8) ? ncByte : ncShort;
+  if(lowPrecision)
+    return ncFloat;
+  return ncDouble;
+}
 
+/// Convert n values to the type of var, and write them
+/*!
+ * Writes a record if t >= 0, otherwise counts values at the current position.
+ * The data is converted into buffers, so isn't modified. The type is
+ * taken from the variable, so appending to an existing file still works
+ * if the precision options have changed.
+ */
+bool NcFormat::put_real(NcVar *var, const real *data, int n, long *counts, long t)
+{
+  switch(var->type()) {
+  case ncFloat: {
+    float *f = to_float(data, n, fbuffer);
+    if(t >= 0)
+      return var->put_rec(f, t);
+    return var->put(f, counts);
+  }
+  case ncShort: {
+    sbuffer.resize(n);
+    pack_values(data, n, 32766, &sbuffer[0], scale, offset);
+    if(t >= 0)
+      return var->put_rec(&sbuffer[0], t);
+    return var->put(&sbuffer[0], counts);
+  }
+  case ncByte: {
+    bbuffer.resize(n);
+    pack_values(data, n, 126, &bbuffer[0], scale, offset);
+    if(t >= 0)
+      return var->put_rec(&bbuffer[0], t);
+    return var->put(&bbuffer[0], counts);
+  }
+  default:
+    break;
+  }
+  if(t >= 0)
+    return var->put_rec(data, t);
+  return var->put(data, counts);
+}
+
+/// Write the packing of the last array to <name>_scale and <name>_offset
+/*!
+ * Always written as doubles: if the offset is large compared to the range
+ * of the data, rounding it to a float would be a larger error than packing
+ */
+bool NcFormat::write_scale(const char *name, bool rec)
+{
+  string sname = string(name) + "_scale";
+  string oname = string(name) + "_offset";
+  real s = scale, o = offset;
+
+  bool lp = lowPrecision;
+  lowPrecision = false;
+
+  bool ok;
+  if(rec) {
+    ok = write_rec(&s, sname) && write_rec(&o, oname);
+  }else
+    ok = write(&s, sname) && write(&o, oname);
+
+  lowPrecision = lp;
+
+  return ok;
+}
+
+/// If var is packed into integers, convert the n values in data back to reals
+/*!
+ * t is the record read, or -1 if var isn't a record variable
+ */
+void NcFormat::unpack(NcVar *var, real *data, int n, const char *name, long t)
+{
+  if((var->type() != ncShort) && (var->type() != ncByte))
+    return;
+
+  string sname = string(name) + "_scale";
+  string oname = string(name) + "_offset";
+  NcVar *svar, *ovar;
+  if(!(svar = dataFile->get_var(sname.c_str())) || !(ovar = dataFile->get_var(oname.c_str())))
+    return;
+
+  real s, o;
+  if(t >= 0) {
+    svar->set_cur(t);
+    ovar->set_cur(t);
+    if(!svar->get(&s, 1) || !ovar->get(&o, 1))
+      return;
+  }else if(!svar->get(&s) || !ovar->get(&o))
+    return;
+
+  // Fill value (-qmax-1) marks a NaN
+  real fill = (var->type() == ncShort) ? -32767. : -127.;
+  real nan = std::numeric_limits<real>::quiet_NaN();
+
+  for(int i=0;i<n;i++)
+    data[i] = (data[i] == fill) ? nan : o + data[i]*s;
+}
@@ -11,6 +11,11 @@
  * of all variables is increased. To work out which record to write to,
  * a map of variable names to record number is kept. 
  * 
+ * Packing: With setPacking(bits), arrays of reals are stored as 8 or 16 bit
+ * integers q, with value = <name>_offset + q * <name>_scale. The scale and
+ * offset are scalars, or records if the array is. NaNs are stored as the
+ * netCDF fill value.
+ * 
  **************************************************************************
  * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
  *
@@ -44,9 +49,11 @@ class NcFormat;
 
 #include <map>
 #include <string>
+#include <vector>
 
 using std::string;
 using std::map;
+using std::vector;
 
 class NcFormat : public DataFormat {
  public:
@@ -98,6 +105,8 @@ class NcFormat : public DataFormat {
   bool write_rec(real *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
   
   void setLowPrecision() { lowPrecision = true; }
+  void setPacking(int bits);
+  void flush();
 
  private:
 
@@ -110,14 +119,29 @@ class NcFormat : public DataFormat {
   NcDim *xDim, *yDim, *zDim, *tDim;
   const NcDim **dimList; ///< List of dimensions (x,y,z)
   const NcDim **recDimList; ///< List of dimensions (t,x,y,z)
+  const NcDim *varDimList[4]; ///< Dimensions for a variable, from get_dims
+
+  const NcDim** get_dims(int lx, int ly, int lz, bool rec);
 
   bool appending;
   bool lowPrecision; ///< When writing, down-convert to floats
+  int packBits;      ///< Store arrays as 8 or 16 bit scaled integers. 0 = off
 
   int x0, y0, z0, t0; ///< Data origins
 
   map<string, int> rec_nr; // Record number for each variable (bit nasty)
   int default_rec;  // Starting record. Useful when appending to existing file
+
+  NcType real_type(bool array);
+  bool put_real(NcVar *var, const real *data, int n, long *counts, long t);
+  bool write_scale(const char *name, bool rec);
+  void unpack(NcVar *var, real *data, int n, const char *name, long t);
+
+  /// Buffers for converted data, so the caller's data isn't changed
+  vector<float> fbuffer;
+  vector<short> sbuffer;
+  vector<ncbyte> bbuffer;
+  real scale, offset; ///< Packing of the last array written
 };
 
 #endif // __NCFORMAT_H__
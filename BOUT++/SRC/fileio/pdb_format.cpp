@@ -112,6 +112,14 @@ void PdbFormat::close()
   fp = NULL;
 }
 
+void PdbFormat::flush()
+{
+  if(fp == NULL)
+    return;
+
+  PD_flush(fp);
+}
+
 const char* PdbFormat::filename()
 {
   return fname;
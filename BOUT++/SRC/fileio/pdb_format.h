@@ -86,6 +86,7 @@ class PdbFormat : public DataFormat {
   bool write_rec(real *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
   
   void setLowPrecision() { lowPrecision = true; }
+  void flush();
 
  private:
   PDBfile *fp;
@@ -0,0 +1,618 @@
+/**************************************************************************
+ * Parallel netCDF-4 format. All processors write to a single file
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "globals.h"
+#include "pnc_format.h"
+
+#include "utils.h"
+
+#include <netcdf_par.h>
+
+#include <stdlib.h>
+
+// Define this to see loads of info messages
+//#define PNCDF_VERBOSE
+
+PncFormat::PncFormat()
+{
+  ncid = -1;
+  x0 = y0 = z0 = t0 = 0;
+  lowPrecision = false;
+
+  default_rec = 0;
+  rec_nr.clear();
+
+  fname = NULL;
+}
+
+PncFormat::~PncFormat()
+{
+  close();
+}
+
+bool PncFormat::openr(const string &name)
+{
+  return openr(name.c_str());
+}
+
+bool PncFormat::openr(const char *name)
+{
+#ifdef CHECK
+  msg_stack.push("PncFormat::openr");
+#endif
+
+  if(is_valid()) // Already open. Close then re-open
+    close();
+
+  if(nc_open_par(name, NC_NOWRITE | NC_MPIIO, MPI_COMM_WORLD, MPI_INFO_NULL, &ncid) != NC_NOERR) {
+    ncid = -1;
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+
+  // Dimensions are optional when reading
+  if(nc_inq_dimid(ncid, "x", &xDim) != NC_NOERR)
+    xDim = -1;
+  if(nc_inq_dimid(ncid, "y", &yDim) != NC_NOERR)
+    yDim = -1;
+  if(nc_inq_dimid(ncid, "z", &zDim) != NC_NOERR)
+    zDim = -1;
+  if(nc_inq_dimid(ncid, "t", &tDim) != NC_NOERR)
+    tDim = -1;
+
+  fname = copy_string(name);
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return true;
+}
+
+bool PncFormat::openw(const string &name, bool append)
+{
+  return openw(name.c_str(), append);
+}
+
+bool PncFormat::openw(const char *name, bool append)
+{
+#ifdef CHECK
+  msg_stack.push("PncFormat::openw");
+#endif
+
+  if(is_valid()) // Already open. Close then re-open
+    close();
+
+  // Global sizes. X includes boundary cells, Y doesn't include guard cells
+  size_t nx = NXPE*MXSUB + 2*MXG;
+  size_t ny = NYPE*MYSUB;
+
+  if(append) {
+    if(nc_open_par(name, NC_WRITE | NC_MPIIO, MPI_COMM_WORLD, MPI_INFO_NULL, &ncid) != NC_NOERR) {
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+
+    /// Get the dimensions from the file, and check they're the right size
+    size_t len[3];
+    if((nc_inq_dimid(ncid, "x", &xDim) != NC_NOERR) ||
+       (nc_inq_dimid(ncid, "y", &yDim) != NC_NOERR) ||
+       (nc_inq_dimid(ncid, "z", &zDim) != NC_NOERR) ||
+       (nc_inq_dimid(ncid, "t", &tDim) != NC_NOERR) ||
+       (nc_inq_dimlen(ncid, xDim, len) != NC_NOERR) ||
+       (nc_inq_dimlen(ncid, yDim, len+1) != NC_NOERR) ||
+       (nc_inq_dimlen(ncid, zDim, len+2) != NC_NOERR) ||
+       (len[0] != nx) || (len[1] != ny) || (len[2] != (size_t) ngz)) {
+      output.write("ERROR: NetCDF file '%s' has the wrong dimensions\n", name);
+      nc_close(ncid);
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+
+    // Get the size of the 't' dimension for records
+    size_t nt;
+    nc_inq_dimlen(ncid, tDim, &nt);
+    default_rec = nt;
+  }else {
+    if(nc_create_par(name, NC_NETCDF4 | NC_MPIIO | NC_CLOBBER,
+		     MPI_COMM_WORLD, MPI_INFO_NULL, &ncid) != NC_NOERR) {
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+
+    /// Add the dimensions
+    if((nc_def_dim(ncid, "x", nx, &xDim) != NC_NOERR) ||
+       (nc_def_dim(ncid, "y", ny, &yDim) != NC_NOERR) ||
+       (nc_def_dim(ncid, "z", ngz, &zDim) != NC_NOERR) ||
+       (nc_def_dim(ncid, "t", NC_UNLIMITED, &tDim) != NC_NOERR)) {
+      nc_close(ncid);
+      ncid = -1;
+#ifdef CHECK
+      msg_stack.pop();
+#endif
+      return false;
+    }
+    nc_enddef(ncid);
+
+    default_rec = 0; // Starting at record 0
+  }
+  rec_nr.clear();
+
+  fname = copy_string(name);
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return true;
+}
+
+void PncFormat::close()
+{
+  if(!is_valid())
+    return;
+
+#ifdef CHECK
+  msg_stack.push("PncFormat::close");
+#endif
+
+  nc_close(ncid);
+  ncid = -1;
+
+  free(fname);
+  fname = NULL;
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+}
+
+void PncFormat::flush()
+{
+  if(!is_valid())
+    return;
+
+  nc_sync(ncid);
+}
+
+const vector<int> PncFormat::getSize(const char *name)
+{
+  vector<int> size;
+
+  if(!is_valid())
+    return size;
+
+  int varid, nd;
+  if((nc_inq_varid(ncid, name, &varid) != NC_NOERR) ||
+     (nc_inq_varndims(ncid, varid, &nd) != NC_NOERR))
+    return size;
+
+  if(nd == 0) {
+    size.push_back(1);
+    return size;
+  }
+
+  int dimids[NC_MAX_VAR_DIMS];
+  nc_inq_vardimid(ncid, varid, dimids);
+  for(int i=0;i<nd;i++) {
+    size_t len;
+    nc_inq_dimlen(ncid, dimids[i], &len);
+    size.push_back((int) len);
+  }
+
+  return size;
+}
+
+const vector<int> PncFormat::getSize(const string &var)
+{
+  return getSize(var.c_str());
+}
+
+bool PncFormat::setOrigin(int x, int y, int z)
+{
+  x0 = x;
+  y0 = y;
+  z0 = z;
+
+  return true;
+}
+
+bool PncFormat::setRecord(int t)
+{
+  t0 = t;
+
+  return true;
+}
+
+bool PncFormat::read(int *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, false);
+}
+
+bool PncFormat::read(int *var, const string &name, int lx, int ly, int lz)
+{
+  return read(var, name.c_str(), lx, ly, lz);
+}
+
+bool PncFormat::read(real *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, false);
+}
+
+bool PncFormat::read(real *var, const string &name, int lx, int ly, int lz)
+{
+  return read(var, name.c_str(), lx, ly, lz);
+}
+
+bool PncFormat::write(int *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, false);
+}
+
+bool PncFormat::write(int *var, const string &name, int lx, int ly, int lz)
+{
+  return write(var, name.c_str(), lx, ly, lz);
+}
+
+bool PncFormat::write(real *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, false);
+}
+
+bool PncFormat::write(real *var, const string &name, int lx, int ly, int lz)
+{
+  return write(var, name.c_str(), lx, ly, lz);
+}
+
+/***************************************************************************
+ * Record-based (time-dependent) data
+ ***************************************************************************/
+
+bool PncFormat::read_rec(int *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, true);
+}
+
+bool PncFormat::read_rec(int *var, const string &name, int lx, int ly, int lz)
+{
+  return read_rec(var, name.c_str(), lx, ly, lz);
+}
+
+bool PncFormat::read_rec(real *data, const char *name, int lx, int ly, int lz)
+{
+  return read_data(data, name, lx, ly, lz, true);
+}
+
+bool PncFormat::read_rec(real *var, const string &name, int lx, int ly, int lz)
+{
+  return read_rec(var, name.c_str(), lx, ly, lz);
+}
+
+bool PncFormat::write_rec(int *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, true);
+}
+
+bool PncFormat::write_rec(int *var, const string &name, int lx, int ly, int lz)
+{
+  return write_rec(var, name.c_str(), lx, ly, lz);
+}
+
+bool PncFormat::write_rec(real *data, const char *name, int lx, int ly, int lz)
+{
+  return write_data(data, name, lx, ly, lz, true);
+}
+
+bool PncFormat::write_rec(real *var, const string &name, int lx, int ly, int lz)
+{
+  return write_rec(var, name.c_str(), lx, ly, lz);
+}
+
+/***************************************************************************
+ * Private functions
+ ***************************************************************************/
+
+/// Work out which part of the local array goes where in the file
+/*!
+ * Arrays the size of a field are split between processors: each writes
+ * its interior points, plus the X boundary cells at the edges of the domain.
+ * Scalars are the same on all processors, so only processor 0 writes them.
+ * Returns false for any other size of array.
+ */
+bool PncFormat::region(int lx, int ly, int lz, bool rec, int t, Region &r)
+{
+  int d = 0;
+  if(rec) {
+    r.start[0] = t;
+    r.count[0] = 1;
+    d = 1;
+  }
+
+  if((ly == 0) && (lz == 0) && (lx <= 1)) {
+    // Scalar
+    r.field = false;
+    if(rec && (MYPE != 0))
+      r.count[0] = 0;
+    return true;
+  }
+
+  if((lx != ngx) || (ly != ngy) || ((lz != 0) && (lz != ngz)))
+    return false;
+
+  r.field = true;
+  r.xs = (PE_XIND == 0) ? 0 : MXG;
+  r.nx = ((PE_XIND == NXPE-1) ? ngx : ngx-MXG) - r.xs;
+  r.ys = MYG;
+  r.ny = MYSUB;
+  r.nz = (lz == 0) ? 1 : lz;
+  r.ly = ly;
+  r.lz = r.nz;
+
+  r.start[d] = PE_XIND*MXSUB + r.xs;   r.count[d] = r.nx;
+  r.start[d+1] = PE_YIND*MYSUB;        r.count[d+1] = r.ny;
+  r.start[d+2] = 0;                    r.count[d+2] = r.nz;
+
+  return true;
+}
+
+/// Find a variable, adding it to the file if needed. Returns -1 on failure
+int PncFormat::get_var(const char *name, nc_type type, int lx, int ly, int lz, bool rec)
+{
+  int varid;
+  if(nc_inq_varid(ncid, name, &varid) != NC_NOERR) {
+    // Variable not in file, so add it. This is collective
+    int nd = 0, dimids[4];
+    size_t chunks[4];
+    if(rec) {
+      dimids[nd] = tDim; chunks[nd] = 1; nd++;
+    }
+    if(lx > 1) {
+      // One chunk per processor sub-domain. Chunks start at x = 0, so in X
+      // they're offset from the processor boundaries (at PE_XIND*MXSUB + MXG)
+      // and each is shared by two processors. Collective writes merge these,
+      // whereas smaller chunks would make the file's index very large
+      int cx = NXPE*MXSUB + 2*MXG; // One processor in X: whole range
+      if(NXPE > 1)
+	cx = MXSUB;
+      dimids[nd] = xDim; chunks[nd] = cx; nd++;
+      dimids[nd] = yDim; chunks[nd] = MYSUB; nd++;
+      if(lz != 0) {
+	dimids[nd] = zDim; chunks[nd] = ngz; nd++;
+      }
+    }
+
+    nc_redef(ncid);
+    if(nc_def_var(ncid, name, type, nd, dimids, &varid) != NC_NOERR) {
+      output.write("ERROR: NetCDF could not add '%s' to file '%s'\n", name, fname);
+      nc_enddef(ncid);
+      return -1;
+    }
+    if(lx > 1)
+      nc_def_var_chunking(ncid, varid, NC_CHUNKED, chunks);
+    nc_enddef(ncid);
+
+    if(rec)
+      rec_nr[name] = default_rec; // Starting record
+  }
+
+  // All processors take part in every write
+  nc_var_par_access(ncid, varid, NC_COLLECTIVE);
+
+  return varid;
+}
+
+/// Record to read or write for a variable
+int PncFormat::get_rec(const char *name, bool write)
+{
+  if(write) {
+    if(rec_nr.find(name) == rec_nr.end())
+      rec_nr[name] = default_rec;
+    return rec_nr[name]++;
+  }
+
+  if(t0 >= 0)
+    return t0;
+
+  // Latest record
+  size_t nt = 0;
+  if(tDim >= 0)
+    nc_inq_dimlen(ncid, tDim, &nt);
+  return (nt > 0) ? nt-1 : 0;
+}
+
+bool PncFormat::read_data(int *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+  Region r;
+  if(!region(lx, ly, lz, rec, rec ? get_rec(name, false) : 0, r))
+    return false;
+
+  int varid;
+  if(nc_inq_varid(ncid, name, &varid) != NC_NOERR)
+    return false;
+
+  if(!r.field) {
+    // All processors read scalars
+    if(rec)
+      r.count[0] = 1;
+    return nc_get_vara_int(ncid, varid, r.start, r.count, data) == NC_NOERR;
+  }
+
+  ibuffer.resize(r.nx*r.ny*r.nz);
+  if(nc_get_vara_int(ncid, varid, r.start, r.count, &ibuffer[0]) != NC_NOERR)
+    return false;
+
+  for(int i=0;i<r.nx;i++)
+    for(int j=0;j<r.ny;j++)
+      for(int k=0;k<r.nz;k++)
+	data[((r.xs+i)*r.ly + r.ys+j)*r.lz + k] = ibuffer[(i*r.ny + j)*r.nz + k];
+
+  return true;
+}
+
+bool PncFormat::read_data(real *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+  Region r;
+  if(!region(lx, ly, lz, rec, rec ? get_rec(name, false) : 0, r))
+    return false;
+
+  int varid;
+  if(nc_inq_varid(ncid, name, &varid) != NC_NOERR)
+    return false;
+
+  if(!r.field) {
+    if(rec)
+      r.count[0] = 1;
+    return nc_get_vara_double(ncid, varid, r.start, r.count, data) == NC_NOERR;
+  }
+
+  dbuffer.resize(r.nx*r.ny*r.nz);
+  if(nc_get_vara_double(ncid, varid, r.start, r.count, &dbuffer[0]) != NC_NOERR)
+    return false;
+
+  for(int i=0;i<r.nx;i++)
+    for(int j=0;j<r.ny;j++)
+      for(int k=0;k<r.nz;k++)
+	data[((r.xs+i)*r.ly + r.ys+j)*r.lz + k] = dbuffer[(i*r.ny + j)*r.nz + k];
+
+  return true;
+}
+
+bool PncFormat::write_data(int *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+#ifdef CHECK
+  msg_stack.push("PncFormat::write(int)");
+#endif
+
+  Region r;
+  if(!region(lx, ly, lz, rec, 0, r)) {
+    output.write("ERROR: Can't write '%s' to a parallel file: size %dx%dx%d\n", name, lx, ly, lz);
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+
+  int varid = get_var(name, NC_INT, lx, ly, lz, rec);
+  if(varid < 0) {
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+  if(rec)
+    r.start[0] = get_rec(name, true);
+
+  int *buffer = data;
+  if(r.field) {
+    ibuffer.resize(r.nx*r.ny*r.nz);
+    for(int i=0;i<r.nx;i++)
+      for(int j=0;j<r.ny;j++)
+	for(int k=0;k<r.nz;k++)
+	  ibuffer[(i*r.ny + j)*r.nz + k] = data[((r.xs+i)*r.ly + r.ys+j)*r.lz + k];
+    buffer = &ibuffer[0];
+  }
+
+  bool ok = nc_put_vara_int(ncid, varid, r.start, r.count, buffer) == NC_NOERR;
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return ok;
+}
+
+bool PncFormat::write_data(real *data, const char *name, int lx, int ly, int lz, bool rec)
+{
+  if(!is_valid())
+    return false;
+
+#ifdef CHECK
+  msg_stack.push("PncFormat::write(real)");
+#endif
+
+  Region r;
+  if(!region(lx, ly, lz, rec, 0, r)) {
+    output.write("ERROR: Can't write '%s' to a parallel file: size %dx%dx%d\n", name, lx, ly, lz);
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+
+  int varid = get_var(name, lowPrecision ? NC_FLOAT : NC_DOUBLE, lx, ly, lz, rec);
+  if(varid < 0) {
+#ifdef CHECK
+    msg_stack.pop();
+#endif
+    return false;
+  }
+  if(rec)
+    r.start[0] = get_rec(name, true);
+
+  // Pack the local part of the array
+  int n = 1;
+  real *buffer = data;
+  if(r.field) {
+    n = r.nx*r.ny*r.nz;
+    dbuffer.resize(n);
+    for(int i=0;i<r.nx;i++)
+      for(int j=0;j<r.ny;j++)
+	for(int k=0;k<r.nz;k++)
+	  dbuffer[(i*r.ny + j)*r.nz + k] = data[((r.xs+i)*r.ly + r.ys+j)*r.lz + k];
+    buffer = &dbuffer[0];
+  }
+
+  bool ok;
+  if(lowPrecision) {
+    ok = nc_put_vara_float(ncid, varid, r.start, r.count, to_float(buffer, n, fbuffer)) == NC_NOERR;
+  }else
+    ok = nc_put_vara_double(ncid, varid, r.start, r.count, buffer) == NC_NOERR;
+
+#ifdef CHECK
+  msg_stack.pop();
+#endif
+
+  return ok;
+}
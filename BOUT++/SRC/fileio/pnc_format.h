@@ -0,0 +1,141 @@
+/*!
+ * \file pnc_format.h
+ *
+ * \brief Parallel netCDF-4 data format. All processors write to a single file
+ *
+ * Uses the netCDF-4 C interface with MPI-IO (HDF5 underneath). The file
+ * contains the global arrays: X includes the boundary cells, Y doesn't
+ * include guard cells. Each processor writes its part of each field
+ * collectively, so all processors must write the same variables in the
+ * same order (which Datafile does).
+ *
+ * Only scalars and fields of size (ngx, ngy) or (ngx, ngy, ngz) can be
+ * read or written.
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+class PncFormat;
+
+#ifndef __PNCFORMAT_H__
+#define __PNCFORMAT_H__
+
+#include "dataformat.h"
+
+#include <netcdf.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::map;
+using std::vector;
+
+class PncFormat : public DataFormat {
+ public:
+  PncFormat();
+  ~PncFormat();
+
+  bool openr(const string &name);
+  bool openr(const char *name);
+  bool openw(const string &name, bool append=false);
+  bool openw(const char *name, bool append=false);
+
+  bool is_valid() { return ncid >= 0; }
+
+  void close();
+
+  const char* filename() { return fname; };
+
+  const vector<int> getSize(const char *var);
+  const vector<int> getSize(const string &var);
+
+  // Set the origin for all subsequent calls
+  bool setOrigin(int x = 0, int y = 0, int z = 0);
+  bool setRecord(int t); // negative -> latest
+
+  // Read / Write simple variables up to 3D
+
+  bool read(int *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read(int *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+  bool read(real *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read(real *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+
+  bool write(int *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write(int *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+  bool write(real *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write(real *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+
+  // Read / Write record-based variables
+
+  bool read_rec(int *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read_rec(int *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+  bool read_rec(real *var, const char *name, int lx = 1, int ly = 0, int lz = 0);
+  bool read_rec(real *var, const string &name, int lx = 1, int ly = 0, int lz = 0);
+
+  bool write_rec(int *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write_rec(int *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+  bool write_rec(real *var, const char *name, int lx = 0, int ly = 0, int lz = 0);
+  bool write_rec(real *var, const string &name, int lx = 0, int ly = 0, int lz = 0);
+
+  void setLowPrecision() { lowPrecision = true; }
+  void flush();
+
+ private:
+
+  char *fname; ///< Current file name
+
+  int ncid;    ///< netCDF file ID, or -1 if not open
+  int xDim, yDim, zDim, tDim; ///< Dimension IDs
+
+  bool lowPrecision; ///< When writing, down-convert to floats
+
+  int x0, y0, z0, t0; ///< Data origins
+
+  map<string, int> rec_nr; // Record number for each variable
+  int default_rec;  // Starting record. Useful when appending to existing file
+
+  /// Part of the local arrays in this processor's part of the file
+  struct Region {
+    bool field;       ///< Size of a field, so mapped into the global array
+    size_t start[4], count[4];
+    int xs, ys;       ///< Start of the region in the local array
+    int nx, ny, nz;   ///< Size of the region
+    int ly, lz;       ///< Size of the local array
+  };
+  bool region(int lx, int ly, int lz, bool rec, int t, Region &r);
+
+  int get_var(const char *name, nc_type type, int lx, int ly, int lz, bool rec);
+  int get_rec(const char *name, bool write);
+
+  bool read_data(int *data, const char *name, int lx, int ly, int lz, bool rec);
+  bool read_data(real *data, const char *name, int lx, int ly, int lz, bool rec);
+  bool write_data(int *data, const char *name, int lx, int ly, int lz, bool rec);
+  bool write_data(real *data, const char *name, int lx, int ly, int lz, bool rec);
+
+  vector<double> dbuffer; ///< Buffers for packing the local part of the arrays
+  vector<float> fbuffer;
+  vector<int> ibuffer;
+};
+
+#endif // __PNCFORMAT_H__
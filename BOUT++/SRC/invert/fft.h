@@ -28,6 +28,12 @@
 
 #include "dcomplex.h"
 
+/// Reads the [fft] options. If dir is given and plans are measured, FFTW
+/// wisdom is read from (and saved by fft_finish to) dir/BOUT.fftw_wisdom
+void fft_init(const char *dir = NULL);
+/// Saves FFTW wisdom, if fft_init was given a directory
+void fft_finish();
+
 void cfft(dcomplex *cv, int length, int isign);
 void ZFFT(dcomplex *cv, real zoffset, int isign, bool shift = true);
 
@@ -39,4 +45,17 @@ void irfft(dcomplex *in, int length, real *out);
 void ZFFT(real *in, real zoffset, dcomplex *cv, bool shift = true);
 void ZFFT_rev(dcomplex *cv, real zoffset, real *out, bool shift = true);
 
+// Batched versions, transforming howmany lines in one call.
+// Real lines start stride apart, so all lines of a Field3D are
+// (f.begin(), ngx*ngy lines, stride ngz), and a y slice at jy is
+// (f.begin() + jy*ngz, ngx lines, stride ngy*ngz). Complex lines are
+// contiguous, length/2 + 1 each. The inverse transforms overwrite cv
+
+void rfft_many(const real *in, int length, int howmany, int stride, dcomplex *out);
+void irfft_many(dcomplex *in, int length, int howmany, real *out, int stride);
+
+/// zoffset[i*zstride] is the offset for line i
+void ZFFT_many(const real *in, int howmany, int stride, const real *zoffset, int zstride, dcomplex *cv, bool shift = true);
+void ZFFT_rev_many(dcomplex *cv, int howmany, const real *zoffset, int zstride, real *out, int stride, bool shift = true);
+
 #endif // __FFT_H__
@@ -30,65 +30,188 @@
 
 #include <fftw3.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+using std::vector;
 
 bool fft_options = false;
-bool fft_measure;
+unsigned int fft_flags; ///< FFTW planning flags
+char fft_wisdom_file[512] = ""; ///< Where FFTW wisdom is saved. Empty if not saved
 
-void fft_init()
+void fft_init(const char *dir)
 {
   if(fft_options)
     return;
 
+  bool fft_measure;
   options.setSection("fft");
   options.get("fft_measure", fft_measure, false);
+  fft_flags = fft_measure ? FFTW_MEASURE : FFTW_ESTIMATE;
+
+  // How much effort FFTW puts into planning. Overrides fft_measure
+  char *plan = options.getString("fft_plan");
+  if(plan != NULL) {
+    if(strcasecmp(plan, "estimate") == 0) {
+      fft_flags = FFTW_ESTIMATE;
+    }else if(strcasecmp(plan, "measure") == 0) {
+      fft_flags = FFTW_MEASURE;
+    }else if(strcasecmp(plan, "patient") == 0) {
+      fft_flags = FFTW_PATIENT;
+    }else if(strcasecmp(plan, "exhaustive") == 0) {
+      fft_flags = FFTW_EXHAUSTIVE;
+    }else
+      output.write("\tWARNING: Unknown fft_plan '%s'. Using %s\n", plan, 
+		   fft_measure ? "measure" : "estimate");
+  }
   fft_options = true;
+
+  if((fft_flags != FFTW_ESTIMATE) && (dir != NULL)) {
+    // Measuring plans takes a while, so keep the results between runs
+    bool use_wisdom;
+    options.get("fft_wisdom", use_wisdom, true);
+    if(use_wisdom) {
+      sprintf(fft_wisdom_file, "%s/BOUT.fftw_wisdom", dir);
+      
+      FILE *fp = fopen(fft_wisdom_file, "r");
+      if(fp != NULL) {
+	if(fftw_import_wisdom_from_file(fp)) {
+	  output.write("\tRead FFTW wisdom from %s\n", fft_wisdom_file);
+	}else
+	  output.write("\tWARNING: Couldn't read FFTW wisdom from %s\n", fft_wisdom_file);
+	fclose(fp);
+      }
+    }
+  }
 }
 
+/*
+ * Plan cache
+ *
+ * Plans are kept for every transform size used, so alternating
+ * between sizes doesn't cause re-planning. All plans are made for
+ * unaligned data, and used with the new-array execute functions
+ * on the caller's arrays, so one plan can be shared between threads.
+ * The FFTW planner isn't thread-safe, so the cache is only searched
+ * and added to by one thread at a time.
+ */
+
+enum FFT_KIND {FFT_FORWARD, FFT_BACKWARD, FFT_R2C, FFT_C2R};
+
+struct fft_plan_t {
+  FFT_KIND kind;
+  int length, howmany, stride;
+  fftw_plan plan;
+};
+
+vector<fft_plan_t> fft_plans;
+
+/// Returns a plan for howmany transforms of the given length, with
+/// real data stride apart. Complex data is always contiguous, and
+/// complex to complex transforms are in-place.
+fftw_plan fft_get_plan(FFT_KIND kind, int length, int howmany, int stride)
+{
+  fftw_plan p = NULL;
+  
+  #pragma omp critical(fftw_plan)
+  {
+    for(size_t i=0;i<fft_plans.size();i++) {
+      const fft_plan_t &e = fft_plans[i];
+      if((e.kind == kind) && (e.length == length) && (e.howmany == howmany) && (e.stride == stride)) {
+	p = e.plan;
+	break;
+      }
+    }
+    
+    if(p == NULL) {
+      // Make a new plan, using arrays only for planning
+      fft_init();
+      
+      int nc = (kind == FFT_FORWARD || kind == FFT_BACKWARD) ? length : length/2 + 1;
+      
+      double *rdata = (double*) fftw_malloc(sizeof(double) * ((howmany-1)*stride + length));
+      fftw_complex *cdata = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * howmany*nc);
+      
+      unsigned int flags = fft_flags | FFTW_UNALIGNED;
+      
+      switch(kind) {
+      case FFT_FORWARD: {
+	p = fftw_plan_many_dft(1, &length, howmany, cdata, NULL, 1, nc, cdata, NULL, 1, nc, 
+			       FFTW_FORWARD, flags);
+	break;
+      }
+      case FFT_BACKWARD: {
+	p = fftw_plan_many_dft(1, &length, howmany, cdata, NULL, 1, nc, cdata, NULL, 1, nc, 
+			       FFTW_BACKWARD, flags);
+	break;
+      }
+      case FFT_R2C: {
+	p = fftw_plan_many_dft_r2c(1, &length, howmany, rdata, NULL, 1, stride, cdata, NULL, 1, nc, flags);
+	break;
+      }
+      case FFT_C2R: {
+	p = fftw_plan_many_dft_c2r(1, &length, howmany, cdata, NULL, 1, nc, rdata, NULL, 1, stride, flags);
+	break;
+      }
+      }
+      
+      fftw_free(rdata);
+      fftw_free(cdata);
+      
+      fft_plan_t e;
+      e.kind = kind;
+      e.length = length;
+      e.howmany = howmany;
+      e.stride = stride;
+      e.plan = p;
+      fft_plans.push_back(e);
+    }
+  }
+  
+  return p;
+}
+
+void fft_finish()
+{
+  if((fft_wisdom_file[0] == 0) || (MYPE != 0))
+    return; // Not saving, or another processor will
+  
+  FILE *fp = fopen(fft_wisdom_file, "w");
+  if(fp == NULL) {
+    output.write("\tWARNING: Couldn't write FFTW wisdom to %s\n", fft_wisdom_file);
+    return;
+  }
+  fftw_export_wisdom_to_file(fp);
+  fclose(fp);
+}
+
+/*
+ * One-line transforms. These are called for every z line, so each
+ * thread remembers the last plan it used rather than searching the cache.
+ * dcomplex is two reals, so has the same layout as fftw_complex.
+ */
+
 void cfft(dcomplex *cv, int length, int isign)
 {
-  static fftw_complex *in, *out;
   static fftw_plan pf, pb;
   static int n = 0;
+  #pragma omp threadprivate(pf, pb, n)
 
   if(length != n) {
-    if(n > 0) {
-      fftw_destroy_plan(pf);
-      fftw_destroy_plan(pb);
-      fftw_free(in);
-      fftw_free(out);
-    }
-    
-    fft_init();
-
-    in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * length);
-    out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * length);
-    
-    unsigned int flags = FFTW_ESTIMATE;
-    if(fft_measure)
-      flags = FFTW_MEASURE;
-
-    pf = fftw_plan_dft_1d(length, in, out, FFTW_FORWARD, flags);
-    pb = fftw_plan_dft_1d(length, in, out, FFTW_BACKWARD, flags);
-    
+    pf = fft_get_plan(FFT_FORWARD, length, 1, length);
+    pb = fft_get_plan(FFT_BACKWARD, length, 1, length);
     n = length;
   }
-
-  // Load input data
-  for(int i=0;i<n;i++) {
-    in[i][0] = cv[i].Real();
-    in[i][1] = cv[i].Imag();
-  }
   
   if(isign < 0) {
     // Forward transform
-    fftw_execute(pf);
+    fftw_execute_dft(pf, (fftw_complex*) cv, (fftw_complex*) cv);
     for(int i=0;i<n;i++)
-      cv[i] = dcomplex(out[i][0], out[i][1]) / ((double) n); // Normalise
+      cv[i] = cv[i] / ((double) n); // Normalise
   }else {
     // Backward
-    fftw_execute(pb);
-    for(int i=0;i<n;i++)
-      cv[i] = dcomplex(out[i][0], out[i][1]);
+    fftw_execute_dft(pb, (fftw_complex*) cv, (fftw_complex*) cv);
   }
 }
 
@@ -127,78 +250,42 @@ void ZFFT(dcomplex *cv, real zoffset, int isign, bool shift)
 
 void rfft(real *in, int length, dcomplex *out)
 {
-  static double *fin;
-  static fftw_complex *fout;
   static fftw_plan p;
   static int n = 0;
+  #pragma omp threadprivate(p, n)
   
   if(length != n) {
-    if(n > 0) {
-      fftw_destroy_plan(p);
-      fftw_free(fin);
-      fftw_free(fout);
-    }
-    
-    fft_init();
-    
-    fin = (double*) fftw_malloc(sizeof(double) * length);
-    fout = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (length/2 + 1));
-
-    unsigned int flags = FFTW_ESTIMATE;
-    if(fft_measure)
-      flags = FFTW_MEASURE;
-    
-    p = fftw_plan_dft_r2c_1d(length, fin, fout, flags);
-    
+    p = fft_get_plan(FFT_R2C, length, 1, length);
     n = length;
   }
   
-  for(int i=0;i<n;i++)
-    fin[i] = in[i];
-  
-  fftw_execute(p);
+  // Real to complex transforms don't change the input
+  fftw_execute_dft_r2c(p, in, (fftw_complex*) out);
 
   for(int i=0;i<(n/2)+1;i++)
-    out[i] = dcomplex(fout[i][0], fout[i][1]) / ((double) n); // Normalise
+    out[i] = out[i] / ((double) n); // Normalise
 }
 
 void irfft(dcomplex *in, int length, real *out)
 {
-  static fftw_complex *fin;
-  static double *fout;
+  static dcomplex *fin;
   static fftw_plan p;
   static int n = 0;
+  #pragma omp threadprivate(fin, p, n)
   
   if(length != n) {
-    if(n > 0) {
-      fftw_destroy_plan(p);
-      fftw_free(fin);
-      fftw_free(fout);
-    }
-    
-    fft_init();
-    
-    fin = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (length/2 + 1));
-    fout = (double*) fftw_malloc(sizeof(double) * length);
-
-    unsigned int flags = FFTW_ESTIMATE;
-    if(fft_measure)
-      flags = FFTW_MEASURE;
-    
-    p = fftw_plan_dft_c2r_1d(length, fin, fout, flags);
-    
+    p = fft_get_plan(FFT_C2R, length, 1, length);
+    if(n > 0)
+      delete[] fin;
+    fin = new dcomplex[length/2 + 1];
     n = length;
   }
   
-  for(int i=0;i<(n/2)+1;i++) {
-    fin[i][0] = in[i].Real();
-    fin[i][1] = in[i].Imag();
-  }
+  // Complex to real transforms overwrite the input, so copy it
+  for(int i=0;i<(n/2)+1;i++)
+    fin[i] = in[i];
   
-  fftw_execute(p);
-
-  for(int i=0;i<n;i++)
-    out[i] = fout[i];
+  fftw_execute_dft_c2r(p, (fftw_complex*) fin, out);
 }
 
 void ZFFT(real *in, real zoffset, dcomplex *cv, bool shift)
@@ -235,3 +322,65 @@ void ZFFT_rev(dcomplex *cv, real zoffset, real *out, bool shift)
 
   irfft(cv, ncz, out);
 }
+
+/***********************************************************
+ * Batched real FFTs
+ *
+ * Transform many z lines in one FFTW call, reading and writing
+ * field data directly.
+ ***********************************************************/
+
+void rfft_many(const real *in, int length, int howmany, int stride, dcomplex *out)
+{
+  fftw_plan p = fft_get_plan(FFT_R2C, length, howmany, stride);
+  
+  // Real to complex transforms don't change the input
+  fftw_execute_dft_r2c(p, (double*) in, (fftw_complex*) out);
+  
+  int nc = length/2 + 1;
+  real fac = 1.0 / ((double) length); // Normalise
+  for(int i=0;i<howmany*nc;i++)
+    out[i] *= fac;
+}
+
+void irfft_many(dcomplex *in, int length, int howmany, real *out, int stride)
+{
+  fftw_plan p = fft_get_plan(FFT_C2R, length, howmany, stride);
+  
+  fftw_execute_dft_c2r(p, (fftw_complex*) in, out);
+}
+
+void ZFFT_many(const real *in, int howmany, int stride, const real *zoffset, int zstride, dcomplex *cv, bool shift)
+{
+  int nc = ncz/2 + 1;
+  
+  rfft_many(in, ncz, howmany, stride, cv);
+  
+  if((ShiftXderivs) && shift) {
+    // Forward FFT
+    for(int i=0;i<howmany;i++)
+      for(int jz=0;jz<nc;jz++) {
+	real kwave=jz*2.0*PI/zlength; // wave number is 1/[rad]
+	
+	// Multiply by EXP(-ik*zoffset)
+	cv[i*nc+jz] *= dcomplex(cos(kwave*zoffset[i*zstride]) , -sin(kwave*zoffset[i*zstride]));
+      }
+  }
+}
+
+void ZFFT_rev_many(dcomplex *cv, int howmany, const real *zoffset, int zstride, real *out, int stride, bool shift)
+{
+  int nc = ncz/2 + 1;
+  
+  if((ShiftXderivs) && shift) {
+    for(int i=0;i<howmany;i++)
+      for(int jz=0;jz<nc;jz++) { // Only do positive frequencies
+	real kwave=jz*2.0*PI/zlength; // wave number is 1/[rad]
+	
+	// Multiply by EXP(ik*zoffset)
+	cv[i*nc+jz] *= dcomplex(cos(kwave*zoffset[i*zstride]) , sin(kwave*zoffset[i*zstride]));
+      }
+  }
+  
+  irfft_many(cv, ncz, howmany, out, stride);
+}
@@ -66,6 +66,19 @@ bool invert_low_mem;    ///< If true, reduce the amount of memory used
 bool laplace_all_terms; // applies to Delp2 operator and laplacian inversion
 bool laplace_nonuniform; // Non-uniform mesh correction
 
+/// Factorised tridiagonal matrices for one Y slice, kept between calls
+struct laplace_cache {
+  bool valid;        ///< False if not set, or factorisation failed
+  int jy;            ///< Y index of the matrices
+  int flags;         ///< Flags used to set the matrix
+  bool has_a, has_c; ///< Were a and c coefficients given?
+  real *a, *c;       ///< Coefficients used to set the matrix
+  
+  tridag_factors f;
+};
+
+static laplace_cache *tridag_cache = NULL; ///< One per Y index, or NULL if not caching
+
 /// Laplacian inversion initialisation. Called once at the start to get settings
 int invert_init()
 {
@@ -105,6 +118,11 @@ int invert_init()
   // THIS LINE CAUSES SEGFAULT ON LLNL GRENDEL
   //MPI_Bcast(&laplace_maxmode, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
+  if(!invert_low_mem && (NXPE == 1)) {
+    // Keep the factorised matrices for each slice (serial 2nd-order solver)
+    tridag_cache = new laplace_cache[ngy]();
+  }
+
   return 0;
 }
 
@@ -157,16 +175,383 @@ void laplace_tridag_coefs(int jx, int jy, int jz, dcomplex &a, dcomplex &b, dcom
  *                                 SERIAL CODE
  **********************************************************************************/
 
+/// Sets the tridiagonal matrix for one Z mode, including boundary rows
+static void laplace_tridag_matrix(dcomplex *avec, dcomplex *bvec, dcomplex *cvec,
+				  int jy, int iz, int flags, const Field2D *a, const Field2D *ccoef)
+{
+  int ix;
+
+  int xbndry = MXG;
+  if(flags & INVERT_BNDRY_ONE)
+    xbndry = 1;
+
+  for(ix=xbndry;ix<=ncx-xbndry;ix++) {
+    laplace_tridag_coefs(ix, jy, iz, avec[ix], bvec[ix], cvec[ix], ccoef);
+
+    if(a != (Field2D*) NULL)
+      bvec[ix] += (*a)[ix][jy];
+  }
+
+  // Set boundary conditions
+
+  if(iz == 0) {
+    // DC
+
+    // Inner boundary
+    if(flags & INVERT_DC_IN_GRAD) {
+      // Zero gradient at inner boundary
+
+      if((flags & INVERT_IN_SYM) && (xbndry > 1) && BoundaryOnCell) {
+	// Use symmetric boundary to set zero-gradient
+
+	for (ix=0;ix<xbndry-1;ix++) {
+	  avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
+	}
+	// Symmetric on last point
+	avec[xbndry-1] = 1.0; bvec[xbndry-1] = 0.0; cvec[xbndry-1] = -1.0;
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  avec[ix]=dcomplex(0.0,0.0);
+	  bvec[ix]=dcomplex(1.,0.); cvec[ix]=dcomplex(-1.,0.);
+	}
+      }
+    }else if(flags & INVERT_IN_SET) {
+      for(ix=0;ix<xbndry;ix++) {
+	avec[ix] = 0.0;
+	bvec[ix] = 1.0;
+	cvec[ix] = 0.0;
+      }
+    }else {
+      // Zero value at inner boundary
+      if(flags & INVERT_IN_SYM) {
+	// Use anti-symmetric boundary to set zero-value
+
+	// Zero-gradient for first point(s)
+	for(ix=0;ix<xbndry-1;ix++) {
+	  avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
+	}
+
+	if(BoundaryOnCell) {
+	  // Antisymmetric about boundary on cell
+	  avec[xbndry-1]=1.0; bvec[xbndry-1]=0.0; cvec[xbndry-1]= 1.0;
+	}else {
+	  // Antisymmetric across boundary between cells
+	  avec[xbndry-1]=0.0; bvec[xbndry-1]=1.0; cvec[xbndry-1]= 1.0;
+	}
+
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  avec[ix]=dcomplex(0.,0.);
+	  bvec[ix]=dcomplex(1.,0.);cvec[ix]=dcomplex(0.,0.);
+	}
+      }
+    }
+
+    // Outer boundary
+    if(flags & INVERT_DC_OUT_GRAD) {
+      // Zero gradient at outer boundary
+
+      if((flags & INVERT_OUT_SYM) && (xbndry > 1) && BoundaryOnCell) {
+	// Use symmetric boundary to set zero-gradient
+
+	for (ix=0;ix<xbndry-1;ix++) {
+	  avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
+	}
+	// Symmetric on last point
+	ix = xbndry-1;
+	avec[ncx-ix] = 1.0; bvec[ncx-ix] = 0.0; cvec[ncx-ix] = -1.0;
+
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  cvec[ncx-ix]=dcomplex(0.,0.);
+	  bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(-1.,0.);
+	}
+      }
+    }else if(flags & INVERT_OUT_SET) {
+      // Setting the values in the outer boundary
+      for(ix=0;ix<xbndry;ix++) {
+	avec[ncx-ix] = 0.0;
+	bvec[ncx-ix] = 1.0;
+	cvec[ncx-ix] = 0.0;
+      }
+    }else {
+      // Zero value at outer boundary
+      if(flags & INVERT_OUT_SYM) {
+	// Use anti-symmetric boundary to set zero-value
+
+	// Zero-gradient for first point(s)
+	for(ix=0;ix<xbndry-1;ix++) {
+	  avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
+	}
+	ix = xbndry-1;
+	if(BoundaryOnCell) {
+	  // Antisymmetric about boundary on cell
+	  avec[ncx-ix]=1.0; bvec[ncx-ix]=0.0; cvec[ncx-ix]= 1.0;
+	}else {
+	  // Antisymmetric across boundary between cells
+	  avec[ncx-ix]=1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
+	}
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  cvec[ncx-ix]=dcomplex(0.,0.);
+	  bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(0.,0.);
+	}
+      }
+    }
+  }else {
+    // AC
+
+    // Inner boundary
+    if(flags & INVERT_AC_IN_GRAD) {
+      // Zero gradient at inner boundary
+
+      if((flags & INVERT_IN_SYM) && (xbndry > 1) && BoundaryOnCell) {
+	// Use symmetric boundary to set zero-gradient
+
+	for (ix=0;ix<xbndry-1;ix++) {
+	  avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
+	}
+	// Symmetric on last point
+	avec[xbndry-1] = 1.0; bvec[xbndry-1] = 0.0; cvec[xbndry-1] = -1.0;
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  avec[ix]=dcomplex(0.,0.);
+	  bvec[ix]=dcomplex(1.,0.);cvec[ix]=dcomplex(-1.,0.);
+	}
+      }
+    }else if(flags & INVERT_IN_SET) {
+      // Setting the values in the boundary
+      for(ix=0;ix<xbndry;ix++) {
+	avec[ix] = 0.0;
+	bvec[ix] = 1.0;
+	cvec[ix] = 0.0;
+      }
+    }else if(flags & INVERT_AC_IN_LAP) {
+      // Use decaying zero-Laplacian solution in the boundary
+      real kwave=iz*2.0*PI/zlength; // wave number is 1/[rad]
+      for (ix=0;ix<xbndry;ix++) {
+	avec[ix] = 0.0;
+	bvec[ix] = -1.0;
+	cvec[ix] = exp(-1.0*sqrt(g33[ix][jy]/g11[ix][jy])*kwave*dx[ix][jy]);
+      }
+    }else {
+      // Zero value at inner boundary
+
+      if(flags & INVERT_IN_SYM) {
+	// Use anti-symmetric boundary to set zero-value
+
+	// Zero-gradient for first point(s)
+	for(ix=0;ix<xbndry-1;ix++) {
+	  avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
+	}
+
+	if(BoundaryOnCell) {
+	  // Antisymmetric about boundary on cell
+	  avec[xbndry-1]=1.0; bvec[xbndry-1]=0.0; cvec[xbndry-1]= 1.0;
+	}else {
+	  // Antisymmetric across boundary between cells
+	  avec[xbndry-1]=0.0; bvec[xbndry-1]=1.0; cvec[xbndry-1]= 1.0;
+	}
+
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  avec[ix]=dcomplex(0.,0.);
+	  bvec[ix]=dcomplex(1.,0.);cvec[ix]=dcomplex(0.,0.);
+	}
+      }
+    }
+
+    // Outer boundary
+    if(flags & INVERT_AC_OUT_GRAD) {
+      // Zero gradient at outer boundary
+
+      if((flags & INVERT_OUT_SYM) && (xbndry > 1) && BoundaryOnCell) {
+	// Use symmetric boundary to set zero-gradient
+
+	for (ix=0;ix<xbndry-1;ix++) {
+	  avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
+	}
+	// Symmetric on last point
+	ix = xbndry-1;
+	avec[ncx-ix] = 1.0; bvec[ncx-ix] = 0.0; cvec[ncx-ix] = -1.0;
+
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  cvec[ncx-ix]=dcomplex(0.,0.);
+	  bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(-1.,0.);
+	}
+      }
+    }else if(flags & INVERT_AC_OUT_LAP) {
+      // Use decaying zero-Laplacian solution in the boundary
+      real kwave=iz*2.0*PI/zlength; // wave number is 1/[rad]
+      for (ix=0;ix<xbndry;ix++) {
+	avec[ncx-ix] = exp(-1.0*sqrt(g33[ncx-ix][jy]/g11[ncx-ix][jy])*kwave*dx[ncx-ix][jy]);;
+	bvec[ncx-ix] = -1.0;
+	cvec[ncx-ix] = 0.0;
+      }
+    }else if(flags & INVERT_OUT_SET) {
+      // Setting the values in the outer boundary
+      for(ix=0;ix<xbndry;ix++) {
+	avec[ncx-ix] = 0.0;
+	bvec[ncx-ix] = 1.0;
+	cvec[ncx-ix] = 0.0;
+      }
+    }else {
+      // Zero value at outer boundary
+
+      if(flags & INVERT_OUT_SYM) {
+	// Use anti-symmetric boundary to set zero-value
+
+	// Zero-gradient for first point(s)
+	for(ix=0;ix<xbndry-1;ix++) {
+	  avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
+	}
+	ix = xbndry-1;
+	if(BoundaryOnCell) {
+	  // Antisymmetric about boundary on cell
+	  avec[ncx-ix]=1.0; bvec[ncx-ix]=0.0; cvec[ncx-ix]= 1.0;
+	}else {
+	  // Antisymmetric across boundary between cells
+	  avec[ncx-ix]=1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
+	}
+      }else {
+	for (ix=0;ix<xbndry;ix++){
+	  cvec[ncx-ix]=dcomplex(0.,0.);
+	  bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(0.,0.);
+	}
+      }
+    }
+  }
+}
+
+/// True if inner boundary values of mode iz are set from x
+static bool laplace_in_set(int flags, int iz)
+{
+  if(iz == 0)
+    return (flags & INVERT_IN_SET) && !(flags & INVERT_DC_IN_GRAD);
+  return (flags & INVERT_IN_SET) && !(flags & INVERT_AC_IN_GRAD);
+}
+
+/// True if outer boundary values of mode iz are set from x
+static bool laplace_out_set(int flags, int iz)
+{
+  if(iz == 0)
+    return (flags & INVERT_OUT_SET) && !(flags & INVERT_DC_OUT_GRAD);
+  return (flags & INVERT_OUT_SET) && !(flags & (INVERT_AC_OUT_GRAD | INVERT_AC_OUT_LAP));
+}
+
+/// Checks if the cached factorisation was for the same matrix
+static bool laplace_cache_match(const laplace_cache &cache, int jy, int flags, 
+				const Field2D *a, const Field2D *ccoef)
+{
+  if(!cache.valid || (cache.jy != jy) || (cache.flags != flags))
+    return false;
+  
+  if((a != NULL) != cache.has_a)
+    return false;
+  if((ccoef != NULL) != cache.has_c)
+    return false;
+  
+  for(int ix=0;ix<ngx;ix++) {
+    if((a != NULL) && (cache.a[ix] != (*a)[ix][jy]))
+      return false;
+    if((ccoef != NULL) && (cache.c[ix] != (*ccoef)[ix][jy]))
+      return false;
+  }
+  
+  return true;
+}
+
+/// Records the coefficients used for a new factorisation
+static void laplace_cache_set(laplace_cache &cache, int jy, int flags, 
+			      const Field2D *a, const Field2D *ccoef, bool valid)
+{
+  if(cache.a == (real*) NULL) {
+    cache.a = new real[ngx];
+    cache.c = new real[ngx];
+  }
+  
+  cache.valid = valid;
+  cache.jy = jy;
+  cache.flags = flags;
+  cache.has_a = (a != NULL);
+  cache.has_c = (ccoef != NULL);
+  
+  for(int ix=0;ix<ngx;ix++) {
+    cache.a[ix] = (a != NULL) ? (*a)[ix][jy] : 0.0;
+    cache.c[ix] = (ccoef != NULL) ? (*ccoef)[ix][jy] : 0.0;
+  }
+}
+
+/// Sets and factorises the matrices for all Z modes of slice jy
+static void laplace_factorise(laplace_cache &cache, int jy, int flags, 
+			      const Field2D *a, const Field2D *ccoef)
+{
+  int ix, iz;
+  int nmode = ncz/2 + 1;
+
+  static dcomplex *avec = (dcomplex*) NULL, *bvec, *cvec;
+  static dcomplex *amat, *bmat, *cmat;
+  #pragma omp threadprivate(avec, bvec, cvec, amat, bmat, cmat)
+
+  if(avec == (dcomplex*) NULL) {
+    avec = new dcomplex[ngx];
+    bvec = new dcomplex[ngx];
+    cvec = new dcomplex[ngx];
+    
+    amat = new dcomplex[ngx*nmode];
+    bmat = new dcomplex[ngx*nmode];
+    cmat = new dcomplex[ngx*nmode];
+  }
+
+  for(iz=0;iz<nmode;iz++) {
+    laplace_tridag_matrix(avec, bvec, cvec, jy, iz, flags, a, ccoef);
+    
+    for(ix=0;ix<=ncx;ix++) {
+      amat[ix*nmode + iz] = avec[ix];
+      bmat[ix*nmode + iz] = bvec[ix];
+      cmat[ix*nmode + iz] = cvec[ix];
+    }
+  }
+  
+  bool ok = tridag_factor_many(amat, bmat, cmat, ngx, nmode, cache.f);
+  
+  laplace_cache_set(cache, jy, flags, a, ccoef, ok);
+}
+
+/// Frees the memory used by an array of caches
+static void laplace_cache_free(laplace_cache *cache, int n)
+{
+  for(int i=0;i<n;i++) {
+    if(cache[i].a != (real*) NULL) {
+      delete[] cache[i].a;
+      delete[] cache[i].c;
+    }
+    if(cache[i].f.len > 0)
+      delete[] cache[i].f.ar;
+  }
+  delete[] cache;
+}
+
 /// Perpendicular laplacian inversion (serial)
 /*!
  * Inverts an X-Z slice (FieldPerp) using band-diagonal solvers
  * This code is only for serial i.e. NXPE == 1
+ * 
+ * Work arrays are kept between calls, one set per OpenMP thread,
+ * so different slices can be inverted at the same time. x must
+ * be allocated before calling from inside a parallel region
+ *
+ * cache is an array of factorised matrices, one per Y index. If NULL
+ * then only the last factorisation done by this thread is kept
  */
-int invert_laplace_ser(const FieldPerp &b, FieldPerp &x, int flags, const Field2D *a, const Field2D *ccoef=NULL)
+int invert_laplace_ser(const FieldPerp &b, FieldPerp &x, int flags, const Field2D *a, const Field2D *ccoef,
+		       laplace_cache *cache)
 {
   int ix, jy, iz;
   static dcomplex **bk = NULL, *bk1d;
   static dcomplex **xk, *xk1d;
+  #pragma omp threadprivate(bk, bk1d, xk, xk1d)
   int xbndry; // Width of the x boundary
   
   real coef1=0.0, coef2=0.0, coef3=0.0, coef4=0.0, coef5=0.0, coef6=0.0, kwave, flt;
@@ -219,6 +604,7 @@ int invert_laplace_ser(const FieldPerp &b, FieldPerp &x, int flags, const Field2
     // Use band solver - 4th order
 
     static dcomplex **A = (dcomplex**) NULL;
+    #pragma omp threadprivate(A)
     int xstart, xend;
 
     if(A == (dcomplex**) NULL)
@@ -460,295 +846,74 @@ int invert_laplace_ser(const FieldPerp &b, FieldPerp &x, int flags, const Field2
     }
   }else {
     // Use tridiagonal system in x - 2nd order
+    // All Z modes are solved together, stored as [ix*nmode + iz]
     
+    int nmode = ncz/2 + 1;
+
     static dcomplex *avec = (dcomplex*) NULL, *bvec, *cvec;
+    static real *rr, *ri;
+    static laplace_cache work; // Used if cache is NULL
+    #pragma omp threadprivate(avec, bvec, cvec, rr, ri, work)
     
     if(avec == (dcomplex*) NULL) {
       avec = new dcomplex[ngx];
       bvec = new dcomplex[ngx];
       cvec = new dcomplex[ngx];
-    }
-
-    for(iz=0;iz<=ncz/2;iz++) {
-      // solve differential equation in x
 
-      // set bk1d
-      for(ix=0;ix<=ncx;ix++)
-	bk1d[ix] = bk[ix][iz];
+      rr = new real[ngx*nmode];
+      ri = new real[ngx*nmode];
+    }
 
-      ///////// PERFORM INVERSION /////////
-      
-      if (iz>laplace_maxmode) flt=0.0; else flt=1.0;
-      
-      for(ix=xbndry;ix<=ncx-xbndry;ix++) {
-	bk1d[ix] *= flt;
+    // Use the factorisation from the last call for this slice if possible
+    laplace_cache *fact = (cache != NULL) ? cache + jy : &work;
+    
+    if(!laplace_cache_match(*fact, jy, flags, a, ccoef))
+      laplace_factorise(*fact, jy, flags, a, ccoef);
+    
+    // Set the RHS
+    for(ix=0;ix<=ncx;ix++) {
+      for(iz=0;iz<nmode;iz++) {
+	dcomplex val(0.0, 0.0);
 	
-	laplace_tridag_coefs(ix, jy, iz, avec[ix], bvec[ix], cvec[ix], ccoef);
+	if(ix < xbndry) {
+	  // Inner boundary
+	  if(laplace_in_set(flags, iz))
+	    val = xk[ix][iz];
+	}else if(ix > ncx-xbndry) {
+	  // Outer boundary
+	  if(laplace_out_set(flags, iz))
+	    val = xk[ix][iz];
+	}else if(iz <= laplace_maxmode)
+	  val = bk[ix][iz];
 	
-	if(a != (Field2D*) NULL)
-	  bvec[ix] += (*a)[ix][jy];
+	rr[ix*nmode + iz] = val.Real();
+	ri[ix*nmode + iz] = val.Imag();
       }
+    }
+    
+    if(fact->valid) {
+      // Call batched tridiagonal solver
+      tridag_solve_many(fact->f, rr, ri);
       
-      // Set boundary conditions
-      
-      if(iz == 0) {
-	// DC
-	
-	// Inner boundary
-	if(flags & INVERT_DC_IN_GRAD) {
-	  // Zero gradient at inner boundary
-	  
-	  if((flags & INVERT_IN_SYM) && (xbndry > 1) && BoundaryOnCell) {
-	    // Use symmetric boundary to set zero-gradient
-	    
-	    for (ix=0;ix<xbndry-1;ix++) {
-	      avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
-	      bk1d[ix]=0.0;
-	    }
-	    // Symmetric on last point
-	    avec[xbndry-1] = 1.0; bvec[xbndry-1] = 0.0; cvec[xbndry-1] = -1.0;
-	    bk1d[xbndry-1] = 0.0;
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      avec[ix]=dcomplex(0.0,0.0);
-	      bvec[ix]=dcomplex(1.,0.); cvec[ix]=dcomplex(-1.,0.);bk1d[ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}else if(flags & INVERT_IN_SET) {
-	  for(ix=0;ix<xbndry;ix++) {
-	    avec[ix] = 0.0;
-	    bvec[ix] = 1.0;
-	    cvec[ix] = 0.0;
-	    bk1d[ix] = xk[ix][iz];
-	  }
-	}else {
-	  // Zero value at inner boundary
-	  if(flags & INVERT_IN_SYM) {
-	    // Use anti-symmetric boundary to set zero-value
-	    
-	    // Zero-gradient for first point(s)
-	    for(ix=0;ix<xbndry-1;ix++) {
-	      avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
-	      bk1d[ix]=0.0;
-	    }
-
-	    if(BoundaryOnCell) {
-	      // Antisymmetric about boundary on cell
-	      avec[xbndry-1]=1.0; bvec[xbndry-1]=0.0; cvec[xbndry-1]= 1.0;
-	      bk1d[xbndry-1]=0.0;
-	    }else { 
-	      // Antisymmetric across boundary between cells
-	      avec[xbndry-1]=0.0; bvec[xbndry-1]=1.0; cvec[xbndry-1]= 1.0;
-	      bk1d[xbndry-1]=0.0;
-	    }
-	    
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      avec[ix]=dcomplex(0.,0.);
-	      bvec[ix]=dcomplex(1.,0.);cvec[ix]=dcomplex(0.,0.);bk1d[ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}
+      for(ix=0;ix<=ncx;ix++)
+	for(iz=0;iz<nmode;iz++)
+	  xk[ix][iz] = dcomplex(rr[ix*nmode + iz], ri[ix*nmode + iz]);
+    }else {
+      // Zero pivot, so solve one mode at a time (LAPACK pivots)
+      for(iz=0;iz<nmode;iz++) {
+	laplace_tridag_matrix(avec, bvec, cvec, jy, iz, flags, a, ccoef);
 	
-	// Outer boundary
-	if(flags & INVERT_DC_OUT_GRAD) {
-	  // Zero gradient at outer boundary
-
-	  if((flags & INVERT_OUT_SYM) && (xbndry > 1) && BoundaryOnCell) {
-	    // Use symmetric boundary to set zero-gradient
-	    
-	    for (ix=0;ix<xbndry-1;ix++) {
-	      avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
-	      bk1d[ncx-ix]=0.0;
-	    }
-	    // Symmetric on last point
-	    ix = xbndry-1;
-	    avec[ncx-ix] = 1.0; bvec[ncx-ix] = 0.0; cvec[ncx-ix] = -1.0;
-	    bk1d[ncx-ix] = 0.0;
-	    
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      cvec[ncx-ix]=dcomplex(0.,0.);
-	      bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(-1.,0.);bk1d[ncx-ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}else if(flags & INVERT_OUT_SET) {
-	  // Setting the values in the outer boundary
-	  for(ix=0;ix<xbndry;ix++) {
-	    avec[ncx-ix] = 0.0;
-	    bvec[ncx-ix] = 1.0;
-	    cvec[ncx-ix] = 0.0;
-	    bk1d[ncx-ix] = xk[ncx-ix][iz];
-	  }
-	}else {
-	  // Zero value at outer boundary
-	  if(flags & INVERT_OUT_SYM) {
-	    // Use anti-symmetric boundary to set zero-value
-	    
-	    // Zero-gradient for first point(s)
-	    for(ix=0;ix<xbndry-1;ix++) {
-	      avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
-	      bk1d[ncx-ix]=0.0;
-	    }
-	    ix = xbndry-1;
-	    if(BoundaryOnCell) {
-	      // Antisymmetric about boundary on cell
-	      avec[ncx-ix]=1.0; bvec[ncx-ix]=0.0; cvec[ncx-ix]= 1.0;
-	      bk1d[ncx-ix]=0.0;
-	    }else { 
-	      // Antisymmetric across boundary between cells
-	      avec[ncx-ix]=1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
-	      bk1d[ncx-ix]=0.0;
-	    }
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      cvec[ncx-ix]=dcomplex(0.,0.);
-	      bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(0.,0.);bk1d[ncx-ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}
-      }else {
-	// AC
+	for(ix=0;ix<=ncx;ix++)
+	  bk1d[ix] = dcomplex(rr[ix*nmode + iz], ri[ix*nmode + iz]);
 	
-	// Inner boundary
-	if(flags & INVERT_AC_IN_GRAD) {
-	  // Zero gradient at inner boundary
-	  
-	  if((flags & INVERT_IN_SYM) && (xbndry > 1) && BoundaryOnCell) {
-	    // Use symmetric boundary to set zero-gradient
-	    
-	    for (ix=0;ix<xbndry-1;ix++) {
-	      avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
-	      bk1d[ix]=0.0;
-	    }
-	    // Symmetric on last point
-	    avec[xbndry-1] = 1.0; bvec[xbndry-1] = 0.0; cvec[xbndry-1] = -1.0;
-	    bk1d[xbndry-1] = 0.0;
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      avec[ix]=dcomplex(0.,0.);
-	      bvec[ix]=dcomplex(1.,0.);cvec[ix]=dcomplex(-1.,0.);bk1d[ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}else if(flags & INVERT_IN_SET) {
-	  // Setting the values in the boundary
-	  for(ix=0;ix<xbndry;ix++) {
-	    avec[ix] = 0.0;
-	    bvec[ix] = 1.0;
-	    cvec[ix] = 0.0;
-	    bk1d[ix] = xk[ix][iz];
-	  }
-	}else if(flags & INVERT_AC_IN_LAP) {
-	  // Use decaying zero-Laplacian solution in the boundary
-	  real kwave=iz*2.0*PI/zlength; // wave number is 1/[rad]
-	  for (ix=0;ix<xbndry;ix++) {
-	    avec[ix] = 0.0;
-	    bvec[ix] = -1.0;
-	    cvec[ix] = exp(-1.0*sqrt(g33[ix][jy]/g11[ix][jy])*kwave*dx[ix][jy]);
-	    bk1d[ix] = 0.0;
-	  }
-	}else {
-	  // Zero value at inner boundary
-
-	  if(flags & INVERT_IN_SYM) {
-	    // Use anti-symmetric boundary to set zero-value
-	    
-	    // Zero-gradient for first point(s)
-	    for(ix=0;ix<xbndry-1;ix++) {
-	      avec[ix]=0.0; bvec[ix]=1.0; cvec[ix]= -1.0;
-	      bk1d[ix]=0.0;
-	    }
-
-	    if(BoundaryOnCell) {
-	      // Antisymmetric about boundary on cell
-	      avec[xbndry-1]=1.0; bvec[xbndry-1]=0.0; cvec[xbndry-1]= 1.0;
-	      bk1d[xbndry-1]=0.0;
-	    }else { 
-	      // Antisymmetric across boundary between cells
-	      avec[xbndry-1]=0.0; bvec[xbndry-1]=1.0; cvec[xbndry-1]= 1.0;
-	      bk1d[xbndry-1]=0.0;
-	    }
-	    
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      avec[ix]=dcomplex(0.,0.);
-	      bvec[ix]=dcomplex(1.,0.);cvec[ix]=dcomplex(0.,0.);bk1d[ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}
+	tridag(avec, bvec, cvec, bk1d, xk1d, ngx);
 	
-	// Outer boundary
-	if(flags & INVERT_AC_OUT_GRAD) {
-	  // Zero gradient at outer boundary
-	  
-	  if((flags & INVERT_OUT_SYM) && (xbndry > 1) && BoundaryOnCell) {
-	    // Use symmetric boundary to set zero-gradient
-	    
-	    for (ix=0;ix<xbndry-1;ix++) {
-	      avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
-	      bk1d[ncx-ix]=0.0;
-	    }
-	    // Symmetric on last point
-	    ix = xbndry-1;
-	    avec[ncx-ix] = 1.0; bvec[ncx-ix] = 0.0; cvec[ncx-ix] = -1.0;
-	    bk1d[ncx-ix] = 0.0;
-	    
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      cvec[ncx-ix]=dcomplex(0.,0.);
-	      bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(-1.,0.);bk1d[ncx-ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}else if(flags & INVERT_AC_OUT_LAP) {
-	  // Use decaying zero-Laplacian solution in the boundary
-	  real kwave=iz*2.0*PI/zlength; // wave number is 1/[rad]
-	  for (ix=0;ix<xbndry;ix++) {
-	    avec[ncx-ix] = exp(-1.0*sqrt(g33[ncx-ix][jy]/g11[ncx-ix][jy])*kwave*dx[ncx-ix][jy]);;
-	    bvec[ncx-ix] = -1.0;
-	    cvec[ncx-ix] = 0.0;
-	    bk1d[ncx-ix] = 0.0;
-	  }
-	}else if(flags & INVERT_OUT_SET) {
-	  // Setting the values in the outer boundary
-	  for(ix=0;ix<xbndry;ix++) {
-	    avec[ncx-ix] = 0.0;
-	    bvec[ncx-ix] = 1.0;
-	    cvec[ncx-ix] = 0.0;
-	    bk1d[ncx-ix] = xk[ncx-ix][iz];
-	  }
-	}else {
-	  // Zero value at outer boundary
-
-	  if(flags & INVERT_OUT_SYM) {
-	    // Use anti-symmetric boundary to set zero-value
-	    
-	    // Zero-gradient for first point(s)
-	    for(ix=0;ix<xbndry-1;ix++) {
-	      avec[ncx-ix]=-1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
-	      bk1d[ncx-ix]=0.0;
-	    }
-	    ix = xbndry-1;
-	    if(BoundaryOnCell) {
-	      // Antisymmetric about boundary on cell
-	      avec[ncx-ix]=1.0; bvec[ncx-ix]=0.0; cvec[ncx-ix]= 1.0;
-	      bk1d[ncx-ix]=0.0;
-	    }else { 
-	      // Antisymmetric across boundary between cells
-	      avec[ncx-ix]=1.0; bvec[ncx-ix]=1.0; cvec[ncx-ix]= 0.0;
-	      bk1d[ncx-ix]=0.0;
-	    }
-	  }else {
-	    for (ix=0;ix<xbndry;ix++){
-	      cvec[ncx-ix]=dcomplex(0.,0.);
-	      bvec[ncx-ix]=dcomplex(1.,0.);avec[ncx-ix]=dcomplex(0.,0.);bk1d[ncx-ix]=dcomplex(0.0,0.0);
-	    }
-	  }
-	}
+	for(ix=0;ix<=ncx;ix++)
+	  xk[ix][iz] = xk1d[ix];
       }
-      
-      // Call tridiagonal solver
-      tridag(avec, bvec, cvec, bk1d, xk1d, ngx);
-
+    }
+    
+    for(iz=0;iz<nmode;iz++) {
       if((flags & INVERT_IN_SYM) && (xbndry > 1)) {
 	// (Anti-)symmetry on inner boundary. Nothing to do if only one boundary cell
 	int xloc = 2*xbndry;
@@ -758,11 +923,11 @@ int invert_laplace_ser(const FieldPerp &b, FieldPerp &x, int flags, const Field2
 	if( ((iz == 0) && (flags & INVERT_DC_IN_GRAD)) || ((iz != 0) && (flags & INVERT_AC_IN_GRAD)) ) {
 	  // Inner gradient zero - symmetric
 	  for(ix=0;ix<xbndry-1;ix++)
-	    xk1d[ix] = xk1d[xloc-ix];
+	    xk[ix][iz] = xk[xloc-ix][iz];
 	}else {
 	  // Inner value zero - antisymmetric
 	  for(ix=0;ix<xbndry-1;ix++)
-	    xk1d[ix] = -xk1d[xloc-ix];
+	    xk[ix][iz] = -xk[xloc-ix][iz];
 	}
       }
       if((flags & INVERT_OUT_SYM) && (xbndry > 1)) {
@@ -775,19 +940,13 @@ int invert_laplace_ser(const FieldPerp &b, FieldPerp &x, int flags, const Field2
 	if( ((iz == 0) && (flags & INVERT_DC_IN_GRAD)) || ((iz != 0) && (flags & INVERT_AC_IN_GRAD)) ) {
 	  // Outer gradient zero - symmetric
 	  for(ix=0;ix<xbndry-1;ix++)
-	    xk1d[ncx-ix] = xk1d[xloc + ix];
+	    xk[ncx-ix][iz] = xk[xloc + ix][iz];
 	}else {
 	  // Outer value zero - antisymmetric
 	  for(ix=0;ix<xbndry-1;ix++)
-	    xk1d[ncx-ix] = -xk1d[xloc + ix];
+	    xk[ncx-ix][iz] = -xk[xloc + ix][iz];
 	}
       }
-      
-      // Fill xk
-      
-      for (ix=0; ix<=ncx; ix++){
-	xk[ix][iz]=xk1d[ix];
-      }
     }
   }
 
@@ -1708,7 +1867,7 @@ int invert_laplace(const FieldPerp &b, FieldPerp &x, int flags, const Field2D *a
 {
   if(NXPE == 1) {
     // Just use the serial code
-    return invert_laplace_ser(b, x, flags, a, c);
+    return invert_laplace_ser(b, x, flags, a, c, tridag_cache);
   }else {
     // Parallel inversion using PDD
 
@@ -1739,13 +1898,30 @@ int invert_laplace(const FieldPerp &b, FieldPerp &x, int flags, const Field2D *a
   return 0;
 }
 
+/// Range of Y indices to invert
+static void laplace_yrange(int &ys, int &ye)
+{
+  ys = jstart;
+  ye = jend;
+ 
+  if(MYPE_IN_CORE == 0) {
+    // NOTE: REFINE THIS TO ONLY SOLVE IN BOUNDARY Y CELLS
+    ys = 0;
+    ye = ngy-1;
+  }
+}
+
 /// Extracts perpendicular slices from 3D fields and inverts separately
 /*!
+ * With NXPE == 1 the slices are shared between OpenMP threads.
  * In parallel (NXPE > 1) this tries to overlap computation and communication.
  * This is done at the expense of more memory useage. Setting low_mem
  * in the config file uses less memory, and less communication overlap
+ *
+ * cache is passed to invert_laplace_ser (NXPE == 1 only)
  */
-int invert_laplace(const Field3D &b, Field3D &x, int flags, const Field2D *a, const Field2D *c)
+static int invert_laplace_3d(const Field3D &b, Field3D &x, int flags, const Field2D *a, const Field2D *c,
+			     laplace_cache *cache)
 {
   int jy, jy2;
   FieldPerp xperp;
@@ -1756,15 +1932,46 @@ int invert_laplace(const Field3D &b, Field3D &x, int flags, const Field2D *a, co
   
   x.Allocate();
 
-  int ys = jstart, ye = jend;
- 
-  if(MYPE_IN_CORE == 0) {
-    // NOTE: REFINE THIS TO ONLY SOLVE IN BOUNDARY Y CELLS
-    ys = 0;
-    ye = ngy-1;
-  }
+  int ys, ye;
+  laplace_yrange(ys, ye);
   
-  if((NXPE == 1) || invert_low_mem) {
+  if(NXPE == 1) {
+    // Slices are independent, so split them between threads. Fields
+    // can't be allocated inside a parallel region, so make them first
+    
+    int ny = ye - ys + 1;
+    FieldPerp *bp = new FieldPerp[ny];
+    FieldPerp *xp = new FieldPerp[ny];
+    
+    for(jy=ys; jy <= ye; jy++) {
+      bp[jy-ys] = b.Slice(jy);
+      if((flags & INVERT_IN_SET) || (flags & INVERT_OUT_SET)) {
+	xp[jy-ys] = x.Slice(jy); // Using boundary values
+      }else
+	xp[jy-ys].Allocate();
+    }
+    
+    ret = 0;
+    #pragma omp parallel for
+    for(jy=ys; jy <= ye; jy++) {
+      int r = invert_laplace_ser(bp[jy-ys], xp[jy-ys], flags, a, c, cache);
+      if(r) {
+	#pragma omp critical(invert_laplace_ret)
+	ret = r;
+      }
+    }
+    
+    if(ret == 0)
+      for(jy=ys; jy <= ye; jy++)
+	x = xp[jy-ys];
+    
+    delete[] bp;
+    delete[] xp;
+    
+    if(ret)
+      return(ret);
+    
+  }else if(invert_low_mem) {
     
     for(jy=ys; jy <= ye; jy++) {
       if((flags & INVERT_IN_SET) || (flags & INVERT_OUT_SET))
@@ -1842,6 +2049,12 @@ int invert_laplace(const Field3D &b, Field3D &x, int flags, const Field2D *a, co
 
   return 0;
 }
+
+int invert_laplace(const Field3D &b, Field3D &x, int flags, const Field2D *a, const Field2D *c)
+{
+  return invert_laplace_3d(b, x, flags, a, c, tridag_cache);
+}
+
 const Field3D invert_laplace(const Field3D &b, int flags, const Field2D *a, const Field2D *c)
 {
   Field3D x;
@@ -1850,3 +2063,63 @@ const Field3D invert_laplace(const Field3D &b, int flags, const Field2D *a, cons
   return x;
 }
 
+/**********************************************************************************
+ *                           LAPLACIAN SOLVER OBJECT
+ **********************************************************************************/
+
+LaplaceSolver::LaplaceSolver(int flags, const Field2D *a, const Field2D *c)
+{
+  setFlags(flags);
+  setCoefA(a);
+  setCoefC(c);
+  
+  cache = NULL;
+  if((NXPE != 1) || (flags & INVERT_4TH_ORDER))
+    return; // Only the serial 2nd-order solver uses factorised matrices
+  
+  cache = new laplace_cache[ngy]();
+  
+  // Factorise the matrices now, so each solve only does substitution
+  int ys, ye;
+  laplace_yrange(ys, ye);
+  
+  #pragma omp parallel for
+  for(int jy=ys;jy<=ye;jy++)
+    laplace_factorise(cache[jy], jy, flags, a, c);
+}
+
+LaplaceSolver::~LaplaceSolver()
+{
+  if(cache != NULL)
+    laplace_cache_free(cache, ngy);
+}
+
+void LaplaceSolver::setFlags(int f)
+{
+  flags = f;
+}
+
+void LaplaceSolver::setCoefA(const Field2D *f)
+{
+  a = f;
+}
+
+void LaplaceSolver::setCoefC(const Field2D *f)
+{
+  c = f;
+}
+
+int LaplaceSolver::solve(const Field3D &b, Field3D &x)
+{
+  // Slices whose coefficients or flags have changed are factorised again
+  return invert_laplace_3d(b, x, flags, a, c, cache);
+}
+
+const Field3D LaplaceSolver::solve(const Field3D &b)
+{
+  Field3D x;
+  
+  solve(b, x);
+  return x;
+}
+
@@ -30,10 +30,6 @@
 #ifndef __LAPLACE_H__
 #define __LAPLACE_H__
 
-#ifdef PETSC
-#define PVEC_REAL_MPI_TYPE MPI_DOUBLE
-#endif
-
 #include "fieldperp.h"
 #include "field3d.h"
 #include "field2d.h"
@@ -69,5 +65,44 @@ int invert_laplace(const Field3D &b, Field3D &x, int flags, const Field2D *a, co
 /// More readable API for calling Laplacian inversion. Returns x
 const Field3D invert_laplace(const Field3D &b, int flags, const Field2D *a = NULL, const Field2D *c=NULL);
 
+struct laplace_cache;
+
+/// Laplacian inversion with coefficients which don't change often
+/*!
+ * The matrices for every Y slice and Z mode are factorised when this
+ * is created, so each solve only does the forward and back substitution.
+ * The flags and the values of a and c are checked on each solve, and
+ * slices where they have changed are factorised again.
+ *
+ * Factorised matrices are only kept by the serial 2nd-order solver
+ * (NXPE = 1). Otherwise this does the same as invert_laplace.
+ *
+ * Example:
+ *   LaplaceSolver *phisolver = new LaplaceSolver(INVERT_AC_IN_GRAD, NULL, &Ni0);
+ *   ...
+ *   phi = phisolver->solve(rho/Ni0);
+ */
+class LaplaceSolver {
+ public:
+  LaplaceSolver(int flags, const Field2D *a = NULL, const Field2D *c = NULL);
+  ~LaplaceSolver();
+  
+  void setFlags(int flags);
+  void setCoefA(const Field2D *a);
+  void setCoefC(const Field2D *c);
+  
+  int solve(const Field3D &b, Field3D &x);
+  const Field3D solve(const Field3D &b);
+  
+ private:
+  LaplaceSolver(const LaplaceSolver &l); // Not copyable
+  LaplaceSolver & operator=(const LaplaceSolver &l);
+
+  int flags;
+  const Field2D *a, *c;
+  
+  laplace_cache *cache; ///< Factorised matrices, one per Y index
+};
+
 #endif // __LAPLACE_H__
 
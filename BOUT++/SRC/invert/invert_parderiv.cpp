@@ -1,36 +1,39 @@
 /************************************************************************
  * Inversion of parallel derivatives
  * Intended for use in preconditioner for reduced MHD
- * 
- * Inverts a matrix of the form 
+ *
+ * Inverts a matrix of the form
  *
  * (A + B * Grad2_par2) x = r
- * 
+ *
+ * or (A + B * Grad_par(K * Grad_par)) x = r
+ *
  * Stages:
  * - Problem trivially parallel in X, so gather all data for fixed X onto
- *   a single processor. Split MXSUB locations between NYPE processors
- * - Use nearest neighbour for twist-shift location.
- *   This splits the problem into one or more (cyclic) tridiagonal problems
- *   (number depends on the q value)
+ *   a single processor, using the Y communicator for this X processor.
+ *   Split MXSUB locations between NYPE processors
+ * - Fourier transform in Z, so each (x, kz) is a separate problem and
+ *   the twist-shift is an exact phase shift
+ * - Follow the grid topology to split Y into field lines: closed (cyclic)
+ *   in the core, open in the SOL and private flux regions
  * - Solve each of these tridiagonal systems O(Nz*Ny)
- * - Scatter data back 
+ * - Scatter data back
  *
  * Author: Ben Dudson, University of York, June 2009
- * 
+ *
  * Known issues:
  * ------------
  *
- * - Assumes all points are in the core: no handling of SOL / PF regions
  * - This algorithm can only use MXSUB processors, so if NYPE > MXSUB
  *   (i.e. Np > Nx) then efficiency will fall.
- * - When higher-order interpolation is used at the twist-shift location,
- *   errors can become large
- * 
+ * - Open field lines are solved with zero value in the guard cells
+ *   beyond the ends, and limiters aren't included.
+ *
  **************************************************************************
  * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
  *
  * Contact: Ben Dudson, bd512@york.ac.uk
- * 
+ *
  * This file is part of BOUT++.
  *
  * BOUT++ is free software: you can redistribute it and/or modify
@@ -56,194 +59,261 @@
 #include "utils.h"
 #include "meshtopology.h"
 #include "comm_group.h" // Gather/scatter operations
+#include "fft.h"
+#include "dcomplex.h"
 
-#include "lapack_routines.h" // For tridiagonal inversions
+#include <math.h>
+#include <vector>
 
-#define PVEC_REAL_MPI_TYPE MPI_DOUBLE
+using std::vector;
 
-namespace invpar { 
+namespace invpar {
 
   /***********************************************************************
-   *                          COMMUNICATIONS
-   * 
-   * Need to perform a load of gather and scatter operations simultaneously
-   * For now, use MPI_Gather etc. to do each operation in turn.
+   *                          TOPOLOGY
+   *
+   * The same connections as topology() in meshtopology.cpp, but in
+   * global y indices so that whole field lines can be followed
    *
    ***********************************************************************/
-  
-  static bool comms_init = false; ///< Signals whether the comms are set up
-  MPI_Comm comm_in; ///< Communicator
 
-  /// Initialise communicators
-  bool init_comms()
+  /// A field line through the gathered y points
+  struct ParLine {
+    vector<int> y;  ///< Global y indices, in order along the line
+    bool closed;    ///< Last point connected to the first
+    bool shifted;   ///< Twist-shift between the last and first points
+  };
+
+  /// Connect the top of ylow to the bottom of yup
+  static void link(vector<int> &up, vector<bool> &ts, int ylow, int yup, bool shift = false)
+  {
+    if((ylow < 0) || (ylow >= MY) || (yup < 0) || (yup >= MY))
+      return; // As in set_connection
+    up[ylow] = yup;
+    ts[ylow] = shift;
+  }
+
+  /// Split the y points at global x index xglobal into field lines
+  static void par_lines(int xglobal, vector<ParLine> &lines)
   {
-    if(comms_init)
-      return true; // Already initialised
-    
-    int ype0 = YPROC(jyseps1_1+1); // The processor at beginning of twist shift
-    
-    if(NXPE > 1) {
-      /// Create a group and communicator for this X location
-      MPI_Group group_world;
-      
-      MPI_Comm_group(MPI_COMM_WORLD, &group_world); // Get the entire group
-      
-      bout_error("SORRY: invert_parderivs can't cope with NXPE > 1 yet\n");
+    vector<int> up(MY);
+    vector<bool> ts(MY, false);
+    for(int y=0;y<MY;y++)
+      up[y] = (y < MY-1) ? y+1 : -1;
+
+    if(jyseps2_1 == jyseps1_2) {
+      // Single null
+      if(xglobal < ixseps1) {
+	link(up, ts, jyseps2_2, jyseps1_1+1, true); // Core
+	link(up, ts, jyseps1_1, jyseps2_2+1);       // PF
+      }
     }else {
-      // All processors. May need to re-number 
-      
-      if(ype0 == 0) { 
-	comm_in = MPI_COMM_WORLD;
-      }else {
-	// Rotate around so rank0 is at beginning of twist shift
-	
-	bout_error("SORRY: invert_parderivs can't cope with this topology yet\n");
+      // Double null. ixseps1 is the lower X-point, ixseps2 the upper
+      int ixseps_lower = ixseps1, ixseps_upper = ixseps2;
+
+      if(xglobal < ixseps_lower) {
+	link(up, ts, jyseps2_2, jyseps1_1+1, ixseps1 <= ixseps2);
+	link(up, ts, jyseps1_1, jyseps2_2+1);
+      }
+      if(xglobal < ixseps_upper) {
+	link(up, ts, jyseps2_1, jyseps1_2+1, ixseps1 > ixseps2);
+	link(up, ts, jyseps1_2, jyseps2_1+1);
       }
+      // Upper targets
+      if((ny_inner > 0) && (ny_inner < MY))
+	up[ny_inner-1] = -1;
     }
 
-    comms_init = true;
+    vector<bool> down(MY, false); // Has a connection below
+    for(int y=0;y<MY;y++)
+      if(up[y] >= 0)
+	down[up[y]] = true;
+
+    lines.clear();
+    vector<bool> done(MY, false);
+
+    // Open lines, starting at a target
+    for(int y0=0;y0<MY;y0++) {
+      if(down[y0])
+	continue;
+      ParLine l;
+      l.closed = l.shifted = false;
+      for(int y=y0; y >= 0; y=up[y]) {
+	l.y.push_back(y);
+	done[y] = true;
+      }
+      lines.push_back(l);
+    }
 
-    return true;
+    // Closed lines, starting after the twist-shift if there is one
+    for(int pass=0;pass<2;pass++)
+      for(int y0=0;y0<MY;y0++) {
+	if(done[y0] || ((pass == 0) && !ts[y0]))
+	  continue;
+	ParLine l;
+	l.closed = true;
+	l.shifted = (pass == 0) && TwistShift;
+	int y = (pass == 0) ? up[y0] : y0;
+	do {
+	  l.y.push_back(y);
+	  done[y] = true;
+	  y = up[y];
+	}while(!done[y]);
+	lines.push_back(l);
+      }
   }
-  
+
   /***********************************************************************
    *                          INVERSION ROUTINES
-   * 
-   * 
+   *
+   *
    ***********************************************************************/
 
-  /// Solve the cyclic problem for core points
+  /// Solve one field line for all kz
   /*!
-   * Assumes that the twist-shift location is between the last and first point
+   * The matrix is real, so is factorised once and the real and imaginary
+   * parts of each kz are solved together as 2*nk right hand sides. For closed
+   * lines the cyclic terms are added with the Sherman-Morrison formula; the
+   * twist-shift makes the corner terms depend on kz, but not their product
    *
-   * @param[in]    ysize    Number of y points
-   * @param[in]    coeffs   Matrix coefficients
+   * @param[in]    line     Field line to solve
    * @param[in]    xpos     X location. Needed for shift
-   * @param[in]    data     Data to be inverted. Input is interleaved
-   * @param[out]   result
+   * @param[in]    coef     Gathered a, b, c coefficients. Global y at coef[3*y]
+   * @param[in]    rhs      Gathered Fourier coefficients. Global y at rhs[2*nk*y]
+   * @param[out]   result   Fourier coefficients of the result, same layout as rhs
    */
-  void cyclic_solve(int ysize, int xpos, real *data, real *result, bool coef3d = false)
+  static void line_solve(const ParLine &line, int xpos, const real *coef, const real *rhs, real *result)
   {
-#ifdef CHECK
-    msg_stack.push("cyclic_solve(%d, %d)", ysize, xpos);
-#endif
+    int n = line.y.size();
+    int nk = ncz/2 + 1;
+    int m = 2*nk; // Number of right hand sides
+
+    static vector<real> a, b, c, gam, bet, x, z0, z1;
+    if((int) a.size() < n) {
+      a.resize(n); b.resize(n); c.resize(n);
+      gam.resize(n); bet.resize(n);
+      z0.resize(n); z1.resize(n);
+    }
+    if((int) x.size() < n*m)
+      x.resize(n*m);
+
+    for(int i=0;i<n;i++) {
+      int y = line.y[i];
+      a[i] = coef[3*y];
+      b[i] = coef[3*y+1];
+      c[i] = coef[3*y+2];
+      for(int j=0;j<m;j++)
+	x[i*m + j] = rhs[m*y + j];
+    }
 
-    int tshift = ROUND(ShiftAngle[xpos] / dz); // Nearest neighbour
-
-    static int ylen = 0;
-    static bool *done; // Record whether a particular location has been inverted
-    static real *avec, *bvec, *cvec; // Matrix coefficients
-    static real *rvec, *xvec;
-    
-    if(ysize > ylen) {
-      // Initialise
-      if(ylen > 0) {
-	delete[] done;
-	delete[] avec;
-	delete[] bvec;
-	delete[] cvec;
-	delete[] rvec;
-	delete[] xvec;
-      }
-      done = new bool[ncz];
-      // Allocate largest possible array
-      avec = new real[ysize * ncz];
-      bvec = new real[ysize * ncz];
-      cvec = new real[ysize * ncz];
-      rvec = new real[ysize * ncz];
-      xvec = new real[ysize * ncz];
-
-      ylen = ysize;
+    real g = 0.0;
+    if(line.closed) {
+      if(n < 3)
+	bout_error("ERROR: Closed field line too short in invert_parderiv\n");
+      // Corners are alpha = c[n-1]*exp(ik*shift) and beta = a[0]*exp(-ik*shift)
+      g = -b[0];
+      b[0] -= g;
+      b[n-1] -= c[n-1]*a[0]/g;
     }
 
-    for(int i=0;i<ncz;i++)
-      done[i] = false;
-    
-    int z0 = 0; // Starting z location
-    do {
-      /////////////////////////////////////////////
-      // Get the matrix coefficients. Could invert
-      // everything in-place, but simpler to use new arrays
-      
-      int zpos = z0;
-      int ind = 0; // Index in matrix
-      do {
-	if(coef3d) {
-	  // Matrix coefficients depend on Z
-	  for(int y=0;y<ysize;y++) {
-	    avec[ind] = data[(4*ncz)*y         + zpos]; 
-	    bvec[ind] = data[(4*ncz)*y + ncz   + zpos];
-	    cvec[ind] = data[(4*ncz)*y + 2*ncz + zpos];
-	    
-	    rvec[ind] = data[(4*ncz)*y + 3*ncz + zpos];
-	    
-	    ind++;
-	  }
-	}else {
-	  // Matrix coefficients 2D. Each y location has [a,b,c,<RHS>]
-	  for(int y=0;y<ysize;y++) {
-	    avec[ind] = data[(3+ncz)*y]; 
-	    bvec[ind] = data[(3+ncz)*y+1];
-	    cvec[ind] = data[(3+ncz)*y+2];
-	    
-	    rvec[ind] = data[(3+ncz)*y + 3 + zpos];
-	    ind++;
-	  }
-	}
+    // Factorise
+    bet[0] = 1.0 / b[0];
+    for(int i=1;i<n;i++) {
+      gam[i] = c[i-1]*bet[i-1];
+      bet[i] = 1.0 / (b[i] - a[i]*gam[i]);
+    }
 
-	done[zpos] = true; // Mark as solved
+    // Solve for all right hand sides
+    for(int j=0;j<m;j++)
+      x[j] *= bet[0];
+    for(int i=1;i<n;i++)
+      for(int j=0;j<m;j++)
+	x[i*m + j] = (x[i*m + j] - a[i]*x[(i-1)*m + j])*bet[i];
+    for(int i=n-2;i>=0;i--)
+      for(int j=0;j<m;j++)
+	x[i*m + j] -= gam[i+1]*x[(i+1)*m + j];
+
+    if(line.closed) {
+      // Responses to unit vectors at each end
+      for(int i=0;i<n;i++)
+	z0[i] = z1[i] = 0.0;
+      z0[0] = 1.0;
+      z1[n-1] = 1.0;
+      z0[0] *= bet[0];
+      for(int i=1;i<n;i++) {
+	z0[i] = (z0[i] - a[i]*z0[i-1])*bet[i];
+	z1[i] = (z1[i] - a[i]*z1[i-1])*bet[i];
+      }
+      for(int i=n-2;i>=0;i--) {
+	z0[i] -= gam[i+1]*z0[i+1];
+	z1[i] -= gam[i+1]*z1[i+1];
+      }
 
-	// Get the next z index
-	zpos = (((zpos + tshift) % ncz) + ncz) % ncz; // Next location
+      real shift = line.shifted ? ShiftAngle[xpos] : 0.0;
+      for(int k=0;k<nk;k++) {
+	real kwave = k*2.0*PI/zlength; // wave number is 1/[rad]
+	dcomplex phase(cos(kwave*shift), sin(kwave*shift));
+	dcomplex alpha = phase*c[n-1];
+	dcomplex beta = dcomplex(phase.Real(), -phase.Imag())*a[0];
 
-	if((zpos != z0) && done[zpos]) {
-	  // Somehow hit a different fieldline. Should never happen
-	  bout_error("ERROR: Crossed streams in invpar::cyclic_solve!\n");
-	}
-	
-      }while(zpos != z0);
-      
-      /////////////////////////////////////////////
-      // Solve cyclic tridiagonal system
-      
-      cyclic_tridag(avec, bvec, cvec, rvec, xvec, ind);
-      
-      /////////////////////////////////////////////
-      // Copy result back
-      
-      zpos = z0;
-      ind = 0;
-      do {
-	for(int y=0;y<ysize;y++) {
-	  result[y*ncz + zpos] = xvec[ind];
-	  ind++;
-	}
-	zpos = (((zpos + tshift) % ncz) + ncz) % ncz; // Next location
-      }while(zpos != z0);
+	// z = A^-1 u, u = (g, 0, ..., 0, alpha)
+	dcomplex zfirst = g*z0[0] + alpha*z1[0];
+	dcomplex zlast  = g*z0[n-1] + alpha*z1[n-1];
+
+	dcomplex xfirst(x[2*k], x[2*k+1]);
+	dcomplex xlast(x[(n-1)*m + 2*k], x[(n-1)*m + 2*k+1]);
 
-      /////////////////////////////////////////////
+	dcomplex fact = (xfirst + beta*xlast/g) / (1.0 + zfirst + beta*zlast/g);
 
-      // Find the next place to start
-      z0 = -1;
-      for(int i=0;i<ncz;i++) {
-	if(!done[i])
-	  z0 = i;
+	for(int i=0;i<n;i++) {
+	  dcomplex zi = g*z0[i] + alpha*z1[i];
+	  dcomplex d = fact*zi;
+	  x[i*m + 2*k]   -= d.Real();
+	  x[i*m + 2*k+1] -= d.Imag();
+	}
       }
-    }while(z0 != -1); // Keep going until everything's been inverted
-    
-#ifdef CHECK
-    msg_stack.pop();
-#endif
+    }
+
+    for(int i=0;i<n;i++) {
+      int y = line.y[i];
+      for(int j=0;j<m;j++)
+	result[m*y + j] = x[i*m + j];
+    }
   }
 
-  /***********************************************************************
-   *                         EXTERNAL INTERFACE
-   * 
-   * 
-   ***********************************************************************/
-  
-  /// Parallel inversion routine
-  const Field3D invert_parderiv(const Field2D &A, const Field2D &B, const Field3D &r)
+  /// Solve all the field lines at one x, from data gathered onto this processor
+  /*!
+   * Each processor sends coefficients for its MYSUB points, followed by
+   * the Fourier coefficients of the RHS
+   */
+  static void x_solve(int xpos, const real *data, real *result)
+  {
+    static vector<real> coef, rhs;
+    static vector<ParLine> lines;
+
+    int nk = ncz/2 + 1;
+    int nvals = 3 + 2*nk; // Values for each y point
+
+    coef.resize(3*MY);
+    rhs.resize(2*nk*MY);
+
+    // Unpack into global y order
+    for(int p=0;p<NYPE;p++) {
+      const real *d = data + p*MYSUB*nvals;
+      for(int i=0;i<3*MYSUB;i++)
+	coef[3*p*MYSUB + i] = d[i];
+      for(int i=0;i<2*nk*MYSUB;i++)
+	rhs[2*nk*p*MYSUB + i] = d[3*MYSUB + i];
+    }
+
+    par_lines(XGLOBAL(xpos), lines);
+
+    for(unsigned int l=0;l<lines.size();l++)
+      line_solve(lines[l], xpos, &coef[0], &rhs[0], result);
+  }
+
+  /// Parallel inversion routine, given matrix coefficients
+  static const Field3D par_solve(const Field2D &acoef, const Field2D &bcoef, const Field2D &ccoef, const Field3D &r)
   {
     static real *senddata;
     static real *recvdata;
@@ -260,84 +330,63 @@ namespace invpar {
     int xe = (ODATA_DEST < 0) ? ngx-1 : (ngx-1 - MXG);
 
     int nxsolve = xe - xs + 1; // Number of X points to solve
-    
+
+    int nk = ncz/2 + 1; // Number of Fourier modes
+    int nvals = 3 + 2*nk; // Values for each y point
+
     if(!initialised) {
       // Allocate working memory
-      senddata = new real[nxsolve * MYSUB * (3 + ncz) ]; // Problem data sent out
-      recvdata = new real[MY * (3+ncz)];  // Problem data received (to be solved)
-      resultdata = new real[MY*ncz];  // Inverted result
+      senddata = new real[nxsolve * MYSUB * nvals ]; // Problem data sent out
+      recvdata = new real[MY * nvals];  // Problem data received (to be solved)
+      resultdata = new real[MY*2*nk];  // Inverted result
       handles = new Comm_handle_t[NYPE];
       initialised = true;
-
-      // Initialise communications
-      init_comms();
     }
-    
-    Field2D sg = sqrt(g_22); // Needed for first Y derivative
 
     int x0 = xs; ///< Starting x of this round of inversions
     int offset  = 0; // Location in data array
     for(int xpos=xs; xpos <= xe; xpos++) {
-      
+
       /// Calculate matrix coefficients
       real *dptr = senddata + offset; // Start of this chunk of data
-      
-      int off0 = offset; // This for debugging only
 
       // First all the matrix coefficients (2D only in this case)
       for(int j=jstart;j<=jend;j++) {
-	// See Grad2_par2 in difops.cpp for these coefficients
-	real coeff1 = (1./sg[xpos][j+1] - 1./sg[xpos][j-1])/(4.*SQ(dy[xpos][j])) / sg[xpos][j];
-	real coeff2 = 1. / (g_22[xpos][j] * SQ(dy[xpos][j])); // Second derivative
-	
-	senddata[offset] = B[xpos][j] * (coeff2 - coeff1); // a coefficient (y-1)
-	offset++;
-	
-	senddata[offset] = A[xpos][j] + -2.*B[xpos][j]*coeff2;  // b coefficient (diagonal)
-	offset++;
-	
-	senddata[offset] = B[xpos][j] * (coeff2 + coeff1); // c coefficient (y+1);
-	offset++;
-
-	// Then the vector to be inverted (3D)
-	for(int k=0;k<ncz;k++) {
-	  senddata[offset] = r[xpos][j][k];
-	  offset++;
-	}
+	senddata[offset]   = acoef[xpos][j]; // a coefficient (y-1)
+	senddata[offset+1] = bcoef[xpos][j]; // b coefficient (diagonal)
+	senddata[offset+2] = ccoef[xpos][j]; // c coefficient (y+1);
+	offset += 3;
       }
 
-      // Check the amount of data is correct
-      if(offset - off0 != MYSUB * (3 + ncz)) {
-	output.write("In invert_parderiv: wrong amount of data: %d, %d\n", offset - off0, MYSUB * (3 + ncz));
-	bout_error("aborting\n");
-      }
-      
+      // Then the Fourier transform of the vector to be inverted
+      rfft_many(r.begin() + (xpos*ngy + jstart)*ngz, ncz, MYSUB, ngz, (dcomplex*) (senddata + offset));
+      offset += 2*nk*MYSUB;
+
       /// Gather data onto processors
-      
+
       int yproc = (xpos-x0) % NYPE; // the destination processor
 
       // Start a gather operation (blocking or nonblocking)
-      Comm_gather_start(dptr, MYSUB * (3 + ncz), PVEC_REAL_MPI_TYPE,
+      Comm_gather_start(dptr, MYSUB * nvals, PVEC_REAL_MPI_TYPE,
 			recvdata,
-			yproc, comm_in,
+			yproc, comm_y,
 			handles+yproc);
 
       if((yproc == (NYPE-1)) || (xpos == xe)) {
 	// Either each processor has a chunk of data, or run out of data
-	
+
 	int nsolve = yproc + 1; // Number of x slice being solved
 
 	/// Perform inversion if data is available
-	if(nsolve >= PE_YIND) {
+	if(nsolve > PE_YIND) {
 	  // Wait for the gather to finish
 	  if(!Comm_wait(handles+PE_YIND)) {
 	    bout_error("Gather failed\n");
 	  }
-	  
-	  cyclic_solve(NYPE * MYSUB,  // Number of y locations
-		       x0 + PE_YIND,  // The x index being solved
-		       recvdata,      // Interleaved coefficients and data
-		       resultdata);
+
+	  x_solve(x0 + PE_YIND,  // The x index being solved
+		  recvdata,      // Coefficients and data from each processor
+		  resultdata);
 	}
 
 	// Need to wait for all the gathers to finish (frees memory)
@@ -346,9 +395,9 @@ namespace invpar {
 	// Scatter result back
 	for(int xrec = x0; xrec <= xpos; xrec++) { // Loop over the current range
 	  yproc = (xrec-x0) % NYPE;
-	  Comm_scatter_start(resultdata, MYSUB*ncz, PVEC_REAL_MPI_TYPE,
-			     senddata + (xrec-xs)*MYSUB*ncz, // Put result back into senddata
-			     yproc, comm_in,
+	  Comm_scatter_start(resultdata, MYSUB*2*nk, PVEC_REAL_MPI_TYPE,
+			     senddata + (xrec-xs)*MYSUB*2*nk, // Put result back into senddata
+			     yproc, comm_y,
 			     handles+yproc);
 	}
 
@@ -358,21 +407,19 @@ namespace invpar {
 	x0 += NYPE; // Shift starting place for next time
       }
     }
-    
-    Field3D result;
-    result.Allocate();
 
-    // Result is now in senddata. Copy across
-    int ind = 0;
+    // Points not solved for (y guard cells) are left unchanged
+    Field3D result = r;
+    real *d = result.begin();
+
+    // Result is now in senddata. Transform back
     for(int xpos=xs; xpos <= xe; xpos++) {
-      for(int j=jstart;j<=jend;j++) {
-	for(int k=0;k<ncz;k++) {
-	  result[xpos][j][k] = senddata[ind];
-	  ind++;
-	}
-      }
+      real *line = d + (xpos*ngy + jstart)*ngz;
+      irfft_many((dcomplex*) (senddata + (xpos-xs)*MYSUB*2*nk), ncz, MYSUB, line, ngz);
+      for(int j=0;j<MYSUB;j++)
+	line[j*ngz + ncz] = line[j*ngz];
     }
-    
+
 #ifdef CHECK
     msg_stack.pop();
 #endif
@@ -381,20 +428,47 @@ namespace invpar {
     return result;
   }
 
+  /***********************************************************************
+   *                         EXTERNAL INTERFACE
+   *
+   *
+   ***********************************************************************/
+
+  const Field3D invert_parderiv(const Field2D &A, const Field2D &B, const Field3D &r)
+  {
+    Field2D a, b, c;
+    a.Allocate(); b.Allocate(); c.Allocate();
+
+    Field2D sg = sqrt(g_22); // Needed for first Y derivative
+
+    for(int xpos=0;xpos<ngx;xpos++)
+      for(int j=jstart;j<=jend;j++) {
+	// See Grad2_par2 in difops.cpp for these coefficients
+	real coeff1 = (1./sg[xpos][j+1] - 1./sg[xpos][j-1])/(4.*SQ(dy[xpos][j])) / sg[xpos][j];
+	real coeff2 = 1. / (g_22[xpos][j] * SQ(dy[xpos][j])); // Second derivative
+
+	a[xpos][j] = B[xpos][j] * (coeff2 - coeff1);
+	b[xpos][j] = A[xpos][j] + -2.*B[xpos][j]*coeff2;
+	c[xpos][j] = B[xpos][j] * (coeff2 + coeff1);
+      }
+
+    return par_solve(a, b, c, r);
+  }
+
   const Field3D invert_parderiv(real val, const Field2D &B, const Field3D &r)
   {
     Field2D A;
     A = val;
     return invert_parderiv(A, B, r);
   }
-  
+
   const Field3D invert_parderiv(const Field2D &A, real val, const Field3D &r)
   {
     Field2D B;
     B = val;
     return invert_parderiv(A, B, r);
   }
-  
+
   const Field3D invert_parderiv(real val, real val2, const Field3D &r)
   {
     Field2D A, B;
@@ -402,5 +476,37 @@ namespace invpar {
     B = val2;
     return invert_parderiv(A, B, r);
   }
-  
+
+  const Field3D invert_pardiff(const Field2D &A, const Field2D &B, const Field2D &K, const Field3D &r)
+  {
+    Field2D a, b, c;
+    a.Allocate(); b.Allocate(); c.Allocate();
+
+    Field2D sg = sqrt(g_22);
+
+    for(int xpos=0;xpos<ngx;xpos++)
+      for(int j=jstart;j<=jend;j++) {
+	// Flux K*Grad_par at j+1/2 and j-1/2
+	real cp = 0.5*(K[xpos][j] + K[xpos][j+1])
+	  / (0.25*(sg[xpos][j] + sg[xpos][j+1])*(dy[xpos][j] + dy[xpos][j+1]));
+	real cm = 0.5*(K[xpos][j] + K[xpos][j-1])
+	  / (0.25*(sg[xpos][j] + sg[xpos][j-1])*(dy[xpos][j] + dy[xpos][j-1]));
+	real fac = B[xpos][j] / (sg[xpos][j]*dy[xpos][j]);
+
+	a[xpos][j] = fac*cm;
+	b[xpos][j] = A[xpos][j] - fac*(cp + cm);
+	c[xpos][j] = fac*cp;
+      }
+
+    return par_solve(a, b, c, r);
+  }
+
+  const Field3D invert_pardiff(real val, real val2, const Field2D &K, const Field3D &r)
+  {
+    Field2D A, B;
+    A = val;
+    B = val2;
+    return invert_pardiff(A, B, K, r);
+  }
+
 } // End of namespace invpar
@@ -5,13 +5,15 @@
  * Inverts a matrix of the form 
  *
  * A + B * Grad2_par2
+ *
+ * or A + B * Grad_par(K * Grad_par)
  * 
  * Stages:
  * - Problem trivially parallel in X, so gather all data for fixed X onto
  *   a single processor. Split MXSUB locations between NYPE processors
- * - Use nearest neighbour for twist-shift location.
- *   This splits the problem into one or more (cyclic) tridiagonal problems
- *   (number depends on the q value)
+ * - Fourier transform in Z, so the twist-shift is a phase shift
+ * - Follow the topology to split each (x, kz) into (cyclic) tridiagonal
+ *   problems along field lines
  * - Solve each of these tridiagonal systems O(Nz*Ny)
  * - Scatter data back 
  *
@@ -48,9 +50,14 @@ namespace invpar {
   const Field3D invert_parderiv(real val, const Field2D &B, const Field3D &r);
   const Field3D invert_parderiv(const Field2D &A, real val, const Field3D &r);
   const Field3D invert_parderiv(real val, real val2, const Field3D &r);
+
+  /// Inverts (A + B * Grad_par(K * Grad_par)). K must be set in the Y guard cells
+  const Field3D invert_pardiff(const Field2D &A, const Field2D &B, const Field2D &K, const Field3D &r);
+  const Field3D invert_pardiff(real val, real val2, const Field2D &K, const Field3D &r);
 }
 
 using invpar::invert_parderiv;
+using invpar::invert_pardiff;
 
 
 #endif // __INV_PAR_H__
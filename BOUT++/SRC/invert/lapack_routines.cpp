@@ -36,6 +36,7 @@
 
 #include "globals.h"
 #include "dcomplex.h"
+#include "lapack_routines.h"
 
 #ifdef LAPACK
 
@@ -63,6 +64,7 @@ int tridag(const dcomplex *a, const dcomplex *b, const dcomplex *c, const dcompl
   // Lapack routines overwrite their inputs, so need to copy
   static int len = 0;
   static fcmplx *dl, *d, *du, *x;
+  #pragma omp threadprivate(len, dl, d, du, x)
 
   if(n > len) {
     // Allocate more memory (as a single block)
@@ -134,6 +136,7 @@ bool tridag(const real *a, const real *b, const real *c, const real *r, real *u,
   // Lapack routines overwrite their inputs, so need to copy
   static int len = 0;
   static real *dl, *d, *du, *x;
+  #pragma omp threadprivate(len, dl, d, du, x)
 
   if(n > len) {
     // Allocate more memory (as a single block)
@@ -200,6 +203,7 @@ void cyclic_tridag(real *a, real *b, real *c, real *r, real *x, int n)
   
   static int len = 0;
   static real *u, *z;
+  #pragma omp threadprivate(len, u, z)
   
   if(n > len) {
     if(len > 0) {
@@ -276,6 +280,7 @@ void cband_solve(dcomplex **a, int n, int m1, int m2, dcomplex *b)
   static int *ipiv;
   static int len = 0, alen = 0;
   static fcmplx *x, *AB; 
+  #pragma omp threadprivate(ipiv, len, alen, x, AB)
 
   if(alen < ldab*n) {
     if(alen > 0)
@@ -338,6 +343,7 @@ int tridag(const dcomplex *a, const dcomplex *b, const dcomplex *c, const dcompl
   dcomplex bet;
   static dcomplex *gam;
   static int len = 0;
+  #pragma omp threadprivate(gam, len)
 
   if(n > len) {
     if(len > 0)
@@ -379,6 +385,7 @@ bool tridag(const real *a, const real *b, const real *c, const real *r, real *x,
   real bet;
   static real *gam;
   static int len = 0;
+  #pragma omp threadprivate(gam, len)
   
   if(n > len) {
     if(len > 0)
@@ -420,6 +427,7 @@ void cyclic_tridag(real *a, real *b, real *c, real *r, real *x, int n)
   
   static int len = 0;
   static real *u, *z;
+  #pragma omp threadprivate(len, u, z)
   
   if(n > len) {
     if(len > 0) {
@@ -539,6 +547,7 @@ void cband_solve(dcomplex **a, int n, int m1, int m2, dcomplex *b)
   static dcomplex **al;
   static unsigned long *indx;
   static int an = 0, am1 = 0; // Allocated sizes
+  #pragma omp threadprivate(al, indx, an, am1)
   dcomplex d;
   
   if(an < n) {
@@ -568,3 +577,132 @@ void cband_solve(dcomplex **a, int n, int m1, int m2, dcomplex *b)
 
 #endif // LAPACK
 
+
+///////////////////////////////////////////////////////////////////////
+// Batched tridiagonal solver. Used with or without LAPACK
+///////////////////////////////////////////////////////////////////////
+
+/// Factorises m complex tridiagonal systems of size n
+/*!
+ * Uses the Thomas algorithm without pivoting, so returns false
+ * if there is a zero pivot. Bands are stored as [i*m + k] for
+ * element i of system k.
+ */
+bool tridag_factor_many(const dcomplex *a, const dcomplex *b, const dcomplex *c, int n, int m, tridag_factors &f)
+{
+  int i, k;
+  bool ok = true;
+
+  if(n*m > f.len) {
+    // Allocate more memory (as a single block)
+    if(f.len > 0)
+      delete[] f.ar;
+    
+    f.ar = new real[6*n*m];
+    f.ai = f.ar + n*m;
+    f.gr = f.ai + n*m;
+    f.gi = f.gr + n*m;
+    f.dr = f.gi + n*m;
+    f.di = f.dr + n*m;
+    
+    f.len = n*m;
+  }
+  f.n = n;
+  f.m = m;
+  
+  // dcomplex is stored as (real, imag) pairs
+  const real *ac = (const real*) a;
+  const real *bc = (const real*) b;
+  const real *cc = (const real*) c;
+
+  // First row: bet = b[0]
+  for(k=0;k<m;k++) {
+    real br = bc[2*k], bi = bc[2*k+1];
+    real mag = br*br + bi*bi;
+    if(mag == 0.0) {
+      ok = false;
+      mag = 1.0;
+    }
+    f.ar[k] = 0.0;
+    f.ai[k] = 0.0;
+    f.gr[k] = 0.0;
+    f.gi[k] = 0.0;
+    f.dr[k] =  br / mag;
+    f.di[k] = -bi / mag;
+  }
+
+  for(i=1;i<n;i++) {
+    int j = i*m; // Start of row i
+    
+    for(k=0;k<m;k++) {
+      // gam = c[i-1] / bet
+      real cr = cc[2*(j-m+k)], ci = cc[2*(j-m+k)+1];
+      real gr = cr*f.dr[j-m+k] - ci*f.di[j-m+k];
+      real gi = cr*f.di[j-m+k] + ci*f.dr[j-m+k];
+      
+      // bet = b[i] - a[i]*gam
+      real ar = ac[2*(j+k)], ai = ac[2*(j+k)+1];
+      real br = bc[2*(j+k)]   - (ar*gr - ai*gi);
+      real bi = bc[2*(j+k)+1] - (ar*gi + ai*gr);
+      
+      real mag = br*br + bi*bi;
+      if(mag == 0.0) {
+	ok = false;
+	mag = 1.0;
+      }
+      
+      f.ar[j+k] = ar;
+      f.ai[j+k] = ai;
+      f.gr[j+k] = gr;
+      f.gi[j+k] = gi;
+      f.dr[j+k] =  br / mag;
+      f.di[j+k] = -bi / mag;
+    }
+  }
+
+  return ok;
+}
+
+/// Solves m systems factorised by tridag_factor_many
+/*!
+ * The RHS (rr, ri) is replaced by the solution. Each step is a loop over
+ * all the systems so that it vectorises
+ */
+void tridag_solve_many(const tridag_factors &f, real *rr, real *ri)
+{
+  int i, k;
+  int n = f.n, m = f.m;
+  
+  const real *ar = f.ar, *ai = f.ai;
+  const real *gr = f.gr, *gi = f.gi;
+  const real *dr = f.dr, *di = f.di;
+
+  // u[0] = r[0] / bet[0]
+  for(k=0;k<m;k++) {
+    real ur = rr[k]*dr[k] - ri[k]*di[k];
+    real ui = rr[k]*di[k] + ri[k]*dr[k];
+    rr[k] = ur;
+    ri[k] = ui;
+  }
+  
+  // u[i] = (r[i] - a[i]*u[i-1]) / bet[i]
+  for(i=1;i<n;i++) {
+    int j = i*m;
+    for(k=0;k<m;k++) {
+      real vr = rr[j+k] - (ar[j+k]*rr[j-m+k] - ai[j+k]*ri[j-m+k]);
+      real vi = ri[j+k] - (ar[j+k]*ri[j-m+k] + ai[j+k]*rr[j-m+k]);
+      rr[j+k] = vr*dr[j+k] - vi*di[j+k];
+      ri[j+k] = vr*di[j+k] + vi*dr[j+k];
+    }
+  }
+  
+  // u[i] -= gam[i+1]*u[i+1]
+  for(i=n-2;i>=0;i--) {
+    int j = i*m;
+    for(k=0;k<m;k++) {
+      real ur = rr[j+m+k], ui = ri[j+m+k];
+      rr[j+k] -= gr[j+m+k]*ur - gi[j+m+k]*ui;
+      ri[j+k] -= gr[j+m+k]*ui + gi[j+m+k]*ur;
+    }
+  }
+}
@@ -49,5 +49,24 @@ void cyclic_tridag(real *a, real *b, real *c, real *r, real *x, int n);
 /// Complex band matrix solver
 void cband_solve(dcomplex **a, int n, int m1, int m2, dcomplex *b);
 
+/// Factorised complex tridiagonal systems, for solving many at once
+/*!
+ * Element i of system k is at [i*m + k], with real and imaginary
+ * parts in separate arrays so that loops over systems vectorise.
+ * Set len = 0 before first use
+ */
+typedef struct {
+  int n, m;      ///< Size of each system, number of systems
+  int len;       ///< Allocated size of each array
+  real *ar, *ai; ///< Left of diagonal
+  real *gr, *gi; ///< Right of diagonal divided by pivot
+  real *dr, *di; ///< 1 / pivot
+}tridag_factors;
+
+/// Factorise m systems with bands stored as [i*m + k]. Returns false if a pivot is zero
+bool tridag_factor_many(const dcomplex *a, const dcomplex *b, const dcomplex *c, int n, int m, tridag_factors &f);
+/// Solve the factorised systems. RHS (real and imaginary parts) replaced by the result
+void tridag_solve_many(const tridag_factors &f, real *rr, real *ri);
+
 #endif // __LAPACK_ROUTINES_H__
 
@@ -59,6 +59,8 @@ const int OUT_SENT_IN  = 5;
 
 real Communicator::wtime = 0.0;
 
+std::vector<Communicator*> Communicator::active;
+
 /**************************************************************************
  * Global communicator options
  *
@@ -68,6 +70,7 @@ real Communicator::wtime = 0.0;
 bool Communicator::options_set = false;
 bool Communicator::async_send = false;
 bool Communicator::pre_post = false;
+bool Communicator::persistent = false;
 
 /**************************************************************************
  * Constructor / Destructor
@@ -80,11 +83,15 @@ Communicator::Communicator()
   send_cur = send_pending = false;
 
   first_time = true;
+  received = false;
 
   for(int i=0;i<6;i++) {
     request[i] = MPI_REQUEST_NULL;
     sendreq[i] = MPI_REQUEST_NULL;
+    precv[i] = psend[i] = MPI_REQUEST_NULL;
+    recv_active[i] = false;
   }
+  persist_set = false;
 
   ybufflen = xbufflen = 0;
 }
@@ -115,11 +122,15 @@ Communicator::Communicator(Communicator &copy)
   send_cur = send_pending = false;
 
   first_time = true;
+  received = false;
 
   for(int i=0;i<6;i++) {
     request[i] = MPI_REQUEST_NULL;
     sendreq[i] = MPI_REQUEST_NULL;
+    precv[i] = psend[i] = MPI_REQUEST_NULL;
+    recv_active[i] = false;
   }
+  persist_set = false;
 }
 
 Communicator::~Communicator()
@@ -128,6 +139,10 @@ Communicator::~Communicator()
 
   var_list.clear();
 
+  set_active(false);
+
+  cancel_requests();
+
   /// Free message buffers
   
   if(ybufflen > 0) {
@@ -160,9 +175,13 @@ void Communicator::add(FieldData &f)
     options.setSection("comms");
     options.get("async", async_send, false);
     options.get("pre_post", pre_post, false); 
+    options.get("persistent", persistent, false);
     options_set = true;
   }
   
+  // Message lengths will change
+  cancel_requests();
+
   // Add to the list
   var_list.push_back(&f);
 }
@@ -171,16 +190,15 @@ void Communicator::clear()
 {
   /// Free pointers to fields
 
+  cancel_requests();
+
   var_list.clear();
   
   /// Reset message flags
   
-  send_cur = send_pending = false;
-
-  for(int i=0;i<6;i++) {
-    request[i] = MPI_REQUEST_NULL;
-    sendreq[i] = MPI_REQUEST_NULL;
-  }
+  send_cur = false;
+  received = false;
+  set_active(false);
 }
 
 /**************************************************************************
@@ -194,6 +212,17 @@ void Communicator::post_receive()
   real *inbuff;
   int len;
   
+  if(persistent) {
+    if(!persist_set)
+      init_persistent();
+    for(int i=0;i<6;i++)
+      if(precv[i] != MPI_REQUEST_NULL) {
+	MPI_Start(&precv[i]);
+	recv_active[i] = true;
+      }
+    return;
+  }
+
   /// Post receive data from above (y+1)
 
   len = 0;
@@ -268,6 +297,110 @@ void Communicator::post_receive()
   }
 }
 
+/**************************************************************************
+ * Persistent requests. The same messages are sent every time, so
+ * setting persistent=true creates the requests once, and then just
+ * starts them in send() and post_receive()
+ **************************************************************************/
+
+void Communicator::init_persistent()
+{
+  int len;
+  
+  /// Receive from above (y+1), send up
+  
+  len = 0;
+  if(UDATA_INDEST != -1) {
+    len = msg_len(0, UDATA_XSPLIT, 0, MYG);
+    MPI_Recv_init(umsg_recvbuff, len, PVEC_REAL_MPI_TYPE, UDATA_INDEST,
+		  IN_SENT_DOWN, MPI_COMM_WORLD, &precv[0]);
+    MPI_Send_init(umsg_sendbuff, len, PVEC_REAL_MPI_TYPE, UDATA_INDEST,
+		  IN_SENT_UP, MPI_COMM_WORLD, &psend[0]);
+  }
+  if(UDATA_OUTDEST != -1) {
+    MPI_Recv_init(&umsg_recvbuff[len], msg_len(UDATA_XSPLIT, ngx, 0, MYG), PVEC_REAL_MPI_TYPE, 
+		  UDATA_OUTDEST, OUT_SENT_DOWN, MPI_COMM_WORLD, &precv[1]);
+    MPI_Send_init(&umsg_sendbuff[len], msg_len(UDATA_XSPLIT, ngx, 0, MYG), PVEC_REAL_MPI_TYPE, 
+		  UDATA_OUTDEST, OUT_SENT_UP, MPI_COMM_WORLD, &psend[1]);
+  }
+  
+  /// Receive from below (y-1), send down
+  
+  len = 0;
+  if(DDATA_INDEST != -1) {
+    len = msg_len(0, DDATA_XSPLIT, 0, MYG);
+    MPI_Recv_init(dmsg_recvbuff, len, PVEC_REAL_MPI_TYPE, DDATA_INDEST,
+		  IN_SENT_UP, MPI_COMM_WORLD, &precv[2]);
+    MPI_Send_init(dmsg_sendbuff, len, PVEC_REAL_MPI_TYPE, DDATA_INDEST,
+		  IN_SENT_DOWN, MPI_COMM_WORLD, &psend[2]);
+  }
+  if(DDATA_OUTDEST != -1) {
+    MPI_Recv_init(&dmsg_recvbuff[len], msg_len(DDATA_XSPLIT, ngx, 0, MYG), PVEC_REAL_MPI_TYPE,
+		  DDATA_OUTDEST, OUT_SENT_UP, MPI_COMM_WORLD, &precv[3]);
+    MPI_Send_init(&dmsg_sendbuff[len], msg_len(DDATA_XSPLIT, ngx, 0, MYG), PVEC_REAL_MPI_TYPE,
+		  DDATA_OUTDEST, OUT_SENT_DOWN, MPI_COMM_WORLD, &psend[3]);
+  }
+  
+  /// Left (x-1) and right (x+1)
+  
+  len = msg_len(0, MXG, 0, MYSUB);
+  if(IDATA_DEST != -1) {
+    MPI_Recv_init(imsg_recvbuff, len, PVEC_REAL_MPI_TYPE, IDATA_DEST,
+		  OUT_SENT_IN, MPI_COMM_WORLD, &precv[4]);
+    MPI_Send_init(imsg_sendbuff, len, PVEC_REAL_MPI_TYPE, IDATA_DEST,
+		  IN_SENT_OUT, MPI_COMM_WORLD, &psend[4]);
+  }
+  if(ODATA_DEST != -1) {
+    MPI_Recv_init(omsg_recvbuff, len, PVEC_REAL_MPI_TYPE, ODATA_DEST,
+		  IN_SENT_OUT, MPI_COMM_WORLD, &precv[5]);
+    MPI_Send_init(omsg_sendbuff, len, PVEC_REAL_MPI_TYPE, ODATA_DEST,
+		  OUT_SENT_IN, MPI_COMM_WORLD, &psend[5]);
+  }
+  
+  persist_set = true;
+}
+
+void Communicator::cancel_requests()
+{
+  int finalised;
+  MPI_Finalized(&finalised); // Global communicators are destroyed after MPI_Finalize
+  
+  MPI_Status status;
+  for(int i=0;i<6;i++) {
+    if(!finalised) {
+      // Cancel receives posted early (pre_post), which would
+      // otherwise write into buffers which are about to be freed
+      if(request[i] != MPI_REQUEST_NULL) {
+	MPI_Cancel(&request[i]);
+	MPI_Wait(&request[i], &status);
+      }
+      // Only receives still in progress. Cancelling an inactive
+      // (completed or never started) persistent request is an error
+      if(recv_active[i]) {
+	MPI_Cancel(&precv[i]);
+	MPI_Wait(&precv[i], &status);
+      }
+      // Make sure sends have completed
+      if(send_pending) {
+	MPI_Wait(&sendreq[i], &status);
+	MPI_Wait(&psend[i], &status);
+      }
+      
+      if(precv[i] != MPI_REQUEST_NULL)
+	MPI_Request_free(&precv[i]);
+      if(psend[i] != MPI_REQUEST_NULL)
+	MPI_Request_free(&psend[i]);
+    }
+    request[i] = sendreq[i] = MPI_REQUEST_NULL;
+    precv[i] = psend[i] = MPI_REQUEST_NULL;
+    recv_active[i] = false;
+  }
+  
+  persist_set = false;
+  send_pending = false;
+  first_time = true; // Need to post receives again
+}
+
 /**************************************************************************
  * Main communication routines
  **************************************************************************/
@@ -291,7 +424,11 @@ void Communicator::send()
   /// Record starting wall-time
   t = MPI_Wtime();
 
-  if(async_send && send_pending) {
+  if(persistent && send_pending) {
+    /// Sends must complete before the buffers are packed again
+    MPI_Status status[6];
+    MPI_Waitall(6, psend, status);
+  }else if(async_send && send_pending) {
     /// Asyncronous sending: Need to check if previous sends have completed
 
     MPI_Status status;
@@ -370,7 +507,9 @@ void Communicator::send()
     len = pack_data(0, UDATA_XSPLIT, MYSUB, MYSUB+MYG, umsg_sendbuff);
     // Send the data to processor UDATA_INDEST
 
-    if(async_send) {
+    if(persistent) {
+      MPI_Start(&psend[0]);
+    }else if(async_send) {
       MPI_Isend(umsg_sendbuff,   // Buffer to send
 		len,             // Length of buffer in reals
 		PVEC_REAL_MPI_TYPE,  // Real variable type
@@ -391,7 +530,9 @@ void Communicator::send()
                                    // of the buffer 
     len = pack_data(UDATA_XSPLIT, ngx, MYSUB, MYSUB+MYG, outbuff);
     // Send the data to processor UDATA_OUTDEST
-    if(async_send) {
+    if(persistent) {
+      MPI_Start(&psend[1]);
+    }else if(async_send) {
       MPI_Isend(outbuff, 
 		len, 
 		PVEC_REAL_MPI_TYPE,
@@ -414,7 +555,9 @@ void Communicator::send()
   if(DDATA_INDEST != -1) { // If there is a destination for inner x data
     len = pack_data(0, DDATA_XSPLIT, MYG, 2*MYG, dmsg_sendbuff);    
     // Send the data to processor DDATA_INDEST
-    if(async_send) {
+    if(persistent) {
+      MPI_Start(&psend[2]);
+    }else if(async_send) {
       MPI_Isend(dmsg_sendbuff, 
 		len,
 		PVEC_REAL_MPI_TYPE,
@@ -436,7 +579,9 @@ void Communicator::send()
     len = pack_data(DDATA_XSPLIT, ngx, MYG, 2*MYG, outbuff);
     // Send the data to processor DDATA_OUTDEST
 
-    if(async_send) {
+    if(persistent) {
+      MPI_Start(&psend[3]);
+    }else if(async_send) {
       MPI_Isend(outbuff,
 		len,
 		PVEC_REAL_MPI_TYPE,
@@ -457,7 +602,9 @@ void Communicator::send()
   
   if(IDATA_DEST != -1) {
     len = pack_data(MXG, 2*MXG, MYG, MYG+MYSUB, imsg_sendbuff);
-    if(async_send) {
+    if(persistent) {
+      MPI_Start(&psend[4]);
+    }else if(async_send) {
       MPI_Isend(imsg_sendbuff,
 		len,
 		PVEC_REAL_MPI_TYPE,
@@ -478,7 +625,9 @@ void Communicator::send()
 
   if(ODATA_DEST != -1) {
     len = pack_data(MXSUB, MXSUB+MXG, MYG, MYG+MYSUB, omsg_sendbuff);
-    if(async_send) {
+    if(persistent) {
+      MPI_Start(&psend[5]);
+    }else if(async_send) {
       MPI_Isend(omsg_sendbuff,
 		len,
 		PVEC_REAL_MPI_TYPE,
@@ -497,6 +646,8 @@ void Communicator::send()
   
   send_cur = true; // Mark a send in process
   send_pending = true;
+  received = false;
+  set_active(true);
 
 #ifdef PRINT_TIME
   output.write("Send: %e\n", (t2 = MPI_Wtime()) - t3);
@@ -513,6 +664,11 @@ void Communicator::receive()
   real t;
 
   if(!send_cur) {
+    if(received) {
+      // Already received by wait()
+      received = false;
+      return;
+    }
     output.write("Error: Communicator receive called without call to send first\n");
     exit(1);
   }
@@ -525,9 +681,12 @@ void Communicator::receive()
   output.write("RECEIVING: ");
 #endif  
   
+  // Persistent requests become inactive when complete, rather than null
+  MPI_Request *req = persistent ? precv : request;
+  
   int ind;
   do {
-    MPI_Waitany(6, request, &ind, &status);
+    MPI_Waitany(6, req, &ind, &status);
     switch(ind) {
     case 0: { // Up, inner
       unpack_data(0, UDATA_XSPLIT, MYSUB+MYG, MYSUB+2*MYG, umsg_recvbuff);
@@ -574,12 +733,17 @@ void Communicator::receive()
       break;
     }
     }
-    if(ind != MPI_UNDEFINED)
-      request[ind] = MPI_REQUEST_NULL;
+    if(ind != MPI_UNDEFINED) {
+      if(persistent) {
+	recv_active[ind] = false;
+      }else
+	request[ind] = MPI_REQUEST_NULL;
+    }
     
   }while(ind != MPI_UNDEFINED);
   
   send_cur = false; // Finished this send-receive pair
+  set_active(false);
 
 #ifdef PRINT_TIME
   output.write("RECV: %e\n", MPI_Wtime() - t);
@@ -644,6 +808,58 @@ void Communicator::run()
   receive();
 }
 
+/************************************************************************//**
+ * Fields waiting for guard cells
+ **************************************************************************/
+
+bool Communicator::sending(const FieldData &f) const
+{
+  if(!send_cur)
+    return false;
+  
+  for(std::vector<FieldData*>::const_iterator it = var_list.begin(); it != var_list.end(); it++)
+    if(*it == &f)
+      return true;
+  
+  return false;
+}
+
+Communicator* Communicator::pending(const FieldData &f)
+{
+  for(std::vector<Communicator*>::iterator it = active.begin(); it != active.end(); it++)
+    if((*it)->sending(f))
+      return *it;
+  
+  return NULL;
+}
+
+void Communicator::wait(const FieldData &f)
+{
+  if(active.empty())
+    return; // Usual case
+  
+  Communicator *comm = pending(f);
+  if(comm == NULL)
+    return;
+  
+  comm->receive();
+  comm->received = true; // So the next receive() does nothing
+}
+
+/// Adds or removes this communicator from the list of active communicators
+void Communicator::set_active(bool on)
+{
+  std::vector<Communicator*>::iterator it;
+  for(it = active.begin(); it != active.end(); it++)
+    if(*it == this)
+      break;
+  
+  if(on && (it == active.end()))
+    active.push_back(this);
+  if(!on && (it != active.end()))
+    active.erase(it);
+}
+
 
 /************************************************************************//**
  * Pack and unpack data from buffers
@@ -659,6 +875,13 @@ int Communicator::pack_data(int xge, int xlt, int yge, int ylt, real *buffer)
     
     /// Loop over variables
     for(it = var_list.begin(); it != var_list.end(); it++) {
+      // Copy whole lines if the field supports it
+      int n = (*it)->getLines(jx, yge, ylt, buffer+len);
+      if(n >= 0) {
+	len += n;
+	continue;
+      }
+      
       if((*it)->is3D()) {
 	// 3D variable
 	
@@ -690,6 +913,12 @@ int Communicator::unpack_data(int xge, int xlt, int yge, int ylt, real *buffer)
 
     /// Loop over variables
     for(it = var_list.begin(); it != var_list.end(); it++) {
+      int n = (*it)->setLines(jx, yge, ylt, buffer+len);
+      if(n >= 0) {
+	len += n;
+	continue;
+      }
+      
       if((*it)->is3D()) {
 	// 3D variable
    
@@ -43,6 +43,20 @@ class Communicator;
  * \note July 2008: Modified to communicate in X and Y. Generalised to use the FieldData
  * interface. Changed to use MPI_Isend instead of MPI_Send, and MPI_Waitany instead of MPI_Wait
  * for (hopefully) faster communications.
+ *
+ * Between send() and receive() the guard cells of the fields are out of date.
+ * Derivative operators check for this (using pending), calculate the points
+ * which don't need guard cells, then wait for the data to arrive before
+ * calculating the rest. Communication can therefore be overlapped with
+ * calculation by putting operators between send() and receive():
+ *
+ *   comms.send();
+ *   ddt(Ni) = -b0xGrad_dot_Grad(phi, Ni0) ... // Uses Ni0, phi
+ *   ddt(Vi) = -Grad_par(phi) ...             // Finishes communication
+ *   comms.receive(); // Does nothing if data already received
+ *
+ * Operators which don't use guard cells (e.g. +,-,*,/) don't wait, so use
+ * the old guard cell values of fields being communicated.
  */
 class Communicator {
  public:
@@ -62,16 +76,33 @@ class Communicator {
   /// Tells MPI to expect a message, and sends data to processors
   void send();
   /// Waits for data from processors. This should always be called AFTER send().
+  /// If the data has already been received by wait() then this does nothing
   void receive();
 
   /// Perform communications. Same as send() then receive();
   void run();
 
+  /// True if between send() and receive(), and f is one of the fields being sent
+  bool sending(const FieldData &f) const;
+  /// The communicator which is sending f, or NULL if f's guard cells are up to date
+  static Communicator* pending(const FieldData &f);
+  /// If f is being sent, waits for the data (calls receive())
+  static void wait(const FieldData &f);
+
   /// Elapsed wall-time. Used to keep track of time spent communicating
   static real wtime;
  private:
+  /// Communicators between send() and receive()
+  static std::vector<Communicator*> active;
+  /// Set if receive() was called by wait()
+  bool received;
+  
   
   void post_receive();
+  void set_active(bool on);
+
+  void init_persistent(); ///< Create persistent requests
+  void cancel_requests(); ///< Cancel or finish all messages, and free persistent requests
   
   std::vector<FieldData*> var_list; ///< Array of fields to communicate
 
@@ -95,6 +126,7 @@ class Communicator {
   static bool options_set; ///< Prevents options being read each time
   static bool async_send; ///< Switch to asyncronous sends (ISend, not Send)
   static bool pre_post; ///< Post receives early. May speed up comms.
+  static bool persistent; ///< Use persistent requests (MPI_Send_init, MPI_Recv_init)
 
   /// When using pre_post, need to make an exception for first time
   bool first_time;
@@ -103,6 +135,12 @@ class Communicator {
   bool send_pending;
   /// Array of send requests (non-blocking send)
   MPI_Request sendreq[6];
+
+  /// Persistent receive and send requests, set up the first time
+  /// data is sent, and kept until fields are added or removed
+  MPI_Request precv[6], psend[6];
+  bool persist_set;  ///< Persistent requests have been created
+  bool recv_active[6]; ///< Persistent receives which have been started and not yet completed
 };
 
 
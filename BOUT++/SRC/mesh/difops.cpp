@@ -32,6 +32,7 @@
 #include "invert_laplace.h" // Delp2 uses same coefficients as inversion code
 
 #include "interpolation.h"
+#include "communicator.h"
 
 #include <math.h>
 #include <stdlib.h>
@@ -167,6 +168,8 @@ const Field3D Div_par(const Field3D &f, DIFF_METHOD method, CELL_LOC outloc)
 
 const Field3D Grad_par_CtoL(const Field3D &var)
 {
+  Communicator::wait(var);
+  
   Field3D result;
   result.Allocate();
   real ***d = result.getData();
@@ -200,6 +203,9 @@ const Field3D Vpar_Grad_par_LCtoC(const Field &v, const Field &f)
   bstencil fval, vval;
   Field3D result;
   
+  comm_wait(v);
+  comm_wait(f);
+  
   result.Allocate();
   real ***d = result.getData();
 
@@ -224,6 +230,8 @@ const Field3D Grad_par_LtoC(const Field &var)
   bstencil f;
   Field3D result;
   
+  comm_wait(var);
+  
   result.Allocate();
   real ***d = result.getData();
 
@@ -352,28 +360,31 @@ const Field3D Delp2(const Field3D &f, real zsmooth)
   // NEW: SOLVE USING FFT
 
   static dcomplex **ft = (dcomplex**) NULL, **delft;
+  #pragma omp threadprivate(ft, delft)
   int jx, jy, jz;
   real filter;
   dcomplex a, b, c;
 
+  Communicator::wait(f); // Guard cells are transformed too
+
   result.Allocate();
 
   fd = f.getData();
   rd = result.getData();
 
-  if(ft == (dcomplex**) NULL) {
-    // Allocate memory
-    ft = cmatrix(ngx, ncz/2 + 1);
-    delft = cmatrix(ngx, ncz/2 + 1);
-  }
-  
-  // Loop over all y indices
+  // Loop over all y indices, split between threads
+  #pragma omp parallel for private(jx, jz, filter, a, b, c)
   for(jy=0;jy<ngy;jy++) {
 
-    // Take forward FFT
+    if(ft == (dcomplex**) NULL) {
+      // Allocate memory (once for each thread)
+      ft = cmatrix(ngx, ncz/2 + 1);
+      delft = cmatrix(ngx, ncz/2 + 1);
+    }
+
+    // Take forward FFT of all x in one go
     
-    for(jx=0;jx<ngx;jx++)
-      ZFFT(fd[jx][jy], zShift[jx][jy], ft[jx]);
+    ZFFT_many(fd[0][jy], ngx, ngy*ngz, zShift[0]+jy, ngy, ft[0]);
 
     // Loop over kz
     for(jz=0;jz<=ncz/2;jz++) {
@@ -401,11 +412,9 @@ const Field3D Delp2(const Field3D &f, real zsmooth)
     }
   
     // Reverse FFT
-    for(jx=1;jx<(ngx-1);jx++) {
-
-      ZFFT_rev(delft[jx], zShift[jx][jy], rd[jx][jy]);
+    ZFFT_rev_many(delft[1], ngx-2, zShift[1]+jy, ngy, rd[1][jy], ngy*ngz);
+    for(jx=1;jx<(ngx-1);jx++)
       rd[jx][jy][ncz] = rd[jx][jy][0];
-    }
 
     // Boundaries
     for(jz=0;jz<ncz;jz++) {
@@ -622,3 +631,101 @@ const Field3D b0xGrad_dot_Grad(const Field3D &phi, const Field3D &A, CELL_LOC ou
 #endif
   return result;
 }
+
+/*******************************************************************************
+ * Poisson bracket
+ * Terms of form [f, g] = b0 x Grad(f) dot Grad(g), for ExB advection
+ *******************************************************************************/
+
+/// Arakawa bracket in X-Z. f and g must be in real space (not shifted)
+const Field3D bracket_arakawa(const Field3D &f, const Field3D &g)
+{
+  Field3D result;
+  result.Allocate();
+  real ***r = result.getData();
+  
+  const real *fd = f.begin(), *gd = g.begin();
+  
+  // Each y slice is done in one pass, with no temporary fields
+  #pragma omp parallel for
+  for(int jx=MXG;jx<ngx-MXG;jx++) {
+    for(int jy=jstart;jy<=jend;jy++) {
+      // z lines at jx-1, jx, jx+1
+      const real *fm = fd + ((jx-1)*ngy + jy)*ngz, *fc = fd + (jx*ngy + jy)*ngz, *fp = fd + ((jx+1)*ngy + jy)*ngz;
+      const real *gm = gd + ((jx-1)*ngy + jy)*ngz, *gc = gd + (jx*ngy + jy)*ngz, *gp = gd + ((jx+1)*ngy + jy)*ngz;
+      
+      real fac = 1.0 / (12.0*dx[jx][jy]*dz);
+      
+      for(int jz=0;jz<ncz;jz++) {
+	int zm = (jz == 0) ? ncz-1 : jz-1; // Periodic in z
+	int zp = (jz == ncz-1) ? 0 : jz+1;
+	
+	// J++
+	real Jpp = (gp[jz] - gm[jz])*(fc[zp] - fc[zm]) 
+	  - (gc[zp] - gc[zm])*(fp[jz] - fm[jz]);
+	
+	// J+x
+	real Jpx = gp[jz]*(fp[zp] - fp[zm]) - gm[jz]*(fm[zp] - fm[zm])
+	  - gc[zp]*(fp[zp] - fm[zp]) + gc[zm]*(fp[zm] - fm[zm]);
+	
+	// Jx+
+	real Jxp = gp[zp]*(fc[zp] - fp[jz]) - gm[zm]*(fm[jz] - fc[zm])
+	  - gm[zp]*(fc[zp] - fm[jz]) + gp[zm]*(fp[jz] - fc[zm]);
+	
+	r[jx][jy][jz] = (Jpp + Jpx + Jxp) * fac;
+      }
+      r[jx][jy][ncz] = r[jx][jy][0];
+    }
+  }
+
+#ifdef CHECK
+  // Mark boundaries as invalid
+  result.bndry_xin = result.bndry_xout = result.bndry_yup = result.bndry_ydown = false;
+#endif
+
+  return result;
+}
+
+const Field3D bracket(const Field3D &f, const Field3D &g, BRACKET_METHOD method)
+{
+  Field3D result;
+
+#ifdef CHECK
+  int msg_pos = msg_stack.push("bracket( Field3D , Field3D )");
+#endif
+
+  switch(method) {
+  case BRACKET_STD: {
+    result = b0xGrad_dot_Grad(f, g);
+    break;
+  }
+  case BRACKET_SIMPLE: {
+    result = VDDX(DDZ(f), g) + VDDZ(-DDX(f), g);
+    break;
+  }
+  case BRACKET_ARAKAWA: {
+#ifdef CHECK
+    f.check_data();
+    g.check_data();
+#endif
+    Communicator::wait(f);
+    Communicator::wait(g);
+    if(ShiftXderivs) {
+      // X differences need to be in real space
+      result = bracket_arakawa(f.ShiftZ(true), g.ShiftZ(true)).ShiftZ(false);
+    }else
+      result = bracket_arakawa(f, g);
+    break;
+  }
+  default:
+    bout_error("bracket: Invalid method\n");
+  }
+
+#ifdef TRACK
+  result.name = "bracket("+f.name+","+g.name+")";
+#endif
+#ifdef CHECK
+  msg_stack.pop(msg_pos);
+#endif
+  return result;
+}
@@ -91,4 +91,14 @@ const Field3D b0xGrad_dot_Grad(const Field3D &phi, const Field2D &A, CELL_LOC ou
 const Field3D b0xGrad_dot_Grad(const Field2D &phi, const Field3D &A);
 const Field3D b0xGrad_dot_Grad(const Field3D &phi, const Field3D &A, CELL_LOC outloc=CELL_DEFAULT);
 
+/// Methods for the Poisson bracket
+enum BRACKET_METHOD {BRACKET_STD, BRACKET_SIMPLE, BRACKET_ARAKAWA};
+
+// Poisson bracket [f, g] for ExB advection of g by potential f.
+// BRACKET_STD     is b0xGrad_dot_Grad(f, g), using all terms
+// BRACKET_SIMPLE  is VDDX(DDZ(f), g) + VDDZ(-DDX(f), g), the X-Z terms only (as BOUT-06)
+// BRACKET_ARAKAWA is the same X-Z terms using Arakawa's energy and enstrophy
+//                 conserving scheme, done in a single pass
+const Field3D bracket(const Field3D &f, const Field3D &g, BRACKET_METHOD method = BRACKET_STD);
+
 #endif /* __DIFOPS_H__ */
@@ -62,6 +62,8 @@ const Field3D interp_to(const Field3D &var, CELL_LOC loc)
     msg_stack.push("Interpolating %s -> %s", strLocation(var.getLocation()), strLocation(loc));
 #endif
 
+    Communicator::wait(var);
+
     Field3D result;
 
     result = var; // NOTE: This is just for boundaries. FIX!
@@ -195,6 +197,7 @@ const Field3D interpolate(const Field3D &var, const Field3D &delta_x, const Fiel
   msg_stack.push("Interpolating 3D field");
 #endif
   
+  Communicator::wait(var);
 
   result.Allocate();
 
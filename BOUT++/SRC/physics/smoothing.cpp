@@ -40,6 +40,8 @@ const Field3D smooth_x(const Field3D &f, bool realspace)
 {
   Field3D fs, result;
 
+  Communicator::wait(f); // Uses guard cells
+
   if(realspace) {
     fs = f.ShiftZ(true); // Shift into real space
   }else
@@ -78,6 +80,8 @@ const Field3D smooth_y(const Field3D &f)
 {
   Field3D result;
 
+  Communicator::wait(f); // Uses guard cells
+
   result.Allocate();
   
   // Copy boundary region
@@ -197,6 +201,8 @@ const Field3D nl_filter_x(const Field3D &f, real w)
   msg_stack.push("nl_filter_x( Field3D )");
 #endif
   
+  Communicator::wait(f); // Uses guard cells
+
   Field3D fs;
   fs = f.ShiftZ(true); // Shift into real space
   Field3D result;
@@ -223,6 +229,8 @@ const Field3D nl_filter_y(const Field3D &fs, real w)
   msg_stack.push("nl_filter_x( Field3D )");
 #endif
   
+  Communicator::wait(fs); // Uses guard cells
+
   Field3D result;
   rvec v;
   
@@ -245,6 +253,8 @@ const Field3D nl_filter_z(const Field3D &fs, real w)
   msg_stack.push("nl_filter_x( Field3D )");
 #endif
   
+  Communicator::wait(fs); // Uses guard cells
+
   Field3D result;
   rvec v;
   
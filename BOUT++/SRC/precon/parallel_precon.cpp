@@ -0,0 +1,98 @@
+/**************************************************************************
+ * Preconditioner for parallel diffusion
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ * 
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "parallel_precon.h"
+
+#include "globals.h"
+#include "invert_parderiv.h"
+
+void ParallelPrecon::add(Field3D &var, Field3D &F_var, const Field2D &K)
+{
+  PreVar<Field3D> d;
+  d.var = &var;
+  d.F_var = &F_var;
+  d.K = &K;
+  d.Kval = 0.0;
+  v3d.push_back(d);
+}
+
+void ParallelPrecon::add(Field3D &var, Field3D &F_var, real K)
+{
+  PreVar<Field3D> d;
+  d.var = &var;
+  d.F_var = &F_var;
+  d.K = (Field2D*) NULL;
+  d.Kval = K;
+  v3d.push_back(d);
+}
+
+void ParallelPrecon::add(Field3D &var, Field3D &F_var)
+{
+  add(var, F_var, 0.0);
+}
+
+void ParallelPrecon::add(Field2D &var, Field2D &F_var)
+{
+  PreVar<Field2D> d;
+  d.var = &var;
+  d.F_var = &F_var;
+  d.K = (Field2D*) NULL;
+  d.Kval = 0.0;
+  v2d.push_back(d);
+}
+
+int ParallelPrecon::apply(real gamma, real scale)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("ParallelPrecon::apply(%e)", gamma);
+#endif
+
+  for(unsigned int i=0;i<v3d.size();i++) {
+    PreVar<Field3D> &d = v3d[i];
+    if(d.K != NULL) {
+      *(d.var) = invert_pardiff(1.0, -gamma, *(d.K), *(d.F_var));
+    }else if(d.Kval != 0.0) {
+      Field2D K;
+      K = d.Kval;
+      *(d.var) = invert_pardiff(1.0, -gamma, K, *(d.F_var));
+    }else
+      *(d.var) = *(d.F_var);
+    
+    if(scale != 1.0)
+      *(d.var) *= scale;
+  }
+  
+  for(unsigned int i=0;i<v2d.size();i++) {
+    *(v2d[i].var) = *(v2d[i].F_var);
+    if(scale != 1.0)
+      *(v2d[i].var) *= scale;
+  }
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return 0;
+}
@@ -0,0 +1,86 @@
+/**************************************************************************
+ * Preconditioner for parallel diffusion
+ *
+ * Approximately inverts (1 - gamma * Grad_par(K * Grad_par)) for each
+ * variable added, using invert_pardiff along field lines. For use with
+ * the Newton-Krylov solvers, e.g. in physics_init:
+ *
+ *   ParallelPrecon pc; // Global
+ *   ...
+ *   solver->add(Te, F_Te, "Te");
+ *   pc.add(Te, F_Te, kappa_par);
+ *   solver->add(Vi, F_Vi, "Vi");
+ *   pc.add(Vi, F_Vi); // No parallel diffusion
+ *   solver->setPrecon(precon);
+ *
+ * where precon is
+ *
+ *   int precon(real t, real gamma, real delta) { return pc.apply(gamma); }
+ *
+ * Every evolving variable must be added, as the preconditioner must set
+ * them all. IDA passes cj (~ 1/gamma) to the preconditioner, and inverts
+ * (cj - J), so use apply(1./cj, 1./cj).
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ * 
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+class ParallelPrecon;
+
+#ifndef __PARALLEL_PRECON_H__
+#define __PARALLEL_PRECON_H__
+
+#include "field2d.h"
+#include "field3d.h"
+
+#include <vector>
+
+using std::vector;
+
+class ParallelPrecon {
+ public:
+  /// Precondition var, inverting parallel diffusion with coefficient K.
+  /// K is kept by reference, so can change during the run
+  void add(Field3D &var, Field3D &F_var, const Field2D &K);
+  /// Constant diffusion coefficient
+  void add(Field3D &var, Field3D &F_var, real K);
+  
+  /// Evolving variables which aren't preconditioned
+  void add(Field3D &var, Field3D &F_var);
+  void add(Field2D &var, Field2D &F_var);
+
+  /// Sets each var from F_var. Call from the function given to setPrecon
+  int apply(real gamma, real scale = 1.0);
+
+ private:
+  /// Stores a variable and its diffusion coefficient
+  template <class T>
+    struct PreVar {
+      T *var, *F_var;
+      const Field2D *K; ///< NULL if not preconditioned
+      real Kval;        ///< Value used if K is NULL and Kval != 0
+    };
+
+  vector< PreVar<Field3D> > v3d;
+  vector< PreVar<Field2D> > v2d;
+};
+
+#endif // __PARALLEL_PRECON_H__
@@ -23,7 +23,7 @@
  * 
  **************************************************************************/
 
-#include "solver.h"
+#include "cvode_solver.h"
 
 #include "globals.h"
 
@@ -37,7 +37,6 @@
 #include <stdlib.h>
 
 #include "boundary.h"
-#include "interpolation.h" // Cell interpolation
 
 void solver_f(integer N, real t, N_Vector u, N_Vector udot, void *f_data);
 void solver_gloc(integer N, real t, real* u, real* udot, void *f_data);
@@ -51,14 +50,14 @@ static PVBBDData pdata;
 long int iopt[OPT_SIZE];
 real ropt[OPT_SIZE];
 
-Solver::Solver() : GenericSolver()
+PvodeSolver::PvodeSolver() : GenericSolver()
 {
   gfunc = (rhsfunc) NULL;
 
   has_constraints = false; ///< This solver doesn't have constraints
 }
 
-Solver::~Solver()
+PvodeSolver::~PvodeSolver()
 {
   if(initialised) {
     // Free CVODE memory
@@ -70,11 +69,17 @@ Solver::~Solver()
   }
 }
 
+/// Creates a PVODE solver. Called by GenericSolver::create() in solver.cpp
+GenericSolver* new_pvode_solver()
+{
+  return new PvodeSolver();
+}
+
 /**************************************************************************
  * Initialise
  **************************************************************************/
 
-int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
+int PvodeSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
 {
   int mudq, mldq, mukeep, mlkeep;
   boole optIn;
@@ -100,8 +105,7 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
 
   output.write("Initialising PVODE solver\n");
   
-  // Set the rhs solver function
-  func = f;
+  // Set the preconditioner function
   if(gfunc == (rhsfunc) NULL)
     gfunc = f; // If preconditioner function not specified, use f
 
@@ -218,10 +222,10 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
  * Run - Advance time
  **************************************************************************/
 
-int Solver::run(MonitorFunc monitor)
+int PvodeSolver::run(MonitorFunc monitor)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("CVODE Solver::run()");
+  int msg_point = msg_stack.push("PvodeSolver::run()");
 #endif
   
   if(!initialised)
@@ -271,13 +275,13 @@ int Solver::run(MonitorFunc monitor)
   return 0;
 }
 
-real Solver::run(real tout, int &ncalls, real &rhstime)
+real PvodeSolver::run(real tout, int &ncalls, real &rhstime)
 {
   real *udata;
   int flag;
 
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running solver: solver::run(%e)", tout);
+  int msg_point = msg_stack.push("Running solver: PvodeSolver::run(%e)", tout);
 #endif
 
   rhs_wtime = 0.0;
@@ -297,7 +301,7 @@ real Solver::run(real tout, int &ncalls, real &rhstime)
   
   // Call rhs function to get extra variables at this time
   real tstart = MPI_Wtime();
-  (*func)(simtime);
+  run_rhs(simtime);
   rhstime += MPI_Wtime() - tstart;
   ncalls++;
 
@@ -318,13 +322,13 @@ real Solver::run(real tout, int &ncalls, real &rhstime)
  * RHS function
  **************************************************************************/
 
-void Solver::rhs(int N, real t, real *udata, real *dudata)
+void PvodeSolver::rhs(int N, real t, real *udata, real *dudata)
 {
   int flag;
   real tstart;
 
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running RHS: Solver::rhs(%e)", t);
+  int msg_point = msg_stack.push("Running RHS: PvodeSolver::rhs(%e)", t);
 #endif
 
   tstart = MPI_Wtime();
@@ -333,7 +337,7 @@ void Solver::rhs(int N, real t, real *udata, real *dudata)
   load_vars(udata);
 
   // Call function
-  flag = (*func)(t);
+  flag = run_rhs(t);
 
   // Save derivatives to CVODE
   save_derivs(dudata);
@@ -346,13 +350,13 @@ void Solver::rhs(int N, real t, real *udata, real *dudata)
 #endif
 }
 
-void Solver::gloc(int N, real t, real *udata, real *dudata)
+void PvodeSolver::gloc(int N, real t, real *udata, real *dudata)
 {
   int flag;
   real tstart;
 
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running RHS: Solver::gloc(%e)", t);
+  int msg_point = msg_stack.push("Running RHS: PvodeSolver::gloc(%e)", t);
 #endif
 
   tstart = MPI_Wtime();
@@ -374,215 +378,6 @@ void Solver::gloc(int N, real t, real *udata, real *dudata)
 #endif
 }
 
-/**************************************************************************
- * PRIVATE FUNCTIONS
- **************************************************************************/
-
-/// Perform an operation at a given (jx,jy) location, moving data between BOUT++ and CVODE
-void Solver::loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op)
-{
-  real **d2d, ***d3d;
-  unsigned int i;
-  int jz;
-
-  int n2d = n2Dvars();
-  int n3d = n3Dvars();
- 
-  switch(op) {
-  case LOAD_VARS: {
-    /// Load variables from CVODE into BOUT++
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      d2d[jx][jy] = udata[p];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	d3d[jx][jy][jz] = udata[p];
-	p++;
-      }
-    }
-    break;
-  }
-  case SAVE_VARS: {
-    /// Save variables from BOUT++ into CVODE (only used at start of simulation)
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-    /// Save time-derivatives from BOUT++ into CVODE (returning RHS result)
-  case SAVE_DERIVS: {
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].F_var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].F_var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-  }
-}
-
-/// Loop over variables and domain. Used for all data operations for consistency
-void Solver::loop_vars(real *udata, SOLVER_VAR_OP op)
-{
-  int jx, jy;
-  int p = 0; // Counter for location in udata array
-
-  // Inner X boundary
-  if(IDATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(jx, jy+MYG, udata, p, op);
-  }
-
-  for (jx=MXG; jx < MXSUB+MXG; jx++) {
-    
-    // Lower Y boundary region
-    
-    if( ((DDATA_INDEST == -1) && (jx < DDATA_XSPLIT)) ||
-	((DDATA_OUTDEST == -1) && (jx >= DDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, jy, udata, p, op);
-    }
-    
-    for (jy=0; jy < MYSUB; jy++) {
-      // Bulk of points
-      loop_vars_op(jx, jy+MYG, udata, p, op);
-    }
-
-    // Upper Y boundary condition
-
-    if( ((UDATA_INDEST == -1) && (jx < UDATA_XSPLIT)) ||
-	((UDATA_OUTDEST == -1) && (jx >= UDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, MYSUB+MYG+jy, udata, p, op);
-    }
-  }
-
-  // Outer X boundary
-  if(ODATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(MXG+MXSUB+jx, jy+MYG, udata, p, op);
-  }
-}
-
-void Solver::load_vars(real *udata)
-{
-  unsigned int i;
-  
-  // Make sure data is allocated
-  for(i=0;i<f2d.size();i++)
-    f2d[i].var->Allocate();
-  for(i=0;i<f3d.size();i++) {
-    f3d[i].var->Allocate();
-    f3d[i].var->setLocation(f3d[i].location);
-  }
-
-  loop_vars(udata, LOAD_VARS);
-
-  // Mark each vector as either co- or contra-variant
-
-  for(i=0;i<v2d.size();i++)
-    v2d[i].var->covariant = v2d[i].covariant;
-  for(i=0;i<v3d.size();i++)
-    v3d[i].var->covariant = v3d[i].covariant;
-}
-
-// This function only called during initialisation
-int Solver::save_vars(real *udata)
-{
-  unsigned int i;
-
-  for(i=0;i<f2d.size();i++)
-    if(f2d[i].var->getData() == (real**) NULL)
-      return(1);
-
-  for(i=0;i<f3d.size();i++)
-    if(f3d[i].var->getData() == (real***) NULL)
-      return(1);
-  
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].var->to_covariant();
-    }else
-      v2d[i].var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].var->to_covariant();
-    }else
-      v3d[i].var->to_contravariant();
-  }
-
-  loop_vars(udata, SAVE_VARS);
-
-  return(0);
-}
-
-void Solver::save_derivs(real *dudata)
-{
-  unsigned int i;
-
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].F_var->to_covariant();
-    }else
-      v2d[i].F_var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].F_var->to_covariant();
-    }else
-      v3d[i].F_var->to_contravariant();
-  }
-
-  // Make sure 3D fields are at the correct cell location
-  for(vector< VarStr<Field3D> >::iterator it = f3d.begin(); it != f3d.end(); it++) {
-    if((*it).location != ((*it).F_var)->getLocation()) {
-      //output.write("SOLVER: Interpolating\n");
-      *((*it).F_var) = interp_to(*((*it).F_var), (*it).location);
-    }
-  }
-
-  loop_vars(dudata, SAVE_DERIVS);
-}
-
 /**************************************************************************
  * CVODE rhs function
  **************************************************************************/
@@ -590,12 +385,12 @@ void Solver::save_derivs(real *dudata)
 void solver_f(integer N, real t, N_Vector u, N_Vector udot, void *f_data)
 {
   real *udata, *dudata;
-  Solver *s;
+  PvodeSolver *s;
 
   udata = N_VDATA(u);
   dudata = N_VDATA(udot);
   
-  s = (Solver*) f_data;
+  s = (PvodeSolver*) f_data;
 
   s->rhs(N, t, udata, dudata);
 }
@@ -603,9 +398,9 @@ void solver_f(integer N, real t, N_Vector u, N_Vector udot, void *f_data)
 // Preconditioner RHS
 void solver_gloc(integer N, real t, real* u, real* udot, void *f_data)
 {
-  Solver *s;
+  PvodeSolver *s;
   
-  s = (Solver*) f_data;
+  s = (PvodeSolver*) f_data;
 
   s->gloc(N, t, u, udot);
 }
@@ -24,7 +24,7 @@
  * 
  **************************************************************************/
 
-class Solver;
+class PvodeSolver;
 
 #ifndef __CVODE_SOLVER_H__
 #define __CVODE_SOLVER_H__
@@ -44,12 +44,10 @@ class Solver;
 
 using std::vector;
 
-enum SOLVER_VAR_OP {LOAD_VARS, SAVE_VARS, SAVE_DERIVS};
-
-class Solver : public GenericSolver {
+class PvodeSolver : public GenericSolver {
  public:
-  Solver();
-  ~Solver();
+  PvodeSolver();
+  ~PvodeSolver();
 
   void setPrecon(PhysicsPrecon f) {} // Doesn't do much yet
   
@@ -70,16 +68,7 @@ class Solver : public GenericSolver {
   machEnvType machEnv;
   void *cvode_mem;
   
-  rhsfunc func; // RHS function
   rhsfunc gfunc; // Preconditioner function
-  
-  // Loading data from BOUT++ to/from CVODE
-  void loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op);
-  void loop_vars(real *udata, SOLVER_VAR_OP op);
-  
-  void load_vars(real *udata);
-  int save_vars(real *udata);
-  void save_derivs(real *dudata);
 };
 
 #endif // __CVODE_SOLVER_H__
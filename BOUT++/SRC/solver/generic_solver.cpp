@@ -27,6 +27,8 @@
 #include "boundary.h"
 #include "interpolation.h"
 
+#include <string.h>
+
 /**************************************************************************
  * Constructor
  **************************************************************************/
@@ -42,6 +44,11 @@ GenericSolver::GenericSolver() {
 
   // Restart directory
   restartdir = string("data");
+
+  phys_run = phys_conv = phys_diff = (rhsfunc) NULL;
+  split_operator = false;
+
+  field_order = false;
 }
 
 /**************************************************************************
@@ -197,6 +204,72 @@ void GenericSolver::add(Vector3D &v, Vector3D &F_v, const char* name)
 #endif
 }
 
+/**************************************************************************
+ * Split operator
+ **************************************************************************/
+
+void GenericSolver::setSplitOperator(rhsfunc fC, rhsfunc fD)
+{
+  if(initialised)
+    bout_error("Error: Cannot split operator after initialisation\n");
+
+  phys_conv = fC;
+  phys_diff = fD;
+  split_operator = true;
+}
+
+/// If the operator is split, calls both parts and adds the time derivatives
+int GenericSolver::run_rhs(real t)
+{
+  if(!split_operator)
+    return (*phys_run)(t);
+
+  int status = (*phys_conv)(t);
+  if(status)
+    return status;
+
+  // Keep the convective part. Vectors in the basis they're evolved in
+  for(unsigned int i=0;i<v2d.size();i++) {
+    if(v2d[i].covariant) {
+      v2d[i].F_var->to_covariant();
+    }else
+      v2d[i].F_var->to_contravariant();
+  }
+  for(unsigned int i=0;i<v3d.size();i++) {
+    if(v3d[i].covariant) {
+      v3d[i].F_var->to_covariant();
+    }else
+      v3d[i].F_var->to_contravariant();
+  }
+  vector<Field2D> c2d(f2d.size());
+  vector<Field3D> c3d(f3d.size());
+  for(unsigned int i=0;i<f2d.size();i++)
+    c2d[i] = *(f2d[i].F_var);
+  for(unsigned int i=0;i<f3d.size();i++)
+    c3d[i] = *(f3d[i].F_var);
+
+  status = (*phys_diff)(t);
+  
+  for(unsigned int i=0;i<v2d.size();i++) {
+    if(v2d[i].covariant) {
+      v2d[i].F_var->to_covariant();
+    }else
+      v2d[i].F_var->to_contravariant();
+  }
+  for(unsigned int i=0;i<v3d.size();i++) {
+    if(v3d[i].covariant) {
+      v3d[i].F_var->to_covariant();
+    }else
+      v3d[i].F_var->to_contravariant();
+  }
+  for(unsigned int i=0;i<f2d.size();i++)
+    *(f2d[i].F_var) += c2d[i];
+  for(unsigned int i=0;i<f3d.size();i++)
+    *(f3d[i].F_var) += c3d[i];
+
+  return status;
+}
+
 /**************************************************************************
  * Constraints
  **************************************************************************/
@@ -356,6 +429,8 @@ int GenericSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int n
     bout_error("ERROR: Solver is already initialised\n");
 
   output.write("Initialising solver\n");
+
+  phys_run = f;
   
   /// GET GLOBAL OPTIONS
   options.setSection(NULL);
@@ -387,6 +462,8 @@ int GenericSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int n
 
   restart.add(NPES, "NPES", 0);
   restart.add(NXPE, "NXPE", 0);
+  restart.add(MXSUB, "MXSUB", 0);
+  restart.add(MYSUB, "MYSUB", 0);
 
   /// Add variables to the restart and dump files.
   /// NOTE: Since vector components are already in the field arrays,
@@ -415,36 +492,76 @@ int GenericSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int n
     // that the restart file is for the correct number of processors etc.
     int tmp_NP = NPES;
     int tmp_NX = NXPE;
+    int tmp_MXSUB = MXSUB;
+    int tmp_MYSUB = MYSUB;
     
 #ifdef CHECK
     int msg_pt2 = msg_stack.push("Loading restart file");
 #endif
-    
-    /// Load restart file
-    if(restart.read("%s/BOUT.restart.%d.%s", restartdir.c_str(), MYPE, restartext.c_str()) != 0) {
-      output.write("Error: Could not read restart file\n");
-      return(2);
-    }
 
-    if(NPES == 0) {
-      // Old restart file
-      output.write("WARNING: Cannot verify processor numbers\n");
-      NPES = tmp_NP;
-      NXPE = tmp_NX;
-    }else {
-      // Check the processor numbers match
-      if(NPES != tmp_NP) {
-	output.write("ERROR: Number of processors (%d) doesn't match restart file number (%d)\n",
-		     tmp_NP, NPES);
+    // Find the decomposition the restart files were written with
+    int decomp[5] = {0, 0, 0, 0, 0}; // NPES, NXPE, MXSUB, MYSUB, MZ
+    if(MYPE == 0)
+      restart_decomp(decomp);
+    MPI_Bcast(decomp, 5, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if((decomp[0] > 0) && ((decomp[0] != tmp_NP) || (decomp[1] != tmp_NX))) {
+      /// Restart files for a different number of processors
+      output.write("Restart files are for %d processors (NXPE = %d). Repartitioning\n",
+		   decomp[0], decomp[1]);
+      if(appending) {
+	// Existing dump files are for the old processors
+	output.write("ERROR: Can't append to dump files when repartitioning.\n"
+		     "       Restart without 'append' to start new dump files\n");
 	return(1);
       }
-      if(NXPE != tmp_NX) {
-	output.write("ERROR: Number of X processors (%d) doesn't match restart file number (%d)\n",
-		     tmp_NX, NXPE);
+      if((decomp[4] > 0) && (decomp[4] != ngz)) {
+	output.write("ERROR: MZ (%d) doesn't match restart files (%d)\n", ngz, decomp[4]);
 	return(1);
       }
+      
+      char format[512];
+      sprintf(format, "%s/BOUT.restart.%%d.%s", restartdir.c_str(), restartext.c_str());
+      if(restart.read_repart(format, decomp[0], decomp[1], decomp[2], decomp[3]) != 0) {
+	output.write("Error: Could not read restart files\n");
+	return(2);
+      }
+      NPES = tmp_NP;
+      NXPE = tmp_NX;
+      MXSUB = tmp_MXSUB;
+      MYSUB = tmp_MYSUB;
 
       output.write("Restarting at iteration %d, simulation time %e\n", iteration, simtime);
+    }else {
+      /// Load restart file
+      if(restart.read("%s/BOUT.restart.%d.%s", restartdir.c_str(), MYPE, restartext.c_str()) != 0) {
+	output.write("Error: Could not read restart file\n");
+	return(2);
+      }
+      // Not in old restart files
+      MXSUB = tmp_MXSUB;
+      MYSUB = tmp_MYSUB;
+      
+      if(NPES == 0) {
+	// Old restart file
+	output.write("WARNING: Cannot verify processor numbers\n");
+	NPES = tmp_NP;
+	NXPE = tmp_NX;
+      }else {
+	// Check the processor numbers match
+	if(NPES != tmp_NP) {
+	  output.write("ERROR: Number of processors (%d) doesn't match restart file number (%d)\n",
+		       tmp_NP, NPES);
+	  return(1);
+	}
+	if(NXPE != tmp_NX) {
+	  output.write("ERROR: Number of X processors (%d) doesn't match restart file number (%d)\n",
+		       tmp_NX, NXPE);
+	  return(1);
+	}
+	
+	output.write("Restarting at iteration %d, simulation time %e\n", iteration, simtime);
+      }
     }
 
 #ifdef CHECK
@@ -456,6 +573,9 @@ int GenericSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int n
     simtime = 0.0; iteration = 0;
   }
   
+  /// List the evolving points, used to move data to and from the solver
+  set_points();
+
   /// Mark as initialised. No more variables can be added
   initialised = true;
 
@@ -471,6 +591,50 @@ void GenericSolver::setRestartDir(const string &dir)
   restartdir = dir;
 }
 
+/// Reads the processor decomposition from the first restart file
+/*!
+ * Sets decomp to {NPES, NXPE, MXSUB, MYSUB, MZ}. Older restart files
+ * don't contain MXSUB and MYSUB, so these are found from the size of the
+ * evolving variables. NPES is left as zero if it's not in the file.
+ */
+void GenericSolver::restart_decomp(int *decomp)
+{
+  char filename[512];
+  sprintf(filename, "%s/BOUT.restart.0.%s", restartdir.c_str(), restartext.c_str());
+
+  DataFormat *file = data_format(restartext.c_str());
+  if(!file->openr(filename) || !file->is_valid()) {
+    delete file;
+    return;
+  }
+
+  if(!file->read(decomp, "NPES"))
+    decomp[0] = 0;
+  if(!file->read(decomp+1, "NXPE"))
+    decomp[1] = 0;
+  if(!file->read(decomp+2, "MXSUB"))
+    decomp[2] = 0;
+  if(!file->read(decomp+3, "MYSUB"))
+    decomp[3] = 0;
+
+  // Get the sizes from one of the variables
+  vector<int> size;
+  if(!f3d.empty()) {
+    size = file->getSize(f3d[0].name);
+    if(size.size() == 3)
+      decomp[4] = size[2];
+  }else if(!f2d.empty())
+    size = file->getSize(f2d[0].name);
+
+  if((decomp[2] == 0) && (size.size() >= 2)) {
+    decomp[2] = size[0] - 2*MXG;
+    decomp[3] = size[1] - 2*MYG;
+  }
+
+  file->close();
+  delete file;
+}
+
 /**************************************************************************
  * Useful routines (protected)
  **************************************************************************/
@@ -520,5 +684,237 @@ int GenericSolver::getLocalN()
     output.write("\tBoundary region outer X\n");
   }
   
+  if((int) points.size()*(n2d + ncz*n3d) != local_N)
+    bout_error("ERROR: Number of evolving points doesn't match local_N\n");
+
   return local_N;
 }
+
+/// Lists the points evolved on this processor, in the order they're stored
+void GenericSolver::set_points()
+{
+  int jx, jy;
+
+  points.clear();
+
+  // Inner X boundary
+  if(IDATA_DEST == -1) {
+    for(jx=0;jx<MXG;jx++)
+      for(jy=0;jy<MYSUB;jy++)
+	points.push_back(jx*ngy + jy+MYG);
+  }
+
+  for (jx=MXG; jx < MXSUB+MXG; jx++) {
+    
+    // Lower Y boundary region
+    
+    if( ((DDATA_INDEST == -1) && (jx < DDATA_XSPLIT)) ||
+	((DDATA_OUTDEST == -1) && (jx >= DDATA_XSPLIT)) ) {
+      for(jy=0;jy<MYG;jy++)
+	points.push_back(jx*ngy + jy);
+    }
+    
+    for (jy=0; jy < MYSUB; jy++) {
+      // Bulk of points
+      points.push_back(jx*ngy + jy+MYG);
+    }
+
+    // Upper Y boundary condition
+
+    if( ((UDATA_INDEST == -1) && (jx < UDATA_XSPLIT)) ||
+	((UDATA_OUTDEST == -1) && (jx >= UDATA_XSPLIT)) ) {
+      for(jy=0;jy<MYG;jy++)
+	points.push_back(jx*ngy + MYSUB+MYG+jy);
+    }
+  }
+
+  // Outer X boundary
+  if(ODATA_DEST == -1) {
+    for(jx=0;jx<MXG;jx++)
+      for(jy=0;jy<MYSUB;jy++)
+	points.push_back((MXG+MXSUB+jx)*ngy + jy+MYG);
+  }
+}
+
+/// Move data between BOUT++ and a solver. Used for all data operations for consistency
+/*!
+  By default the variables are interleaved: at each point come the 2D
+  variables, then for each z the 3D variables. With field_order
+  each variable is a separate block, and each point of a 3D variable
+  is a z line which is copied in one go.
+
+  SET_ID sets each value to 0 for constraints and 1 otherwise (for IDA)
+ */
+void GenericSolver::loop_vars(real *udata, SOLVER_VAR_OP op)
+{
+  int n2d = f2d.size();
+  int n3d = f3d.size();
+  int npts = points.size();
+  int nper = n2d + n3d*ncz; // Values per point
+  
+  bool id = (op == SET_ID);
+  bool vars = (op == LOAD_VARS) || (op == SAVE_VARS); // Otherwise F_vars
+  bool load = (op == LOAD_VARS) || (op == LOAD_DERIVS); // Solver -> BOUT++
+
+  // Get pointers to the data once
+  vector<real*> d2d(n2d), d3d(n3d);
+  if(!id) {
+    for(int i=0;i<n2d;i++)
+      d2d[i] = vars ? f2d[i].var->begin() : f2d[i].F_var->begin();
+    for(int i=0;i<n3d;i++)
+      d3d[i] = vars ? f3d[i].var->begin() : f3d[i].F_var->begin();
+  }
+
+  #pragma omp parallel for
+  for(int k=0;k<npts;k++) {
+    int pt = points[k];
+    
+    // Loop over 2D variables
+    for(int i=0;i<n2d;i++) {
+      real *u = field_order ? udata + i*npts + k : udata + k*nper + i;
+      if(id) {
+	*u = f2d[i].constraint ? 0.0 : 1.0;
+      }else if(load) {
+	d2d[i][pt] = *u;
+      }else
+	*u = d2d[i][pt];
+    }
+    
+    // Loop over 3D variables
+    for(int i=0;i<n3d;i++) {
+      int stride = 1; // Between z points in udata
+      real *u;
+      if(field_order) {
+	u = udata + n2d*npts + (i*npts + k)*ncz;
+      }else {
+	u = udata + k*nper + n2d + i;
+	stride = n3d;
+      }
+      
+      if(id) {
+	real c = f3d[i].constraint ? 0.0 : 1.0;
+	for(int jz=0;jz<ncz;jz++)
+	  u[jz*stride] = c;
+	continue;
+      }
+
+      real *d = d3d[i] + pt*ngz;
+      if(stride == 1) {
+	if(load) {
+	  memcpy(d, u, ncz*sizeof(real));
+	}else
+	  memcpy(u, d, ncz*sizeof(real));
+      }else if(load) {
+	for(int jz=0;jz<ncz;jz++)
+	  d[jz] = u[jz*stride];
+      }else
+	for(int jz=0;jz<ncz;jz++)
+	  u[jz*stride] = d[jz];
+    }
+  }
+}
+
+void GenericSolver::load_vars(real *udata)
+{
+  unsigned int i;
+  
+  // Make sure data is allocated
+  for(i=0;i<f2d.size();i++)
+    f2d[i].var->Allocate();
+  for(i=0;i<f3d.size();i++) {
+    f3d[i].var->Allocate();
+    f3d[i].var->setLocation(f3d[i].location);
+  }
+
+  loop_vars(udata, LOAD_VARS);
+
+  // Mark each vector as either co- or contra-variant
+
+  for(i=0;i<v2d.size();i++)
+    v2d[i].var->covariant = v2d[i].covariant;
+  for(i=0;i<v3d.size();i++)
+    v3d[i].var->covariant = v3d[i].covariant;
+}
+
+void GenericSolver::load_derivs(real *udata)
+{
+  unsigned int i;
+  
+  // Make sure data is allocated
+  for(i=0;i<f2d.size();i++)
+    f2d[i].F_var->Allocate();
+  for(i=0;i<f3d.size();i++) {
+    f3d[i].F_var->Allocate();
+    f3d[i].F_var->setLocation(f3d[i].location);
+  }
+
+  loop_vars(udata, LOAD_DERIVS);
+
+  // Mark each vector as either co- or contra-variant
+
+  for(i=0;i<v2d.size();i++)
+    v2d[i].F_var->covariant = v2d[i].covariant;
+  for(i=0;i<v3d.size();i++)
+    v3d[i].F_var->covariant = v3d[i].covariant;
+}
+
+// This function only called during initialisation
+int GenericSolver::save_vars(real *udata)
+{
+  unsigned int i;
+
+  for(i=0;i<f2d.size();i++)
+    if(f2d[i].var->getData() == (real**) NULL)
+      return(1);
+
+  for(i=0;i<f3d.size();i++)
+    if(f3d[i].var->getData() == (real***) NULL)
+      return(1);
+  
+  // Make sure vectors in correct basis
+  for(i=0;i<v2d.size();i++) {
+    if(v2d[i].covariant) {
+      v2d[i].var->to_covariant();
+    }else
+      v2d[i].var->to_contravariant();
+  }
+  for(i=0;i<v3d.size();i++) {
+    if(v3d[i].covariant) {
+      v3d[i].var->to_covariant();
+    }else
+      v3d[i].var->to_contravariant();
+  }
+
+  loop_vars(udata, SAVE_VARS);
+
+  return(0);
+}
+
+void GenericSolver::save_derivs(real *dudata)
+{
+  unsigned int i;
+
+  // Make sure vectors in correct basis
+  for(i=0;i<v2d.size();i++) {
+    if(v2d[i].covariant) {
+      v2d[i].F_var->to_covariant();
+    }else
+      v2d[i].F_var->to_contravariant();
+  }
+  for(i=0;i<v3d.size();i++) {
+    if(v3d[i].covariant) {
+      v3d[i].F_var->to_covariant();
+    }else
+      v3d[i].F_var->to_contravariant();
+  }
+
+  // Make sure 3D fields are at the correct cell location
+  for(vector< VarStr<Field3D> >::iterator it = f3d.begin(); it != f3d.end(); it++) {
+    if((*it).location != ((*it).F_var)->getLocation()) {
+      //output.write("SOLVER: Interpolating\n");
+      *((*it).F_var) = interp_to(*((*it).F_var), (*it).location);
+    }
+  }
+
+  loop_vars(dudata, SAVE_DERIVS);
+}
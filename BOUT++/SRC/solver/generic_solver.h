@@ -54,10 +54,17 @@ typedef int (*Jacobian)(real t);
 /// Solution monitor, called each timestep
 typedef int (*MonitorFunc)(real simtime, int iter, int NOUT);
 
+/// Operations for moving data between BOUT++ and a solver's state
+enum SOLVER_VAR_OP {LOAD_VARS, LOAD_DERIVS, SET_ID, SAVE_VARS, SAVE_DERIVS};
+
 class GenericSolver {
  public:
   GenericSolver();
   virtual ~GenericSolver() { }
+
+  /// Create a solver. The type is set by "type" in the [solver]
+  /// section of the options file. Defined in solver.cpp
+  static GenericSolver* create();
   
   // Routines to add variables. Solvers can just call these
   // (or leave them as-is)
@@ -80,6 +87,11 @@ class GenericSolver {
   /// Specify a Jacobian (optional)
   virtual void setJacobian(Jacobian j) {}
 
+  /// Split the RHS into convective (non-stiff) and diffusive (stiff) parts.
+  /// The split operator (imex) solver treats these explicitly and implicitly;
+  /// other solvers call both and add the time derivatives
+  void setSplitOperator(rhsfunc fC, rhsfunc fD);
+
   /// Initialise the solver, passing the RHS function
   /// NOTE: nout and tstep should be passed to run, not init.
   ///       Needed because of how the PETSc TS code works
@@ -104,6 +116,14 @@ protected:
   
   /// Calculate the number of evolving variables on this processor
   int getLocalN();
+
+  rhsfunc phys_run;     ///< The RHS function passed to init
+  rhsfunc phys_conv;    ///< Convective part, if split
+  rhsfunc phys_diff;    ///< Diffusive part, if split
+  bool split_operator;  ///< True if setSplitOperator has been called
+
+  /// Calculate the time derivatives, leaving them in the F_vars
+  int run_rhs(real t);
   
   /// A structure to hold an evolving variable
   template <class T>
@@ -129,11 +149,24 @@ protected:
   string restartext;  ///< Restart file extension
   int archive_restart;
 
+  void restart_decomp(int *decomp); ///< Processor decomposition of the restart files
+
   bool has_constraints; ///< Can this solver handle constraints? Set to true if so.
   bool initialised; ///< Has init been called yet?
 
   real simtime;  ///< Current simulation time
   int iteration; ///< Current iteration (output time-step) number
+
+  // Moving data between BOUT++ and a solver's state array
+  bool field_order;   ///< State ordered by variable, rather than by point
+  vector<int> points; ///< Index (jx*ngy + jy) of the evolving points, in order. Set in init
+  void set_points();
+  void loop_vars(real *udata, SOLVER_VAR_OP op);
+
+  void load_vars(real *udata);
+  void load_derivs(real *udata);
+  int save_vars(real *udata);
+  void save_derivs(real *dudata);
 };
 
 #endif // __GENERIC_SOLVER_H__
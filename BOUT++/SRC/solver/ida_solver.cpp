@@ -31,7 +31,6 @@
 
 #include "globals.h"
 #include "boundary.h"
-#include "interpolation.h" // Cell interpolation
 
 #include <ida/ida.h>
 #include <ida/ida_spgmr.h>
@@ -53,14 +52,14 @@ static int ida_pre(real t, N_Vector yy,
 		   real cj, real delta, 
 		   void *user_data, N_Vector tmp);
 
-Solver::Solver() : GenericSolver()
+IdaSolver::IdaSolver() : GenericSolver()
 {
   has_constraints = true; ///< This solver has constraints
   
   prefunc = NULL;
 }
 
-Solver::~Solver()
+IdaSolver::~IdaSolver()
 {
   if(initialised) {
     // Free IDA memory
@@ -70,11 +69,17 @@ Solver::~Solver()
   }
 }
 
+/// Creates a SUNDIALS IDA solver. Called by GenericSolver::create() in solver.cpp
+GenericSolver* new_ida_solver()
+{
+  return new IdaSolver();
+}
+
 /**************************************************************************
  * Initialise
  **************************************************************************/
 
-int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
+int IdaSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
 {
 
 #ifdef CHECK
@@ -91,9 +96,6 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
   
   output.write("Initialising IDA solver\n");
   
-  // Set the rhs solver function
-  func = f;
-
   // Calculate number of variables
   int n2d = f2d.size();
   int n3d = f3d.size();
@@ -123,7 +125,7 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
     bout_error("\tERROR: Initial variable value not set\n");
   
   // Get the starting time derivative
-  (*func)(simtime);
+  run_rhs(simtime);
   
   // Put the time-derivatives into duvec
   save_derivs(NV_DATA_P(duvec));
@@ -205,10 +207,10 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
  * Run - Advance time
  **************************************************************************/
 
-int Solver::run(MonitorFunc monitor)
+int IdaSolver::run(MonitorFunc monitor)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("IDA Solver::run()");
+  int msg_point = msg_stack.push("IdaSolver::run()");
 #endif
   
   if(!initialised)
@@ -258,13 +260,13 @@ int Solver::run(MonitorFunc monitor)
   return 0;
 }
 
-real Solver::run(real tout, int &ncalls, real &rhstime)
+real IdaSolver::run(real tout, int &ncalls, real &rhstime)
 {
   if(!initialised)
     bout_error("ERROR: Running IDA solver without initialisation\n");
 
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running solver: solver::run(%e)", tout);
+  int msg_point = msg_stack.push("Running solver: IdaSolver::run(%e)", tout);
 #endif
 
   rhs_wtime = 0.0;
@@ -283,7 +285,7 @@ real Solver::run(real tout, int &ncalls, real &rhstime)
 
   // Call rhs function to get extra variables at this time
   real tstart = MPI_Wtime();
-  (*func)(simtime);
+  run_rhs(simtime);
   rhstime += MPI_Wtime() - tstart;
   ncalls++;
   
@@ -303,10 +305,10 @@ real Solver::run(real tout, int &ncalls, real &rhstime)
  * Residual function F(t, u, du)
  **************************************************************************/
 
-void Solver::res(real t, real *udata, real *dudata, real *rdata)
+void IdaSolver::res(real t, real *udata, real *dudata, real *rdata)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running RHS: Solver::res(%e)", t);
+  int msg_point = msg_stack.push("Running RHS: IdaSolver::res(%e)", t);
 #endif
 
   real tstart = MPI_Wtime();
@@ -315,7 +317,7 @@ void Solver::res(real t, real *udata, real *dudata, real *rdata)
   load_vars(udata);
   
   // Call RHS function
-  (*func)(t);
+  run_rhs(t);
   
   // Save derivatives to rdata (residual)
   save_derivs(rdata);
@@ -340,10 +342,10 @@ void Solver::res(real t, real *udata, real *dudata, real *rdata)
  * Preconditioner function
  **************************************************************************/
 
-void Solver::pre(real t, real cj, real delta, real *udata, real *rvec, real *zvec)
+void IdaSolver::pre(real t, real cj, real delta, real *udata, real *rvec, real *zvec)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running preconditioner: Solver::pre(%e)", t);
+  int msg_point = msg_stack.push("Running preconditioner: IdaSolver::pre(%e)", t);
 #endif
 
   real tstart = MPI_Wtime();
@@ -380,289 +382,12 @@ void Solver::pre(real t, real cj, real delta, real *udata, real *rvec, real *zve
  * PRIVATE FUNCTIONS
  **************************************************************************/
 
-/// Perform an operation at a given (jx,jy) location, moving data between BOUT++ and CVODE
-void Solver::loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op)
-{
-  real **d2d, ***d3d;
-  int i;
-  int jz;
- 
-  int n2d = f2d.size();
-  int n3d = f3d.size();
-
-  switch(op) {
-  case LOAD_VARS: {
-    /// Load variables from IDA into BOUT++
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      d2d[jx][jy] = udata[p];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	d3d[jx][jy][jz] = udata[p];
-	p++;
-      }  
-    }
-    break;
-  }
-  case LOAD_DERIVS: {
-    /// Load derivatives from IDA into BOUT++
-    /// Used for preconditioner
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].F_var->getData(); // Get pointer to data
-      d2d[jx][jy] = udata[p];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].F_var->getData(); // Get pointer to data
-	d3d[jx][jy][jz] = udata[p];
-	p++;
-      }  
-    }
-    
-    break;
-  }
-  case SET_ID: {
-    /// Set the type of equation (Differential or Algebraic)
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      if(f2d[i].constraint) {
-	udata[p] = ZERO;
-      }else {
-	udata[p] = ONE;
-      }
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	if(f3d[i].constraint) {
-	  udata[p] = ZERO;
-	}else {
-	  udata[p] = ONE;
-	}
-	p++;
-      }
-    }
-    
-    break;
-  }
-  case SAVE_VARS: {
-    /// Save variables from BOUT++ into IDA (only used at start of simulation)
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-    /// Save time-derivatives from BOUT++ into CVODE (returning RHS result)
-  case SAVE_DERIVS: {
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].F_var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].F_var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-  }
-}
-
-/// Loop over variables and domain. Used for all data operations for consistency
-void Solver::loop_vars(real *udata, SOLVER_VAR_OP op)
-{
-  int jx, jy;
-  int p = 0; // Counter for location in udata array
-
-  // Inner X boundary
-  if(IDATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(jx, jy+MYG, udata, p, op);
-  }
-
-  for (jx=MXG; jx < MXSUB+MXG; jx++) {
-    
-    // Lower Y boundary region
-    
-    if( ((DDATA_INDEST == -1) && (jx < DDATA_XSPLIT)) ||
-	((DDATA_OUTDEST == -1) && (jx >= DDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, jy, udata, p, op);
-    }
-    
-    for (jy=0; jy < MYSUB; jy++) {
-      // Bulk of points
-      loop_vars_op(jx, jy+MYG, udata, p, op);
-    }
-
-    // Upper Y boundary condition
-
-    if( ((UDATA_INDEST == -1) && (jx < UDATA_XSPLIT)) ||
-	((UDATA_OUTDEST == -1) && (jx >= UDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, MYSUB+MYG+jy, udata, p, op);
-    }
-  }
-
-  // Outer X boundary
-  if(ODATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(MXG+MXSUB+jx, jy+MYG, udata, p, op);
-  }
-}
-
-void Solver::load_vars(real *udata)
-{
-  unsigned int i;
-  
-  // Make sure data is allocated
-  for(i=0;i<f2d.size();i++)
-    f2d[i].var->Allocate();
-  for(i=0;i<f3d.size();i++) {
-    f3d[i].var->Allocate();
-    f3d[i].var->setLocation(f3d[i].location);
-  }
-
-  loop_vars(udata, LOAD_VARS);
-
-  // Mark each vector as either co- or contra-variant
-
-  for(i=0;i<v2d.size();i++)
-    v2d[i].var->covariant = v2d[i].covariant;
-  for(i=0;i<v3d.size();i++)
-    v3d[i].var->covariant = v3d[i].covariant;
-}
-
-void Solver::load_derivs(real *udata)
-{
-  unsigned int i;
-  
-  // Make sure data is allocated
-  for(i=0;i<f2d.size();i++)
-    f2d[i].F_var->Allocate();
-  for(i=0;i<f3d.size();i++) {
-    f3d[i].F_var->Allocate();
-    f3d[i].F_var->setLocation(f3d[i].location);
-  }
-
-  loop_vars(udata, LOAD_DERIVS);
-
-  // Mark each vector as either co- or contra-variant
-
-  for(i=0;i<v2d.size();i++)
-    v2d[i].F_var->covariant = v2d[i].covariant;
-  for(i=0;i<v3d.size();i++)
-    v3d[i].F_var->covariant = v3d[i].covariant;
-}
-
-void Solver::set_id(real *udata)
+/// Set the type of equation (Differential or Algebraic)
+void IdaSolver::set_id(real *udata)
 {
   loop_vars(udata, SET_ID);
 }
 
-// This function only called during initialisation
-int Solver::save_vars(real *udata)
-{
-  unsigned int i;
-
-  for(i=0;i<f2d.size();i++)
-    if(f2d[i].var->getData() == (real**) NULL)
-      return(1);
-
-  for(i=0;i<f3d.size();i++)
-    if(f3d[i].var->getData() == (real***) NULL)
-      return(1);
-  
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].var->to_covariant();
-    }else
-      v2d[i].var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].var->to_covariant();
-    }else
-      v3d[i].var->to_contravariant();
-  }
-
-  loop_vars(udata, SAVE_VARS);
-
-  return(0);
-}
-
-void Solver::save_derivs(real *dudata)
-{
-  unsigned int i;
-
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].F_var->to_covariant();
-    }else
-      v2d[i].F_var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].F_var->to_covariant();
-    }else
-      v3d[i].F_var->to_contravariant();
-  }
-
-  // Make sure 3D fields are at the correct cell location
-  for(vector< VarStr<Field3D> >::iterator it = f3d.begin(); it != f3d.end(); it++) {
-    if((*it).location != ((*it).F_var)->getLocation()) {
-      //output.write("SOLVER: Interpolating\n");
-      *((*it).F_var) = interp_to(*((*it).F_var), (*it).location);
-    }
-  }
-
-  loop_vars(dudata, SAVE_DERIVS);
-}
-
 /**************************************************************************
  * IDA res function
  **************************************************************************/
@@ -675,7 +400,7 @@ static int idares(real t,
   real *dudata = NV_DATA_P(du);
   real *rdata = NV_DATA_P(rr);
   
-  Solver *s = (Solver*) user_data;
+  IdaSolver *s = (IdaSolver*) user_data;
 
   // Calculate residuals
   s->res(t, udata, dudata, rdata);
@@ -702,7 +427,7 @@ static int ida_pre(real t, N_Vector yy,
   real *rdata = NV_DATA_P(rvec);
   real *zdata = NV_DATA_P(zvec);
   
-  Solver *s = (Solver*) user_data;
+  IdaSolver *s = (IdaSolver*) user_data;
 
   // Calculate residuals
   s->pre(t, cj, delta, udata, rdata, zdata);
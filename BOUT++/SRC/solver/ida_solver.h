@@ -27,7 +27,7 @@
  *
  **************************************************************************/
 
-class Solver;
+class IdaSolver;
 
 #ifndef __IDA_SOLVER_H__
 #define __IDA_SOLVER_H__
@@ -48,12 +48,10 @@ class Solver;
 #include <vector>
 using std::vector;
 
-enum SOLVER_VAR_OP {LOAD_VARS, LOAD_DERIVS, SET_ID, SAVE_VARS, SAVE_DERIVS};
-
-class Solver : public GenericSolver {
+class IdaSolver : public GenericSolver {
  public:
-  Solver();
-  ~Solver();
+  IdaSolver();
+  ~IdaSolver();
 
   void setPrecon(PhysicsPrecon f) {prefunc = f;}
   
@@ -69,21 +67,12 @@ class Solver : public GenericSolver {
   int NOUT; // Number of outputs. Specified in init, needed in run
   real TIMESTEP; // Time between outputs
   
-  rhsfunc func; // RHS function
   PhysicsPrecon prefunc; // Preconditioner
   
   N_Vector uvec, duvec, id; // Values, time-derivatives, and equation type
   void *idamem;
 
-  // Loading data from BOUT++ to/from IDA
-  void loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op);
-  void loop_vars(real *udata, SOLVER_VAR_OP op);
-
-  void load_vars(real *udata);
-  void load_derivs(real *udata);
-  void set_id(real *udata);
-  int save_vars(real *udata);
-  void save_derivs(real *dudata);
+  void set_id(real *udata); // Mark constraints (algebraic equations)
 
   real pre_Wtime; // Time in preconditioner
   real pre_ncalls; // Number of calls to preconditioner
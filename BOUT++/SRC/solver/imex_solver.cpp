@@ -0,0 +1,699 @@
+/**************************************************************************
+ * Split operator (IMEX) solver
+ *
+ * Each step of ARS(2,2,2), with g = 1 - 1/sqrt(2), d = 1 - 1/(2g):
+ *
+ *   U2 = u + dt*g*fC(u)                           + dt*g*fD(U2)
+ *   U3 = u + dt*(d*fC(u) + (1-d)*fC(U2)) + dt*(1-g)*fD(U2) + dt*g*fD(U3)
+ *
+ * and u(t+dt) = U3. Each implicit stage U = R + h*fD(U) is solved by
+ * Newton iteration, the linear systems (I - h*J)dU = -G being solved
+ * by GMRES using finite difference Jacobian-vector products.
+ * The preconditioner, if used, is passed gamma = h (as with CVODE).
+ *
+ * The explicit part limits the step. The largest eigenvalue of the
+ * convective Jacobian is estimated each step from the two convective
+ * evaluations, as in the RK solver:
+ *
+ *   L ~ |fC(U2) - fC(u)| / |U2 - u|
+ *
+ * and the step set to cfl*limit/L. A step past the limit is repeated.
+ * Since this only sees the direction the solution is moving in, the
+ * step is also limited by the spectral radius, found by a few power
+ * iterations at the start of each output.
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "imex_solver.h"
+
+#include "globals.h"
+#include "utils.h"
+#include "interpolation.h" // Cell interpolation
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Explicit stability limit of dt*L. The explicit part is a two stage second order
+/// method, stable within the circle |1 + z| <= 1 (for upwinded advection)
+static const real imex_limit = 1.0;
+
+/// Number of power iterations for the spectral radius, and of times a
+/// difference is halved before giving up
+static const int npower = 5;
+static const int max_halve = 20;
+
+ImexSolver::ImexSolver() : GenericSolver()
+{
+  has_constraints = false; ///< This solver doesn't have constraints
+
+  prefunc = NULL;
+
+  u = fe1 = fe2 = fi2 = R = U = F = G = dU = wt = z = tmp = (real*) NULL;
+}
+
+ImexSolver::~ImexSolver()
+{
+  real **arrays[] = {&u, &fe1, &fe2, &fi2, &R, &U, &F, &G, &dU, &wt, &z, &tmp};
+  for(int i=0;i<12;i++)
+    if(*arrays[i] != (real*) NULL)
+      free(*arrays[i]);
+  for(unsigned int i=0;i<V.size();i++)
+    free(V[i]);
+}
+
+/// Creates a split operator solver. Called by GenericSolver::create() in solver.cpp
+GenericSolver* new_imex_solver()
+{
+  return new ImexSolver();
+}
+
+/**************************************************************************
+ * Initialise
+ **************************************************************************/
+
+int ImexSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Initialising IMEX solver");
+#endif
+
+  /// Call the generic initialisation first
+  if(GenericSolver::init(f, argc, argv, restarting, nout, tstep))
+    return 1;
+
+  // Save nout and tstep for use in run
+  NOUT = nout;
+  TIMESTEP = tstep;
+
+  output.write("Initialising IMEX solver\n");
+
+  if(!split_operator) {
+    output.write("\tERROR: The IMEX solver needs the RHS split into convective and\n"
+		 "\tdiffusive parts. Call setSplitOperator in physics_init\n");
+    return 1;
+  }
+
+  nlocal = getLocalN();
+
+  if(MPI_Allreduce(&nlocal, &neq, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD)) {
+    output.write("\tERROR: MPI_Allreduce failed!\n");
+    return 1;
+  }
+
+  output.write("\t3d fields = %d, 2d fields = %d neq=%d, local_N=%d\n",
+	       n3Dvars(), n2Dvars(), neq, nlocal);
+
+  ///////////// GET OPTIONS /////////////
+
+  options.setSection("solver");
+  options.get("max_timestep", max_timestep, TIMESTEP);
+  options.get("timestep", timestep, -1.0); // Estimated in run if not set
+  options.get("cfl", cfl, 0.8);
+  options.get("ATOL", abstol, 1.0e-12);
+  options.get("RTOL", reltol, 1.0e-5);
+  options.get("newton_tol", newton_tol, 0.1);
+  options.get("max_newton", max_newton, 5);
+  options.get("maxl", maxl, 20);
+  options.get("lin_tol", lin_tol, 0.05);
+  options.get("use_precon", use_precon, false);
+
+  if(use_precon && (prefunc == NULL)) {
+    output.write("\tWARNING: No preconditioner set. Ignoring use_precon\n");
+    use_precon = false;
+  }
+  dtlimit = max_timestep;
+
+  ////////// ALLOCATE AND SAVE INITIAL STATE ///////////
+
+  field_order = true; // Each variable is a separate block of the state
+
+  real **arrays[] = {&u, &fe1, &fe2, &fi2, &R, &U, &F, &G, &dU, &wt, &z, &tmp};
+  for(int i=0;i<12;i++)
+    if((*arrays[i] = rvector_aligned(nlocal)) == (real*) NULL) {
+      output.write("\tERROR: Couldn't allocate IMEX solver memory\n");
+      return 1;
+    }
+  V.resize(maxl+1);
+  for(int i=0;i<=maxl;i++)
+    if((V[i] = rvector_aligned(nlocal)) == (real*) NULL) {
+      output.write("\tERROR: Couldn't allocate IMEX solver memory\n");
+      return 1;
+    }
+
+  if(save_vars(u)) {
+    bout_error("\tError: Initial variable value not set\n");
+    return(1);
+  }
+
+  pre_Wtime = 0.0;
+  pre_ncalls = 0;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return 0;
+}
+
+/**************************************************************************
+ * Run - Advance time
+ **************************************************************************/
+
+int ImexSolver::run(MonitorFunc monitor)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("ImexSolver::run()");
+#endif
+
+  if(!initialised)
+    bout_error("Solver not initialised\n");
+
+  for(int i=0;i<NOUT;i++) {
+
+    /// Run the solver for one output timestep
+    simtime = run(simtime + TIMESTEP, rhs_ncalls, rhs_wtime);
+    iteration++;
+
+    /// Check if the run succeeded
+    if(simtime < 0.0) {
+      // Step failed
+      output.write("Timestep failed. Aborting\n");
+
+      // Write restart to a different file
+      restart.write("%s/BOUT.failed.%d.%s", restartdir.c_str(), MYPE, restartext.c_str());
+
+      bout_error("IMEX timestep failed\n");
+    }
+
+    /// Write the restart file
+    restart.write("%s/BOUT.restart.%d.%s", restartdir.c_str(), MYPE, restartext.c_str());
+
+    if((archive_restart > 0) && (iteration % archive_restart == 0)) {
+      restart.write("%s/BOUT.restart_%04d.%d.%s", restartdir.c_str(), iteration, MYPE, restartext.c_str());
+    }
+
+    /// Call the monitor function
+
+    if(monitor(simtime, i, NOUT)) {
+      // User signalled to quit
+
+      // Write restart to a different file
+      restart.write("%s/BOUT.final.%d.%s", restartdir.c_str(), MYPE, restartext.c_str());
+
+      output.write("Monitor signalled to quit. Returning\n");
+      break;
+    }
+  }
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return 0;
+}
+
+real ImexSolver::run(real tout, int &ncalls, real &rhstime)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Running solver: ImexSolver::run(%e)", tout);
+#endif
+
+  rhs_wtime = 0.0;
+  rhs_ncalls = 0;
+  newton_its = linear_its = 0;
+
+  real t = simtime;
+
+  // The spectral radius changes as the solution evolves, so estimate it for each output
+  probe_dtlimit = explicit_limit(t);
+  bool failed = (probe_dtlimit <= 0.0);
+  if(!failed) {
+    if(timestep <= 0.0) {
+      // First call, and the timestep wasn't set
+      timestep = max_timestep;
+      if(timestep > cfl*probe_dtlimit)
+	timestep = cfl*probe_dtlimit;
+      output.write("\tIMEX solver first timestep %e\n", timestep);
+    }else if(timestep > cfl*probe_dtlimit)
+      timestep = cfl*probe_dtlimit;
+  }
+  
+  while(!failed && (t < tout)) {
+    // Don't step past the output time
+    real dt = timestep;
+    bool last = (t + dt >= tout);
+    if(last)
+      dt = tout - t;
+
+    int flag = take_step(t, dt);
+    if(flag) {
+      if(flag == 1) {
+	// Newton iteration failed. Try again with a smaller step
+	timestep = 0.5*dt;
+      }else
+	timestep = cfl*dtlimit; // Past the explicit stability limit
+      
+      if(timestep < 1.0e-10*max_timestep) {
+	output.write("ERROR: IMEX timestep too small at t = %e\n", t);
+	failed = true;
+	break;
+      }
+      continue;
+    }
+    t = last ? tout : t + dt;
+
+    // Recover from any reductions in step, within the stability limit
+    real next = last ? timestep : 1.5*timestep;
+    if(next > cfl*dtlimit)
+      next = cfl*dtlimit;
+    if(next > max_timestep)
+      next = max_timestep;
+    timestep = next;
+  }
+
+  // Copy variables
+  load_vars(u);
+
+  // Call rhs function to get extra variables at this time
+  real tstart = MPI_Wtime();
+  run_rhs(t);
+  rhs_wtime += MPI_Wtime() - tstart;
+  rhs_ncalls++;
+
+  ncalls = rhs_ncalls;
+  rhstime = rhs_wtime;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  if(failed)
+    return -1.0;
+
+  return t;
+}
+
+/// Take a step of dt from time t, leaving u unchanged if the step failed.
+/// Returns 1 if an implicit stage didn't converge, 2 if dt is past the explicit limit
+int ImexSolver::take_step(real t, real dt)
+{
+  const real g = 1. - 1./sqrt(2.);
+  const real d = 1. - 0.5/g;
+  real h = g*dt;
+
+  rhs(phys_conv, t, u, fe1);
+
+  // Second stage
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    U[i] = R[i] = u[i] + h*fe1[i];
+
+  if(!solve(t + h, h))
+    return 1;
+
+  // Diffusive time derivative from the converged stage
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    fi2[i] = (U[i] - R[i]) / h;
+
+  rhs(phys_conv, t + h, U, fe2);
+
+  // Check the step against the explicit stability limit
+  real L;
+  if(!estimate(fe1, fe2, U, L))
+    return 1;
+  dtlimit = probe_dtlimit;
+  if((L > 0.0) && (imex_limit / L < dtlimit))
+    dtlimit = imex_limit / L;
+  if(dt > dtlimit)
+    return 2;
+
+  // Third stage
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    U[i] = R[i] = u[i] + dt*(d*fe1[i] + (1.-d)*fe2[i] + (1.-g)*fi2[i]);
+
+  if(!solve(t + dt, h))
+    return 1;
+
+  memcpy(u, U, nlocal*sizeof(real));
+
+  return 0;
+}
+
+/// Estimate the explicit stability limit, from the spectral radius of the convective
+/// Jacobian about u. This is found by power iteration, starting from the direction the
+/// solution is moving in, using finite differences. Returns the limit, or -1 on failure
+real ImexSolver::explicit_limit(real t)
+{
+  rhs(phys_conv, t, u, fe1);
+
+  real unorm = sqrt(dot(u, u)/neq);
+  memcpy(z, fe1, nlocal*sizeof(real)); // Direction of the difference
+
+  real Lmax = 0.0;
+  int nhalve = 0;
+  bool ok = true;
+  for(int n=0;n<npower;) {
+    real vnorm = sqrt(dot(z, z)/neq);
+    if(!finite(vnorm))
+      break;
+    if(vnorm <= 0.0)
+      break; // No convective terms in this direction
+    real eps = sqrt(DBL_EPSILON)*(1.0 + unorm)/vnorm;
+    eps *= pow(0.5, nhalve);
+
+    #pragma omp parallel for
+    for(int i=0;i<nlocal;i++)
+      U[i] = u[i] + eps*z[i];
+    
+    rhs(phys_conv, t, U, fe2);
+
+    real L;
+    if(!estimate(fe1, fe2, U, L)) {
+      // Not finite. Try again with a smaller difference
+      if(nhalve == max_halve) {
+	ok = false;
+	break;
+      }
+      nhalve++;
+      continue;
+    }
+    if(L > Lmax)
+      Lmax = L;
+
+    // Next direction is J*z
+    #pragma omp parallel for
+    for(int i=0;i<nlocal;i++)
+      z[i] = (fe2[i] - fe1[i])/eps;
+    n++;
+  }
+
+  if(!ok) {
+    output.write("ERROR: IMEX solver state is not finite at t = %e\n", t);
+    return -1.0;
+  }
+
+  return (Lmax > 0.0) ? imex_limit / Lmax : max_timestep;
+}
+
+/**************************************************************************
+ * Implicit stages
+ **************************************************************************/
+
+/// Solve U = R + h*fD(t, U) by Newton iteration, starting from U.
+/// Returns true if converged
+bool ImexSolver::solve(real t, real h)
+{
+  // Error weights, from the initial guess
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    wt[i] = 1.0 / (reltol*fabs(U[i]) + abstol);
+
+  for(int it=0;it<max_newton;it++) {
+    newton_its++;
+
+    // Residual G = U - h*fD(U) - R
+    rhs(phys_diff, t, U, F);
+    #pragma omp parallel for
+    for(int i=0;i<nlocal;i++)
+      G[i] = U[i] - h*F[i] - R[i];
+
+    real unorm = sqrt(dot(U, U)/neq);
+
+    // Solve (I - h*J) dU = -G
+    gmres(t, h, unorm);
+
+    #pragma omp parallel for
+    for(int i=0;i<nlocal;i++)
+      U[i] += dU[i];
+
+    real norm = wrms(dU);
+    if(!finite(norm))
+      return false;
+    if(norm < newton_tol)
+      return true;
+  }
+  return false;
+}
+
+/// Solves (I - h*J) dU = -G approximately, using right-preconditioned GMRES
+void ImexSolver::gmres(real t, real h, real unorm)
+{
+  vector<real> H((maxl+1)*maxl, 0.0), g(maxl+1, 0.0), cs(maxl), sn(maxl), y(maxl);
+
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++) {
+    V[0][i] = -G[i];
+    dU[i] = 0.0;
+  }
+  real beta = sqrt(dot(V[0], V[0]));
+  if(beta <= 0.0)
+    return;
+
+  real scale = 1.0/beta;
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    V[0][i] *= scale;
+  g[0] = beta;
+
+  int k = 0; // Number of Krylov vectors used
+  while(k < maxl) {
+    linear_its++;
+
+    // V[k+1] = J P^-1 V[k]
+    precon(t, h, V[k], z);
+    jac_vec(t, h, unorm, z, V[k+1]);
+
+    // Modified Gram-Schmidt
+    for(int i=0;i<=k;i++) {
+      real hik = dot(V[k+1], V[i]);
+      H[i*maxl + k] = hik;
+      real *v = V[k+1], *vi = V[i];
+      #pragma omp parallel for
+      for(int j=0;j<nlocal;j++)
+	v[j] -= hik*vi[j];
+    }
+    real hn = sqrt(dot(V[k+1], V[k+1]));
+    H[(k+1)*maxl + k] = hn;
+    if(hn > 0.0) {
+      scale = 1.0/hn;
+      real *v = V[k+1];
+      #pragma omp parallel for
+      for(int j=0;j<nlocal;j++)
+	v[j] *= scale;
+    }
+
+    // Apply previous Givens rotations to the new column
+    for(int i=0;i<k;i++) {
+      real a = H[i*maxl + k], b = H[(i+1)*maxl + k];
+      H[i*maxl + k]     =  cs[i]*a + sn[i]*b;
+      H[(i+1)*maxl + k] = -sn[i]*a + cs[i]*b;
+    }
+    // New rotation to zero H[k+1][k]
+    real a = H[k*maxl + k], b = H[(k+1)*maxl + k];
+    real r = sqrt(a*a + b*b);
+    if(r == 0.0)
+      break;
+    cs[k] = a/r; sn[k] = b/r;
+    H[k*maxl + k] = r;
+    H[(k+1)*maxl + k] = 0.0;
+    g[k+1] = -sn[k]*g[k];
+    g[k]   =  cs[k]*g[k];
+    k++;
+
+    if((fabs(g[k]) <= lin_tol*beta) || (hn <= 0.0))
+      break;
+  }
+
+  if(k == 0)
+    return;
+
+  // Solve the upper triangular system H y = g
+  for(int i=k-1;i>=0;i--) {
+    real s = g[i];
+    for(int j=i+1;j<k;j++)
+      s -= H[i*maxl + j]*y[j];
+    y[i] = s / H[i*maxl + i];
+  }
+
+  // dU = P^-1 (V y)
+  #pragma omp parallel for
+  for(int j=0;j<nlocal;j++) {
+    real s = 0.0;
+    for(int i=0;i<k;i++)
+      s += y[i]*V[i][j];
+    tmp[j] = s;
+  }
+  precon(t, h, tmp, dU);
+}
+
+/// Jv = (I - h*J) v, with J v from a finite difference of fD about U
+void ImexSolver::jac_vec(real t, real h, real unorm, real *v, real *Jv)
+{
+  real vnorm = sqrt(dot(v, v)/neq);
+  if(vnorm <= 0.0) {
+    memset(Jv, 0, nlocal*sizeof(real));
+    return;
+  }
+  real eps = sqrt(DBL_EPSILON)*(1.0 + unorm)/vnorm;
+
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    tmp[i] = U[i] + eps*v[i];
+
+  rhs(phys_diff, t, tmp, Jv);
+
+  real he = h/eps;
+  #pragma omp parallel for
+  for(int i=0;i<nlocal;i++)
+    Jv[i] = v[i] - he*(Jv[i] - F[i]);
+}
+
+/// Apply the user preconditioner, which should approximately invert (I - h*J)
+void ImexSolver::precon(real t, real h, real *v, real *pv)
+{
+  if(!use_precon) {
+    if(pv != v)
+      memcpy(pv, v, nlocal*sizeof(real));
+    return;
+  }
+
+#ifdef CHECK
+  int msg_point = msg_stack.push("Running preconditioner: ImexSolver::precon(%e)", t);
+#endif
+
+  real tstart = MPI_Wtime();
+
+  // Load state
+  load_vars(U);
+
+  // Load vector to be inverted into F_vars
+  load_derivs(v);
+
+  (*prefunc)(t, h, lin_tol);
+
+  // Save the solution from vars
+  save_vars(pv);
+
+  pre_Wtime += MPI_Wtime() - tstart;
+  pre_ncalls++;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+}
+
+/**************************************************************************
+ * RHS function
+ **************************************************************************/
+
+/// Calls one part of the RHS with the state udata, putting the time derivatives into dudata
+void ImexSolver::rhs(rhsfunc f, real t, real *udata, real *dudata)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Running RHS: ImexSolver::rhs(%e)", t);
+#endif
+
+  real tstart = MPI_Wtime();
+
+  load_vars(udata);
+
+  (*f)(t);
+
+  save_derivs(dudata);
+
+  rhs_wtime += MPI_Wtime() - tstart;
+  rhs_ncalls++;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+}
+
+/**************************************************************************
+ * PRIVATE FUNCTIONS
+ **************************************************************************/
+
+/// Global dot product
+real ImexSolver::dot(const real *a, const real *b)
+{
+  real loc = 0.0, glob;
+  #pragma omp parallel for reduction(+:loc)
+  for(int i=0;i<nlocal;i++)
+    loc += a[i]*b[i];
+  MPI_Allreduce(&loc, &glob, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return glob;
+}
+
+/// Estimate the largest eigenvalue L of the convective part, from f0 = fC(u) and
+/// f1 = fC(u1). L is zero if there's no estimate. Returns false if it isn't finite
+bool ImexSolver::estimate(const real *f0, const real *f1, const real *u1, real &L)
+{
+  int n2d = n2Dvars();
+  int nvars = n2d + n3Dvars();
+  int npts = points.size();
+  vector<real> loc(2*nvars), glob(2*nvars);
+
+  // Each variable is a separate block of the state
+  for(int i=0;i<nvars;i++) {
+    int p0 = (i < n2d) ? i*npts : n2d*npts + (i-n2d)*npts*ncz;
+    int p1 = p0 + ((i < n2d) ? npts : npts*ncz);
+    
+    real num = 0.0, den = 0.0;
+    #pragma omp parallel for reduction(+:num,den)
+    for(int j=p0;j<p1;j++) {
+      real df = f1[j] - f0[j];
+      real du = u1[j] - u[j];
+      num += df*df;
+      den += du*du;
+    }
+    loc[2*i] = num;
+    loc[2*i+1] = den;
+  }
+  MPI_Allreduce(&loc[0], &glob[0], 2*nvars, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  // Largest over the variables, so a stiff variable isn't hidden by the others
+  L = 0.0;
+  for(int i=0;i<nvars;i++) {
+    real num = glob[2*i], den = glob[2*i+1];
+    if(!finite(num) || !finite(den))
+      return false;
+    if((num > 0.0) && (den > 0.0) && (num > L*L*den))
+      L = sqrt(num / den);
+  }
+  return true;
+}
+
+/// Weighted RMS norm, using weights wt
+real ImexSolver::wrms(const real *v)
+{
+  real loc = 0.0, glob;
+  #pragma omp parallel for reduction(+:loc)
+  for(int i=0;i<nlocal;i++)
+    loc += v[i]*wt[i]*v[i]*wt[i];
+  MPI_Allreduce(&loc, &glob, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return sqrt(glob/neq);
+}
@@ -0,0 +1,112 @@
+/**************************************************************************
+ * Split operator (IMEX) solver
+ *
+ * The RHS is split into convective and diffusive parts using
+ * setSplitOperator. The convective part is treated explicitly and the
+ * diffusive part implicitly, using the ARS(2,2,2) scheme of
+ * Ascher, Ruuth & Spiteri, Appl.Numer.Math. 25 (1997).
+ * Implicit stages are solved with Jacobian-free Newton-Krylov (GMRES),
+ * optionally with the user preconditioner set by setPrecon.
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+class ImexSolver;
+
+#ifndef __IMEX_SOLVER_H__
+#define __IMEX_SOLVER_H__
+
+#include "field2d.h"
+#include "field3d.h"
+#include "vector2d.h"
+#include "vector3d.h"
+
+#include "generic_solver.h"
+
+#include "bout_types.h"
+
+#include <vector>
+
+using std::vector;
+
+class ImexSolver : public GenericSolver {
+ public:
+  ImexSolver();
+  ~ImexSolver();
+
+  void setPrecon(PhysicsPrecon f) {prefunc = f;}
+
+  int init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep);
+
+  int run(MonitorFunc f);
+  real run(real tout, int &ncalls, real &rhstime);
+
+ private:
+  int NOUT; // Number of outputs. Specified in init, needed in run
+  real TIMESTEP; // Time between outputs
+
+  PhysicsPrecon prefunc; // Preconditioner
+  bool use_precon;
+
+  real timestep;     ///< Current internal timestep
+  real max_timestep;
+  real cfl;          ///< Fraction of the explicit stability limit to use
+  real dtlimit;      ///< Explicit stability limit, from the last step
+  real probe_dtlimit; ///< Explicit stability limit from the spectral radius, at the last output
+  real abstol, reltol;
+  real newton_tol;   ///< Newton convergence, in weighted RMS norm
+  int max_newton;    ///< Maximum Newton iterations per stage
+  int maxl;          ///< Maximum Krylov subspace dimension
+  real lin_tol;      ///< GMRES residual reduction
+
+  int nlocal, neq;
+
+  // Work arrays
+  real *u;            ///< State
+  real *fe1, *fe2;    ///< Convective time derivatives at stages 1 and 2
+  real *fi2;          ///< Diffusive time derivative at stage 2
+  real *R, *U;        ///< Stage right hand side and solution
+  real *F, *G, *dU;   ///< Newton: diffusive RHS, residual and update
+  real *wt;           ///< Error weights
+  real *z, *tmp;      ///< GMRES
+  vector<real*> V;    ///< Krylov vectors
+
+  int newton_its, linear_its; ///< Iteration counts, for each output
+
+  real pre_Wtime; // Time in preconditioner
+  int pre_ncalls; // Number of calls to preconditioner
+
+  int take_step(real t, real dt);
+  real explicit_limit(real t);
+  bool estimate(const real *f0, const real *f1, const real *u1, real &L);
+  bool solve(real t, real h);
+  void gmres(real t, real h, real unorm);
+  void jac_vec(real t, real h, real unorm, real *v, real *Jv);
+  void precon(real t, real h, real *v, real *pv);
+
+  void rhs(rhsfunc f, real t, real *udata, real *dudata);
+
+  real dot(const real *a, const real *b);
+  real wrms(const real *v);
+};
+
+#endif // __IMEX_SOLVER_H__
@@ -31,17 +31,16 @@
 
 #include "communicator.h" // Parallel communication
 #include "boundary.h"
-#include "interpolation.h" // Cell interpolation
 
 
 EXTERN PetscErrorCode solver_f(TS ts, real t, Vec globalin, Vec globalout, void *f_data);
 
-Solver::Solver()
+PetscSolver::PetscSolver()
 {
   has_constraints = false; // No constraints
 }
 
-Solver::~Solver()
+PetscSolver::~PetscSolver()
 {
   if(initialised) {
     // Free CVODE memory
@@ -53,11 +52,17 @@ Solver::~Solver()
   }
 }
 
+/// Creates a PETSc solver. Called by GenericSolver::create() in solver.cpp
+GenericSolver* new_petsc_solver()
+{
+  return new PetscSolver();
+}
+
 /**************************************************************************
  * Initialise
  **************************************************************************/
 
-int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, real TIMESTEP)
+int PetscSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, real TIMESTEP)
 {
   int neq;
   int mudq, mldq, mukeep, mlkeep;
@@ -78,9 +83,6 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, re
 
   output.write("Initialising PETSc solver\n");
   
-  // Set the rhs solver function
-  func = f;
-
   int n2d = n2Dvars();       // Number of 2D variables
   int n3d = n3Dvars();       // Number of 3D variables
   int local_N = getLocalN(); // Number of evolving variables on this processor
@@ -181,6 +183,14 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, re
   PetscReal tfinal = NOUT*TIMESTEP; // Final output time
   TSSetDuration(ts,pvode_mxstep,tfinal);
 
+  // Preconditioner type e.g. "ilu", "asm" or "hypre". Can be overridden by -pc_type
+  char *pc_type = options.getString("pc_type");
+  if(pc_type != NULL) {
+    output.write("\tUsing PETSc preconditioner '%s'\n", pc_type);
+    TSSundialsGetPC(ts,&pc);
+    PCSetType(pc, pc_type);
+  }
+
   /////////////////////////////////////////////////////
 
   TSSetTime(ts, simtime); // Set the simulation time
@@ -209,30 +219,16 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, re
       MatSetSizes(J,local_N,local_N,PETSC_DECIDE,PETSC_DECIDE);
       MatSetFromOptions(J);
 
-      // Get nonzero pattern of J - color_none !!!
-      MatSeqAIJSetPreallocation(J,10,PETSC_NULL);
-      MatMPIAIJSetPreallocation(J,10,PETSC_NULL,10,PETSC_NULL);
-
       PetscOptionsHasName(PETSC_NULL,"-J_slowfd",&J_slowfd);
       if (J_slowfd){ // create Jacobian matrix by slow fd
+        MatSeqAIJSetPreallocation(J,10,PETSC_NULL);
+        MatMPIAIJSetPreallocation(J,10,PETSC_NULL,10,PETSC_NULL);
+
         PetscPrintf(PETSC_COMM_SELF,"compute Jmat by slow fd...\n");
         TSDefaultComputeJacobian(ts,simtime,u,&J,&J,&J_structure,this);
-      } else { // get sparse pattern of the Jacobian
-        PetscPrintf(PETSC_COMM_SELF,"get sparse pattern of the Jacobian...\n");
-        int stat;
-
-	
-	int NVARS=n3Dvars()+n2Dvars();
-        printf("NVARS=%d\n",NVARS);  
-        printf("NXPE=%d\n", NXPE);
-        printf("MXSUB=%d\n",MXSUB); 
-        printf("NYPE=%d\n",NYPE);   //-number of poloidal subdomains
-        printf("MYSUB=%d\n",MYSUB);  //64; //-number of poloidal polongs per subdomain
-        printf("MZ=%d\n",MZ);     //65;    // toroidal grid size +1
-        printf("MYG=%d\n",MYG);    //-poloidal guard cells
-        printf("MXG=%d\n",MXG);    //-radial guard cells
-
-        stat=jstruc( NVARS,  NXPE,  MXSUB,  NYPE,  MYSUB,  MZ,  MYG,  MXG);
+      } else { // get sparse pattern of the Jacobian from the stencils
+        output.write("\tSetting sparsity pattern of the Jacobian\n");
+        ierr = jstruc(J, n2d, n3d, points);CHKERRQ(ierr);
       }
 
       PetscInt diag;
@@ -284,7 +280,7 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, re
  * Run - Advance time
  **************************************************************************/
 
-PetscErrorCode Solver::run(MonitorFunc mon)
+PetscErrorCode PetscSolver::run(MonitorFunc mon)
 {
   integer steps;
   real ftime;
@@ -302,14 +298,14 @@ PetscErrorCode Solver::run(MonitorFunc mon)
  * RHS function
  **************************************************************************/
 
-PetscErrorCode Solver::rhs(TS ts, real t, Vec udata, Vec dudata)
+PetscErrorCode PetscSolver::rhs(TS ts, real t, Vec udata, Vec dudata)
 {
   int flag;
   real *udata_array, *dudata_array;
 
   PetscFunctionBegin;
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running RHS: Solver::rhs(%e)", t);
+  int msg_point = msg_stack.push("Running RHS: PetscSolver::rhs(%e)", t);
 #endif
 
   real tstart = MPI_Wtime();
@@ -320,7 +316,7 @@ PetscErrorCode Solver::rhs(TS ts, real t, Vec udata, Vec dudata)
   VecRestoreArray(udata, &udata_array);
 
   // Call RHS function
-  flag = (*func)(t);
+  flag = run_rhs(t);
 
   // Save derivatives to PETSc
   VecGetArray(dudata, &dudata_array);
@@ -369,234 +365,25 @@ PetscErrorCode Solver::rhs(TS ts, real t, Vec udata, Vec dudata)
   PetscFunctionReturn(0);
 }
 
-/**************************************************************************
- * PRIVATE FUNCTIONS
- **************************************************************************/
-
-/// Perform an operation at a given (jx,jy) location, moving data between BOUT++ and CVODE
-void Solver::loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op)
-{
-  real **d2d, ***d3d;
-  unsigned int i;
-  int jz;
- 
-  unsigned int n2d = f2d.size();
-  unsigned int n3d = f3d.size();
-
-  switch(op) {
-  case LOAD_VARS: {
-    /// Load variables from PETSc into BOUT++
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      d2d[jx][jy] = udata[p];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	d3d[jx][jy][jz] = udata[p];
-	p++;
-      }  
-    }
-    break;
-  }
-  case SAVE_VARS: {
-    /// Save variables from BOUT++ into CVODE (only used at start of simulation)
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-    /// Save time-derivatives from BOUT++ into CVODE (returning RHS result)
-  case SAVE_DERIVS: {
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].F_var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].F_var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-  }
-}
-
-/// Loop over variables and domain. Used for all data operations for consistency
-void Solver::loop_vars(real *udata, SOLVER_VAR_OP op)
-{
-  int jx, jy;
-  int p = 0; // Counter for location in udata array
-
-  // Inner X boundary
-  if(IDATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(jx, jy+MYG, udata, p, op);
-  }
-
-  for (jx=MXG; jx < MXSUB+MXG; jx++) {
-    
-    // Lower Y boundary region
-    
-    if( ((DDATA_INDEST == -1) && (jx < DDATA_XSPLIT)) ||
-	((DDATA_OUTDEST == -1) && (jx >= DDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, jy, udata, p, op);
-    }
-    
-    for (jy=0; jy < MYSUB; jy++) {
-      // Bulk of points
-      loop_vars_op(jx, jy+MYG, udata, p, op);
-    }
-
-    // Upper Y boundary condition
-
-    if( ((UDATA_INDEST == -1) && (jx < UDATA_XSPLIT)) ||
-	((UDATA_OUTDEST == -1) && (jx >= UDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, MYSUB+MYG+jy, udata, p, op);
-    }
-  }
-
-  // Outer X boundary
-  if(ODATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(MXG+MXSUB+jx, jy+MYG, udata, p, op);
-  }
-}
-
-void Solver::load_vars(real *udata)
-{
-  unsigned int i;
-
-  // Make sure data is allocated
-  for(i=0;i<f2d.size();i++)
-    f2d[i].var->Allocate();
-  for(i=0;i<f3d.size();i++) {
-    f3d[i].var->Allocate();
-    f3d[i].var->setLocation(f3d[i].location);
-  }
-
-  loop_vars(udata, LOAD_VARS);
-
-  // Mark each vector as either co- or contra-variant
-
-  for(i=0;i<v2d.size();i++)
-    v2d[i].var->covariant = v2d[i].covariant;
-  for(i=0;i<v3d.size();i++)
-    v3d[i].var->covariant = v3d[i].covariant;
-}
-
-// This function only called during initialisation
-int Solver::save_vars(real *udata)
-{
-  unsigned int i;
-
-  for(i=0;i<f2d.size();i++)
-    if(f2d[i].var->getData() == (real**) NULL)
-      return(1);
-
-  for(i=0;i<f3d.size();i++)
-    if(f3d[i].var->getData() == (real***) NULL)
-      return(1);
-  
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].var->to_covariant();
-    }else
-      v2d[i].var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].var->to_covariant();
-    }else
-      v3d[i].var->to_contravariant();
-  }
-
-  loop_vars(udata, SAVE_VARS);
-
-  return(0);
-}
-
-void Solver::save_derivs(real *dudata)
-{
-  unsigned int i;
-
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].F_var->to_covariant();
-    }else
-      v2d[i].F_var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].F_var->to_covariant();
-    }else
-      v3d[i].F_var->to_contravariant();
-  }
-
-  // Make sure 3D fields are at the correct cell location
-  for(vector< VarStr<Field3D> >::iterator it = f3d.begin(); it != f3d.end(); it++) {
-    if((*it).location != ((*it).F_var)->getLocation()) {
-      //output.write("SOLVER: Interpolating\n");
-      *((*it).F_var) = interp_to(*((*it).F_var), (*it).location);
-    }
-  }
-
-  loop_vars(dudata, SAVE_DERIVS);
-}
-
 /**************************************************************************
  * Static functions which can be used for PETSc callbacks
  **************************************************************************/
 #undef __FUNCT__  
-#define __FUNCT__ "Solver::solver_f"
+#define __FUNCT__ "PetscSolver::solver_f"
 PetscErrorCode solver_f(TS ts, real t, Vec globalin, Vec globalout, void *f_data)
 {
-  Solver *s;
+  PetscSolver *s;
   
   PetscFunctionBegin;
-  s = (Solver*) f_data;
+  s = (PetscSolver*) f_data;
   PetscFunctionReturn(s->rhs(ts, t, globalin, globalout));
 }
 
 #undef __FUNCT__  
-#define __FUNCT__ "Solver::PreUpdate"
+#define __FUNCT__ "PetscSolver::PreUpdate"
 PetscErrorCode PreStep(TS ts) 
 {
-  Solver *s;
+  PetscSolver *s;
 	PetscReal t, dt;
   PetscErrorCode ierr;
   
@@ -619,7 +406,7 @@ PetscErrorCode PreStep(TS ts)
 }
 
 #undef __FUNCT__  
-#define __FUNCT__ "Solver::PostUpdate"
+#define __FUNCT__ "PetscSolver::PostUpdate"
 PetscErrorCode PostStep(TS ts) 
 {
   PetscFunctionReturn(0);
@@ -24,7 +24,7 @@
  *
  **************************************************************************/
 
-class Solver;
+class PetscSolver;
 
 #ifndef __PETSC_SOLVER_H__
 #define __PETSC_SOLVER_H__
@@ -49,16 +49,14 @@ using std::vector;
 
 typedef int (*rhsfunc)(real);
 
-enum SOLVER_VAR_OP {LOAD_VARS, SAVE_VARS, SAVE_DERIVS};
-
 EXTERN PetscErrorCode PreStep(TS);
 EXTERN PetscErrorCode PostStep(TS);
-EXTERN int jstruc(int NVARS, int NXPE, int MXSUB, int NYPE, int MYSUB, int MZ, int MYG, int MXG);
+EXTERN int jstruc(Mat J, int n2d, int n3d, const vector<int> &points); // Sets the nonzero pattern of J. In precon/jstruc.cpp
 
-class Solver : public GenericSolver {
+class PetscSolver : public GenericSolver {
  public:
-  Solver();
-  ~Solver();
+  PetscSolver();
+  ~PetscSolver();
   
   int init(rhsfunc f, int argc, char **argv, bool restarting, int NOUT, real TIMESTEP);
   
@@ -79,17 +77,6 @@ class Solver : public GenericSolver {
   
   real next_time;  // When the monitor should be called next
   bool outputnext; // true if the monitor should be called next time 
-
-  rhsfunc func; // RHS function
-
-  // Looping over variables. This should be in generic, but better...
-  void loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op);
-  void loop_vars(real *udata, SOLVER_VAR_OP op);
-
-  // Move data between 
-  void load_vars(real *udata);
-  int save_vars(real *udata);
-  void save_derivs(real *dudata);
 };
 
 
@@ -0,0 +1,570 @@
+/**************************************************************************
+ * Explicit low-storage Runge-Kutta solvers
+ *
+ * The timestep is set from an estimate of the largest eigenvalue of
+ * the RHS Jacobian, made each step from the first two stages:
+ *
+ *   L ~ |f(u1) - f(u0)| / |u1 - u0|
+ *
+ * calculated for each evolving variable, taking the largest.
+ * For advection this is ~ max(|v|/dx), so timestep = cfl*limit/L is
+ * a CFL condition. If a step turns out to be past the stability limit
+ * it's retried (at the cost of one RHS call) before being completed,
+ * and if the estimate isn't finite the step is halved and retried.
+ * The first step is found the same way from a small forward Euler probe.
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "rk_solver.h"
+
+#include "globals.h"
+#include "utils.h"
+#include "interpolation.h" // Cell interpolation
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Carpenter & Kennedy five stage, fourth order coefficients
+static const int rk4_stages = 5;
+static const real rk4_a[] = {0.0,
+			     -567301805773.0/1357537059087.0,
+			     -2404267990393.0/2016746695238.0,
+			     -3550918686646.0/2091501179385.0,
+			     -1275806237668.0/842570457699.0};
+static const real rk4_b[] = {1432997174477.0/9575080441755.0,
+			     5161836677717.0/13612068292357.0,
+			     1720146321549.0/2090206949498.0,
+			     3134564353537.0/4481467310338.0,
+			     2277821191437.0/14882151754819.0};
+static const real rk4_c[] = {0.0,
+			     1432997174477.0/9575080441755.0,
+			     2526269341429.0/6820363962896.0,
+			     2006345519317.0/3224310063776.0,
+			     2802321613138.0/2924317926251.0};
+
+/// Shu & Osher SSP-RK3. Stage is y = a*u0 + b*(y + dt*f(y))
+static const int ssp_stages = 3;
+static const real ssp_a[] = {0.0, 0.75, 1.0/3.0};
+static const real ssp_b[] = {1.0, 0.25, 2.0/3.0};
+static const real ssp_c[] = {0.0, 1.0,  0.5};
+
+/// Extent of the stability region along the imaginary axis (advection)
+static const real rk4_limit = 3.34;
+static const real ssp_limit = 1.73;
+
+/// Number of times a step is shortened before giving up
+static const int max_halve = 20;
+
+RKSolver::RKSolver() : GenericSolver()
+{
+  has_constraints = false; ///< This solver doesn't have constraints
+
+  x = y = (real*) NULL;
+}
+
+RKSolver::~RKSolver()
+{
+  if(x != (real*) NULL)
+    free(x);
+  if(y != (real*) NULL)
+    free(y);
+}
+
+/// Creates an explicit Runge-Kutta solver. Called by GenericSolver::create() in solver.cpp
+GenericSolver* new_rk_solver()
+{
+  return new RKSolver();
+}
+
+/**************************************************************************
+ * Initialise
+ **************************************************************************/
+
+int RKSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Initialising RK solver");
+#endif
+
+  /// Call the generic initialisation first
+  if(GenericSolver::init(f, argc, argv, restarting, nout, tstep))
+    return 1;
+
+  // Save nout and tstep for use in run
+  NOUT = nout;
+  TIMESTEP = tstep;
+
+  output.write("Initialising RK solver\n");
+
+  nlocal = getLocalN();
+
+  int neq;
+  if(MPI_Allreduce(&nlocal, &neq, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD)) {
+    output.write("\tERROR: MPI_Allreduce failed!\n");
+    return 1;
+  }
+
+  output.write("\t3d fields = %d, 2d fields = %d neq=%d, local_N=%d\n",
+	       n3Dvars(), n2Dvars(), neq, nlocal);
+
+  ///////////// GET OPTIONS /////////////
+
+  options.setSection("solver");
+
+  char *s = options.getString("rk_scheme");
+  scheme = RK_RK4;
+  if(s != NULL) {
+    if(strcasecmp(s, "ssprk3") == 0) {
+      scheme = RK_SSPRK3;
+    }else if(strcasecmp(s, "rk4") != 0)
+      output.write("\tWARNING: Unknown rk_scheme '%s'. Using rk4\n", s);
+  }
+
+  options.get("adaptive", adaptive, true);
+  options.get("cfl", cfl, 0.8);
+  options.get("max_timestep", max_timestep, TIMESTEP);
+  // If adaptive, the first step is estimated in run unless set here
+  options.get("timestep", timestep, adaptive ? -1.0 : max_timestep);
+  options.get("rk_mxstep", mxstep, 10000);
+
+  if(adaptive && ((cfl <= 0.0) || (cfl >= 1.0))) {
+    // The step must be shorter than the stability limit, or unstable steps are never accepted
+    output.write("\tERROR: RK solver cfl must be between 0 and 1, not %e\n", cfl);
+    return 1;
+  }
+
+  output.write("\tScheme %s, ", (scheme == RK_RK4) ? "rk4" : "ssprk3");
+  if(adaptive) {
+    output.write("adaptive timestep with cfl = %e\n", cfl);
+  }else
+    output.write("fixed timestep %e\n", timestep);
+
+  ////////// SAVE INITIAL STATE ///////////
+
+  field_order = true; // Each variable is a separate block of the state (see stage)
+
+  x = rvector_aligned(nlocal);
+  y = rvector_aligned(nlocal);
+  if((x == (real*) NULL) || (y == (real*) NULL)) {
+    output.write("\tERROR: Couldn't allocate RK solver memory\n");
+    return 1;
+  }
+
+  // First rk4 stage multiplies the register by zero
+  memset(x, 0, nlocal*sizeof(real));
+
+  if(save_vars(y)) {
+    bout_error("\tError: Initial variable value not set\n");
+    return(1);
+  }
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return 0;
+}
+
+/**************************************************************************
+ * Run - Advance time
+ **************************************************************************/
+
+int RKSolver::run(MonitorFunc monitor)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("RKSolver::run()");
+#endif
+
+  if(!initialised)
+    bout_error("Solver not initialised\n");
+
+  for(int i=0;i<NOUT;i++) {
+
+    /// Run the solver for one output timestep
+    simtime = run(simtime + TIMESTEP, rhs_ncalls, rhs_wtime);
+    iteration++;
+
+    /// Check if the run succeeded
+    if(simtime < 0.0) {
+      // Step failed
+      output.write("Timestep failed. Aborting\n");
+
+      // Write restart to a different file
+      restart.write("%s/BOUT.failed.%d.%s", restartdir.c_str(), MYPE, restartext.c_str());
+
+      bout_error("RK timestep failed\n");
+    }
+
+    /// Write the restart file
+    restart.write("%s/BOUT.restart.%d.%s", restartdir.c_str(), MYPE, restartext.c_str());
+
+    if((archive_restart > 0) && (iteration % archive_restart == 0)) {
+      restart.write("%s/BOUT.restart_%04d.%d.%s", restartdir.c_str(), iteration, MYPE, restartext.c_str());
+    }
+
+    /// Call the monitor function
+
+    if(monitor(simtime, i, NOUT)) {
+      // User signalled to quit
+
+      // Write restart to a different file
+      restart.write("%s/BOUT.final.%d.%s", restartdir.c_str(), MYPE, restartext.c_str());
+
+      output.write("Monitor signalled to quit. Returning\n");
+      break;
+    }
+  }
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return 0;
+}
+
+real RKSolver::run(real tout, int &ncalls, real &rhstime)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Running solver: RKSolver::run(%e)", tout);
+#endif
+
+  rhs_wtime = 0.0;
+  rhs_ncalls = 0;
+
+  real t = simtime;
+  int nsteps = 0;
+  bool failed = false;
+  if(timestep <= 0.0) {
+    // First call, and the timestep wasn't set
+    timestep = first_timestep(t);
+    failed = (timestep <= 0.0);
+  }
+  while(!failed && (t < tout)) {
+    if(nsteps == mxstep) {
+      output.write("ERROR: RK solver took %d steps without reaching output\n", mxstep);
+      failed = true;
+      break;
+    }
+
+    // Don't step past the output time. This doesn't change timestep
+    real dt = timestep;
+    bool last = (t + dt >= tout);
+    if(last)
+      dt = tout - t;
+
+    real taken = take_step(t, dt);
+    if(taken <= 0.0) {
+      failed = true;
+      break;
+    }
+    t = last && (taken == dt) ? tout : t + taken;
+    nsteps++;
+  }
+
+  // Copy variables
+  load_vars(y);
+
+  // Call rhs function to get extra variables at this time
+  real tstart = MPI_Wtime();
+  run_rhs(t);
+  rhs_wtime += MPI_Wtime() - tstart;
+  rhs_ncalls++;
+
+  ncalls = rhs_ncalls;
+  rhstime = rhs_wtime;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  if(failed)
+    return -1.0;
+
+  return t;
+}
+
+/// Take one step of at most dt from time t. Returns the step actually taken, or -1 on failure
+real RKSolver::take_step(real t, real dt)
+{
+  const real *a, *b, *c;
+  int nstages;
+  real limit;
+  if(scheme == RK_RK4) {
+    a = rk4_a; b = rk4_b; c = rk4_c; nstages = rk4_stages; limit = rk4_limit;
+  }else {
+    a = ssp_a; b = ssp_b; c = ssp_c; nstages = ssp_stages; limit = ssp_limit;
+    // Keep the state at the start of the step
+    memcpy(x, y, nlocal*sizeof(real));
+  }
+
+  real dtlimit = max_timestep;
+
+  for(int s=0;s<nstages;s++) {
+    rhs(t + c[s]*dt, y);
+
+    if(adaptive && (s == 1)) {
+      // Estimate the largest eigenvalue, and check the step was stable
+      int nshorten = 0;
+      for(;;) {
+	real L, scale;
+	if(estimate(b[0], dt, L)) {
+	  if(L <= 0.0)
+	    break; // No estimate. Keep the current timestep
+	  
+	  dtlimit = limit / L;
+	  
+	  if(dt <= dtlimit)
+	    break;
+	  
+	  // Past the stability limit. Redo the first stage with a shorter step
+	  scale = cfl*dtlimit / dt;
+	}else {
+	  // Not finite, so no estimate. Redo the first stage with half the step
+	  scale = 0.5;
+	  dtlimit = 0.5*dt;
+	}
+
+	if(nshorten == max_halve) {
+	  output.write("ERROR: RK solver step still unstable after %d reductions at t = %e\n",
+		       max_halve, t);
+	  return -1.0;
+	}
+	nshorten++;
+
+	if(scheme == RK_RK4) {
+	  real bs = b[0]*(scale - 1.0);
+          #pragma omp parallel for
+	  for(int i=0;i<nlocal;i++) {
+	    y[i] += bs*x[i];
+	    x[i] *= scale;
+	  }
+	}else {
+          #pragma omp parallel for
+	  for(int i=0;i<nlocal;i++)
+	    y[i] = x[i] + scale*(y[i] - x[i]);
+	}
+	dt *= scale;
+	rhs(t + c[s]*dt, y);
+      }
+    }
+
+    stage(RK_UPDATE, a[s], b[s], dt, NULL);
+  }
+
+  if(adaptive) {
+    // Next step. Don't let the step grow too quickly, since the
+    // estimate only sees the direction the solution is moving in
+    real next = cfl*dtlimit;
+    if(next > 2.*timestep)
+      next = 2.*timestep;
+    if(next > max_timestep)
+      next = max_timestep;
+    timestep = next;
+  }
+
+  return dt;
+}
+
+/// Estimate the first timestep, from a forward Euler step of size h much smaller than
+/// the output timestep. Returns the timestep, or -1 on failure. The state is unchanged
+real RKSolver::first_timestep(real t)
+{
+  real limit = (scheme == RK_RK4) ? rk4_limit : ssp_limit;
+
+  vector<real> u0(y, y + nlocal);
+
+  real h = 1.0e-3*max_timestep;
+  real L = 0.0;
+  bool ok = false;
+  for(int n=0;(n <= max_halve) && !ok;n++, h *= 0.5) {
+    // The rk4 register and the ssprk3 start both give u1 - u0 = y - u0
+    if(scheme == RK_RK4) {
+      memset(x, 0, nlocal*sizeof(real));
+    }else
+      memcpy(x, y, nlocal*sizeof(real));
+    
+    rhs(t, y);
+    stage(RK_UPDATE, 0.0, 1.0, h, NULL);
+    rhs(t + h, y);
+    ok = estimate(1.0, h, L);
+    
+    memcpy(y, &u0[0], nlocal*sizeof(real));
+  }
+
+  // First rk4 stage multiplies the register by zero
+  memset(x, 0, nlocal*sizeof(real));
+
+  if(!ok) {
+    output.write("ERROR: RK solver state is not finite at t = %e\n", t);
+    return -1.0;
+  }
+
+  real dt = max_timestep;
+  if((L > 0.0) && (cfl*limit/L < dt))
+    dt = cfl*limit/L;
+
+  output.write("\tRK solver first timestep %e\n", dt);
+  
+  return dt;
+}
+
+/// Estimate the largest eigenvalue L after the first stage, with weight b and step h.
+/// L is zero if there's no estimate. Returns false if the estimate isn't finite
+bool RKSolver::estimate(real b, real h, real &L)
+{
+  int nvars = n2Dvars() + n3Dvars();
+  vector<real> loc(2*nvars), glob(2*nvars);
+
+  stage(RK_ESTIMATE, 0.0, b, h, &loc[0]);
+  MPI_Allreduce(&loc[0], &glob[0], 2*nvars, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  // Largest over the variables, so a stiff variable isn't hidden by the others
+  L = 0.0;
+  for(int i=0;i<nvars;i++) {
+    real num = glob[2*i], den = glob[2*i+1];
+    if(!finite(num) || !finite(den))
+      return false;
+    if((num > 0.0) && (den > 0.0) && (num > L*L*den))
+      L = sqrt(num / den);
+  }
+  return true;
+}
+
+/**************************************************************************
+ * RHS function
+ **************************************************************************/
+
+void RKSolver::rhs(real t, real *udata)
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("Running RHS: RKSolver::rhs(%e)", t);
+#endif
+
+  real tstart = MPI_Wtime();
+
+  load_vars(udata);
+
+  run_rhs(t);
+
+  // Make sure vectors in correct basis
+  for(unsigned int i=0;i<v2d.size();i++) {
+    if(v2d[i].covariant) {
+      v2d[i].F_var->to_covariant();
+    }else
+      v2d[i].F_var->to_contravariant();
+  }
+  for(unsigned int i=0;i<v3d.size();i++) {
+    if(v3d[i].covariant) {
+      v3d[i].F_var->to_covariant();
+    }else
+      v3d[i].F_var->to_contravariant();
+  }
+
+  // Make sure 3D fields are at the correct cell location
+  for(vector< VarStr<Field3D> >::iterator it = f3d.begin(); it != f3d.end(); it++) {
+    if((*it).location != ((*it).F_var)->getLocation()) {
+      *((*it).F_var) = interp_to(*((*it).F_var), (*it).location);
+    }
+  }
+
+  rhs_wtime += MPI_Wtime() - tstart;
+  rhs_ncalls++;
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+}
+
+/**************************************************************************
+ * PRIVATE FUNCTIONS
+ **************************************************************************/
+
+/// Update or estimate on a block of n values, given time derivatives f
+/*!
+  RK_UPDATE:   rk4     x = a*x + h*f, y += b*x
+               ssprk3  y = a*x + b*(y + h*f)
+  RK_ESTIMATE: adds |f - f0|^2 to num and |u1 - u0|^2 to den, where
+               for rk4 f0 = x/h, u1 - u0 = b*x and for ssprk3 u1 - u0 = y - x
+ */
+static void rk_block(RK_SCHEME scheme, bool update, int n, const real *f, real *x, real *y,
+		     real a, real b, real h, real &num, real &den)
+{
+  if(update) {
+    if(scheme == RK_RK4) {
+      for(int j=0;j<n;j++) {
+	x[j] = a*x[j] + h*f[j];
+	y[j] += b*x[j];
+      }
+    }else {
+      for(int j=0;j<n;j++)
+	y[j] = a*x[j] + b*(y[j] + h*f[j]);
+    }
+  }else {
+    for(int j=0;j<n;j++) {
+      real du = (scheme == RK_RK4) ? b*x[j] : y[j] - x[j];
+      real f0 = (scheme == RK_RK4) ? x[j]/h : du/h;
+      real d = f[j] - f0;
+      num += d*d;
+      den += du*du;
+    }
+  }
+}
+
+/// Apply a stage operation to the state, using the time derivatives in the F_vars.
+/// For RK_ESTIMATE, est is set to the sums (num, den) for each variable
+void RKSolver::stage(RK_OP op, real a, real b, real h, real *est)
+{
+  int n2d = f2d.size();
+  int n3d = f3d.size();
+  int npts = points.size();
+
+  RK_SCHEME sch = scheme;
+  bool update = (op == RK_UPDATE);
+
+  // Each variable is a separate block of the state
+  for(int i=0;i<n2d+n3d;i++) {
+    // Pointer to the time derivative. Const, so nothing is copied
+    const real *F;
+    int p0, n, stride;
+    if(i < n2d) {
+      F = ((const Field2D*) f2d[i].F_var)->begin();
+      p0 = i*npts; n = 1; stride = 1;
+    }else {
+      F = ((const Field3D*) f3d[i-n2d].F_var)->begin();
+      p0 = n2d*npts + (i-n2d)*npts*ncz; n = ncz; stride = ngz;
+    }
+
+    real num = 0.0, den = 0.0;
+    #pragma omp parallel for reduction(+:num,den)
+    for(int k=0;k<npts;k++) {
+      int p = p0 + k*n;
+      rk_block(sch, update, n, F + points[k]*stride, x + p, y + p, a, b, h, num, den);
+    }
+
+    if(!update) {
+      est[2*i] = num;
+      est[2*i+1] = den;
+    }
+  }
+}
@@ -0,0 +1,88 @@
+/**************************************************************************
+ * Explicit low-storage Runge-Kutta solvers
+ *
+ * For non-stiff (e.g. advection dominated) problems. Only two copies
+ * of the state are kept, and there's no Newton iteration or history.
+ *
+ *  rk4    - Five stage, fourth order 2N-storage scheme of
+ *           Carpenter & Kennedy, NASA TM-109112 (1994)
+ *  ssprk3 - Three stage, third order strong stability preserving
+ *           scheme of Shu & Osher, J.Comput.Phys. 77 (1988)
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+class RKSolver;
+
+#ifndef __RK_SOLVER_H__
+#define __RK_SOLVER_H__
+
+#include "field2d.h"
+#include "field3d.h"
+#include "vector2d.h"
+#include "vector3d.h"
+
+#include "generic_solver.h"
+
+#include "bout_types.h"
+
+#include <vector>
+
+using std::vector;
+
+enum RK_SCHEME {RK_RK4, RK_SSPRK3};
+
+class RKSolver : public GenericSolver {
+ public:
+  RKSolver();
+  ~RKSolver();
+
+  int init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep);
+
+  int run(MonitorFunc f);
+  real run(real tout, int &ncalls, real &rhstime);
+
+ private:
+  int NOUT; // Number of outputs. Specified in init, needed in run
+  real TIMESTEP; // Time between outputs
+
+
+  RK_SCHEME scheme;
+  bool adaptive;     ///< Set the step from an estimate of the CFL limit
+  real cfl;          ///< Fraction of the stability limit to use
+  real timestep;     ///< Current internal timestep
+  real max_timestep;
+  int mxstep;        ///< Maximum number of steps between outputs
+
+  int nlocal;        ///< Number of values on this processor
+  real *x, *y;       ///< State arrays. For rk4 the register and state, for ssprk3 the start and stage
+
+  real take_step(real t, real dt); ///< Returns the step actually taken
+  real first_timestep(real t);     ///< Estimate the first step with a small probe
+  bool estimate(real b, real h, real &L); ///< Largest eigenvalue from the first stage
+  void rhs(real t, real *udata);   ///< Calls the RHS, leaving time derivatives in F_vars
+
+  enum RK_OP {RK_UPDATE, RK_ESTIMATE};
+  void stage(RK_OP op, real a, real b, real h, real *est);
+};
+
+#endif // __RK_SOLVER_H__
@@ -0,0 +1,87 @@
+/**************************************************************************
+ * Run-time choice of time integration solver
+ *
+ **************************************************************************
+ * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
+ *
+ * Contact: Ben Dudson, bd512@york.ac.uk
+ *
+ * This file is part of BOUT++.
+ *
+ * BOUT++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BOUT++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with BOUT++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ **************************************************************************/
+
+#include "globals.h"
+#include "solver.h"
+
+#include <string.h>
+
+/// Table of the solvers compiled in. The first is the default
+struct SolverType {
+  const char *name;
+  GenericSolver* (*create)();
+};
+
+static const SolverType SolverTable[] = {
+#ifdef IDA
+  {"ida", new_ida_solver},
+#endif
+#ifdef CVODE
+  {"cvode", new_cvode_solver},
+#endif
+#ifdef PETSC
+  {"petsc", new_petsc_solver},
+#endif
+#ifdef PVODE_SOLVER
+  {"pvode", new_pvode_solver},
+#endif
+  {"rk", new_rk_solver},
+  {"imex", new_imex_solver},
+  {NULL, NULL}
+};
+
+GenericSolver* GenericSolver::create()
+{
+#ifdef CHECK
+  int msg_point = msg_stack.push("GenericSolver::create()");
+#endif
+
+  const SolverType *s = SolverTable; // Default
+
+  char *type = options.getString("solver", "type");
+  if(type != NULL) {
+    const SolverType *t;
+    for(t = SolverTable; t->name != NULL; t++)
+      if(strcasecmp(type, t->name) == 0)
+	break;
+
+    if(t->name == NULL) {
+      output.write("\tERROR: Solver type '%s' not available. Compiled in:", type);
+      for(t = SolverTable; t->name != NULL; t++)
+	output.write(" %s", t->name);
+      output.write("\n");
+      bout_error("Unknown solver type\n");
+    }
+    s = t;
+  }
+
+  output.write("\tUsing %s solver\n", s->name);
+
+#ifdef CHECK
+  msg_stack.pop(msg_point);
+#endif
+
+  return s->create();
+}
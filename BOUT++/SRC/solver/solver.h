@@ -1,8 +1,17 @@
-/* 
- * This switches between different solver header files based 
- * on command-line defines. 
+/*
+ * Creates time integration solvers. Any of the solvers compiled in
+ * can be chosen at run time by setting "type" in the [solver]
+ * section of BOUT.inp:
  *
- * Need a better solution later...
+ *   pvode  - PVODE, the old version of CVODE supplied with BOUT++
+ *   cvode  - SUNDIALS' CVODE  (compiled with -DCVODE)
+ *   ida    - SUNDIALS' IDA    (compiled with -DIDA)
+ *   petsc  - PETSc TS         (compiled with -DPETSC)
+ *   rk     - Explicit low-storage Runge-Kutta (always available)
+ *   imex   - Split operator IMEX, needs setSplitOperator (always available)
+ *
+ * PVODE can't be linked with the SUNDIALS libraries (it defines the same
+ * symbols), so it's only available if none of the others are.
  *
  **************************************************************************
  * Copyright 2010 B.D.Dudson, S.Farley, M.V.Umansky, X.Q.Xu
@@ -29,30 +38,29 @@
 #ifndef __SOLVER_H__
 #define __SOLVER_H__
 
-#ifdef IDA
+#include "generic_solver.h"
 
-#include "ida_solver.h"
+// Functions to create each solver. These are defined in the solver's
+// source file, so that this header doesn't need the library headers
 
-#else
-// Using a CVODE solver
-#ifdef CVODE
+#if !defined(IDA) && !defined(CVODE) && !defined(PETSC)
+#define PVODE_SOLVER
+GenericSolver* new_pvode_solver();
+#endif
 
-#include "sundials_solver.h"
+#ifdef CVODE
+GenericSolver* new_cvode_solver();
+#endif
 
-#else
+#ifdef IDA
+GenericSolver* new_ida_solver();
+#endif
 
 #ifdef PETSC
+GenericSolver* new_petsc_solver();
+#endif
 
-#include "petsc_solver.h"
-
-#else
-
-#include "cvode_solver.h"
-
-#endif // CVODE
-
-#endif // PETSC
-
-#endif // IDA
+GenericSolver* new_rk_solver();
+GenericSolver* new_imex_solver();
 
 #endif // __SOLVER_H__
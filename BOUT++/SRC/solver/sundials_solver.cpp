@@ -53,7 +53,7 @@ static int cvode_jac(N_Vector v, N_Vector Jv,
 		     realtype t, N_Vector y, N_Vector fy,
 		     void *user_data, N_Vector tmp);
 
-Solver::Solver() : GenericSolver()
+CvodeSolver::CvodeSolver() : GenericSolver()
 {
   has_constraints = false; ///< This solver doesn't have constraints
   
@@ -61,16 +61,22 @@ Solver::Solver() : GenericSolver()
   jacfunc = NULL;
 }
 
-Solver::~Solver()
+CvodeSolver::~CvodeSolver()
 {
   
 }
 
+/// Creates a SUNDIALS CVODE solver. Called by GenericSolver::create() in solver.cpp
+GenericSolver* new_cvode_solver()
+{
+  return new CvodeSolver();
+}
+
 /**************************************************************************
  * Initialise
  **************************************************************************/
 
-int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
+int CvodeSolver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, real tstep)
 {
 #ifdef CHECK
   int msg_point = msg_stack.push("Initialising CVODE solver");
@@ -86,9 +92,6 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
 
   output.write("Initialising SUNDIALS' CVODE solver\n");
 
-  // Set the rhs solver function
-  func = f;
-
   // Calculate number of variables (in generic_solver)
   int local_N = getLocalN();
   
@@ -107,10 +110,6 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
   if((uvec = N_VNew_Parallel(MPI_COMM_WORLD, local_N, neq)) == NULL)
     bout_error("ERROR: SUNDIALS memory allocation failed\n");
   
-  // Put the variables into uvec
-  if(save_vars(NV_DATA_P(uvec)))
-    bout_error("\tERROR: Initial variable value not set\n");
-  
   /// Get options
 
   real abstol, reltol;
@@ -131,6 +130,7 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
   options.get("use_precon", use_precon, false);
   options.get("use_jacobian", use_jacobian, false);
   options.get("max_timestep", max_timestep, -1.);
+  options.get("field_order", field_order, false);
   
   int mxsteps; // Maximum number of steps to take between outputs
   options.get("pvode_mxstep", mxsteps, 500);
@@ -153,6 +153,16 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
   if(func_iter)
     iter = CV_FUNCTIONAL;
 
+  if(field_order && use_precon && (prefunc == NULL) && !func_iter) {
+    // BBD bandwidths (mudq etc.) assume variables are interleaved
+    output.write("\tWARNING: field_order can't be used with BBD preconditioner. Ignoring\n");
+    field_order = false;
+  }
+
+  // Put the variables into uvec
+  if(save_vars(NV_DATA_P(uvec)))
+    bout_error("\tERROR: Initial variable value not set\n");
+
   // Call CVodeCreate
   if((cvode_mem = CVodeCreate(lmm, iter)) == NULL)
     bout_error("ERROR: CVodeCreate failed\n");
@@ -230,10 +240,10 @@ int Solver::init(rhsfunc f, int argc, char **argv, bool restarting, int nout, re
  * Run - Advance time
  **************************************************************************/
 
-int Solver::run(MonitorFunc monitor)
+int CvodeSolver::run(MonitorFunc monitor)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("CVODE Solver::run()");
+  int msg_point = msg_stack.push("CvodeSolver::run()");
 #endif
   
   if(!initialised)
@@ -283,10 +293,10 @@ int Solver::run(MonitorFunc monitor)
   return 0;
 }
 
-real Solver::run(real tout, int &ncalls, real &rhstime)
+real CvodeSolver::run(real tout, int &ncalls, real &rhstime)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running solver: solver::run(%e)", tout);
+  int msg_point = msg_stack.push("Running solver: CvodeSolver::run(%e)", tout);
 #endif
 
   MPI_Barrier(MPI_COMM_WORLD);
@@ -307,7 +317,7 @@ real Solver::run(real tout, int &ncalls, real &rhstime)
 
   // Call rhs function to get extra variables at this time
   real tstart = MPI_Wtime();
-  (*func)(simtime);
+  run_rhs(simtime);
   rhs_wtime += MPI_Wtime() - tstart;
   rhs_ncalls++;
   
@@ -327,10 +337,10 @@ real Solver::run(real tout, int &ncalls, real &rhstime)
  * RHS function du = F(t, u)
  **************************************************************************/
 
-void Solver::rhs(real t, real *udata, real *dudata)
+void CvodeSolver::rhs(real t, real *udata, real *dudata)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running RHS: Solver::res(%e)", t);
+  int msg_point = msg_stack.push("Running RHS: CvodeSolver::rhs(%e)", t);
 #endif
 
   real tstart = MPI_Wtime();
@@ -339,7 +349,7 @@ void Solver::rhs(real t, real *udata, real *dudata)
   load_vars(udata);
   
   // Call RHS function
-  (*func)(t);
+  run_rhs(t);
   
   // Save derivatives to dudata
   save_derivs(dudata);
@@ -356,10 +366,10 @@ void Solver::rhs(real t, real *udata, real *dudata)
  * Preconditioner function
  **************************************************************************/
 
-void Solver::pre(real t, real gamma, real delta, real *udata, real *rvec, real *zvec)
+void CvodeSolver::pre(real t, real gamma, real delta, real *udata, real *rvec, real *zvec)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running preconditioner: Solver::pre(%e)", t);
+  int msg_point = msg_stack.push("Running preconditioner: CvodeSolver::pre(%e)", t);
 #endif
 
   real tstart = MPI_Wtime();
@@ -396,10 +406,10 @@ void Solver::pre(real t, real gamma, real delta, real *udata, real *rvec, real *
  * Jacobian-vector multiplication function
  **************************************************************************/
 
-void Solver::jac(real t, real *ydata, real *vdata, real *Jvdata)
+void CvodeSolver::jac(real t, real *ydata, real *vdata, real *Jvdata)
 {
 #ifdef CHECK
-  int msg_point = msg_stack.push("Running Jacobian: Solver::jac(%e)", t);
+  int msg_point = msg_stack.push("Running Jacobian: CvodeSolver::jac(%e)", t);
 #endif
   
   if(jacfunc == NULL)
@@ -422,260 +432,6 @@ void Solver::jac(real t, real *ydata, real *vdata, real *Jvdata)
 #endif
 }
 
-/**************************************************************************
- * PRIVATE FUNCTIONS
- **************************************************************************/
-
-/// Perform an operation at a given (jx,jy) location, moving data between BOUT++ and CVODE
-void Solver::loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op)
-{
-  real **d2d, ***d3d;
-  int i;
-  int jz;
- 
-  int n2d = f2d.size();
-  int n3d = f3d.size();
-
-  switch(op) {
-  case LOAD_VARS: {
-    /// Load variables from IDA into BOUT++
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      d2d[jx][jy] = udata[p];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	d3d[jx][jy][jz] = udata[p];
-	p++;
-      }  
-    }
-    break;
-  }
-  case LOAD_DERIVS: {
-    /// Load derivatives from IDA into BOUT++
-    /// Used for preconditioner
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].F_var->getData(); // Get pointer to data
-      d2d[jx][jy] = udata[p];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].F_var->getData(); // Get pointer to data
-	d3d[jx][jy][jz] = udata[p];
-	p++;
-      }  
-    }
-    
-    break;
-  }
-  case SAVE_VARS: {
-    /// Save variables from BOUT++ into IDA (only used at start of simulation)
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-    /// Save time-derivatives from BOUT++ into CVODE (returning RHS result)
-  case SAVE_DERIVS: {
-    
-    // Loop over 2D variables
-    for(i=0;i<n2d;i++) {
-      d2d = f2d[i].F_var->getData(); // Get pointer to data
-      udata[p] = d2d[jx][jy];
-      p++;
-    }
-    
-    for (jz=0; jz < ncz; jz++) {
-      
-      // Loop over 3D variables
-      for(i=0;i<n3d;i++) {
-	d3d = f3d[i].F_var->getData(); // Get pointer to data
-	udata[p] = d3d[jx][jy][jz];
-	p++;
-      }  
-    }
-    break;
-  }
-  }
-}
-
-/// Loop over variables and domain. Used for all data operations for consistency
-void Solver::loop_vars(real *udata, SOLVER_VAR_OP op)
-{
-  int jx, jy;
-  int p = 0; // Counter for location in udata array
-
-  // Inner X boundary
-  if(IDATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(jx, jy+MYG, udata, p, op);
-  }
-
-  for (jx=MXG; jx < MXSUB+MXG; jx++) {
-    
-    // Lower Y boundary region
-    
-    if( ((DDATA_INDEST == -1) && (jx < DDATA_XSPLIT)) ||
-	((DDATA_OUTDEST == -1) && (jx >= DDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, jy, udata, p, op);
-    }
-    
-    for (jy=0; jy < MYSUB; jy++) {
-      // Bulk of points
-      loop_vars_op(jx, jy+MYG, udata, p, op);
-    }
-
-    // Upper Y boundary condition
-
-    if( ((UDATA_INDEST == -1) && (jx < UDATA_XSPLIT)) ||
-	((UDATA_OUTDEST == -1) && (jx >= UDATA_XSPLIT)) ) {
-      for(jy=0;jy<MYG;jy++)
-	loop_vars_op(jx, MYSUB+MYG+jy, udata, p, op);
-    }
-  }
-
-  // Outer X boundary
-  if(ODATA_DEST == -1) {
-    for(jx=0;jx<MXG;jx++)
-      for(jy=0;jy<MYSUB;jy++)
-	loop_vars_op(MXG+MXSUB+jx, jy+MYG, udata, p, op);
-  }
-}
-
-void Solver::load_vars(real *udata)
-{
-  unsigned int i;
-  
-  // Make sure data is allocated
-  for(i=0;i<f2d.size();i++)
-    f2d[i].var->Allocate();
-  for(i=0;i<f3d.size();i++) {
-    f3d[i].var->Allocate();
-    f3d[i].var->setLocation(f3d[i].location);
-  }
-
-  loop_vars(udata, LOAD_VARS);
-
-  // Mark each vector as either co- or contra-variant
-
-  for(i=0;i<v2d.size();i++)
-    v2d[i].var->covariant = v2d[i].covariant;
-  for(i=0;i<v3d.size();i++)
-    v3d[i].var->covariant = v3d[i].covariant;
-}
-
-void Solver::load_derivs(real *udata)
-{
-  unsigned int i;
-  
-  // Make sure data is allocated
-  for(i=0;i<f2d.size();i++)
-    f2d[i].F_var->Allocate();
-  for(i=0;i<f3d.size();i++) {
-    f3d[i].F_var->Allocate();
-    f3d[i].F_var->setLocation(f3d[i].location);
-  }
-
-  loop_vars(udata, LOAD_DERIVS);
-
-  // Mark each vector as either co- or contra-variant
-
-  for(i=0;i<v2d.size();i++)
-    v2d[i].F_var->covariant = v2d[i].covariant;
-  for(i=0;i<v3d.size();i++)
-    v3d[i].F_var->covariant = v3d[i].covariant;
-}
-
-// This function only called during initialisation
-int Solver::save_vars(real *udata)
-{
-  unsigned int i;
-
-  for(i=0;i<f2d.size();i++)
-    if(f2d[i].var->getData() == (real**) NULL)
-      return(1);
-
-  for(i=0;i<f3d.size();i++)
-    if(f3d[i].var->getData() == (real***) NULL)
-      return(1);
-  
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].var->to_covariant();
-    }else
-      v2d[i].var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].var->to_covariant();
-    }else
-      v3d[i].var->to_contravariant();
-  }
-
-  loop_vars(udata, SAVE_VARS);
-
-  return(0);
-}
-
-void Solver::save_derivs(real *dudata)
-{
-  unsigned int i;
-
-  // Make sure vectors in correct basis
-  for(i=0;i<v2d.size();i++) {
-    if(v2d[i].covariant) {
-      v2d[i].F_var->to_covariant();
-    }else
-      v2d[i].F_var->to_contravariant();
-  }
-  for(i=0;i<v3d.size();i++) {
-    if(v3d[i].covariant) {
-      v3d[i].F_var->to_covariant();
-    }else
-      v3d[i].F_var->to_contravariant();
-  }
-
-  // Make sure 3D fields are at the correct cell location
-  for(vector< VarStr<Field3D> >::iterator it = f3d.begin(); it != f3d.end(); it++) {
-    if((*it).location != ((*it).F_var)->getLocation()) {
-      //output.write("SOLVER: Interpolating\n");
-      *((*it).F_var) = interp_to(*((*it).F_var), (*it).location);
-    }
-  }
-
-  loop_vars(dudata, SAVE_DERIVS);
-}
-
 /**************************************************************************
  * CVODE RHS functions
  **************************************************************************/
@@ -687,7 +443,7 @@ static int cvode_rhs(real t,
   real *udata = NV_DATA_P(u);
   real *dudata = NV_DATA_P(du);
   
-  Solver *s = (Solver*) user_data;
+  CvodeSolver *s = (CvodeSolver*) user_data;
 
   // Calculate residuals
   s->rhs(t, udata, dudata);
@@ -713,7 +469,7 @@ static int cvode_pre(real t, N_Vector yy, N_Vector yp,
   real *rdata = NV_DATA_P(rvec);
   real *zdata = NV_DATA_P(zvec);
   
-  Solver *s = (Solver*) user_data;
+  CvodeSolver *s = (CvodeSolver*) user_data;
 
   // Calculate residuals
   s->pre(t, gamma, delta, udata, rdata, zdata);
@@ -730,7 +486,7 @@ static int cvode_jac(N_Vector v, N_Vector Jv,
   real *vdata = NV_DATA_P(v);   ///< Input vector
   real *Jvdata = NV_DATA_P(Jv);  ///< Jacobian*vector output
   
-  Solver *s = (Solver*) user_data;
+  CvodeSolver *s = (CvodeSolver*) user_data;
   
   s->jac(t, ydata, vdata, Jvdata);
   
@@ -25,7 +25,7 @@
  *
  **************************************************************************/
 
-class Solver;
+class CvodeSolver;
 
 #ifndef __SUNDIAL_SOLVER_H__
 #define __SUNDIAL_SOLVER_H__
@@ -48,12 +48,10 @@ class Solver;
 #include <vector>
 using std::vector;
 
-enum SOLVER_VAR_OP {LOAD_VARS, LOAD_DERIVS, SAVE_VARS, SAVE_DERIVS};
-
-class Solver : public GenericSolver {
+class CvodeSolver : public GenericSolver {
  public:
-  Solver();
-  ~Solver();
+  CvodeSolver();
+  ~CvodeSolver();
   
   void setPrecon(PhysicsPrecon f) {prefunc = f;}
   
@@ -72,22 +70,12 @@ class Solver : public GenericSolver {
   int NOUT; // Number of outputs. Specified in init, needed in run
   real TIMESTEP; // Time between outputs
 
-  rhsfunc func; // RHS function
   PhysicsPrecon prefunc; // Preconditioner
   Jacobian jacfunc; // Jacobian - vector function
   
   N_Vector uvec; // Values
   void *cvode_mem;
 
-  // Loading data from BOUT++ to/from IDA
-  void loop_vars_op(int jx, int jy, real *udata, int &p, SOLVER_VAR_OP op);
-  void loop_vars(real *udata, SOLVER_VAR_OP op);
-
-  void load_vars(real *udata);
-  void load_derivs(real *udata);
-  int save_vars(real *udata);
-  void save_derivs(real *dudata);
-
   real pre_Wtime; // Time in preconditioner
   real pre_ncalls; // Number of calls to preconditioner
 };
@@ -30,6 +30,11 @@ using std::vector;
 
 typedef double real;
 
+/// MPI type corresponding to real. Same as PVODE's definition
+#ifndef PVEC_REAL_MPI_TYPE
+#define PVEC_REAL_MPI_TYPE MPI_DOUBLE
+#endif
+
 typedef vector<real> rvec;  // Vector of reals
 
 /// 4 possible variable locations. Default is for passing to functions
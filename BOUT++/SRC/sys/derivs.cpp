@@ -29,6 +29,7 @@
 #include "utils.h"
 #include "fft.h"
 #include "interpolation.h"
+#include "communicator.h"
 
 #include <math.h>
 #include <string.h>
@@ -37,6 +38,15 @@
 typedef real (*deriv_func)(stencil &); // f
 typedef real (*upwind_func)(stencil &, stencil &); // v, f
 
+/// Pointers to lines of data, offset in the direction of differencing
+/// so that the stencil at point i is (mm[i], m[i], c[i], p[i], pp[i])
+struct stencil_line {
+  const real *mm, *m, *c, *p, *pp;
+};
+
+typedef void (*deriv_line_func)(stencil_line &, real *, int); // f, result, n
+typedef void (*upwind_line_func)(const real *, stencil_line &, real *, int); // v, f, result, n
+
 /*******************************************************************************
  * Basic derivative methods.
  * All expect to have an input grid cell at the same location as the output
@@ -284,6 +294,113 @@ real VDDX_U1_stag(stencil &v, stencil &f)
   return result;
 }
 
+/*******************************************************************************
+ * Line versions of the above methods
+ * These calculate a whole line of n points at once, so the loop can be
+ * inlined and vectorised rather than calling a function for each point.
+ * Each must give the same result as the single-point method.
+ *******************************************************************************/
+
+void DDX_C2_line(stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = 0.5*(f.p[i] - f.m[i]);
+}
+
+void DDX_C4_line(stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = (8.*f.p[i] - 8.*f.m[i] + f.mm[i] - f.pp[i])/12.;
+}
+
+void DDX_CWENO2_line(stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++) {
+    real dc = 0.5*(f.p[i] - f.m[i]);
+    real dl = f.c[i] - f.m[i];
+    real dr = f.p[i] - f.c[i];
+    
+    real isl = SQ(dl);
+    real isr = SQ(dr);
+    real isc = (13./3.)*SQ(f.p[i] - 2.*f.c[i] + f.m[i]) + 0.25*SQ(f.p[i]-f.m[i]);
+    
+    real al = 0.25/SQ(WENO_SMALL + isl);
+    real ar = 0.25/SQ(WENO_SMALL + isr);
+    real ac = 0.5/SQ(WENO_SMALL + isc);
+    real sa = al + ar + ac;
+    
+    r[i] = (al*dl + ar*dr + ac*dc)/sa;
+  }
+}
+
+void DDX_CWENO3_line(stencil_line &f, real *r, int n)
+{
+  // Uses stencil arithmetic, so just call the point version
+  for(int i=0;i<n;i++) {
+    stencil s(f.c[i], f.m[i], f.p[i], f.mm[i], f.pp[i]);
+    r[i] = DDX_CWENO3(s);
+  }
+}
+
+void D2DX2_C2_line(stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = f.p[i] + f.m[i] - 2.*f.c[i];
+}
+
+void D2DX2_C4_line(stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = (-f.pp[i] + 16.*f.p[i] - 30.*f.c[i] + 16.*f.m[i] - f.mm[i])/12.;
+}
+
+void VDDX_C2_line(const real *v, stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = v[i]*0.5*(f.p[i] - f.m[i]);
+}
+
+void VDDX_C4_line(const real *v, stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = v[i]*(8.*f.p[i] - 8.*f.m[i] + f.mm[i] - f.pp[i])/12.;
+}
+
+void VDDX_U1_line(const real *v, stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = v[i]>=0.0 ? v[i]*(f.c[i] - f.m[i]): v[i]*(f.p[i] - f.c[i]);
+}
+
+void VDDX_U4_line(const real *v, stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++)
+    r[i] = v[i] >= 0.0 ? v[i]*(4.*f.p[i] - 12.*f.m[i] + 2.*f.mm[i] + 6.*f.c[i])/12.
+      : v[i]*(-4.*f.m[i] + 12.*f.p[i] - 2.*f.pp[i] - 6.*f.c[i])/12.;
+}
+
+void VDDX_WENO3_line(const real *v, stencil_line &f, real *r, int n)
+{
+  for(int i=0;i<n;i++) {
+    real deriv, w, q;
+    
+    if(v[i] > 0.0) {
+      // Left-biased stencil
+      q = (WENO_SMALL + SQ(f.c[i] - 2.0*f.m[i] + f.mm[i])) / (WENO_SMALL + SQ(f.p[i] - 2.0*f.c[i] + f.m[i]));
+      w = 1.0 / (1.0 + 2.0*q*q);
+      
+      deriv = 0.5*(f.p[i] - f.m[i]) - 0.5*w*(-f.mm[i] + 3.*f.m[i] - 3.*f.c[i] + f.p[i]);
+    }else {
+      // Right-biased
+      q = (WENO_SMALL + SQ(f.pp[i] - 2.0*f.p[i] + f.c[i])) / (WENO_SMALL + SQ(f.p[i] - 2.0*f.c[i] + f.m[i]));
+      w = 1.0 / (1.0 + 2.0*q*q);
+      
+      deriv = 0.5*(f.p[i] - f.m[i]) - 0.5*w*( -f.m[i] + 3.*f.c[i] - 3.*f.p[i] + f.pp[i] );
+    }
+    r[i] = v[i]*deriv;
+  }
+}
+
 /*******************************************************************************
  * Lookup tables of functions. Map between names, codes and functions
  *******************************************************************************/
@@ -293,6 +410,8 @@ struct DiffLookup {
   DIFF_METHOD method;
   deriv_func func;     // Single-argument differencing function
   upwind_func up_func; // Upwinding function
+  deriv_line_func line_func;     // Line versions of func and up_func.
+  upwind_line_func up_line_func; // NULL if not implemented
 };
 
 /// Translate between short names, long names and DIFF_METHOD codes
@@ -310,42 +429,42 @@ static DiffNameLookup DiffNameTable[] = { {DIFF_U1, "U1", "First order upwinding
 					  {DIFF_C4, "C4", "Fourth order central"},
 					  {DIFF_U4, "U4", "Fourth order upwinding"},
 					  {DIFF_FFT, "FFT", "FFT"},
-					  {DIFF_DEFAULT}}; // Use to terminate the list
+					  {DIFF_DEFAULT, NULL, NULL}}; // Use to terminate the list
 
 /// First derivative lookup table
-static DiffLookup FirstDerivTable[] = { {DIFF_C2, DDX_C2,     NULL},
-					{DIFF_W2, DDX_CWENO2, NULL},
-					{DIFF_W3, DDX_CWENO3, NULL},
-					{DIFF_C4, DDX_C4,     NULL},
-					{DIFF_FFT, NULL,      NULL},
-					{DIFF_DEFAULT}};
+static DiffLookup FirstDerivTable[] = { {DIFF_C2, DDX_C2,     NULL, DDX_C2_line,     NULL},
+					{DIFF_W2, DDX_CWENO2, NULL, DDX_CWENO2_line, NULL},
+					{DIFF_W3, DDX_CWENO3, NULL, DDX_CWENO3_line, NULL},
+					{DIFF_C4, DDX_C4,     NULL, DDX_C4_line,     NULL},
+					{DIFF_FFT, NULL,      NULL, NULL,            NULL},
+					{DIFF_DEFAULT, NULL,  NULL, NULL,            NULL}};
 
 /// Second derivative lookup table
-static DiffLookup SecondDerivTable[] = { {DIFF_C2, D2DX2_C2, NULL},
-					{DIFF_C4, D2DX2_C4, NULL},
-					{DIFF_FFT, NULL,    NULL},
-					{DIFF_DEFAULT}};
+static DiffLookup SecondDerivTable[] = { {DIFF_C2, D2DX2_C2, NULL, D2DX2_C2_line, NULL},
+					{DIFF_C4, D2DX2_C4, NULL, D2DX2_C4_line, NULL},
+					{DIFF_FFT, NULL,    NULL, NULL,          NULL},
+					{DIFF_DEFAULT, NULL, NULL, NULL,         NULL}};
 
 /// Upwinding functions lookup table
-static DiffLookup UpwindTable[] = { {DIFF_U1, NULL, VDDX_U1},
-				    {DIFF_C2, NULL, VDDX_C2},
-				    {DIFF_U4, NULL, VDDX_U4},
-				    {DIFF_W3, NULL, VDDX_WENO3},
-				    {DIFF_C4, NULL, VDDX_C4},
-				    {DIFF_DEFAULT}};
+static DiffLookup UpwindTable[] = { {DIFF_U1, NULL, VDDX_U1,    NULL, VDDX_U1_line},
+				    {DIFF_C2, NULL, VDDX_C2,    NULL, VDDX_C2_line},
+				    {DIFF_U4, NULL, VDDX_U4,    NULL, VDDX_U4_line},
+				    {DIFF_W3, NULL, VDDX_WENO3, NULL, VDDX_WENO3_line},
+				    {DIFF_C4, NULL, VDDX_C4,    NULL, VDDX_C4_line},
+				    {DIFF_DEFAULT, NULL, NULL,  NULL, NULL}};
 
 /// First staggered derivative lookup
-static DiffLookup FirstStagDerivTable[] = { {DIFF_C2, DDX_C2_stag, NULL}, 
-					    {DIFF_C4, DDX_C4_stag, NULL},
-					    {DIFF_DEFAULT}};
+static DiffLookup FirstStagDerivTable[] = { {DIFF_C2, DDX_C2_stag, NULL, NULL, NULL}, 
+					    {DIFF_C4, DDX_C4_stag, NULL, NULL, NULL},
+					    {DIFF_DEFAULT, NULL,   NULL, NULL, NULL}};
 
 /// Second staggered derivative lookup
-static DiffLookup SecondStagDerivTable[] = { {DIFF_C4, D2DX2_C4_stag, NULL},
-					     {DIFF_DEFAULT}};
+static DiffLookup SecondStagDerivTable[] = { {DIFF_C4, D2DX2_C4_stag, NULL, NULL, NULL},
+					     {DIFF_DEFAULT, NULL,     NULL, NULL, NULL}};
 
 /// Upwinding staggered lookup
-static DiffLookup UpwindStagTable[] = { {DIFF_U1, NULL, VDDX_U1_stag},
-					{DIFF_DEFAULT} };
+static DiffLookup UpwindStagTable[] = { {DIFF_U1, NULL, VDDX_U1_stag, NULL, NULL},
+					{DIFF_DEFAULT, NULL, NULL,   NULL, NULL} };
 
 /*******************************************************************************
  * Routines to use the above tables to map between function codes, names
@@ -378,6 +497,28 @@ upwind_func lookupUpwindFunc(DiffLookup* table, DIFF_METHOD method)
   return table[0].up_func;
 }
 
+/// Find the line version of a differencing function. Returns NULL if
+/// func is not in the (non-staggered) tables or has no line version
+deriv_line_func lookupLineFunc(deriv_func func)
+{
+  DiffLookup *tables[] = {FirstDerivTable, SecondDerivTable};
+  
+  for(int t=0;t<2;t++) {
+    for(int i=0;tables[t][i].method != DIFF_DEFAULT;i++)
+      if((tables[t][i].func == func) && (func != NULL))
+	return tables[t][i].line_func;
+  }
+  return NULL;
+}
+
+upwind_line_func lookupUpwindLineFunc(upwind_func func)
+{
+  for(int i=0;UpwindTable[i].method != DIFF_DEFAULT;i++)
+    if((UpwindTable[i].up_func == func) && (func != NULL))
+      return UpwindTable[i].up_line_func;
+  return NULL;
+}
+
 /// Test if a given DIFF_METHOD exists in a table
 bool isImplemented(DiffLookup* table, DIFF_METHOD method)
 {
@@ -464,27 +605,62 @@ deriv_func sfDDX, sfDDY, sfDDZ;
 deriv_func sfD2DX2, sfD2DY2, sfD2DZ2;
 upwind_func sfVDDX, sfVDDY, sfVDDZ;
 
+// Number of points either side used by the selected methods (-1 for FFT)
+int stencil_xw = 0, stencil_yw = 0, stencil_zw = 0;
+
 /*******************************************************************************
  * Initialisation
  *******************************************************************************/
 
+/// Number of points either side of the centre used by a method, or -1 for the whole line
+int method_width(DIFF_METHOD method)
+{
+  switch(method) {
+  case DIFF_U1:
+  case DIFF_C2:
+  case DIFF_W2:
+    return 1;
+  case DIFF_W3:
+  case DIFF_C4:
+  case DIFF_U4:
+    return 2;
+  case DIFF_FFT:
+    return -1;
+  default:
+    break;
+  }
+  return 0;
+}
+
+/// Widen a stencil to include a method
+void widen_stencil(int &w, DIFF_METHOD method)
+{
+  int mw = method_width(method);
+  if((w < 0) || (mw < 0)) {
+    w = -1;
+  }else if(mw > w)
+    w = mw;
+}
+
 /// Set the derivative method, given a table and option name
-void derivs_set(DiffLookup *table, const char* name, deriv_func &f)
+void derivs_set(DiffLookup *table, const char* name, deriv_func &f, int &width)
 {
   char *label = options.getString(name);
 
   DIFF_METHOD method = lookupFunc(table, label); // Find the function
   printFuncName(method); // Print differential function name
   f = lookupFunc(table, method); // Find the function pointer
+  widen_stencil(width, method);
 }
 
-void derivs_set(DiffLookup *table, const char* name, upwind_func &f)
+void derivs_set(DiffLookup *table, const char* name, upwind_func &f, int &width)
 {
   char *label = options.getString(name);
 
   DIFF_METHOD method = lookupFunc(table, label); // Find the function
   printFuncName(method); // Print differential function name
   f = lookupUpwindFunc(table, method);
+  widen_stencil(width, method);
 }
 
 /// Initialise the derivative methods. Must be called before any derivatives are used
@@ -497,22 +673,22 @@ int derivs_init()
   output.write("Setting X differencing methods\n");
   options.setSection("ddx");
   output.write("\tFirst       : ");
-  derivs_set(FirstDerivTable, "first",  fDDX);
+  derivs_set(FirstDerivTable, "first",  fDDX, stencil_xw);
   if(StaggerGrids) {
     output.write("\tStag. First : ");
-    derivs_set(FirstStagDerivTable, "first",  sfDDX);
+    derivs_set(FirstStagDerivTable, "first",  sfDDX, stencil_xw);
   }
   output.write("\tSecond      : ");
-  derivs_set(SecondDerivTable, "second", fD2DX2);
+  derivs_set(SecondDerivTable, "second", fD2DX2, stencil_xw);
   if(StaggerGrids) {
     output.write("\tStag. Second: ");
-    derivs_set(SecondStagDerivTable, "second", sfD2DX2);
+    derivs_set(SecondStagDerivTable, "second", sfD2DX2, stencil_xw);
   }
   output.write("\tUpwind      : ");
-  derivs_set(UpwindTable,     "upwind", fVDDX);
+  derivs_set(UpwindTable,     "upwind", fVDDX, stencil_xw);
   if(StaggerGrids) {
     output.write("\tStag. Upwind: ");
-    derivs_set(UpwindStagTable,     "upwind", sfVDDX);
+    derivs_set(UpwindStagTable,     "upwind", sfVDDX, stencil_xw);
   }
   
   if((fDDX == NULL) || (fD2DX2 == NULL)) {
@@ -523,22 +699,22 @@ int derivs_init()
   output.write("Setting Y differencing methods\n");
   options.setSection("ddy");
   output.write("\tFirst       : ");
-  derivs_set(FirstDerivTable, "first",  fDDY);
+  derivs_set(FirstDerivTable, "first",  fDDY, stencil_yw);
   if(StaggerGrids) {
     output.write("\tStag. First : ");
-    derivs_set(FirstStagDerivTable, "first",  sfDDY);
+    derivs_set(FirstStagDerivTable, "first",  sfDDY, stencil_yw);
   }
   output.write("\tSecond      : ");
-  derivs_set(SecondDerivTable, "second", fD2DY2);
+  derivs_set(SecondDerivTable, "second", fD2DY2, stencil_yw);
   if(StaggerGrids) {
     output.write("\tStag. Second: ");
-    derivs_set(SecondStagDerivTable, "second", sfD2DY2);
+    derivs_set(SecondStagDerivTable, "second", sfD2DY2, stencil_yw);
   }
   output.write("\tUpwind      : ");
-  derivs_set(UpwindTable,     "upwind", fVDDY);
+  derivs_set(UpwindTable,     "upwind", fVDDY, stencil_yw);
   if(StaggerGrids) {
     output.write("\tStag. Upwind: ");
-    derivs_set(UpwindStagTable,     "upwind", sfVDDY);
+    derivs_set(UpwindStagTable,     "upwind", sfVDDY, stencil_yw);
   }
 
   if((fDDY == NULL) || (fD2DY2 == NULL)) {
@@ -549,22 +725,22 @@ int derivs_init()
   output.write("Setting Z differencing methods\n");
   options.setSection("ddz");
   output.write("\tFirst       : ");
-  derivs_set(FirstDerivTable, "first",  fDDZ);
+  derivs_set(FirstDerivTable, "first",  fDDZ, stencil_zw);
   if(StaggerGrids) {
     output.write("\tStag. First : ");
-    derivs_set(FirstStagDerivTable, "first",  sfDDZ);
+    derivs_set(FirstStagDerivTable, "first",  sfDDZ, stencil_zw);
   }
   output.write("\tSecond      : ");
-  derivs_set(SecondDerivTable, "second", fD2DZ2);
+  derivs_set(SecondDerivTable, "second", fD2DZ2, stencil_zw);
   if(StaggerGrids) {
     output.write("\tStag. Second: ");
-    derivs_set(SecondStagDerivTable, "second", sfD2DZ2);
+    derivs_set(SecondStagDerivTable, "second", sfD2DZ2, stencil_zw);
   }
   output.write("\tUpwind      : ");
-  derivs_set(UpwindTable,     "upwind", fVDDZ);
+  derivs_set(UpwindTable,     "upwind", fVDDZ, stencil_zw);
   if(StaggerGrids) {
     output.write("\tStag. Upwind: ");
-    derivs_set(UpwindStagTable,     "upwind", sfVDDZ);
+    derivs_set(UpwindStagTable,     "upwind", sfVDDZ, stencil_zw);
   }
 
 #ifdef CHECK
@@ -574,31 +750,245 @@ int derivs_init()
   return 0;
 }
 
+/// Number of points either side used by the default methods in each direction
+/*!
+ * Set by derivs_init. zw is -1 if FFT methods are used in Z, in which
+ * case all points in Z are coupled. Used to find the sparsity pattern
+ * of the Jacobian (see precon/jstruc.cpp)
+ */
+void derivs_stencil(int &xw, int &yw, int &zw)
+{
+  xw = stencil_xw;
+  yw = stencil_yw;
+  zw = stencil_zw;
+}
+
 /*******************************************************************************
  * Apply differential operators. These are fairly brain-dead functions
  * which apply a derivative function to a field (sort of like map). Decisions
  * of what to apply are made in the DDX,DDY and DDZ functions lower down.
  *
+ * Where the method has a line version and the stencil doesn't need
+ * shifting, whole lines are done at once, and the lines are split
+ * between OpenMP threads. Otherwise a stencil is set for each point.
+ *
  * loc  is the cell location of the result
  *******************************************************************************/
 
+/// Neighbouring x indices of jx, clipped at the edges as in calc_index
+void line_xindex(int jx, int &jx2m, int &jxm, int &jxp, int &jx2p)
+{
+  jxp = (jx+1 >= ngx) ? ngx-1 : jx+1;
+  jxm = (jx-1 < 0) ? 0 : jx-1;
+  jx2m = (jx > 1) ? jx-2 : jxm;
+  jx2p = (jx < ngx-2) ? jx+2 : jxp;
+}
+
+/// Neighbouring y indices of jy, as in calc_index
+void line_yindex(int jy, int &jy2m, int &jym, int &jyp, int &jy2p)
+{
+  jyp = jy+1;
+  jym = jy-1;
+  jy2p = (jy < jend || MYG > 1) ? jy+2 : jy+1;
+  jy2m = (jy > jstart || MYG > 1) ? jy-2 : jy-1;
+}
+
+/// Pointer to the z line at (jx, jy). Unlike operator[] this doesn't
+/// make the data unique, so shared data isn't copied
+const real* zline(const Field3D &f, int jx, int jy)
+{
+  return f.begin() + (jx*ngy + jy)*ngz;
+}
+
+/// Copies a periodic z line into a buffer with two points either side,
+/// and points the stencil into it. Each thread has its own buffer
+void line_zstencil(const real *f, stencil_line &s)
+{
+  static real *buffer = (real*) NULL;
+  #pragma omp threadprivate(buffer)
+  
+  if(buffer == (real*) NULL)
+    buffer = rvector_aligned(ncz+4);
+  
+  for(int jz=0;jz<ncz+4;jz++)
+    buffer[jz] = f[(jz+2*ncz-2) % ncz];
+
+  s.mm = buffer;
+  s.m  = buffer+1;
+  s.c  = buffer+2;
+  s.p  = buffer+3;
+  s.pp = buffer+4;
+}
+
+/// Velocity along a z line for the upwinding line functions (which only use
+/// the centre value). Returns NULL if v is not a Field2D or Field3D
+const real* line_zvalues(const Field &v, int jx, int jy)
+{
+  static real *buffer = (real*) NULL;
+  #pragma omp threadprivate(buffer)
+  
+  const Field3D *v3 = dynamic_cast<const Field3D*>(&v);
+  if(v3 != NULL)
+    return zline(*v3, jx, jy);
+  
+  const Field2D *v2 = dynamic_cast<const Field2D*>(&v);
+  if(v2 == NULL)
+    return NULL;
+  
+  // Constant in z
+  if(buffer == (real*) NULL)
+    buffer = rvector_aligned(ncz);
+  for(int jz=0;jz<ncz;jz++)
+    buffer[jz] = (*v2)[jx][jy];
+  
+  return buffer;
+}
+
+/// Set*Stencil functions change the stencil if loc is not var's location
+bool stagger_shift(const Field &var, CELL_LOC loc)
+{
+  return StaggerGrids && (loc != CELL_DEFAULT) && (loc != var.getLocation());
+}
+
+/// Waits for f's guard cells if they're being communicated
+void comm_wait(const Field &f)
+{
+  const FieldData *d = dynamic_cast<const FieldData*>(&f);
+  if(d != NULL)
+    Communicator::wait(*d);
+}
+
+/// X derivative along z lines, for xs <= jx < xe
+void xdiff_lines(const Field3D &var, deriv_line_func lfunc, const Field2D &dd, real ***r, int xs, int xe)
+{
+  #pragma omp parallel for
+  for(int jx=xs;jx<xe;jx++) {
+    int jx2m, jxm, jxp, jx2p;
+    stencil_line s;
+    line_xindex(jx, jx2m, jxm, jxp, jx2p);
+    for(int jy=jstart;jy<=jend;jy++) {
+      s.mm = zline(var, jx2m, jy);
+      s.m  = zline(var, jxm, jy);
+      s.c  = zline(var, jx, jy);
+      s.p  = zline(var, jxp, jy);
+      s.pp = zline(var, jx2p, jy);
+      
+      lfunc(s, r[jx][jy], ncz);
+      
+      for(int jz=0;jz<ncz;jz++)
+	r[jx][jy][jz] /= dd[jx][jy];
+    }
+  }
+}
+
+/// Y derivative along z lines, for xs <= jx < xe and ys <= jy <= ye
+void ydiff_lines(const Field3D &var, deriv_line_func lfunc, const Field2D &dd, real ***r, 
+		 int xs, int xe, int ys, int ye)
+{
+#ifdef CHECK
+  // msg_stack isn't thread safe, so record the first bad point
+  // and report it after the parallel loop
+  int bad_x = -1, bad_y = 0, bad_z = 0;
+#endif
+  #pragma omp parallel for
+  for(int jx=xs;jx<xe;jx++) {
+    int jy2m, jym, jyp, jy2p;
+    stencil_line s;
+    for(int jy=ys;jy<=ye;jy++) {
+      line_yindex(jy, jy2m, jym, jyp, jy2p);
+      s.mm = zline(var, jx, jy2m);
+      s.m  = zline(var, jx, jym);
+      s.c  = zline(var, jx, jy);
+      s.p  = zline(var, jx, jyp);
+      s.pp = zline(var, jx, jy2p);
+      
+      lfunc(s, r[jx][jy], ncz);
+      
+      for(int jz=0;jz<ncz;jz++) {
+	r[jx][jy][jz] /= dd[jx][jy];
+#ifdef CHECK
+	if(!finite(r[jx][jy][jz])) {
+          #pragma omp critical
+	  if(bad_x < 0) {
+	    bad_x = jx; bad_y = jy; bad_z = jz;
+	  }
+	}
+#endif
+      }
+    }
+  }
+#ifdef CHECK
+  if(bad_x >= 0) {
+    int jy2m, jym, jyp, jy2p;
+    line_yindex(bad_y, jy2m, jym, jyp, jy2p);
+    msg_stack.push("At [%d][%d][%d]: %e, %e, %e, %e, %e",
+		   bad_x, bad_y, bad_z, 
+		   zline(var, bad_x, jy2m)[bad_z], zline(var, bad_x, jym)[bad_z], 
+		   zline(var, bad_x, bad_y)[bad_z], zline(var, bad_x, jyp)[bad_z], 
+		   zline(var, bad_x, jy2p)[bad_z]);
+    bout_error("Non-finite value\n");
+  }
+#endif
+}
+
+/// Z derivative along z lines, for xs <= jx < xe
+void zdiff_lines(const Field3D &var, deriv_line_func lfunc, real dd, real ***r, int xs, int xe)
+{
+  #pragma omp parallel for
+  for(int jx=xs;jx<xe;jx++)
+    for(int jy=jstart;jy<=jend;jy++) {
+      stencil_line s;
+      line_zstencil(zline(var, jx, jy), s);
+      
+      lfunc(s, r[jx][jy], ncz);
+      
+      for(int jz=0;jz<ncz;jz++)
+	r[jx][jy][jz] /= dd;
+    }
+}
+
 // X derivative
 
 const Field2D applyXdiff(const Field2D &var, deriv_func func, const Field2D &dd, CELL_LOC loc = CELL_DEFAULT)
 {
+  Communicator::wait(var);
+
   Field2D result;
   result.Allocate(); // Make sure data allocated
 
-  bindex bx;
-  stencil s;
-
   real **r = result.getData();
-
-  start_index(&bx, RGN_NOX);
-  do {
-    var.SetXStencil(s, bx, loc);
-    r[bx.jx][bx.jy] = func(s) / dd[bx.jx][bx.jy];
-  }while(next_index2(&bx));
+  
+  deriv_line_func lfunc = lookupLineFunc(func);
+  
+  if(lfunc != NULL) {
+    // Lines in Y
+    real **d = var.getData();
+    #pragma omp parallel for
+    for(int jx=MXG;jx<ngx-MXG;jx++) {
+      int jx2m, jxm, jxp, jx2p;
+      stencil_line s;
+      line_xindex(jx, jx2m, jxm, jxp, jx2p);
+      s.mm = d[jx2m] + jstart;
+      s.m  = d[jxm]  + jstart;
+      s.c  = d[jx]   + jstart;
+      s.p  = d[jxp]  + jstart;
+      s.pp = d[jx2p] + jstart;
+      
+      lfunc(s, r[jx] + jstart, jend - jstart + 1);
+      
+      for(int jy=jstart;jy<=jend;jy++)
+	r[jx][jy] /= dd[jx][jy];
+    }
+  }else {
+    bindex bx;
+    stencil s;
+    
+    start_index(&bx, RGN_NOX);
+    do {
+      var.SetXStencil(s, bx, loc);
+      r[bx.jx][bx.jy] = func(s) / dd[bx.jx][bx.jy];
+    }while(next_index2(&bx));
+  }
 
 #ifdef CHECK
   // Mark boundaries as invalid
@@ -612,8 +1002,30 @@ const Field3D applyXdiff(const Field3D &var, deriv_func func, const Field2D &dd,
 {
   Field3D result;
   result.Allocate(); // Make sure data allocated
+  real ***r = result.getData();
   
-  stencil s;
+  deriv_line_func lfunc = lookupLineFunc(func);
+
+  // Points which don't use guard cells
+  int xs = MXG+2, xe = ngx-MXG-2;
+  
+  if((lfunc != NULL) && !ShiftXderivs && !stagger_shift(var, loc) 
+     && (xe > xs) && (Communicator::pending(var) != NULL)) {
+    // Guard cells being communicated. Calculate the interior first
+    xdiff_lines(var, lfunc, dd, r, xs, xe);
+    
+    Communicator::wait(var);
+    
+    xdiff_lines(var, lfunc, dd, r, MXG, xs);
+    xdiff_lines(var, lfunc, dd, r, xe, ngx-MXG);
+    
+#ifdef CHECK
+    result.bndry_xin = result.bndry_xout = result.bndry_yup = result.bndry_ydown = false;
+#endif
+    return result;
+  }
+  
+  Communicator::wait(var);
 
   Field3D vs = var;
   if(ShiftXderivs && (ShiftOrder == 0)) {
@@ -621,14 +1033,20 @@ const Field3D applyXdiff(const Field3D &var, deriv_func func, const Field2D &dd,
     vs = var.ShiftZ(true); // Shift into real space
   }
   
-  bindex bx;
-  real ***r = result.getData();
-  
-  start_index(&bx, RGN_NOX);
-  do {
-    vs.SetXStencil(s, bx, loc);
-    r[bx.jx][bx.jy][bx.jz] = func(s) / dd[bx.jx][bx.jy];
-  }while(next_index3(&bx));
+  if((lfunc != NULL) && !(ShiftXderivs && (ShiftOrder != 0)) && !stagger_shift(vs, loc)) {
+    // Lines in Z
+    xdiff_lines(vs, lfunc, dd, r, MXG, ngx-MXG);
+  }else {
+    // Shifted or staggered stencils
+    bindex bx;
+    stencil s;
+    
+    start_index(&bx, RGN_NOX);
+    do {
+      vs.SetXStencil(s, bx, loc);
+      r[bx.jx][bx.jy][bx.jz] = func(s) / dd[bx.jx][bx.jy];
+    }while(next_index3(&bx));
+  }
   
   if(ShiftXderivs && (ShiftOrder == 0))
     result = result.ShiftZ(false); // Shift back
@@ -645,18 +1063,41 @@ const Field3D applyXdiff(const Field3D &var, deriv_func func, const Field2D &dd,
 
 const Field2D applyYdiff(const Field2D &var, deriv_func func, const Field2D &dd, CELL_LOC loc = CELL_DEFAULT)
 {
+  Communicator::wait(var);
+
   Field2D result;
   result.Allocate(); // Make sure data allocated
   real **r = result.getData();
   
-  bindex bx;
-  stencil s;
-
-  start_index(&bx, RGN_NOY);
-  do{
-    var.SetYStencil(s, bx, loc);
-    r[bx.jx][bx.jy] = func(s) / dd[bx.jx][bx.jy];
-  }while(next_index2(&bx));
+  deriv_line_func lfunc = lookupLineFunc(func);
+  
+  if((lfunc != NULL) && (MYG > 1)) {
+    // Lines in Y. Needs the same offsets for all points
+    real **d = var.getData();
+    #pragma omp parallel for
+    for(int jx=0;jx<ngx;jx++) {
+      stencil_line s;
+      s.mm = d[jx] + jstart - 2;
+      s.m  = d[jx] + jstart - 1;
+      s.c  = d[jx] + jstart;
+      s.p  = d[jx] + jstart + 1;
+      s.pp = d[jx] + jstart + 2;
+      
+      lfunc(s, r[jx] + jstart, jend - jstart + 1);
+      
+      for(int jy=jstart;jy<=jend;jy++)
+	r[jx][jy] /= dd[jx][jy];
+    }
+  }else {
+    bindex bx;
+    stencil s;
+    
+    start_index(&bx, RGN_NOY);
+    do{
+      var.SetYStencil(s, bx, loc);
+      r[bx.jx][bx.jy] = func(s) / dd[bx.jx][bx.jy];
+    }while(next_index2(&bx));
+  }
   
 #ifdef CHECK
   // Mark boundaries as invalid
@@ -672,14 +1113,40 @@ const Field3D applyYdiff(const Field3D &var, deriv_func func, const Field2D &dd,
   result.Allocate(); // Make sure data allocated
   real ***r = result.getData();
   
-  stencil s;
-  bindex bx;
-  start_index(&bx, RGN_NOY);
-  do {
-    var.SetYStencil(s, bx, loc);
-    
-    r[bx.jx][bx.jy][bx.jz] = func(s) / dd[bx.jx][bx.jy];
+  deriv_line_func lfunc = lookupLineFunc(func);
   
+  bool lines = (lfunc != NULL) && !(TwistShift && (TwistOrder != 0)) && !stagger_shift(var, loc);
+
+  // Points which don't use guard cells
+  int ys = jstart+2, ye = jend-2;
+  
+  if(lines && (ye >= ys) && (Communicator::pending(var) != NULL)) {
+    // Guard cells being communicated. Calculate the interior first
+    ydiff_lines(var, lfunc, dd, r, MXG, ngx-MXG, ys, ye);
+    
+    Communicator::wait(var);
+    
+    ydiff_lines(var, lfunc, dd, r, 0, MXG, jstart, jend);
+    ydiff_lines(var, lfunc, dd, r, ngx-MXG, ngx, jstart, jend);
+    ydiff_lines(var, lfunc, dd, r, MXG, ngx-MXG, jstart, ys-1);
+    ydiff_lines(var, lfunc, dd, r, MXG, ngx-MXG, ye+1, jend);
+  }else if(lines) {
+    // Lines in Z
+    Communicator::wait(var);
+    
+    ydiff_lines(var, lfunc, dd, r, 0, ngx, jstart, jend);
+  }else {
+    // Twist-shifted or staggered stencils
+    Communicator::wait(var);
+    
+    stencil s;
+    bindex bx;
+    start_index(&bx, RGN_NOY);
+    do {
+      var.SetYStencil(s, bx, loc);
+      
+      r[bx.jx][bx.jy][bx.jz] = func(s) / dd[bx.jx][bx.jy];
+      
 #ifdef CHECK
       if(!finite(r[bx.jx][bx.jy][bx.jz])) {
 	msg_stack.push("At [%d][%d][%d]: %e, %e, %e, %e, %e",
@@ -688,7 +1155,8 @@ const Field3D applyYdiff(const Field3D &var, deriv_func func, const Field2D &dd,
 	bout_error("Non-finite value\n");
       }
 #endif
-  }while(next_index3(&bx));
+    }while(next_index3(&bx));
+  }
 
 #ifdef CHECK
   // Mark boundaries as invalid
@@ -706,14 +1174,30 @@ const Field3D applyZdiff(const Field3D &var, deriv_func func, real dd, CELL_LOC
   result.Allocate(); // Make sure data allocated
   real ***r = result.getData();
   
-  bindex bx;
-  stencil s;
+  deriv_line_func lfunc = lookupLineFunc(func);
+  
+  if((lfunc != NULL) && !stagger_shift(var, loc)) {
+    // Lines in Z, using a buffer for the periodic points
+    if(Communicator::pending(var) != NULL) {
+      // Only the X guard cells are needed from communication
+      zdiff_lines(var, lfunc, dd, r, MXG, ngx-MXG);
+      Communicator::wait(var);
+      zdiff_lines(var, lfunc, dd, r, 0, MXG);
+      zdiff_lines(var, lfunc, dd, r, ngx-MXG, ngx);
+    }else
+      zdiff_lines(var, lfunc, dd, r, 0, ngx);
+  }else {
+    Communicator::wait(var);
 
-  start_index(&bx, RGN_NOZ);
-  do {
-    var.SetZStencil(s, bx, loc);
-    r[bx.jx][bx.jy][bx.jz] = func(s) / dd;
-  }while(next_index3(&bx));
+    bindex bx;
+    stencil s;
+    
+    start_index(&bx, RGN_NOZ);
+    do {
+      var.SetZStencil(s, bx, loc);
+      r[bx.jx][bx.jy][bx.jz] = func(s) / dd;
+    }while(next_index3(&bx));
+  }
 
   return result;
 }
@@ -941,6 +1425,8 @@ const Field3D DDZ(const Field3D &f, CELL_LOC outloc, DIFF_METHOD method, bool in
       }
     }
 
+    Communicator::wait(f); // Transforms Y guard cells too
+
     result.Allocate(); // Make sure data allocated
 
     static dcomplex *cv = (dcomplex*) NULL;
@@ -954,30 +1440,32 @@ const Field3D DDZ(const Field3D &f, CELL_LOC outloc, DIFF_METHOD method, bool in
       xlt = ngx;
     }
     
+    int nc = ncz/2 + 1;
     if(cv == (dcomplex*) NULL)
-      cv = new dcomplex[ncz/2 + 1];
-
-    for(jx=xge;jx<xlt;jx++) {
-      for(jy=0;jy<ngy;jy++) {
-	
-	rfft(f[jx][jy], ncz, cv); // Forward FFT
-
-	for(jz=0;jz<=ncz/2;jz++) {
-	  kwave=jz*2.0*PI/zlength; // wave number is 1/[rad]
+      cv = new dcomplex[ngx*ngy*nc];
 
-	  if (jz>0.4*ncz) flt=1e-10; else flt=1.0;
-	  cv[jz] *= dcomplex(0.0, kwave) * flt;
-	  if(StaggerGrids)
-	    cv[jz] *= exp(Im * (shift * kwave * dz));
-	}
-	
-	irfft(cv, ncz, result[jx][jy]); // Reverse FFT
+    // Transform all lines for xge <= jx < xlt at once
+    int nlines = (xlt - xge)*ngy;
+    rfft_many(zline(f, xge, 0), ncz, nlines, ngz, cv); // Forward FFT
 
-	result[jx][jy][ncz] = result[jx][jy][0];
+    for(int i=0;i<nlines;i++) {
+      dcomplex *c = cv + i*nc;
+      for(jz=0;jz<=ncz/2;jz++) {
+	kwave=jz*2.0*PI/zlength; // wave number is 1/[rad]
 	
+	if (jz>0.4*ncz) flt=1e-10; else flt=1.0;
+	c[jz] *= dcomplex(0.0, kwave) * flt;
+	if(StaggerGrids)
+	  c[jz] *= exp(Im * (shift * kwave * dz));
       }
     }
     
+    irfft_many(cv, ncz, nlines, result[xge][0], ngz); // Reverse FFT
+    
+    for(jx=xge;jx<xlt;jx++)
+      for(jy=0;jy<ngy;jy++)
+	result[jx][jy][ncz] = result[jx][jy][0];
+    
 #ifdef CHECK
     // Mark boundaries as invalid
     result.bndry_xin = result.bndry_xout = result.bndry_yup = result.bndry_ydown = false;
@@ -1295,28 +1783,32 @@ const Field3D D2DZ2(const Field3D &f, CELL_LOC outloc, DIFF_METHOD method)
     int jx, jy, jz;
     real kwave;
     
+    int nc = ncz/2 + 1;
+    int nlines = ngy - 2*MYG; // Lines for one x index
     if(cv == (dcomplex*) NULL)
-      cv = new dcomplex[ncz/2 + 1];
+      cv = new dcomplex[nlines*nc];
 
     for(jx=MXG;jx<(ngx-MXG);jx++) {
-      for(jy=MYG;jy<(ngy-MYG);jy++) {
-
-	rfft(f[jx][jy], ncz, cv); // Forward FFT
-	
+      
+      rfft_many(zline(f, jx, MYG), ncz, nlines, ngz, cv); // Forward FFT
+      
+      for(int i=0;i<nlines;i++) {
+	dcomplex *c = cv + i*nc;
 	for(jz=0;jz<=ncz/2;jz++) {
 	  kwave=jz*2.0*PI/zlength; // wave number is 1/[rad]
 	  
 	  if (jz>0.4*ncz) flt=1e-10; else flt=1.0;
-
-	  cv[jz] *= -SQ(kwave) * flt;
+	  
+	  c[jz] *= -SQ(kwave) * flt;
 	  if(StaggerGrids)
-	    cv[jz] *= exp(Im * (shift * kwave * dz));
+	    c[jz] *= exp(Im * (shift * kwave * dz));
 	}
-
-	irfft(cv, ncz, result[jx][jy]); // Reverse FFT
-	
-	result[jx][jy][ncz] = result[jx][jy][0];
       }
+      
+      irfft_many(cv, ncz, nlines, result[jx][MYG], ngz); // Reverse FFT
+      
+      for(jy=MYG;jy<(ngy-MYG);jy++)
+	result[jx][jy][ncz] = result[jx][jy][0];
     }
 
 #ifdef CHECK
@@ -1375,6 +1867,9 @@ const Field3D D2DXDZ(const Field3D &f)
 /// Special case where both arguments are 2D. Output location ignored for now
 const Field2D VDDX(const Field2D &v, const Field2D &f, CELL_LOC outloc, DIFF_METHOD method)
 {
+  Communicator::wait(v);
+  Communicator::wait(f);
+
   upwind_func func = fVDDX;
 
   if(method != DIFF_DEFAULT) {
@@ -1412,6 +1907,9 @@ const Field2D VDDX(const Field2D &v, const Field2D &f, DIFF_METHOD method)
 /// General version for 2 or 3-D objects
 const Field3D VDDX(const Field &v, const Field &f, CELL_LOC outloc, DIFF_METHOD method)
 {
+  comm_wait(v);
+  comm_wait(f);
+
   upwind_func func = fVDDX;
   DiffLookup *table = UpwindTable;
 
@@ -1467,16 +1965,42 @@ const Field3D VDDX(const Field &v, const Field &f, CELL_LOC outloc, DIFF_METHOD
   result.Allocate(); // Make sure data allocated
   real ***d = result.getData();
 
-  bindex bx;
-  stencil vval, fval;
+  upwind_line_func lfunc = lookupUpwindLineFunc(func);
+  const Field3D *f3 = dynamic_cast<const Field3D*>(fp);
   
-  start_index(&bx);
-  do {
-    vp->SetXStencil(vval, bx, diffloc);
-    fp->SetXStencil(fval, bx); // Location is always the same as input
+  if((lfunc != NULL) && (f3 != NULL) && (line_zvalues(*vp, 0, 0) != NULL)
+     && !(ShiftXderivs && (ShiftOrder != 0)) && !stagger_shift(*vp, diffloc)) {
+    // Lines in Z
+    #pragma omp parallel for
+    for(int jx=MXG;jx<ngx-MXG;jx++) {
+      int jx2m, jxm, jxp, jx2p;
+      stencil_line fval;
+      line_xindex(jx, jx2m, jxm, jxp, jx2p);
+      for(int jy=jstart;jy<=jend;jy++) {
+	fval.mm = zline(*f3, jx2m, jy);
+	fval.m  = zline(*f3, jxm, jy);
+	fval.c  = zline(*f3, jx, jy);
+	fval.p  = zline(*f3, jxp, jy);
+	fval.pp = zline(*f3, jx2p, jy);
+	
+	lfunc(line_zvalues(*vp, jx, jy), fval, d[jx][jy], ncz);
+	
+	for(int jz=0;jz<ncz;jz++)
+	  d[jx][jy][jz] /= dx[jx][jy];
+      }
+    }
+  }else {
+    bindex bx;
+    stencil vval, fval;
     
-    d[bx.jx][bx.jy][bx.jz] = func(vval, fval) / dx[bx.jx][bx.jy];
-  }while(next_index3(&bx));
+    start_index(&bx);
+    do {
+      vp->SetXStencil(vval, bx, diffloc);
+      fp->SetXStencil(fval, bx); // Location is always the same as input
+      
+      d[bx.jx][bx.jy][bx.jz] = func(vval, fval) / dx[bx.jx][bx.jy];
+    }while(next_index3(&bx));
+  }
   
   if(ShiftXderivs && (ShiftOrder == 0))
     result = result.ShiftZ(false); // Shift back
@@ -1505,6 +2029,9 @@ const Field3D VDDX(const Field &v, const Field &f, DIFF_METHOD method, CELL_LOC
 // special case where both are 2D
 const Field2D VDDY(const Field2D &v, const Field2D &f, CELL_LOC outloc, DIFF_METHOD method)
 {
+  Communicator::wait(v);
+  Communicator::wait(f);
+
   upwind_func func = fVDDY;
   DiffLookup *table = UpwindTable;
 
@@ -1578,6 +2105,9 @@ const Field2D VDDY(const Field2D &v, const Field2D &f, DIFF_METHOD method)
 // general case
 const Field3D VDDY(const Field &v, const Field &f, CELL_LOC outloc, DIFF_METHOD method)
 {
+  comm_wait(v);
+  comm_wait(f);
+
   upwind_func func = fVDDY;
   DiffLookup *table = UpwindTable;
 
@@ -1618,20 +2148,46 @@ const Field3D VDDY(const Field &v, const Field &f, CELL_LOC outloc, DIFF_METHOD
     // Lookup function
     func = lookupUpwindFunc(table, method);
   }
-  bindex bx;
-  stencil vval, fval;
-  
   Field3D result;
   result.Allocate(); // Make sure data allocated
   real ***d = result.getData();
-
-  start_index(&bx);
-  do {
-    v.SetYStencil(vval, bx, diffloc);
-    f.SetYStencil(fval, bx);
+  
+  upwind_line_func lfunc = lookupUpwindLineFunc(func);
+  const Field3D *f3 = dynamic_cast<const Field3D*>(&f);
+  
+  if((lfunc != NULL) && (f3 != NULL) && (line_zvalues(v, 0, 0) != NULL)
+     && !(TwistShift && (TwistOrder != 0)) && !stagger_shift(v, diffloc)) {
+    // Lines in Z
+    #pragma omp parallel for
+    for(int jx=MXG;jx<ngx-MXG;jx++) {
+      int jy2m, jym, jyp, jy2p;
+      stencil_line fval;
+      for(int jy=jstart;jy<=jend;jy++) {
+	line_yindex(jy, jy2m, jym, jyp, jy2p);
+	fval.mm = zline(*f3, jx, jy2m);
+	fval.m  = zline(*f3, jx, jym);
+	fval.c  = zline(*f3, jx, jy);
+	fval.p  = zline(*f3, jx, jyp);
+	fval.pp = zline(*f3, jx, jy2p);
+	
+	lfunc(line_zvalues(v, jx, jy), fval, d[jx][jy], ncz);
+	
+	for(int jz=0;jz<ncz;jz++)
+	  d[jx][jy][jz] /= dy[jx][jy];
+      }
+    }
+  }else {
+    bindex bx;
+    stencil vval, fval;
     
-    d[bx.jx][bx.jy][bx.jz] = func(vval, fval)/dy[bx.jx][bx.jy];
-  }while(next_index3(&bx));
+    start_index(&bx);
+    do {
+      v.SetYStencil(vval, bx, diffloc);
+      f.SetYStencil(fval, bx);
+      
+      d[bx.jx][bx.jy][bx.jz] = func(vval, fval)/dy[bx.jx][bx.jy];
+    }while(next_index3(&bx));
+  }
 
   result.setLocation(inloc);
 
@@ -1669,6 +2225,9 @@ const Field2D VDDZ(const Field3D &v, const Field2D &f)
 // general case
 const Field3D VDDZ(const Field &v, const Field &f, CELL_LOC outloc, DIFF_METHOD method)
 {
+  comm_wait(v);
+  comm_wait(f);
+
   upwind_func func = fVDDZ;
   DiffLookup *table = UpwindTable;
 
@@ -1710,20 +2269,40 @@ const Field3D VDDZ(const Field &v, const Field &f, CELL_LOC outloc, DIFF_METHOD
     func = lookupUpwindFunc(table, method);
   }
 
-  bindex bx;
-  stencil vval, fval;
-  
   Field3D result;
   result.Allocate(); // Make sure data allocated
   real ***d = result.getData();
   
-  start_index(&bx);
-  do {
-    v.SetZStencil(vval, bx, diffloc);
-    f.SetZStencil(fval, bx);
+  upwind_line_func lfunc = lookupUpwindLineFunc(func);
+  const Field3D *f3 = dynamic_cast<const Field3D*>(&f);
+  
+  if((lfunc != NULL) && (f3 != NULL) && (line_zvalues(v, 0, 0) != NULL)
+     && !stagger_shift(v, diffloc)) {
+    // Lines in Z, using a buffer for the periodic points
+    #pragma omp parallel for
+    for(int jx=MXG;jx<ngx-MXG;jx++) {
+      stencil_line fval;
+      for(int jy=jstart;jy<=jend;jy++) {
+	line_zstencil(zline(*f3, jx, jy), fval);
+	
+	lfunc(line_zvalues(v, jx, jy), fval, d[jx][jy], ncz);
+	
+	for(int jz=0;jz<ncz;jz++)
+	  d[jx][jy][jz] /= dz;
+      }
+    }
+  }else {
+    bindex bx;
+    stencil vval, fval;
     
-    d[bx.jx][bx.jy][bx.jz] = func(vval, fval)/dz;
-  }while(next_index3(&bx));
+    start_index(&bx);
+    do {
+      v.SetZStencil(vval, bx, diffloc);
+      f.SetZStencil(fval, bx);
+      
+      d[bx.jx][bx.jy][bx.jz] = func(vval, fval)/dz;
+    }while(next_index3(&bx));
+  }
 
   result.setLocation(inloc);
 
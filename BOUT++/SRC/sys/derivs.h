@@ -35,6 +35,12 @@
 
 int derivs_init();
 
+/// Number of points either side used by the default methods (-1 for FFT)
+void derivs_stencil(int &xw, int &yw, int &zw);
+
+/// Waits for f's guard cells if they're being communicated (see Communicator::wait)
+void comm_wait(const Field &f);
+
 ////////// FIRST DERIVATIVES //////////
 
 const Field3D DDX(const Field3D &f, CELL_LOC outloc = CELL_DEFAULT, DIFF_METHOD method = DIFF_DEFAULT);
@@ -183,6 +183,7 @@ GLOBAL GridData grid;
 // Settings (read from file, bout++.cpp)
 
 GLOBAL bool restarting;   // Specifies whether code is restarting
+GLOBAL bool appending;    // Append to existing dump files when restarting
 
 GLOBAL bool ShiftXderivs; // Use shifted X derivatives
 GLOBAL bool IncIntShear;  // Include integrated shear (if shifting X)
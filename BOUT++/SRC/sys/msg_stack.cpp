@@ -29,6 +29,16 @@
 #include <string.h>
 #include <stdarg.h>
 
+#ifdef ASYNCIO
+// Only the main thread uses the stack. Calls from the background
+// output thread (in the file formats) are ignored
+#include <pthread.h>
+static pthread_t msg_thread = pthread_self();
+#define OTHER_THREAD (!pthread_equal(pthread_self(), msg_thread))
+#else
+#define OTHER_THREAD false
+#endif
+
 MsgStack::MsgStack()
 {
   nmsg = 0;
@@ -46,6 +56,9 @@ int MsgStack::push(const char *s, ...)
   va_list ap;  // List of arguments
   msg_item_t *m;
 
+  if(OTHER_THREAD)
+    return 0;
+
   if(size > nmsg) {
     m = &msg[nmsg];
   }else {
@@ -96,7 +109,7 @@ void MsgStack::pop()
 {
 #if CHECK > 1
   
-  if(nmsg <= 0)
+  if((nmsg <= 0) || OTHER_THREAD)
     return;
   
   //output.write("Popping %d\n", nmsg);
@@ -108,6 +121,9 @@ void MsgStack::pop()
 void MsgStack::pop(int id)
 {
 #if CHECK > 1
+  if(OTHER_THREAD)
+    return;
+
   if(id < 0)
     id = 0;
 
@@ -122,6 +138,8 @@ void MsgStack::pop(int id)
 void MsgStack::clear()
 {
 #if CHECK > 1
+  if(OTHER_THREAD)
+    return;
   nmsg = 0;
 #endif
 }
@@ -28,6 +28,17 @@
 #include <string.h>
 #include "output.h"
 
+#ifdef ASYNCIO
+// Files may be written (and warnings output) from a background thread
+#include <pthread.h>
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+#define OUTPUT_LOCK pthread_mutex_lock(&output_lock)
+#define OUTPUT_UNLOCK pthread_mutex_unlock(&output_lock)
+#else
+#define OUTPUT_LOCK
+#define OUTPUT_UNLOCK
+#endif
+
 void Output::enable()
 { 
   add(std::cout);
@@ -81,11 +92,15 @@ void Output::write(const char* string, ...)
   if(string == (const char*) NULL)
     return;
   
+  OUTPUT_LOCK;
+
   va_start(ap, string);
     vsprintf(buffer, string, ap);
   va_end(ap);
 
   multioutbuf_init::buf()->sputn(buffer, strlen(buffer));
+
+  OUTPUT_UNLOCK;
 }
 
 void Output::print(const char* string, ...)
@@ -98,9 +113,13 @@ void Output::print(const char* string, ...)
   if(string == (const char*) NULL)
     return;
   
+  OUTPUT_LOCK;
+
   va_start(ap, string);
     vprintf(string, ap);
   va_end(ap);
   
   fflush(stdout);
+
+  OUTPUT_UNLOCK;
 }
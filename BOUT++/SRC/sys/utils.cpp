@@ -33,6 +33,21 @@ real *rvector(int size)
   return (real*) malloc(sizeof(real)*size);
 }
 
+/// Allocate a block of reals aligned to DATA_ALIGN bytes.
+/// Can be released with free()
+real *rvector_aligned(int size)
+{
+  void *ptr;
+  
+  if(size < 1)
+    size = 1;
+  
+  if(posix_memalign(&ptr, DATA_ALIGN, sizeof(real)*size) != 0)
+    return (real*) NULL;
+  
+  return (real*) ptr;
+}
+
 real *rvresize(real *v, int newsize)
 {
   return (real*) realloc(v, sizeof(real)*newsize);
@@ -58,7 +73,8 @@ real **rmatrix(int xsize, int ysize)
     exit(1);
   }
 
-  if((m[0] = (real*) malloc(xsize*ysize*sizeof(real))) == (real*) NULL) {
+  // Contiguous and aligned, so can be looped over as m[0][i]
+  if((m[0] = rvector_aligned(xsize*ysize)) == (real*) NULL) {
     printf("Error: could not allocate memory\n");
     exit(1);
   }
@@ -113,8 +129,12 @@ real ***r3tensor(int nrow, int ncol, int ndep)
   /* allocate pointers to rows and set pointers to them */
   t[0]=(real **) malloc((size_t)(nrow*ncol*sizeof(real*)));
 
-  /* allocate rows and set pointers to them */
-  t[0][0]=(real *) malloc((size_t)(nrow*ncol*ndep*sizeof(real)));
+  /* allocate rows and set pointers to them. This is a single contiguous,
+     aligned block so t[0][0][i] runs over the whole tensor */
+  if((t[0][0] = rvector_aligned(nrow*ncol*ndep)) == (real*) NULL) {
+    printf("Error: could not allocate memory\n");
+    exit(1);
+  }
 
   for(j=1;j!=ncol;j++) t[0][j]=t[0][j-1]+ndep;
   for(i=1;i!=nrow;i++) {
@@ -127,6 +147,13 @@ real ***r3tensor(int nrow, int ncol, int ndep)
   return t;
 }
 
+void free_r3tensor(real ***m)
+{
+  free(m[0][0]);
+  free(m[0]);
+  free(m);
+}
+
 dcomplex **cmatrix(int nrow, int ncol)
 {
   dcomplex **m;
@@ -146,11 +173,6 @@ void free_cmatrix(dcomplex** m)
   delete[] m;
 }
 
-real SQ(real x)
-{
-  return(x*x);
-}
-
 int ROUND(real x)
 {
   return (x > 0.0) ? (int) (x + 0.5) : (int) (x - 0.5);
@@ -29,7 +29,12 @@
 #include "bout_types.h"
 #include "dcomplex.h"
 
+/// Alignment (in bytes) of field data blocks. One cache line,
+/// and enough for any SSE/AVX vector load
+const int DATA_ALIGN = 64;
+
 real *rvector(int size);
+real *rvector_aligned(int size);
 real *rvresize(real *v, int newsize);
 int *ivector(int size);
 int *ivresize(int *v, int newsize);
@@ -38,11 +43,12 @@ int **imatrix(int xsize, int ysize);
 void free_rmatrix(real **m);
 void free_imatrix(int **m);
 real ***r3tensor(int nrow, int ncol, int ndep);
+void free_r3tensor(real ***m);
 
 dcomplex **cmatrix(int nrow, int ncol);
 void free_cmatrix(dcomplex** cm);
 
-real SQ(real x);
+inline real SQ(real x) { return x*x; } ///< Inline so it can be used in vectorised loops
 int ROUND(real x);
 void SWAP(real &a, real &b);
 void SWAP(dcomplex &a, dcomplex &b);
@@ -60,6 +60,7 @@ bool laplace_extra_rho_term; // An extra first-order term in the vorticity inver
 bool vort_include_pi;    // Include Pi in vorticity
 
 bool bout_exb;  // Use BOUT-06 expression for ExB velocity
+bool arakawa;   // Use the Arakawa bracket for the BOUT-06 nonlinear ExB terms
 bool bout_jpar; // Use BOUT-06 method for Jpar
 bool OhmPe;     // Include the Pe term in Ohm's law
 
@@ -93,6 +94,8 @@ bool relax_flat_bndry; // Use relaxing boundary conditions
 int low_pass_z; // Low-pass filter result
 
 int phi_flags, apar_flags; // Inversion flags
+LaplaceSolver *phi_solver, *apar_solver; // Inversions, keeping the factorised matrices
+Field2D acoeff; // Coefficient in the Apar inversion
 
 // Communication object
 Communicator comms;
@@ -161,6 +164,7 @@ int physics_init()
   OPTION(OhmPe,       true);
   OPTION(bout_jpar,   false);
   OPTION(bout_exb,    false);
+  OPTION(arakawa,     false);
   OPTION(curv_upwind, false);
 
   OPTION(nuIonNeutral, -1.); 
@@ -524,6 +528,23 @@ int physics_init()
     }
   }
   
+  ////////////////////////////////////////////////////////
+  // SETUP INVERSIONS
+  // Coefficients are constant, so matrices are only factorised once
+  // Arguments are:   (bit-field, a,    c)
+  // Passing NULL -> missing term
+
+  if(laplace_extra_rho_term) {
+    // Include the first order term Grad_perp Ni dot Grad_perp phi
+    phi_solver = new LaplaceSolver(phi_flags, NULL, &Ni0);
+  }else
+    phi_solver = new LaplaceSolver(phi_flags);
+  
+  if(!(estatic || ZeroElMass)) {
+    acoeff = (-0.5*beta_p/fmei)*Ni0;
+    apar_solver = new LaplaceSolver(apar_flags, &acoeff);
+  }
+
   ////////////////////////////////////////////////////////
   // SETUP COMMUNICATIONS
 
@@ -565,14 +586,9 @@ int physics_run(real t)
   // Invert vorticity to get phi
   //
   // Solves \nabla^2_\perp x + \nabla_perp c\cdot\nabla_\perp x + a x = b
-  // Arguments are:   (b,   bit-field, a,    c)
-  // Passing NULL -> missing term
+  // with a and c set in physics_init
   
-  if(laplace_extra_rho_term) {
-    // Include the first order term Grad_perp Ni dot Grad_perp phi
-    phi = invert_laplace(rho/Ni0, phi_flags, NULL, &Ni0);
-  }else
-    phi = invert_laplace(rho/Ni0, phi_flags);
+  phi = phi_solver->solve(rho/Ni0);
 
   if(vort_include_pi) {
     // Include Pi term in vorticity
@@ -585,16 +601,8 @@ int physics_run(real t)
   if(estatic || ZeroElMass) {
     // Electrostatic operation
     Apar = 0.0;
-  }else {
-    static Field2D acoeff;
-    static bool aset = false;
-    
-    if(!aset) // calculate Apar coefficient
-      acoeff = (-0.5*beta_p/fmei)*Ni0;
-    aset = true;
-  
-    Apar = invert_laplace(acoeff*(Vi - Ajpar), apar_flags, &acoeff);
-  }
+  }else
+    Apar = apar_solver->solve(acoeff*(Vi - Ajpar));
   
   ////////////////////////////////////////////////////////
   // Communicate variables
@@ -1080,7 +1088,7 @@ const Field3D vE_Grad(const Field3D &f, const Field3D &p)
   Field3D result;
   if(bout_exb) {
     // Use a subset of terms for comparison to BOUT-06
-    result = VDDX(DDZ(p), f) + VDDZ(-DDX(p), f);
+    result = bracket(p, f, arakawa ? BRACKET_ARAKAWA : BRACKET_SIMPLE);
     //result = DDX(DDZ(p) * f) + DDZ(-DDX(p) * f);
   }else {
     // Use full expression with all terms
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+make
+
+MPIRUN=mpirun
+
+rm -f data/BOUT.log.* data/test_netcdf4.*
+
+# Run on 4 processors, 2 in X
+
+$MPIRUN -np 4 ./test_netcdf4 >& log.txt
+
+npassed=`grep -c "TEST PASSED" data/BOUT.log.0`
+nfailed=`grep -c "TEST FAILED" data/BOUT.log.0`
+ntotal=$[$npassed+$nfailed]
+
+if test $ntotal = 0; then
+    echo "=> TEST FAILED (no results. Is netCDF-4 support enabled?)"
+    exit 1
+fi
+
+grep "TEST" data/BOUT.log.0
+
+echo "RESULT: Passed $npassed out of $ntotal tests"
@@ -0,0 +1,157 @@
+/*
+ * netCDF-4 round-trip test
+ *
+ * Write fields to a parallel netCDF-4 file (one file for all
+ * processors, chunked in processor sub-domains) and to compressed
+ * netCDF-4 files, then read them back and check that the values
+ * are unchanged (or within the tolerance for lossy compression).
+ *
+ * Needs BOUT++ configured with netCDF-4 built on parallel HDF5
+ */
+
+#include "bout.h"
+#include "meshtopology.h"
+
+#ifdef PNCDF
+#include "pnc_format.h"
+#endif
+#ifdef NC4DF
+#include "nc4_format.h"
+#endif
+
+#include <math.h>
+
+/// Set fields to a function of global index, so the result doesn't depend on the decomposition
+void set_fields(Field2D &f2d, Field3D &f3d, real t)
+{
+  f2d = 0.0;
+  f3d = 0.0;
+
+  for(int jx=0;jx<ngx;jx++)
+    for(int jy=0;jy<ngy;jy++) {
+      real x = (real) XGLOBAL(jx);
+      real y = (real) YGLOBAL(jy);
+      f2d[jx][jy] = sin(0.3*x)*cos(0.2*y) + t;
+      for(int jz=0;jz<ngz;jz++)
+	f3d[jx][jy][jz] = f2d[jx][jy] + 0.1*sin(0.5*x + 0.7*y + (real) jz);
+    }
+}
+
+/// Largest difference over all processors, in the part of the domain read back
+real max_error(Field2D &f2d, Field2D &g2d, Field3D &f3d, Field3D &g3d)
+{
+  // X guard cells between processors are read by the neighbour
+  int xs = (PE_XIND == 0) ? 0 : MXG;
+  int xe = (PE_XIND == NXPE-1) ? ngx-1 : ngx-MXG-1;
+
+  real err = 0.0;
+  for(int jx=xs;jx<=xe;jx++)
+    for(int jy=MYG;jy<MYG+MYSUB;jy++) {
+      if(fabs(f2d[jx][jy] - g2d[jx][jy]) > err)
+	err = fabs(f2d[jx][jy] - g2d[jx][jy]);
+      for(int jz=0;jz<ngz-1;jz++) { // Last point is a copy of the first
+	if(fabs(f3d[jx][jy][jz] - g3d[jx][jy][jz]) > err)
+	  err = fabs(f3d[jx][jy][jz] - g3d[jx][jy][jz]);
+      }
+    }
+
+  real result;
+  MPI_Allreduce(&err, &result, 1, PVEC_REAL_MPI_TYPE, MPI_MAX, MPI_COMM_WORLD);
+  return result;
+}
+
+/// Write fields with the given format, read them back, and compare
+bool round_trip(const char *name, DataFormat *format, const char *filename, real tol)
+{
+  Field2D f2d, f2d_evol, g2d, g2d_evol;
+  Field3D f3d, f3d_evol, g3d, g3d_evol;
+  int ivar = 42, ivar_evol, ivar_in, ivar_evol_in;
+
+  Datafile out(format);
+  out.add(ivar, "ivar", 0);
+  out.add(f2d, "f2d", 0);
+  out.add(f3d, "f3d", 0);
+  out.add(ivar_evol, "ivar_evol", 1);
+  out.add(f2d_evol, "f2d_evol", 1);
+  out.add(f3d_evol, "f3d_evol", 1);
+
+  set_fields(f2d, f3d, 0.0);
+  for(int i=0;i<3;i++) {
+    ivar_evol = ivar + i;
+    set_fields(f2d_evol, f3d_evol, (real) i);
+    if(i == 0) {
+      out.write(filename, "data", MYPE);
+    }else
+      out.append(filename, "data", MYPE);
+  }
+  out.close();
+
+  Datafile in(format);
+  g2d = 0.0; g3d = 0.0; g2d_evol = 0.0; g3d_evol = 0.0;
+  in.add(ivar_in, "ivar", 0);
+  in.add(g2d, "f2d", 0);
+  in.add(g3d, "f3d", 0);
+  in.add(ivar_evol_in, "ivar_evol", 1);
+  in.add(g2d_evol, "f2d_evol", 1);
+  in.add(g3d_evol, "f3d_evol", 1);
+
+  bool ok = (in.read(filename, "data", MYPE) == 0);
+  in.close();
+
+  // Latest record of evolving variables
+  real err = max_error(f2d, g2d, f3d, g3d);
+  real err_evol = max_error(f2d_evol, g2d_evol, f3d_evol, g3d_evol);
+  if(err_evol > err)
+    err = err_evol;
+
+  ok = ok && (ivar_in == ivar) && (ivar_evol_in == ivar_evol) && (err <= tol);
+
+  // All processors must agree on the result
+  int local = ok ? 1 : 0, global;
+  MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  ok = (global == 1);
+
+  output.write("%s: maximum error %e, tolerance %e => TEST %s\n",
+	       name, err, tol, ok ? "PASSED" : "FAILED");
+  return ok;
+}
+
+int physics_init()
+{
+  real abstol;
+  options.setSection("netcdf4");
+  options.get("abstol", abstol, 1e-4);
+
+#ifdef PNCDF
+  // One file for all processors. With NXPE > 1 neighbouring
+  // processors share chunks in X
+  PncFormat *pnc = new PncFormat;
+  round_trip("Parallel netCDF-4", pnc, "%s/test_netcdf4.par.nc", 0.0);
+  delete pnc;
+#else
+  output.write("Parallel netCDF-4 not enabled\n");
+#endif
+
+#ifdef NC4DF
+  Nc4Format *nc4 = new Nc4Format;
+  nc4->setCompression(5); // Lossless
+  round_trip("Compressed netCDF-4", nc4, "%s/test_netcdf4.nc4.%d.nc", 0.0);
+  delete nc4;
+
+  nc4 = new Nc4Format;
+  nc4->setCompression(5, abstol); // Lossy
+  round_trip("Lossy compressed netCDF-4", nc4, "%s/test_netcdf4.tol.%d.nc", abstol);
+  delete nc4;
+#else
+  output.write("Compressed netCDF-4 not enabled\n");
+#endif
+
+  // Send an error code so quits
+  return 1;
+}
+
+int physics_run(real t)
+{
+  // Doesn't do anything
+  return 1;
+}
@@ -58,30 +58,41 @@ FUNCTION collect, xind=xind, yind=yind, zind=zind, tind=tind, $
       IF N_ELEMENTS(tind) EQ 1 THEN tind = [tind, tind]
   ENDIF
 
-  SPAWN, "\ls "+path+"/BOUT.dmp.*", result, exit_status=status
+  ; A single file of global arrays is written with dump_parallel
+  single = 0
+  SPAWN, "\ls "+path+"/BOUT.dmp.*.*", result, exit_status=status
+  IF (status NE 0) AND FILE_TEST(path+"/BOUT.dmp.nc") THEN single = 1
+
+  IF single THEN BEGIN
+    mainfile = path+"/BOUT.dmp.nc"
+    nfiles = 1
+    IF quiet EQ 0 THEN PRINT, "Reading global arrays from "+mainfile
+  ENDIF ELSE BEGIN
+    SPAWN, "\ls "+path+"/BOUT.dmp.*", result, exit_status=status
 
-  IF status NE 0 THEN BEGIN
+    IF status NE 0 THEN BEGIN
       PRINT, "ERROR: No data found"
       RETURN, 0
-  ENDIF
+    ENDIF
 
-  nfiles = N_ELEMENTS(result)
+    nfiles = N_ELEMENTS(result)
   
-  IF quiet EQ 0 THEN PRINT, "Number of files found: ", nfiles
+    IF quiet EQ 0 THEN PRINT, "Number of files found: ", nfiles
   
-  mainfile = result[use] ; File to get most data
+    mainfile = result[use] ; File to get most data
 
-  ; Get the file extension 
-  i = STRPOS(mainfile, '.', /REVERSE_SEARCH)
-  fext = STRMID(mainfile, i+1, STRLEN(mainfile)-(i+1))
+    ; Get the file extension 
+    i = STRPOS(mainfile, '.', /REVERSE_SEARCH)
+    fext = STRMID(mainfile, i+1, STRLEN(mainfile)-(i+1))
 
-  ; Select again only the ones with this extension
-  SPAWN, "\ls "+path+"/BOUT.dmp.*."+fext, result, exit_status=status
+    ; Select again only the ones with this extension
+    SPAWN, "\ls "+path+"/BOUT.dmp.*."+fext, result, exit_status=status
 
-  nfo = nfiles
-  nfiles = N_ELEMENTS(result)
+    nfo = nfiles
+    nfiles = N_ELEMENTS(result)
   
-  IF (quiet EQ 0) AND (nfo NE nfiles) THEN PRINT, "Number of files with same type: ", nfiles
+    IF (quiet EQ 0) AND (nfo NE nfiles) THEN PRINT, "Number of files with same type: ", nfiles
+  ENDELSE
 
   ; get list of variables
   handle = file_open(mainfile)
@@ -126,11 +137,13 @@ FUNCTION collect, xind=xind, yind=yind, zind=zind, tind=tind, $
     NYPE = file_read(handle, "NYPE")
     NPE  = NXPE*NYPE
 
-    IF NPE LT nfiles THEN BEGIN
+    IF single EQ 0 THEN BEGIN
+      IF NPE LT nfiles THEN BEGIN
         PRINT, "WARNING: More files than expected"
         nfiles = NPE
-    ENDIF ELSE IF NPE GT nfiles THEN BEGIN
+      ENDIF ELSE IF NPE GT nfiles THEN BEGIN
         PRINT, "WARNING: Some files missing"
+      ENDIF
     ENDIF
 
     IF quiet EQ 0 THEN PRINT, "MXG = ", mxg
@@ -209,6 +222,32 @@ FUNCTION collect, xind=xind, yind=yind, zind=zind, tind=tind, $
   zsize = zind[1] - zind[0] + 1
   tsize = tind[1] - tind[0] + 1
   
+  IF single AND (ndims GE 2) THEN BEGIN
+    ; Global arrays: indices are the same as in the file
+    ; File order is [t,] x, y [, z], so move t to the end
+    IF quiet LT 2 THEN PRINT, "Reading from "+mainfile
+    handle = file_open(mainfile)
+    IF ndims EQ 4 THEN BEGIN
+      d = file_read(handle, var, inds=LONG([tind, xind, yind, zind]))
+      data = TRANSPOSE(REFORM(d, tsize, xsize, ysize, zsize), [1,2,3,0])
+    ENDIF ELSE IF ndims EQ 3 THEN BEGIN
+      IF dimsize[0] EQ MZ THEN BEGIN
+        d = file_read(handle, var, inds=LONG([xind, yind, zind]))
+        data = REFORM(d, xsize, ysize, zsize)
+      ENDIF ELSE BEGIN
+        d = file_read(handle, var, inds=LONG([tind, xind, yind]))
+        data = TRANSPOSE(REFORM(d, tsize, xsize, ysize), [1,2,0])
+      ENDELSE
+    ENDIF ELSE BEGIN
+      d = file_read(handle, var, inds=LONG([xind, yind]))
+      data = REFORM(d, xsize, ysize)
+    ENDELSE
+    file_close, handle
+    
+    CATCH, /CANCEL
+    RETURN, FLOAT(data)
+  ENDIF
+
   IF ndims EQ 4 THEN BEGIN
     ; print ranges
 
@@ -24,6 +24,148 @@ except ImportError:
 
 print "    data = collect('variable', path='.')"
 
+def unpack(f, varname, d, tind=None):
+    """Convert data packed into integers (dump_pack option) back to reals.
+    
+    The file contains <varname>_scale and <varname>_offset, which are
+    scalars or one value per time-point, and data = offset + d * scale.
+    tind is the range of time indices in d.
+    """
+    
+    if (varname + "_scale") not in f.variables:
+        return d
+    s = f.variables[varname + "_scale"]
+    o = f.variables[varname + "_offset"]
+    
+    # Fill value (-qmax-1) marks a NaN
+    d = np.ma.getdata(d)
+    nan = (d == -np.iinfo(d.dtype).max)
+    d = d.astype(float)
+    d[nan] = np.nan
+    
+    if len(s.dimensions) == 0:
+        return o.getValue() + d * s.getValue()
+    
+    # One scale and offset for each time-point
+    if tind != None:
+        s = s[tind[0]:(tind[1]+1)]
+        o = o[tind[0]:(tind[1]+1)]
+    else:
+        s = s[:]
+        o = o[:]
+    shape = [len(s)] + [1]*(len(d.shape)-1)
+    return o.reshape(shape) + d * s.reshape(shape)
+
+def collect_region(varname, file_list, tind=None):
+    """Collect a variable written using the [output] options.
+    
+    Each file contains <varname>_region = [x0, nx, dx, y0, ny, dy, z0, nz, dz, nkz]
+    i.e. the global index of the first point, number of points and stride
+    in each direction. If nkz > 0 then Z contains (real, imaginary) pairs
+    for the first nkz Fourier modes.
+    """
+    
+    # Find which files contain part of the variable
+    parts = []
+    for filename in file_list:
+        f = Dataset(filename, "r")
+        r = f.variables[varname + "_region"][:]
+        if (r[1] > 0) and (r[4] > 0) and (varname in f.variables):
+            parts.append((filename, r))
+        f.close()
+    
+    if parts == []:
+        print "ERROR: No data for '" + varname + "'"
+        return None
+    
+    # Size of the whole region
+    dx = parts[0][1][2]
+    dy = parts[0][1][5]
+    x0 = min([r[0] for fn, r in parts])
+    y0 = min([r[3] for fn, r in parts])
+    nx = max([(r[0] - x0)/dx + r[1] for fn, r in parts])
+    ny = max([(r[3] - y0)/dy + r[4] for fn, r in parts])
+    print "Region         : X from " + str(x0) + " every " + str(dx) + \
+        ", Y from " + str(y0) + " every " + str(dy)
+    
+    data = None
+    for filename, r in parts:
+        f = Dataset(filename, "r")
+        var = f.variables[varname]
+        
+        if var.dimensions[0] == 't':
+            xdim = 1
+            if tind != None:
+                d = var[tind[0]:(tind[1]+1)]
+            else:
+                d = var[:]
+        else:
+            xdim = 0
+            d = var[:]
+        d = unpack(f, varname, d, tind)
+        f.close()
+        
+        if data is None:
+            shape = list(d.shape)
+            shape[xdim] = nx
+            shape[xdim+1] = ny
+            data = np.zeros(shape)
+        
+        xs = (r[0] - x0)/dx
+        ys = (r[3] - y0)/dy
+        ind = [slice(None)] * len(d.shape)
+        ind[xdim] = slice(xs, xs + r[1])
+        ind[xdim+1] = slice(ys, ys + r[4])
+        data[tuple(ind)] = d
+    
+    return data
+
+def collect_single(varname, filename, xind=None, yind=None, zind=None, tind=None):
+    """Collect a variable from a single file of global arrays (dump_parallel).
+    
+    X includes the boundary cells, and Y doesn't include guard cells,
+    so the indices are the same as in the file.
+    """
+    
+    f = Dataset(filename, "r")
+    print "File format    : " + f.file_format
+    try:
+        var = f.variables[varname]
+    except KeyError:
+        print "ERROR: Variable '"+varname+"' not found"
+        f.close()
+        return None
+    dims = var.dimensions
+    
+    if len(dims) == 0:
+        data = var.getValue()
+        f.close()
+        return data[0]
+    
+    if (tind != None) and (len(tind) == 1):
+        tind = [tind[0], tind[0]]
+    
+    # Don't include the repeated Z point
+    if (zind == None) and ('z' in dims):
+        zind = [0, len(f.dimensions['z'])-2]
+    
+    ranges = {'t':tind, 'x':xind, 'y':yind, 'z':zind}
+    ind = []
+    for d in dims:
+        r = ranges[d]
+        if r == None:
+            ind.append(slice(None))
+        else:
+            ind.append(slice(r[0], r[-1]+1))
+    
+    data = var[tuple(ind)]
+    if 't' in dims:
+        data = unpack(f, varname, data, tind)
+    else:
+        data = unpack(f, varname, data)
+    f.close()
+    return data
+
 def collect(varname, xind=None, yind=None, zind=None, tind=None, path="."):
     """Collect a variable from a set of BOUT++ outputs."""
     
@@ -35,6 +177,10 @@ def collect(varname, xind=None, yind=None, zind=None, tind=None, path="."):
     # Search for BOUT++ dump files in NetCDF format
     file_list = glob.glob(os.path.join(path, "BOUT.dmp.*.nc"))
     if file_list == []:
+        single = os.path.join(path, "BOUT.dmp.nc")
+        if os.path.exists(single):
+            # One file for all processors (dump_parallel)
+            return collect_single(varname, single, xind, yind, zind, tind)
         print "ERROR: No data files found"
         return None
     nfiles = len(file_list)
@@ -43,6 +189,10 @@ def collect(varname, xind=None, yind=None, zind=None, tind=None, path="."):
     # Read data from the first file
     f = Dataset(file_list[0], "r")
     print "File format    : " + f.file_format
+    if (varname + "_region") in f.variables:
+        # Only part of the variable was written ([output] options)
+        f.close()
+        return collect_region(varname, file_list, tind)
     try:
         v = f.variables[varname]
     except KeyError:
@@ -216,19 +366,23 @@ def collect(varname, xind=None, yind=None, zind=None, tind=None, path="."):
 
         if ndims == 4:
             d = var[tind[0]:(tind[1]+1), xmin:(xmax+1), ymin:(ymax+1), zind[0]:(zind[1]+1)]
+            d = unpack(f, varname, d, tind)
             data[:, (xgmin-xind[0]):(xgmin-xind[0]+nx_loc), (ygmin-yind[0]):(ygmin-yind[0]+ny_loc), :] = d
         elif ndims == 3:
             # Could be xyz or txy
             
             if dims[3] == 'z': # xyz
                 d = var[xmin:(xmax+1), ymin:(ymax+1), zind[0]:(zind[1]+1)]
+                d = unpack(f, varname, d)
                 data[(xgmin-xind[0]):(xgmin-xind[0]+nx_loc), (ygmin-yind[0]):(ygmin-yind[0]+ny_loc), :] = d
             else: # txy
                 d = var[tind[0]:(tind[1]+1), xmin:(xmax+1), ymin:(ymax+1)]
+                d = unpack(f, varname, d, tind)
                 data[:, (xgmin-xind[0]):(xgmin-xind[0]+nx_loc), (ygmin-yind[0]):(ygmin-yind[0]+ny_loc)] = d
         elif ndims == 2:
             # xy
             d = var[xmin:(xmax+1), ymin:(ymax+1)]
+            d = unpack(f, varname, d)
             data[(xgmin-xind[0]):(xgmin-xind[0]+nx_loc), (ygmin-yind[0]):(ygmin-yind[0]+ny_loc)] = d
     
     # Finished looping over all files